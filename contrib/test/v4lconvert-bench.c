@@ -0,0 +1,769 @@
+/* libv4lconvert frame conversion benchmark
+   Copyright (C) 2026 the v4l-utils contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation version 2 of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   Measures the throughput of v4lconvert_convert without needing a camera:
+   libv4lconvert is run on top of a fake device (through the dev_ops
+   interface) which only advertises the source format being benchmarked.
+   Frames for raw formats are synthesized, MJPEG / JPEG frames are encoded
+   with libjpeg when available, vendor compressed formats need a fixture
+   (a frame captured from a real device) passed with --fixture.
+
+   Every source format is converted to every destination format libv4lconvert
+   can emulate, at each requested resolution and with flipping, cropping,
+   software processing (whitebalance + gamma) and scaling enabled in turn. The
+   results are written as JSON, one object per combination.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/videodev2.h>
+#ifdef __NR_perf_event_open
+#include <linux/perf_event.h>
+#endif
+#ifdef HAVE_JPEG
+#include <jpeglib.h>
+#endif
+#include "../../lib/include/libv4lconvert.h"
+#include "v4lconvert-fake-dev.h"
+#include <argp.h>
+
+#define ARRAY_SIZE(x) ((int)sizeof(x) / (int)sizeof((x)[0]))
+
+/* Not in our copy of videodev2.h yet, see libv4lconvert-priv.h */
+#ifndef V4L2_PIX_FMT_SBGGR10P
+#define V4L2_PIX_FMT_SBGGR10P v4l2_fourcc('p', 'B', 'A', 'A')
+#define V4L2_PIX_FMT_SGBRG10P v4l2_fourcc('p', 'G', 'A', 'A')
+#define V4L2_PIX_FMT_SGRBG10P v4l2_fourcc('p', 'g', 'A', 'A')
+#define V4L2_PIX_FMT_SRGGB10P v4l2_fourcc('p', 'R', 'A', 'A')
+#endif
+#ifndef V4L2_PIX_FMT_SGBRG16
+#define V4L2_PIX_FMT_SGBRG16 v4l2_fourcc('G', 'B', '1', '6')
+#define V4L2_PIX_FMT_SGRBG16 v4l2_fourcc('G', 'R', '1', '6')
+#define V4L2_PIX_FMT_SRGGB16 v4l2_fourcc('R', 'G', '1', '6')
+#endif
+
+#define BENCH_CARD "v4lconvert-bench"
+#define WARMUP_FRAMES 2
+
+enum synth {
+	SYNTH_NONE,	/* Needs a fixture */
+	SYNTH_BYTES,	/* Any byte pattern is a valid frame */
+	SYNTH_WORDS,	/* 16 bit little endian samples of depth bits */
+	SYNTH_JPEG,	/* Encoded with libjpeg */
+};
+
+struct bench_format {
+	unsigned int fourcc;
+	enum synth synth;
+	/* bytesperline = width * bpl_num / bpl_den,
+	   sizeimage = bytesperline * height * size_num / size_den */
+	int bpl_num, bpl_den;
+	int size_num, size_den;
+	int depth;
+};
+
+/* Keep in sync with supported_src_pixfmts in libv4lconvert.c */
+static const struct bench_format formats[] = {
+	{ V4L2_PIX_FMT_RGB24,		SYNTH_BYTES,	3, 1, 1, 1 },
+	{ V4L2_PIX_FMT_BGR24,		SYNTH_BYTES,	3, 1, 1, 1 },
+	{ V4L2_PIX_FMT_YUV420,		SYNTH_BYTES,	1, 1, 3, 2 },
+	{ V4L2_PIX_FMT_YVU420,		SYNTH_BYTES,	1, 1, 3, 2 },
+	{ V4L2_PIX_FMT_RGB565,		SYNTH_BYTES,	2, 1, 1, 1 },
+	{ V4L2_PIX_FMT_BGR32,		SYNTH_BYTES,	4, 1, 1, 1 },
+	{ V4L2_PIX_FMT_RGB32,		SYNTH_BYTES,	4, 1, 1, 1 },
+	{ V4L2_PIX_FMT_YUYV,		SYNTH_BYTES,	2, 1, 1, 1 },
+	{ V4L2_PIX_FMT_YVYU,		SYNTH_BYTES,	2, 1, 1, 1 },
+	{ V4L2_PIX_FMT_UYVY,		SYNTH_BYTES,	2, 1, 1, 1 },
+	{ V4L2_PIX_FMT_NV16,		SYNTH_BYTES,	1, 1, 2, 1 },
+	{ V4L2_PIX_FMT_NV61,		SYNTH_BYTES,	1, 1, 2, 1 },
+	{ V4L2_PIX_FMT_NV12,		SYNTH_BYTES,	1, 1, 3, 2 },
+	{ V4L2_PIX_FMT_NV21,		SYNTH_BYTES,	1, 1, 3, 2 },
+	{ V4L2_PIX_FMT_SPCA501,		SYNTH_BYTES,	1, 1, 3, 2 },
+	{ V4L2_PIX_FMT_SPCA505,		SYNTH_BYTES,	1, 1, 3, 2 },
+	{ V4L2_PIX_FMT_SPCA508,		SYNTH_BYTES,	1, 1, 3, 2 },
+	{ V4L2_PIX_FMT_CIT_YYVYUY,	SYNTH_BYTES,	1, 1, 3, 2 },
+	{ V4L2_PIX_FMT_KONICA420,	SYNTH_BYTES,	1, 1, 3, 2 },
+	{ V4L2_PIX_FMT_SN9C20X_I420,	SYNTH_BYTES,	1, 1, 3, 2 },
+	{ V4L2_PIX_FMT_M420,		SYNTH_BYTES,	1, 1, 3, 2 },
+	{ V4L2_PIX_FMT_HM12,		SYNTH_BYTES,	1, 1, 3, 2 },
+	{ V4L2_PIX_FMT_CPIA1,		SYNTH_NONE },
+	{ V4L2_PIX_FMT_MJPEG,		SYNTH_JPEG },
+	{ V4L2_PIX_FMT_JPEG,		SYNTH_JPEG },
+	{ V4L2_PIX_FMT_PJPG,		SYNTH_NONE },
+	{ V4L2_PIX_FMT_JPGL,		SYNTH_NONE },
+	{ V4L2_PIX_FMT_OV511,		SYNTH_NONE },
+	{ V4L2_PIX_FMT_OV518,		SYNTH_NONE },
+	{ V4L2_PIX_FMT_SBGGR8,		SYNTH_BYTES,	1, 1, 1, 1 },
+	{ V4L2_PIX_FMT_SGBRG8,		SYNTH_BYTES,	1, 1, 1, 1 },
+	{ V4L2_PIX_FMT_SGRBG8,		SYNTH_BYTES,	1, 1, 1, 1 },
+	{ V4L2_PIX_FMT_SRGGB8,		SYNTH_BYTES,	1, 1, 1, 1 },
+	{ V4L2_PIX_FMT_STV0680,		SYNTH_BYTES,	1, 1, 1, 1 },
+	{ V4L2_PIX_FMT_SBGGR10P,	SYNTH_BYTES,	5, 4, 1, 1 },
+	{ V4L2_PIX_FMT_SGBRG10P,	SYNTH_BYTES,	5, 4, 1, 1 },
+	{ V4L2_PIX_FMT_SGRBG10P,	SYNTH_BYTES,	5, 4, 1, 1 },
+	{ V4L2_PIX_FMT_SRGGB10P,	SYNTH_BYTES,	5, 4, 1, 1 },
+	{ V4L2_PIX_FMT_SBGGR10,		SYNTH_WORDS,	2, 1, 1, 1, 10 },
+	{ V4L2_PIX_FMT_SGBRG10,		SYNTH_WORDS,	2, 1, 1, 1, 10 },
+	{ V4L2_PIX_FMT_SGRBG10,		SYNTH_WORDS,	2, 1, 1, 1, 10 },
+	{ V4L2_PIX_FMT_SRGGB10,		SYNTH_WORDS,	2, 1, 1, 1, 10 },
+	{ V4L2_PIX_FMT_SBGGR12,		SYNTH_WORDS,	2, 1, 1, 1, 12 },
+	{ V4L2_PIX_FMT_SGBRG12,		SYNTH_WORDS,	2, 1, 1, 1, 12 },
+	{ V4L2_PIX_FMT_SGRBG12,		SYNTH_WORDS,	2, 1, 1, 1, 12 },
+	{ V4L2_PIX_FMT_SRGGB12,		SYNTH_WORDS,	2, 1, 1, 1, 12 },
+	{ V4L2_PIX_FMT_SBGGR16,		SYNTH_WORDS,	2, 1, 1, 1, 16 },
+	{ V4L2_PIX_FMT_SGBRG16,		SYNTH_WORDS,	2, 1, 1, 1, 16 },
+	{ V4L2_PIX_FMT_SGRBG16,		SYNTH_WORDS,	2, 1, 1, 1, 16 },
+	{ V4L2_PIX_FMT_SRGGB16,		SYNTH_WORDS,	2, 1, 1, 1, 16 },
+	{ V4L2_PIX_FMT_SPCA561,		SYNTH_NONE },
+	{ V4L2_PIX_FMT_SN9C10X,		SYNTH_NONE },
+	{ V4L2_PIX_FMT_SN9C2028,	SYNTH_NONE },
+	{ V4L2_PIX_FMT_PAC207,		SYNTH_NONE },
+	{ V4L2_PIX_FMT_MR97310A,	SYNTH_NONE },
+	{ V4L2_PIX_FMT_JL2005BCD,	SYNTH_NONE },
+	{ V4L2_PIX_FMT_SQ905C,		SYNTH_NONE },
+	{ V4L2_PIX_FMT_SE401,		SYNTH_NONE },
+	{ V4L2_PIX_FMT_GREY,		SYNTH_BYTES,	1, 1, 1, 1 },
+	{ V4L2_PIX_FMT_Y4,		SYNTH_BYTES,	1, 1, 1, 1 },
+	{ V4L2_PIX_FMT_Y6,		SYNTH_BYTES,	1, 1, 1, 1 },
+	{ V4L2_PIX_FMT_Y10BPACK,	SYNTH_BYTES,	5, 4, 1, 1 },
+	{ V4L2_PIX_FMT_Y16,		SYNTH_WORDS,	2, 1, 1, 1, 16 },
+};
+
+static const unsigned int dest_formats[] = {
+	V4L2_PIX_FMT_RGB24,
+	V4L2_PIX_FMT_BGR24,
+	V4L2_PIX_FMT_YUV420,
+	V4L2_PIX_FMT_YVU420,
+};
+
+enum mode {
+	MODE_PLAIN,
+	MODE_FLIP,
+	MODE_CROP,
+	MODE_PROCESSING,
+	MODE_SCALE,
+	MODE_COUNT
+};
+
+static const char *mode_names[MODE_COUNT] = {
+	"plain", "flip", "crop", "processing", "scale"
+};
+
+struct fixture {
+	unsigned int fourcc;
+	int width;
+	int height;
+	unsigned char *data;
+	int size;
+	struct fixture *next;
+};
+
+/* Static vars to store the parameters */
+static int sizes[16][2] = {
+	{ 320, 240 }, { 640, 480 }, { 1280, 720 }, { 1920, 1080 }
+};
+static int n_sizes = 4;
+static unsigned int only_formats[64];
+static int n_only_formats;
+static int modes = (1 << MODE_COUNT) - 1;
+static int n_frames = 20;
+static int n_threads;
+static char *out_name;
+static struct fixture *fixtures;
+
+static FILE *out;
+static int n_results;
+
+/* Cache misses are counted for the converting thread only, so when using
+   multiple threads (--threads) they only cover part of the work. */
+static int perf_open(void)
+{
+#ifdef __NR_perf_event_open
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+static void perf_start(int fd)
+{
+#ifdef __NR_perf_event_open
+	if (fd != -1) {
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+static long long perf_stop(int fd)
+{
+	long long count;
+
+#ifdef __NR_perf_event_open
+	if (fd != -1) {
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &count, sizeof(count)) == sizeof(count))
+			return count;
+	}
+#endif
+	return -1;
+}
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static const char *fourcc_str(unsigned int fourcc, char *buf)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		buf[i] = (fourcc >> (8 * i)) & 0xff;
+		if (buf[i] < ' ' || buf[i] > '~')
+			buf[i] = '?';
+	}
+	buf[4] = 0;
+	return buf;
+}
+
+static unsigned int str_fourcc(const char *s)
+{
+	char buf[4] = { ' ', ' ', ' ', ' ' };
+	int i;
+
+	for (i = 0; i < 4 && s[i] && s[i] != ':' && s[i] != ','; i++)
+		buf[i] = s[i];
+
+	return v4l2_fourcc(buf[0], buf[1], buf[2], buf[3]);
+}
+
+static void json_string(const char *s)
+{
+	fputc('"', out);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(out, "\\%c", *s);
+		else if (*s == '\n')
+			fputs("\\n", out);
+		else if ((unsigned char)*s < ' ')
+			fprintf(out, "\\u%04x", *s);
+		else
+			fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+/* Starts a result object and writes the fields common to all results,
+   the caller must finish it with fputs("}", out) */
+static void result_start(unsigned int src_fourcc, unsigned int dest_fourcc,
+		int width, int height, int mode)
+{
+	char buf[5];
+
+	fprintf(out, "%s\n\t\t{ \"src\": ", n_results++ ? "," : "");
+	json_string(fourcc_str(src_fourcc, buf));
+	if (!dest_fourcc)
+		return;
+
+	fputs(", \"dst\": ", out);
+	json_string(fourcc_str(dest_fourcc, buf));
+	fprintf(out, ", \"width\": %d, \"height\": %d, \"mode\": \"%s\"",
+		width, height, mode_names[mode]);
+}
+
+static void result_skipped(unsigned int src_fourcc, const char *reason)
+{
+	result_start(src_fourcc, 0, 0, 0, 0);
+	fputs(", \"skipped\": ", out);
+	json_string(reason);
+	fputs(" }", out);
+}
+
+/* Fill buf with a gradient with some noise, roughly what a camera
+   pointed at a scene would produce */
+static void synth_bytes(unsigned char *buf, int bytesperline, int lines)
+{
+	unsigned int seed = 1;
+	int x, y;
+
+	for (y = 0; y < lines; y++)
+		for (x = 0; x < bytesperline; x++) {
+			seed = seed * 1103515245 + 12345;
+			*buf++ = ((x + y) >> 2) + ((seed >> 16) & 31);
+		}
+}
+
+static void synth_words(unsigned char *buf, int width, int lines, int depth)
+{
+	unsigned int seed = 1, val;
+	int x, y;
+
+	for (y = 0; y < lines; y++)
+		for (x = 0; x < width; x++) {
+			seed = seed * 1103515245 + 12345;
+			val = ((x + y) * 4 + ((seed >> 16) & 127)) & 0xffff;
+			val >>= 16 - depth;
+			*buf++ = val & 0xff;
+			*buf++ = val >> 8;
+		}
+}
+
+#ifdef HAVE_JPEG
+#if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
+#define HAVE_JPEG_MEM_DEST 1
+#endif
+#endif
+
+/* Encode a frame the way most UVC cams do: YCbCr 4:2:2, quality 85 */
+static unsigned char *synth_jpeg(int width, int height, int *size)
+{
+#ifdef HAVE_JPEG_MEM_DEST
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	unsigned char *rgb, *jpeg = NULL;
+	unsigned long jpeg_size = 0;
+	JSAMPROW row_pointer[1];
+
+	rgb = malloc(width * height * 3);
+	if (!rgb)
+		return NULL;
+	synth_bytes(rgb, width * 3, height);
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, &jpeg, &jpeg_size);
+	cinfo.image_width = width;
+	cinfo.image_height = height;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 85, TRUE);
+	cinfo.comp_info[0].h_samp_factor = 2;
+	cinfo.comp_info[0].v_samp_factor = 1;
+	jpeg_start_compress(&cinfo, TRUE);
+
+	while (cinfo.next_scanline < cinfo.image_height) {
+		row_pointer[0] = rgb + cinfo.next_scanline * width * 3;
+		jpeg_write_scanlines(&cinfo, row_pointer, 1);
+	}
+
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	free(rgb);
+
+	*size = jpeg_size;
+	return jpeg;
+#else
+	return NULL;
+#endif
+}
+
+static unsigned char *synth_frame(const struct bench_format *f,
+		int width, int height, int *bytesperline, int *size)
+{
+	unsigned char *buf;
+
+	if (f->synth == SYNTH_JPEG) {
+		*bytesperline = 0;
+		return synth_jpeg(width, height, size);
+	}
+
+	*bytesperline = width * f->bpl_num / f->bpl_den;
+	*size = *bytesperline * height * f->size_num / f->size_den;
+	buf = malloc(*size);
+	if (!buf)
+		return NULL;
+
+	if (f->synth == SYNTH_WORDS)
+		synth_words(buf, *size / 2 / height, height, f->depth);
+	else
+		synth_bytes(buf, *bytesperline, *size / *bytesperline);
+
+	return buf;
+}
+
+static int set_ctrl(struct v4lconvert_data *data, int id, int value)
+{
+	struct v4l2_control ctrl = { .id = id, .value = value };
+
+	return v4lconvert_vidioc_s_ctrl(data, &ctrl);
+}
+
+/* The control values live in shared memory which outlives us, so always
+   explicitly set all of them */
+static int set_mode(struct v4lconvert_data *data, int mode)
+{
+	int ret = 0;
+
+	ret |= set_ctrl(data, V4L2_CID_HFLIP, mode == MODE_FLIP);
+	ret |= set_ctrl(data, V4L2_CID_VFLIP, mode == MODE_FLIP);
+	ret |= set_ctrl(data, V4L2_CID_AUTO_WHITE_BALANCE,
+			mode == MODE_PROCESSING);
+	ret |= set_ctrl(data, V4L2_CID_GAMMA,
+			mode == MODE_PROCESSING ? 1500 : 1000);
+	v4lconvert_set_scaling(data, mode == MODE_SCALE);
+
+	return ret;
+}
+
+static void bench_one(struct v4lconvert_data *data, int perf_fd,
+		unsigned int src_fourcc, int width, int height,
+		int bytesperline, unsigned char *src, int src_size,
+		unsigned int dest_fourcc, int mode)
+{
+	struct v4l2_format src_fmt, dest_fmt;
+	unsigned char *dest;
+	int i, res = 0, dest_size;
+	long long start, elapsed, misses, pixels;
+
+	memset(&src_fmt, 0, sizeof(src_fmt));
+	src_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	src_fmt.fmt.pix.width = width;
+	src_fmt.fmt.pix.height = height;
+	src_fmt.fmt.pix.pixelformat = src_fourcc;
+	src_fmt.fmt.pix.field = V4L2_FIELD_NONE;
+	src_fmt.fmt.pix.bytesperline = bytesperline;
+	src_fmt.fmt.pix.sizeimage = src_size;
+
+	dest_fmt = src_fmt;
+	if (mode == MODE_CROP) {
+		/* Crop of 20%, like v4lconvert_try_format does at most */
+		dest_fmt.fmt.pix.width = (width * 4 / 5) & ~7;
+		dest_fmt.fmt.pix.height = (height * 4 / 5) & ~7;
+	} else if (mode == MODE_SCALE) {
+		/* Downscale to 2/3, so not a whole fraction */
+		dest_fmt.fmt.pix.width = (width * 2 / 3) & ~7;
+		dest_fmt.fmt.pix.height = (height * 2 / 3) & ~1;
+	}
+	dest_fmt.fmt.pix.pixelformat = dest_fourcc;
+	dest_fmt.fmt.pix.bytesperline = 0;
+	dest_size = dest_fmt.fmt.pix.width * dest_fmt.fmt.pix.height * 3;
+	dest_fmt.fmt.pix.sizeimage = dest_size;
+
+	result_start(src_fourcc, dest_fourcc, width, height, mode);
+
+	if (set_mode(data, mode)) {
+		fputs(", \"skipped\": \"controls not available\" }", out);
+		return;
+	}
+
+	dest = malloc(dest_size);
+	if (!dest) {
+		fputs(", \"error\": \"out of memory\" }", out);
+		return;
+	}
+
+	/* The first frames pay for allocating the intermediate buffers,
+	   starting helpers, etc. and with processing enabled the lookup
+	   tables get calculated from the first frame */
+	for (i = 0; i < WARMUP_FRAMES && res >= 0; i++)
+		res = v4lconvert_convert(data, &src_fmt, &dest_fmt, src, src_size,
+					 dest, dest_size);
+
+	perf_start(perf_fd);
+	start = now_ns();
+	for (i = 0; i < n_frames && res >= 0; i++)
+		res = v4lconvert_convert(data, &src_fmt, &dest_fmt, src, src_size,
+					 dest, dest_size);
+	elapsed = now_ns() - start;
+	misses = perf_stop(perf_fd);
+	free(dest);
+
+	if (res < 0) {
+		fputs(", \"error\": ", out);
+		json_string(v4lconvert_get_error_message(data));
+		fputs(" }", out);
+		return;
+	}
+
+	if (elapsed <= 0)
+		elapsed = 1;
+	pixels = (long long)dest_fmt.fmt.pix.width * dest_fmt.fmt.pix.height;
+
+	fprintf(out, ", \"src_bytes\": %d, \"dst_bytes\": %d, \"frames\": %d",
+		src_size, res, n_frames);
+	fprintf(out, ", \"ns_per_frame\": %lld, \"mb_per_s\": %.2f",
+		elapsed / n_frames, (double)res * n_frames * 1000.0 / elapsed);
+	fprintf(out, ", \"ns_per_pixel\": %.3f",
+		(double)elapsed / n_frames / pixels);
+	if (misses >= 0)
+		fprintf(out, ", \"cache_misses\": %lld }", misses / n_frames);
+	else
+		fputs(", \"cache_misses\": null }", out);
+}
+
+static void bench_frame(struct v4lconvert_data *data, int perf_fd,
+		unsigned int src_fourcc, int width, int height,
+		int bytesperline, unsigned char *src, int src_size)
+{
+	int i, mode;
+
+	for (i = 0; i < ARRAY_SIZE(dest_formats); i++)
+		for (mode = 0; mode < MODE_COUNT; mode++)
+			if (modes & (1 << mode))
+				bench_one(data, perf_fd, src_fourcc, width,
+					  height, bytesperline, src, src_size,
+					  dest_formats[i], mode);
+}
+
+static void bench_format(const struct bench_format *f, int perf_fd)
+{
+	struct fake_dev dev = { BENCH_CARD, f->fourcc };
+	struct v4lconvert_data *data;
+	struct fixture *fixture;
+	unsigned char *src;
+	int i, size, bytesperline, found = 0;
+
+	data = fake_dev_create_convert(&dev);
+	if (!data) {
+		result_skipped(f->fourcc, "v4lconvert_create failed");
+		return;
+	}
+	if (n_threads)
+		v4lconvert_set_threads(data, n_threads);
+
+	for (fixture = fixtures; fixture; fixture = fixture->next) {
+		if (fixture->fourcc != f->fourcc)
+			continue;
+		bench_frame(data, perf_fd, f->fourcc, fixture->width,
+			    fixture->height, 0, fixture->data, fixture->size);
+		found = 1;
+	}
+
+	if (!found && f->synth != SYNTH_NONE) {
+		for (i = 0; i < n_sizes; i++) {
+			src = synth_frame(f, sizes[i][0], sizes[i][1],
+					  &bytesperline, &size);
+			if (!src) {
+				result_skipped(f->fourcc,
+					       "cannot synthesize frames");
+				break;
+			}
+			bench_frame(data, perf_fd, f->fourcc, sizes[i][0],
+				    sizes[i][1], bytesperline, src, size);
+			free(src);
+		}
+	} else if (!found)
+		result_skipped(f->fourcc, "no fixture");
+
+	set_mode(data, MODE_PLAIN);
+	v4lconvert_destroy(data);
+}
+
+static int format_selected(unsigned int fourcc)
+{
+	int i;
+
+	if (!n_only_formats)
+		return 1;
+
+	for (i = 0; i < n_only_formats; i++)
+		if (only_formats[i] == fourcc)
+			return 1;
+
+	return 0;
+}
+
+static int load_fixture(const char *arg)
+{
+	struct fixture *fixture;
+	const char *name;
+	FILE *f;
+	long len;
+
+	fixture = calloc(1, sizeof(*fixture));
+	if (!fixture)
+		return -1;
+
+	fixture->fourcc = str_fourcc(arg);
+	name = strchr(arg, ':');
+	if (!name || sscanf(name + 1, "%dx%d", &fixture->width,
+			    &fixture->height) != 2)
+		goto error;
+	name = strchr(name + 1, ':');
+	if (!name)
+		goto error;
+
+	f = fopen(name + 1, "rb");
+	if (!f) {
+		perror(name + 1);
+		goto error;
+	}
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	fixture->data = malloc(len);
+	if (len <= 0 || !fixture->data ||
+			fread(fixture->data, 1, len, f) != (size_t)len) {
+		fclose(f);
+		free(fixture->data);
+		goto error;
+	}
+	fclose(f);
+	fixture->size = len;
+
+	fixture->next = fixtures;
+	fixtures = fixture;
+	return 0;
+
+error:
+	free(fixture);
+	return -1;
+}
+
+/*
+ * Main routine. Reads parameters via argp.h and runs the benchmarks.
+ */
+
+const char *argp_program_version = "v4lconvert benchmark version " V4L_UTILS_VERSION;
+
+static const char doc[] = "\nBenchmarks libv4lconvert frame conversion, "
+	"without needing a camera.\n\n"
+	"mb_per_s and ns_per_pixel are calculated from the destination frame, "
+	"cache_misses is per frame and null when the kernel does not give us "
+	"access to the hardware counters.";
+
+static const struct argp_option options[] = {
+	{"format",	'f',	"FOURCC[,...]",	0,	"only benchmark these source formats", 0},
+	{"size",	's',	"WxH[,...]",	0,	"resolutions (default: 320x240,640x480,1280x720,1920x1080)", 0},
+	{"mode",	'm',	"MODE[,...]",	0,	"plain, flip, crop, processing and / or scale (default: all)", 0},
+	{"n-frames",	'n',	"NFRAMES",	0,	"number of frames to time per combination (default: 20)", 0},
+	{"threads",	'j',	"NTHREADS",	0,	"number of conversion threads", 0},
+	{"fixture",	'F',	"FOURCC:WxH:FILE", 0,	"frame to use for a (compressed) source format", 0},
+	{"output",	'o',	"FILE",		0,	"write the results to FILE instead of stdout", 0},
+	{ 0, 0, 0, 0, 0, 0 }
+};
+
+static error_t parse_opt(int k, char *arg, struct argp_state *state)
+{
+	char *s;
+	int i, val;
+
+	switch (k) {
+	case 'f':
+		n_only_formats = 0;
+		for (s = arg; s && n_only_formats < ARRAY_SIZE(only_formats);
+				s = strchr(s, ',') ? strchr(s, ',') + 1 : NULL)
+			only_formats[n_only_formats++] = str_fourcc(s);
+		break;
+	case 's':
+		n_sizes = 0;
+		for (s = arg; s && n_sizes < ARRAY_SIZE(sizes);
+				s = strchr(s, ',') ? strchr(s, ',') + 1 : NULL) {
+			if (sscanf(s, "%dx%d", &sizes[n_sizes][0],
+				   &sizes[n_sizes][1]) != 2 ||
+					sizes[n_sizes][0] < 8 ||
+					sizes[n_sizes][1] < 8)
+				argp_error(state, "invalid size: %s", s);
+			n_sizes++;
+		}
+		break;
+	case 'm':
+		modes = 0;
+		for (s = arg; s; s = strchr(s, ',') ? strchr(s, ',') + 1 : NULL) {
+			for (i = 0; i < MODE_COUNT; i++)
+				if (!strncmp(s, mode_names[i],
+					     strlen(mode_names[i])))
+					break;
+			if (i == MODE_COUNT)
+				argp_error(state, "invalid mode: %s", s);
+			modes |= 1 << i;
+		}
+		break;
+	case 'n':
+		val = atoi(arg);
+		if (val)
+			n_frames = val;
+		break;
+	case 'j':
+		n_threads = atoi(arg);
+		break;
+	case 'F':
+		if (load_fixture(arg))
+			argp_error(state, "invalid fixture: %s", arg);
+		break;
+	case 'o':
+		out_name = arg;
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+static struct argp argp = {
+	.options = options,
+	.parser = parse_opt,
+	.doc = doc,
+};
+
+
+int main(int argc, char **argv)
+{
+	int i, perf_fd;
+
+	argp_parse(&argp, argc, argv, 0, 0, 0);
+
+	/* Formats which do not need conversion normally do not get the software
+	   whitebalance, flip and gamma controls, force them on */
+	setenv("LIBV4LCONTROL_CONTROLS", "0x0f", 0);
+
+	out = stdout;
+	if (out_name) {
+		out = fopen(out_name, "w");
+		if (!out) {
+			perror(out_name);
+			return EXIT_FAILURE;
+		}
+	}
+
+	perf_fd = perf_open();
+
+	fprintf(out, "{\n\t\"version\": \"%s\",\n", V4L_UTILS_VERSION);
+	fprintf(out, "\t\"threads\": %d,\n\t\"frames\": %d,\n",
+		n_threads, n_frames);
+	fputs("\t\"results\": [", out);
+
+	for (i = 0; i < ARRAY_SIZE(formats); i++)
+		if (format_selected(formats[i].fourcc))
+			bench_format(&formats[i], perf_fd);
+
+	fputs("\n\t]\n}\n", out);
+
+	if (perf_fd != -1)
+		close(perf_fd);
+	if (out != stdout)
+		fclose(out);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+/* Fake device for running libv4lconvert without a camera
+   Copyright (C) 2026 the v4l-utils contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation version 2 of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <errno.h>
+#include <linux/videodev2.h>
+#include "../../lib/include/libv4l-plugin.h"
+#include "v4lconvert-fake-dev.h"
+
+static void *dev_init(int fd)
+{
+	return NULL;
+}
+
+static void dev_close(void *dev_ops_priv)
+{
+}
+
+static int dev_ioctl(void *dev_ops_priv, int fd, unsigned long int request,
+		void *arg)
+{
+	struct fake_dev *dev = dev_ops_priv;
+
+	switch (request) {
+	case VIDIOC_QUERYCAP: {
+		struct v4l2_capability *cap = arg;
+
+		memset(cap, 0, sizeof(*cap));
+		strcpy((char *)cap->driver, "fake");
+		strncpy((char *)cap->card, dev->card, sizeof(cap->card) - 1);
+		cap->capabilities = V4L2_CAP_VIDEO_CAPTURE;
+		return 0;
+	}
+	case VIDIOC_ENUM_FMT: {
+		struct v4l2_fmtdesc *fmt = arg;
+
+		if (fmt->index != 0 ||
+				fmt->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+			break;
+		fmt->pixelformat = dev->fourcc;
+		fmt->flags = 0;
+		return 0;
+	}
+	}
+	errno = EINVAL;
+	return -1;
+}
+
+static ssize_t dev_read(void *dev_ops_priv, int fd, void *buf, size_t len)
+{
+	errno = EINVAL;
+	return -1;
+}
+
+static ssize_t dev_write(void *dev_ops_priv, int fd, const void *buf,
+		size_t len)
+{
+	errno = EINVAL;
+	return -1;
+}
+
+static const struct libv4l_dev_ops dev_ops = {
+	.init = dev_init,
+	.close = dev_close,
+	.ioctl = dev_ioctl,
+	.read = dev_read,
+	.write = dev_write,
+};
+
+struct v4lconvert_data *fake_dev_create_convert(struct fake_dev *dev)
+{
+	return v4lconvert_create_with_dev_ops(-1, dev, &dev_ops);
+}
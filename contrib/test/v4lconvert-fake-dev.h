@@ -0,0 +1,31 @@
+/* Fake device for running libv4lconvert without a camera
+   Copyright (C) 2026 the v4l-utils contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation version 2 of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+ */
+
+#ifndef __V4LCONVERT_FAKE_DEV_H
+#define __V4LCONVERT_FAKE_DEV_H
+
+#include "../../lib/include/libv4lconvert.h"
+
+/* The fake device only supports querying its capabilities and enumerating
+   its one capture format, so that libv4lconvert offers to convert that
+   format, and (through libv4lcontrol) its software processing controls */
+struct fake_dev {
+	const char *card;
+	unsigned int fourcc;
+};
+
+/* Create a libv4lconvert instance on top of dev (through the dev_ops
+   interface), dev must stay around until the instance gets destroyed */
+struct v4lconvert_data *fake_dev_create_convert(struct fake_dev *dev);
+
+#endif
@@ -0,0 +1,437 @@
+/* libv4lconvert custom processing filter test
+   Copyright (C) 2026 the v4l-utils contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation version 2 of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   Checks that custom processing filters (v4lconvert_add_filter) get applied
+   to the formats they accept and do not change the builtin processing. With
+   whitebalance and gamma correction enabled, a few frames of each source
+   format get converted:
+
+   - with a filter which only accepts bayer and does not touch the data, the
+     output must be the same as without filter, and the filter must see every
+     row of bayer sources and nothing of other sources.
+   - with a filter which only accepts rgb and does not touch the data, the
+     filter must see every row, and the output must be the same as without
+     filter, except for bayer to yuv420, which then goes through rgb24.
+   - with a filter which only accepts rgb and inverts the data, the rgb24
+     output must be the inverse of the output without filter, as the filter
+     gets applied after the builtin processing.
+   - with a filter which draws a pattern depending on the position, the
+     cropped (and flipped) rgb24 output must be the crop of the uncropped
+     output, as filters get the whole source rows.
+   - with a filter which only accepts rgb and does not touch the data, the
+     scaled rgb24 output must be the same as without filter (unless
+     flipped), and the filter must see every source row exactly once.
+
+   libv4lconvert is run on top of a fake device, through the dev_ops
+   interface, with a fresh instance per test as the processing keeps state
+   between frames.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <linux/videodev2.h>
+#include "../../lib/include/libv4lconvert.h"
+#include "v4lconvert-fake-dev.h"
+
+#define ARRAY_SIZE(x) ((int)sizeof(x) / (int)sizeof((x)[0]))
+
+#define WIDTH 160
+#define HEIGHT 120
+/* Enough frames for the lookup tables to get updated more than once */
+#define FRAMES 12
+#define MAX_BANDS 64
+
+/*
+ * The filters
+ */
+
+/* Rows seen per band, a band is never processed by 2 threads at once */
+static unsigned int rows_seen[MAX_BANDS];
+
+static void count_row(void *priv, unsigned char *buf, int width,
+		unsigned int pixelformat, int band, int y, int height)
+{
+	rows_seen[band]++;
+}
+
+static void invert_row(void *priv, unsigned char *buf, int width,
+		unsigned int pixelformat, int band, int y, int height)
+{
+	int x;
+
+	for (x = 0; x < width * 3; x++)
+		buf[x] = 255 - buf[x];
+	rows_seen[band]++;
+}
+
+/* Overwrites the red component with a pattern depending on the position,
+   like a lens shading correction would depend on it */
+static void position_row(void *priv, unsigned char *buf, int width,
+		unsigned int pixelformat, int band, int y, int height)
+{
+	int x;
+
+	for (x = 0; x < width; x++)
+		buf[x * 3] = x + 7 * y;
+	rows_seen[band]++;
+}
+
+static const struct v4lconvert_filter bayer_filter = {
+	.formats = V4LCONVERT_FILTER_BAYER,
+	.row = count_row,
+};
+
+static const struct v4lconvert_filter rgb_filter = {
+	.formats = V4LCONVERT_FILTER_RGB,
+	.row = count_row,
+};
+
+static const struct v4lconvert_filter invert_filter = {
+	.formats = V4LCONVERT_FILTER_RGB,
+	.row = invert_row,
+};
+
+static const struct v4lconvert_filter position_filter = {
+	.formats = V4LCONVERT_FILTER_RGB,
+	.row = position_row,
+};
+
+/*
+ * The test runner
+ */
+
+struct test {
+	unsigned int src_fourcc;
+	unsigned int dest_fourcc;
+	int threads;
+	int hflip;
+	int vflip;
+	int scale;
+};
+
+static const struct test tests[] = {
+	{ V4L2_PIX_FMT_YUYV,	V4L2_PIX_FMT_RGB24,	1 },
+	{ V4L2_PIX_FMT_YUYV,	V4L2_PIX_FMT_YUV420,	1 },
+	{ V4L2_PIX_FMT_RGB24,	V4L2_PIX_FMT_RGB24,	1 },
+	{ V4L2_PIX_FMT_RGB24,	V4L2_PIX_FMT_YUV420,	1 },
+	{ V4L2_PIX_FMT_SBGGR8,	V4L2_PIX_FMT_RGB24,	1 },
+	{ V4L2_PIX_FMT_SBGGR8,	V4L2_PIX_FMT_YUV420,	1 },
+	{ V4L2_PIX_FMT_YUYV,	V4L2_PIX_FMT_RGB24,	3 },
+	{ V4L2_PIX_FMT_SBGGR8,	V4L2_PIX_FMT_RGB24,	3 },
+	{ V4L2_PIX_FMT_SBGGR8,	V4L2_PIX_FMT_YUV420,	3 },
+};
+
+/* Cropped to CROP_WIDTH x CROP_HEIGHT with the position filter */
+#define CROP_WIDTH 128
+#define CROP_HEIGHT 96
+
+static const struct test crop_tests[] = {
+	{ V4L2_PIX_FMT_YUYV,	V4L2_PIX_FMT_RGB24,	1, 0, 0 },
+	{ V4L2_PIX_FMT_YUYV,	V4L2_PIX_FMT_RGB24,	1, 1, 0 },
+	{ V4L2_PIX_FMT_YUYV,	V4L2_PIX_FMT_RGB24,	3, 1, 1 },
+	{ V4L2_PIX_FMT_RGB24,	V4L2_PIX_FMT_RGB24,	1, 1, 0 },
+	{ V4L2_PIX_FMT_SBGGR8,	V4L2_PIX_FMT_RGB24,	1, 1, 0 },
+};
+
+/* Scaled to SCALE_WIDTH x SCALE_HEIGHT with the rgb filter */
+#define SCALE_WIDTH 200
+#define SCALE_HEIGHT 150
+
+static const struct test scale_tests[] = {
+	{ V4L2_PIX_FMT_YUYV,	V4L2_PIX_FMT_RGB24,	1, 0, 0, 1 },
+	{ V4L2_PIX_FMT_YUYV,	V4L2_PIX_FMT_RGB24,	3, 0, 0, 1 },
+	{ V4L2_PIX_FMT_YUYV,	V4L2_PIX_FMT_RGB24,	3, 1, 1, 1 },
+	{ V4L2_PIX_FMT_RGB24,	V4L2_PIX_FMT_RGB24,	3, 0, 0, 1 },
+};
+
+static int is_bayer(unsigned int fourcc)
+{
+	return fourcc == V4L2_PIX_FMT_SBGGR8;
+}
+
+static int src_bpp(unsigned int fourcc)
+{
+	switch (fourcc) {
+	case V4L2_PIX_FMT_YUYV:
+		return 2;
+	case V4L2_PIX_FMT_RGB24:
+		return 3;
+	}
+	return 1;
+}
+
+static int dest_size(unsigned int fourcc, int width, int height)
+{
+	return fourcc == V4L2_PIX_FMT_RGB24 ? width * height * 3 :
+					      width * height * 3 / 2;
+}
+
+/* A gradient with some noise and a color cast, which changes halfway so
+   that whitebalance has to adapt */
+static void synth_frame(unsigned char *buf, int size, int stride, int frame)
+{
+	unsigned int seed = frame;
+	int i;
+
+	for (i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = (((i % stride) + (i / stride)) >> 2) +
+			 ((seed >> 16) & 31);
+		if (i % 3 == (frame < FRAMES / 2 ? 0 : 1))
+			buf[i] /= 2;
+	}
+}
+
+static int set_ctrl(struct v4lconvert_data *data, int id, int value)
+{
+	struct v4l2_control ctrl = { .id = id, .value = value };
+
+	return v4lconvert_vidioc_s_ctrl(data, &ctrl);
+}
+
+/* Converts FRAMES frames to width x height with filter (if not NULL) added,
+   the output of all frames is stored in out. Returns the number of rows the
+   filter saw, or -1 on error */
+static int run_test(const struct test *test,
+		const struct v4lconvert_filter *filter, unsigned char *out,
+		int width, int height)
+{
+	int bpp = src_bpp(test->src_fourcc);
+	int src_size = WIDTH * HEIGHT * bpp;
+	int size = dest_size(test->dest_fourcc, width, height);
+	/* The fake device only offers a bayer format, so that libv4lconvert
+	   offers its whitebalance and gamma controls */
+	struct fake_dev dev = {
+		"v4lconvert-filter-test", V4L2_PIX_FMT_SBGGR8
+	};
+	struct v4lconvert_data *data;
+	struct v4l2_format src_fmt, dest_fmt;
+	unsigned char *src;
+	int i, res = 0, rows = 0;
+
+	src = malloc(src_size);
+	if (!src)
+		return -1;
+
+	data = fake_dev_create_convert(&dev);
+	if (!data) {
+		free(src);
+		return -1;
+	}
+	if (test->threads > 1)
+		v4lconvert_set_threads(data, test->threads);
+	v4lconvert_set_scaling(data, test->scale);
+
+	if (set_ctrl(data, V4L2_CID_AUTO_WHITE_BALANCE, 1) ||
+			set_ctrl(data, V4L2_CID_GAMMA, 1500) ||
+			set_ctrl(data, V4L2_CID_HFLIP, test->hflip) ||
+			set_ctrl(data, V4L2_CID_VFLIP, test->vflip)) {
+		fprintf(stderr, "error setting the processing controls\n");
+		res = -1;
+		goto leave;
+	}
+
+	if (filter && v4lconvert_add_filter(data, filter)) {
+		res = -1;
+		goto leave;
+	}
+	memset(rows_seen, 0, sizeof(rows_seen));
+
+	memset(&src_fmt, 0, sizeof(src_fmt));
+	src_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	src_fmt.fmt.pix.width = WIDTH;
+	src_fmt.fmt.pix.height = HEIGHT;
+	src_fmt.fmt.pix.pixelformat = test->src_fourcc;
+	src_fmt.fmt.pix.field = V4L2_FIELD_NONE;
+	src_fmt.fmt.pix.bytesperline = WIDTH * bpp;
+	src_fmt.fmt.pix.sizeimage = src_size;
+	dest_fmt = src_fmt;
+	dest_fmt.fmt.pix.width = width;
+	dest_fmt.fmt.pix.height = height;
+	dest_fmt.fmt.pix.pixelformat = test->dest_fourcc;
+	dest_fmt.fmt.pix.bytesperline = test->dest_fourcc ==
+					V4L2_PIX_FMT_RGB24 ? width * 3 : width;
+	dest_fmt.fmt.pix.sizeimage = size;
+
+	for (i = 0; i < FRAMES; i++) {
+		synth_frame(src, src_size, WIDTH * bpp, i);
+		if (v4lconvert_convert(data, &src_fmt, &dest_fmt, src,
+				       src_size, out + i * size, size) != size) {
+			fprintf(stderr, "%s", v4lconvert_get_error_message(data));
+			res = -1;
+			goto leave;
+		}
+	}
+
+	for (i = 0; i < MAX_BANDS; i++)
+		rows += rows_seen[i];
+	res = rows;
+
+leave:
+	v4lconvert_destroy(data);
+	free(src);
+	return res;
+}
+
+static const char *fourcc_str(unsigned int fourcc, char *buf)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		buf[i] = (fourcc >> (8 * i)) & 0xff;
+	buf[4] = 0;
+	return buf;
+}
+
+/* Returns the number of failures */
+static int check(const char *what, int rows, int expected_rows,
+		const unsigned char *out, const unsigned char *expected,
+		int size, int invert)
+{
+	int i, diff = 0;
+
+	if (rows < 0) {
+		printf("  %s: FAILED to run\n", what);
+		return 1;
+	}
+
+	if (expected)
+		for (i = 0; i < size; i++)
+			if (out[i] != (invert ? 255 - expected[i] : expected[i]))
+				diff++;
+
+	if (rows != expected_rows || diff) {
+		printf("  %s: FAILED, %d rows (expected %d), %d bytes differ\n",
+		       what, rows, expected_rows, diff);
+		return 1;
+	}
+
+	printf("  %s: ok\n", what);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char *ref, *out, *crop;
+	char buf[5], buf2[5];
+	int i, j, y, size, rows, bayer, failures = 0;
+
+	/* Make sure no settings from the environment influence the output */
+	setenv("LIBV4LCONTROL_FLAGS", "0", 1);
+
+	ref = malloc(SCALE_WIDTH * SCALE_HEIGHT * 3 * FRAMES);
+	out = malloc(SCALE_WIDTH * SCALE_HEIGHT * 3 * FRAMES);
+	crop = malloc(CROP_WIDTH * CROP_HEIGHT * 3 * FRAMES);
+	if (!ref || !out || !crop) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		const struct test *test = &tests[i];
+
+		printf("%s -> %s (%d threads):\n",
+		       fourcc_str(test->src_fourcc, buf),
+		       fourcc_str(test->dest_fourcc, buf2), test->threads);
+		size = dest_size(test->dest_fourcc, WIDTH, HEIGHT) * FRAMES;
+		bayer = is_bayer(test->src_fourcc);
+
+		if (run_test(test, NULL, ref, WIDTH, HEIGHT) < 0) {
+			printf("  reference: FAILED to run\n");
+			failures++;
+			continue;
+		}
+
+		rows = run_test(test, &bayer_filter, out, WIDTH, HEIGHT);
+		failures += check("bayer filter", rows,
+				  bayer ? FRAMES * HEIGHT : 0, out, ref, size, 0);
+
+		/* Bayer to yuv420 goes through rgb24 for an rgb filter, which
+		   rounds differently than converting to yuv420 directly */
+		rows = run_test(test, &rgb_filter, out, WIDTH, HEIGHT);
+		failures += check("rgb filter", rows, FRAMES * HEIGHT, out,
+				  bayer && test->dest_fourcc != V4L2_PIX_FMT_RGB24 ?
+				  NULL : ref, size, 0);
+
+		if (test->dest_fourcc == V4L2_PIX_FMT_RGB24) {
+			rows = run_test(test, &invert_filter, out, WIDTH,
+					HEIGHT);
+			failures += check("inverting rgb filter", rows,
+					  FRAMES * HEIGHT, out, ref, size, 1);
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(crop_tests); i++) {
+		const struct test *test = &crop_tests[i];
+		int startx = (WIDTH - CROP_WIDTH) / 2;
+		int starty = (HEIGHT - CROP_HEIGHT) / 2;
+
+		printf("%s -> %s cropped (%d threads, hflip %d, vflip %d):\n",
+		       fourcc_str(test->src_fourcc, buf),
+		       fourcc_str(test->dest_fourcc, buf2), test->threads,
+		       test->hflip, test->vflip);
+
+		rows = run_test(test, &position_filter, ref, WIDTH, HEIGHT);
+		failures += check("uncropped", rows, FRAMES * HEIGHT, NULL,
+				  NULL, 0, 0);
+
+		/* The expected output is the center of the uncropped one */
+		for (j = 0; j < FRAMES; j++)
+			for (y = 0; y < CROP_HEIGHT; y++)
+				memcpy(crop + ((j * CROP_HEIGHT + y) *
+					       CROP_WIDTH) * 3,
+				       ref + ((j * HEIGHT + starty + y) * WIDTH +
+					      startx) * 3,
+				       CROP_WIDTH * 3);
+
+		rows = run_test(test, &position_filter, out, CROP_WIDTH,
+				CROP_HEIGHT);
+		failures += check("cropped", rows, FRAMES * HEIGHT, out, crop,
+				  CROP_WIDTH * CROP_HEIGHT * 3 * FRAMES, 0);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(scale_tests); i++) {
+		const struct test *test = &scale_tests[i];
+
+		printf("%s -> %s scaled (%d threads, hflip %d, vflip %d):\n",
+		       fourcc_str(test->src_fourcc, buf),
+		       fourcc_str(test->dest_fourcc, buf2), test->threads,
+		       test->hflip, test->vflip);
+		size = dest_size(test->dest_fourcc, SCALE_WIDTH, SCALE_HEIGHT) *
+		       FRAMES;
+
+		if (run_test(test, NULL, ref, SCALE_WIDTH, SCALE_HEIGHT) < 0) {
+			printf("  reference: FAILED to run\n");
+			failures++;
+			continue;
+		}
+
+		/* When flipping the regular path flips before scaling, which
+		   rounds differently than mirroring the scaled result */
+		rows = run_test(test, &rgb_filter, out, SCALE_WIDTH,
+				SCALE_HEIGHT);
+		failures += check("rgb filter", rows, FRAMES * HEIGHT, out,
+				  test->hflip || test->vflip ? NULL : ref,
+				  size, 0);
+	}
+
+	free(ref);
+	free(out);
+	free(crop);
+
+	printf("%d failures\n", failures);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
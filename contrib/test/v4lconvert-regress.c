@@ -0,0 +1,1178 @@
+/* libv4lconvert decoder regression test
+   Copyright (C) 2026 the v4l-utils contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation version 2 of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   Pushes a corpus of frames through v4lconvert_convert and compares a
+   checksum of the result against the expected value recorded in a manifest,
+   so that the decoders can be changed without needing the cameras.
+
+   Each manifest line describes one test:
+
+   <src fourcc> <width>x<height> <dest fourcc> <frames> <source> <checksum>
+
+   source is either the name of a file (relative to the manifest) containing
+   one raw frame as captured from the device, or "synth", in which case a
+   frame is generated by the synthesizer for the source format below. The
+   synthesizers produce valid (but not necessarily pretty) bitstreams, they
+   must never be changed without re-recording the manifest, as that would
+   invalidate the checksums.
+
+   libv4lconvert is run on top of a fake device, through the dev_ops
+   interface, with a fresh instance per test as some decoders keep state
+   between frames. The checksum is a 64 bit FNV-1a hash over the output of
+   all frames, or "error" when the conversion is expected to fail. Each test
+   is run a second time with REGRESS_THREADS conversion threads, which must
+   give the same checksum.
+
+   Instead of a checksum a test can specify "idct:<n>:<checksum>", the frames
+   are then decoded with tinyjpeg (rather than libjpeg) twice, once with the
+   integer IDCT and once with the float IDCT, and the test fails if any
+   output byte differs by more than n between the two. The checksum is over
+   the float IDCT output, as which IDCT is the integer one depends on the
+   architecture.
+
+   Run with --record to (re)write the checksums in the manifest with the
+   output of the current code, the allowed idct differences are left as is.
+
+   Besides the manifest tests, frames of each multi planar yuv format get
+   converted with v4lconvert_convert_mplane, with padding at the end of the
+   lines of each plane, which must give the same output as converting the
+   same frame in the equivalent single planar format.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <linux/videodev2.h>
+#ifdef HAVE_JPEG
+#include <jpeglib.h>
+#endif
+#include "../../lib/include/libv4lconvert.h"
+#include "v4lconvert-fake-dev.h"
+#include <argp.h>
+
+#define ARRAY_SIZE(x) ((int)sizeof(x) / (int)sizeof((x)[0]))
+
+#define REGRESS_CARD "v4lconvert-regress"
+#define REGRESS_THREADS 4
+#define MAX_LINE 1024
+
+#ifdef HAVE_JPEG
+#if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
+#define HAVE_JPEG_MEM_DEST 1
+#endif
+#endif
+
+/*
+ * Frame synthesizers
+ */
+
+static unsigned int rand_next(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 16) & 0x7fff;
+}
+
+/* Returns a random number in the range [min, max] */
+static int rand_range(unsigned int *seed, int min, int max)
+{
+	return min + rand_next(seed) % (max - min + 1);
+}
+
+/* A gradient with some noise, roughly what a camera would see */
+static void synth_pixels(unsigned char *buf, int count, int stride,
+		unsigned int *seed)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		buf[i] = (((i % stride) + (i / stride)) >> 2) +
+			 rand_range(seed, 0, 31);
+}
+
+struct bitwriter {
+	unsigned char *buf;
+	int size;
+	int bitpos;
+};
+
+/* Bits are written MSB first, the buffer must be zeroed */
+static int put_bits(struct bitwriter *bw, unsigned int value, int n)
+{
+	while (n--) {
+		if ((bw->bitpos >> 3) >= bw->size)
+			return -1;
+		if (value & (1u << n))
+			bw->buf[bw->bitpos >> 3] |= 0x80 >> (bw->bitpos & 7);
+		bw->bitpos++;
+	}
+	return 0;
+}
+
+/* Formats where any bit pattern is valid: stv0680 is not compressed at all
+   and for sn9c10x, sn9c2028 and mr97310a every code in the bitstream is
+   valid. The bitstream decoders do not know the size of the frame, so make
+   sure there is more data than they can consume. */
+static int synth_random(unsigned int fourcc, unsigned char *buf, int size,
+		int width, int height, int frame, unsigned int *seed)
+{
+	int header = 0, needed = width * height * 2;
+
+	switch (fourcc) {
+	case V4L2_PIX_FMT_STV0680:
+		needed = width * height;
+		break;
+	case V4L2_PIX_FMT_SN9C2028:
+		header = 12;
+		break;
+	case V4L2_PIX_FMT_MR97310A:
+		/* 12 byte header and 12 byte footer */
+		header = 12;
+		needed += 12;
+		break;
+	}
+	if (header + needed > size)
+		return -1;
+
+	memset(buf, 0, header);
+	synth_pixels(buf + header, needed, width, seed);
+
+	return header + needed;
+}
+
+/* spca561: 20 byte header, 2 raw lines and then the compressed data. The
+   code tables adapt to the image, so we cannot produce a valid bitstream
+   without an encoder. An all zero bitstream becomes invalid once the decoder
+   switches tables, this exercises the corrupt frame handling, a valid frame
+   is part of the corpus as a file. */
+static int synth_spca561(unsigned int fourcc, unsigned char *buf, int size,
+		int width, int height, int frame, unsigned int *seed)
+{
+	int needed = 0x14 + width * 2 + width * height * 2;
+
+	if (needed > size)
+		return -1;
+
+	memset(buf, 0, needed);
+	synth_pixels(buf + 0x14, width * 2, width, seed);
+
+	return needed;
+}
+
+/* pac207: each line starts with a 16 bit marker telling how it is encoded,
+   this uses all line types */
+static int synth_pac207(unsigned int fourcc, unsigned char *buf, int size,
+		int width, int height, int frame, unsigned int *seed)
+{
+	static const struct {
+		unsigned short marker;
+		int abs_bits;
+	} modes[] = {
+		{ 0x1ee1, 6 }, { 0x2dd2, 5 }, { 0x3cc3, 4 }
+	};
+	/* Prefix codes for a difference of 0, -1, 1, -2, 2, -3, 3, -4, 4 and
+	   an absolute value */
+	static const struct {
+		unsigned int code;
+		int len;
+	} codes[] = {
+		{ 0x00, 2 }, { 0x01, 2 }, { 0x02, 2 }, { 0x0c, 4 }, { 0x0d, 4 },
+		{ 0x1c, 5 }, { 0x1d, 5 }, { 0x3c, 6 }, { 0x3d, 6 }, { 0x1f, 5 }
+	};
+	struct bitwriter bw;
+	int x, y, i, m, pos = 0;
+
+	memset(buf, 0, size);
+	for (y = 0; y < height; y++) {
+		if (pos + 4 + width * 2 > size)
+			return -1;
+
+		i = rand_range(seed, 0, 9);
+		if (i == 0 || (i == 1 && y < 2)) {
+			/* Raw line */
+			buf[pos] = 0x0f;
+			buf[pos + 1] = 0xf0;
+			synth_pixels(buf + pos + 2, width, width, seed);
+			pos += 2 + width;
+		} else if (i == 1) {
+			/* Repeat the line 2 lines up */
+			buf[pos] = 0x4b;
+			buf[pos + 1] = 0xb4;
+			pos += 2;
+		} else {
+			m = i % ARRAY_SIZE(modes);
+			buf[pos] = modes[m].marker >> 8;
+			buf[pos + 1] = modes[m].marker & 0xff;
+			synth_pixels(buf + pos + 2, 2, width, seed);
+
+			bw.buf = buf + pos;
+			bw.size = size - pos;
+			bw.bitpos = 32;
+			for (x = 2; x < width; x++) {
+				/* Mostly small differences */
+				i = rand_range(seed, 0, 15);
+				if (i >= ARRAY_SIZE(codes))
+					i = rand_range(seed, 0, 2);
+				put_bits(&bw, codes[i].code, codes[i].len);
+				if (i == ARRAY_SIZE(codes) - 1)
+					put_bits(&bw, rand_range(seed, 0, 255),
+						 modes[m].abs_bits);
+			}
+			/* Lines are padded to a multiple of 16 bits */
+			pos += 2 * ((bw.bitpos + 15) / 16);
+		}
+	}
+
+	return pos;
+}
+
+/* sq905c: 0x50 byte header followed by prefix coded nibbles */
+static int synth_sq905c(unsigned int fourcc, unsigned char *buf, int size,
+		int width, int height, int frame, unsigned int *seed)
+{
+	static const unsigned char codes[16] = {
+		0, 2, 6, 0x0e, 0xf0, 0xf1, 0xf2, 0xf3,
+		0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb
+	};
+	static const int code_len[16] = {
+		1, 2, 3, 4, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8
+	};
+	struct bitwriter bw;
+	int i, c;
+
+	memset(buf, 0, size);
+	bw.buf = buf + 0x50;
+	bw.size = size - 0x50;
+	bw.bitpos = 0;
+	for (i = 0; i < width * height; i++) {
+		/* Favor the short codes, like real data does */
+		c = rand_range(seed, 0, 31);
+		if (c >= 16)
+			c = c & 3;
+		if (put_bits(&bw, codes[c], code_len[c]))
+			return -1;
+	}
+
+	return 0x50 + (bw.bitpos + 7) / 8;
+}
+
+/* se401: a sequence of packets with a 4 byte header, containing variable
+   length coded differences to the pixel 3 bytes (so one pixel) earlier */
+static int synth_se401(unsigned int fourcc, unsigned char *buf, int size,
+		int width, int height, int frame, unsigned int *seed)
+{
+	struct bitwriter bw;
+	int i, x = 0, pos = 0, pixels, plen, value, len, info;
+	int total = width * height;
+
+	memset(buf, 0, size);
+	while (total) {
+		pixels = total < 128 ? total : 128;
+		if (pos + 4 + pixels * 3 * 2 > size)
+			return -1;
+
+		bw.buf = buf + pos + 4;
+		bw.size = size - pos - 4;
+		bw.bitpos = 0;
+		for (i = 0; i < pixels * 3; i++) {
+			/* The first 3 values of a line are absolute */
+			if (x < 3)
+				value = rand_range(seed, 0, 31);
+			else
+				value = rand_range(seed, -3, 3);
+			if (++x == width * 3)
+				x = 0;
+
+			if (value == 0) {
+				put_bits(&bw, 0, 1);
+				continue;
+			}
+			for (len = 0; (abs(value) >> len); len++)
+				;
+			/* len 1 bits, a 0 bit, and then len bits of value */
+			put_bits(&bw, (1 << len) - 1, len);
+			put_bits(&bw, 0, 1);
+			if (value < 0)
+				value += (1 << len) - 1;
+			put_bits(&bw, value, len);
+		}
+
+		total -= pixels;
+		if (pos == 0)
+			info = 2; /* Start of frame */
+		else if (total == 0)
+			info = 1; /* End of frame */
+		else
+			info = 0;
+
+		buf[pos] = (info << 6) | (pixels >> 8);
+		buf[pos + 1] = pixels & 0xff;
+		buf[pos + 2] = bw.bitpos >> 8;
+		buf[pos + 3] = bw.bitpos & 0xff;
+		plen = ((bw.bitpos + 47) >> 4) << 1;
+		pos += plen;
+	}
+
+	return pos;
+}
+
+/* cpia1: 64 byte header, then lines prefixed with their length and
+   terminated by 0xfd, and 4 0xff bytes at the end of the frame. Frame 0 is
+   uncompressed, later frames are compressed, meaning that they skip over
+   runs of pixels, keeping the values from the previous frame. */
+static int synth_cpia1(unsigned int fourcc, unsigned char *buf, int size,
+		int width, int height, int frame, unsigned int *seed)
+{
+	int x, y, i, skip, ll, pos = 64;
+	int compressed = frame > 0;
+
+	if (size < 64 + height * (2 * width + 3) + 4)
+		return -1;
+
+	memset(buf, 0, 64);
+	buf[0] = 0x19;
+	buf[1] = 0x68;
+	buf[25] = width / 8;
+	buf[27] = height / 4;
+	buf[28] = compressed;
+
+	for (y = 0; y < height; y++) {
+		ll = 0;
+		for (x = 0; x < width; ) {
+			skip = rand_range(seed, -8, 8) * 2;
+			if (compressed && skip > 0 && x + skip <= width) {
+				buf[pos + 2 + ll++] = (skip << 1) | 1;
+				x += skip;
+				continue;
+			}
+			/* even lines: YUYV, odd lines: YY */
+			for (i = 0; i < ((y & 1) ? 2 : 4); i++)
+				buf[pos + 2 + ll++] =
+					(((x + y) >> 1) + rand_range(seed, 0, 63)) &
+					(i == 0 ? 0xfe : 0xff);
+			x += 2;
+		}
+		buf[pos + 2 + ll++] = 0xfd;
+		buf[pos] = ll & 0xff;
+		buf[pos + 1] = ll >> 8;
+		pos += 2 + ll;
+	}
+	memset(buf + pos, 0xff, 4);
+
+	return pos + 4;
+}
+
+/* jpgl: 4x4 DCT blocks, 4 Y blocks followed by a V and a U block for each
+   16x4 pixels. Data is read as 16 bit little endian words. */
+static int synth_jpgl(unsigned int fourcc, unsigned char *buf, int size,
+		int width, int height, int frame, unsigned int *seed)
+{
+	/* AC codes (without the sign bit) for run / amplitude pairs */
+	static const struct {
+		unsigned int code;
+		int len;
+	} codes[] = {
+		{ 0x002, 2 }, { 0x003, 3 }, { 0x006, 3 }, { 0x00e, 4 },
+		{ 0x008, 5 }, { 0x00b, 5 }, { 0x012, 6 }, { 0x014, 6 },
+		{ 0x03d, 6 }, { 0x03e, 6 }, { 0x078, 7 }, { 0x079, 7 },
+		{ 0x07e, 7 }, { 0x054, 8 }, { 0x057, 8 }, { 0x0ff, 8 },
+		{ 0x0aa, 9 }, { 0x0ac, 9 }, { 0x1fc, 9 }, { 0x156, 10 },
+		{ 0x157, 10 }, { 0x15a, 10 }, { 0x15b, 10 }, { 0x3fa, 10 },
+		{ 0x3fb, 10 }
+	};
+	/* Runs for the above codes, used to not go past the 16th coefficient */
+	static const int runs[] = {
+		0, 0, 1, 0, 2, 3, 1, 0, 4, 0, 5, 1, 0, 2, 6, 0, 3, 1, 0, 1, 0,
+		7, 2, 0, 8
+	};
+	struct bitwriter bw;
+	unsigned char tmp;
+	int i, blocks, c, cc;
+
+	memset(buf, 0, size);
+	bw.buf = buf;
+	bw.size = size - 4;
+	bw.bitpos = 0;
+
+	blocks = (width / 16) * (height / 4) * 6;
+	for (i = 0; i < blocks; i++) {
+		/* Block header: 2 bits Q, then either a 1 and a 5 bit signed DC
+		   difference or a 0 and an 8 bit signed absolute DC value */
+		put_bits(&bw, rand_range(seed, 0, 3), 2);
+		if (rand_range(seed, 0, 1)) {
+			put_bits(&bw, 1, 1);
+			put_bits(&bw, rand_range(seed, 0, 31), 5);
+		} else {
+			put_bits(&bw, 0, 1);
+			put_bits(&bw, rand_range(seed, 0, 255), 8);
+		}
+
+		for (cc = 0; ; cc += runs[c] + 1) {
+			c = rand_range(seed, 0, ARRAY_SIZE(codes) - 1);
+			if (cc + runs[c] + 1 > 15 || rand_range(seed, 0, 3) == 0)
+				break;
+			put_bits(&bw, codes[c].code, codes[c].len);
+			put_bits(&bw, rand_range(seed, 0, 1), 1); /* Sign */
+		}
+		/* End of block */
+		if (put_bits(&bw, 0, 2))
+			return -1;
+	}
+
+	/* Swap to little endian 16 bit words */
+	for (i = 0; i < (bw.bitpos + 15) / 16; i++) {
+		tmp = buf[2 * i];
+		buf[2 * i] = buf[2 * i + 1];
+		buf[2 * i + 1] = tmp;
+	}
+
+	/* The bitreader always reads ahead 2 words */
+	return 2 * ((bw.bitpos + 15) / 16) + 4;
+}
+
+#ifdef HAVE_JPEG_MEM_DEST
+/* jl2005bcd: 16 byte header, then a headerless jpeg for each 16 pixel wide
+   column of the image, aligned to 16 bytes. The jpegs are 8 pixels wide
+   with a 1x2 subsampled component 0 (green) and 2 8x8 components (red and
+   blue), all using the luminance tables. */
+static int synth_jl2005bcd(unsigned int fourcc, unsigned char *buf, int size,
+		int width, int height, int frame, unsigned int *seed)
+{
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	JSAMPLE green[8 * 16], red[8 * 8], blue[8 * 8];
+	JSAMPROW green_rows[16], red_rows[8], blue_rows[8];
+	JSAMPARRAY planes[3] = { green_rows, red_rows, blue_rows };
+	unsigned char *jpeg;
+	unsigned long jpeg_size;
+	int i, x, y, start, pos = 16;
+
+	if (width > 2040 || height > 2040 || (width % 16) || (height % 16))
+		return -1;
+
+	memset(buf, 0, size);
+	buf[4] = height >> 3;
+	buf[5] = width >> 3;
+	buf[13] = 50; /* Quality */
+
+	for (i = 0; i < 16; i++)
+		green_rows[i] = green + i * 8;
+	for (i = 0; i < 8; i++) {
+		red_rows[i] = red + i * 8;
+		blue_rows[i] = blue + i * 8;
+	}
+
+	for (x = 0; x < width; x += 16) {
+		jpeg = NULL;
+		jpeg_size = 0;
+		cinfo.err = jpeg_std_error(&jerr);
+		jpeg_create_compress(&cinfo);
+		jpeg_mem_dest(&cinfo, &jpeg, &jpeg_size);
+		cinfo.image_width = 8;
+		cinfo.image_height = height;
+		cinfo.input_components = 3;
+		cinfo.in_color_space = JCS_RGB;
+		jpeg_set_defaults(&cinfo);
+		cinfo.comp_info[0].h_samp_factor = 1;
+		cinfo.comp_info[0].v_samp_factor = 2;
+		for (i = 1; i < 3; i++) {
+			cinfo.comp_info[i].quant_tbl_no = 0;
+			cinfo.comp_info[i].dc_tbl_no = 0;
+			cinfo.comp_info[i].ac_tbl_no = 0;
+		}
+		jpeg_set_linear_quality(&cinfo, 100, TRUE);
+		cinfo.raw_data_in = TRUE;
+		jpeg_start_compress(&cinfo, TRUE);
+		for (y = 0; y < height; y += 16) {
+			synth_pixels(green, sizeof(green), 8, seed);
+			synth_pixels(red, sizeof(red), 8, seed);
+			synth_pixels(blue, sizeof(blue), 8, seed);
+			jpeg_write_raw_data(&cinfo, planes, 16);
+		}
+		jpeg_finish_compress(&cinfo);
+		jpeg_destroy_compress(&cinfo);
+
+		/* Strip the headers, the decoder uses its own */
+		for (start = 2; start + 4 < (int)jpeg_size; ) {
+			if (jpeg[start] != 0xff)
+				break;
+			i = jpeg[start + 1];
+			start += 2 + ((jpeg[start + 2] << 8) | jpeg[start + 3]);
+			if (i == 0xda) /* Start of scan */
+				break;
+		}
+		if (pos + (int)jpeg_size - start + 16 > size) {
+			free(jpeg);
+			return -1;
+		}
+		memcpy(buf + pos, jpeg + start, jpeg_size - start);
+		pos = (pos + jpeg_size - start + 15) & ~15;
+		free(jpeg);
+	}
+
+	return pos;
+}
+
+/* mjpeg: a 4:2:2 jpeg without huffman tables, as sent by most uvc cameras,
+   jpeg: a 4:2:0 jpeg with restart markers. Both use a high quality setting,
+   so that there are plenty of non zero coefficients for the IDCT. */
+static int synth_jpeg(unsigned int fourcc, unsigned char *buf, int size,
+		int width, int height, int frame, unsigned int *seed)
+{
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	JSAMPROW row;
+	unsigned char *pixels, *jpeg = NULL;
+	unsigned long jpeg_size = 0;
+	int i, len, start, pos;
+
+	pixels = malloc(width * height * 3);
+	if (!pixels)
+		return -1;
+	synth_pixels(pixels, width * height * 3, width * 3, seed);
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, &jpeg, &jpeg_size);
+	cinfo.image_width = width;
+	cinfo.image_height = height;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 90, TRUE);
+	if (fourcc == V4L2_PIX_FMT_MJPEG) {
+		cinfo.comp_info[0].h_samp_factor = 2;
+		cinfo.comp_info[0].v_samp_factor = 1;
+	} else {
+		/* Not a divisor of the MCUs per row on purpose */
+		cinfo.restart_interval = 7;
+	}
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		row = pixels + cinfo.next_scanline * width * 3;
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	free(pixels);
+
+	if ((int)jpeg_size > size) {
+		free(jpeg);
+		return -1;
+	}
+
+	/* Copy the jpeg, for mjpeg without the DHT segments */
+	memcpy(buf, jpeg, 2);
+	for (start = pos = 2; start + 4 < (int)jpeg_size; start += len) {
+		i = jpeg[start + 1];
+		if (i == 0xda) /* Start of scan, copy everything from here */
+			break;
+		len = 2 + ((jpeg[start + 2] << 8) | jpeg[start + 3]);
+		if (i == 0xc4 && fourcc == V4L2_PIX_FMT_MJPEG)
+			continue;
+		memcpy(buf + pos, jpeg + start, len);
+		pos += len;
+	}
+	memcpy(buf + pos, jpeg + start, jpeg_size - start);
+	pos += jpeg_size - start;
+	free(jpeg);
+
+	return pos;
+}
+#endif
+
+struct synth {
+	unsigned int fourcc;
+	int (*synth)(unsigned int fourcc, unsigned char *buf, int size,
+		     int width, int height, int frame, unsigned int *seed);
+};
+
+static const struct synth synths[] = {
+	{ V4L2_PIX_FMT_STV0680,		synth_random },
+	{ V4L2_PIX_FMT_SN9C10X,		synth_random },
+	{ V4L2_PIX_FMT_SN9C2028,	synth_random },
+	{ V4L2_PIX_FMT_MR97310A,	synth_random },
+	{ V4L2_PIX_FMT_SPCA561,		synth_spca561 },
+	{ V4L2_PIX_FMT_PAC207,		synth_pac207 },
+	{ V4L2_PIX_FMT_SQ905C,		synth_sq905c },
+	{ V4L2_PIX_FMT_SE401,		synth_se401 },
+	{ V4L2_PIX_FMT_CPIA1,		synth_cpia1 },
+	{ V4L2_PIX_FMT_JPGL,		synth_jpgl },
+#ifdef HAVE_JPEG_MEM_DEST
+	{ V4L2_PIX_FMT_JL2005BCD,	synth_jl2005bcd },
+	{ V4L2_PIX_FMT_MJPEG,		synth_jpeg },
+	{ V4L2_PIX_FMT_JPEG,		synth_jpeg },
+#endif
+};
+
+/*
+ * The test runner
+ */
+
+struct test {
+	unsigned int src_fourcc;
+	unsigned int dest_fourcc;
+	int width;
+	int height;
+	int frames;
+	char source[256];
+	char checksum[32];
+};
+
+/* Static vars to store the parameters */
+static char *manifest_name;
+static int record;
+static int verbose;
+
+static unsigned int str_fourcc(const char *s)
+{
+	char buf[4] = { ' ', ' ', ' ', ' ' };
+	int i;
+
+	for (i = 0; i < 4 && s[i]; i++)
+		buf[i] = s[i];
+
+	return v4l2_fourcc(buf[0], buf[1], buf[2], buf[3]);
+}
+
+static const char *fourcc_str(unsigned int fourcc, char *buf)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		buf[i] = (fourcc >> (8 * i)) & 0xff;
+	buf[4] = 0;
+	return buf;
+}
+
+static uint64_t fnv1a(uint64_t hash, const unsigned char *buf, int size)
+{
+	int i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= buf[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static unsigned char *load_file(const char *dir, const char *name, int *size)
+{
+	char path[PATH_MAX];
+	unsigned char *buf;
+	FILE *f;
+	long len;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	/* Some decoders read past the end of the frame */
+	buf = calloc(1, len > 0 ? len + 65536 : 1);
+	if (!buf || len <= 0 || fread(buf, 1, len, f) != (size_t)len) {
+		fprintf(stderr, "error reading %s\n", path);
+		free(buf);
+		buf = NULL;
+	}
+	fclose(f);
+	*size = len;
+	return buf;
+}
+
+/* Runs a test with threads conversion threads, returns 0 and stores the
+   checksum in result on success, 1 when the test cannot be run with this
+   build. When out is not NULL the output of each frame is stored there too,
+   width * height * 3 bytes apart */
+static int run_test(const struct test *test, const char *dir, int threads,
+		unsigned char *out, char *result)
+{
+	const struct synth *synth = NULL;
+	struct fake_dev dev = { REGRESS_CARD, test->src_fourcc };
+	struct v4lconvert_data *data;
+	struct v4l2_format src_fmt, dest_fmt;
+	unsigned char *src = NULL, *dest;
+	unsigned int seed;
+	int i, res = 0, src_size = 0, buf_size, dest_size;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	if (!strcmp(test->source, "synth")) {
+		for (i = 0; i < ARRAY_SIZE(synths); i++)
+			if (synths[i].fourcc == test->src_fourcc)
+				synth = &synths[i];
+		/* Some synthesizers depend on optional libraries */
+		if (!synth)
+			return 1;
+		/* Plenty of room for the bitstream decoders to read past
+		   the end of the frame */
+		buf_size = test->width * test->height * 4 + 65536;
+		src = malloc(buf_size);
+	} else {
+		src = load_file(dir, test->source, &src_size);
+		buf_size = src_size;
+	}
+	dest_size = test->width * test->height * 3;
+	dest = malloc(dest_size);
+	if (!src || !dest) {
+		free(src);
+		free(dest);
+		return -1;
+	}
+
+	data = fake_dev_create_convert(&dev);
+	if (!data) {
+		free(src);
+		free(dest);
+		return -1;
+	}
+	if (threads > 1)
+		v4lconvert_set_threads(data, threads);
+
+	memset(&src_fmt, 0, sizeof(src_fmt));
+	src_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	src_fmt.fmt.pix.width = test->width;
+	src_fmt.fmt.pix.height = test->height;
+	src_fmt.fmt.pix.pixelformat = test->src_fourcc;
+	src_fmt.fmt.pix.field = V4L2_FIELD_NONE;
+	dest_fmt = src_fmt;
+	dest_fmt.fmt.pix.pixelformat = test->dest_fourcc;
+	dest_fmt.fmt.pix.sizeimage = dest_size;
+
+	seed = test->src_fourcc;
+	for (i = 0; i < test->frames && res >= 0; i++) {
+		if (synth) {
+			src_size = synth->synth(test->src_fourcc, src, buf_size,
+						test->width, test->height, i,
+						&seed);
+			if (src_size < 0) {
+				fprintf(stderr, "error synthesizing frame\n");
+				res = -2;
+				break;
+			}
+		}
+		src_fmt.fmt.pix.sizeimage = src_size;
+
+		/* Make stale data in dest show up as a mismatch */
+		memset(dest, i & 1 ? 0xaa : 0x55, dest_size);
+		res = v4lconvert_convert(data, &src_fmt, &dest_fmt, src,
+					 src_size, dest, dest_size);
+		if (res >= 0) {
+			hash = fnv1a(hash, dest, res);
+			if (out)
+				memcpy(out + i * dest_size, dest, res);
+		} else if (verbose)
+			fprintf(stderr, "%s", v4lconvert_get_error_message(data));
+	}
+
+	v4lconvert_destroy(data);
+	free(src);
+	free(dest);
+
+	if (res == -2)
+		return -1;
+
+	if (res < 0)
+		strcpy(result, "error");
+	else
+		sprintf(result, "%016llx", (unsigned long long)hash);
+
+	return 0;
+}
+
+/* Runs an idct test, stores the largest difference between the integer and
+   the float IDCT output in max_diff and the checksum of the float IDCT
+   output in result */
+static int run_idct_test(const struct test *test, const char *dir,
+		int *max_diff, char *result)
+{
+	int i, res, size = test->width * test->height * 3 * test->frames;
+	unsigned char *out[2];
+
+	out[0] = calloc(1, size);
+	out[1] = calloc(1, size);
+	if (!out[0] || !out[1]) {
+		free(out[0]);
+		free(out[1]);
+		return -1;
+	}
+
+	/* V4LCONTROL_FORCE_TINYJPEG and V4LCONTROL_FLOAT_IDCT */
+	setenv("LIBV4LCONTROL_FLAGS", "0x20", 1);
+	res = run_test(test, dir, 1, out[0], result);
+	if (res == 0 && strcmp(result, "error")) {
+		setenv("LIBV4LCONTROL_FLAGS", "0xa0", 1);
+		res = run_test(test, dir, 1, out[1], result);
+	}
+	setenv("LIBV4LCONTROL_FLAGS", "0", 1);
+	if (res == 0 && !strcmp(result, "error"))
+		res = -1;
+
+	*max_diff = 0;
+	for (i = 0; i < size && res == 0; i++)
+		if (abs(out[0][i] - out[1][i]) > *max_diff)
+			*max_diff = abs(out[0][i] - out[1][i]);
+
+	free(out[0]);
+	free(out[1]);
+	return res;
+}
+
+/* Multi planar formats and their single planar equivalent */
+struct mplane_test {
+	unsigned int mplane_fourcc;
+	unsigned int fourcc;
+	int planes;
+	int uv_height_div;
+};
+
+static const struct mplane_test mplane_tests[] = {
+	{ V4L2_PIX_FMT_NV12M,	V4L2_PIX_FMT_NV12,	2, 2 },
+	{ V4L2_PIX_FMT_NV21M,	V4L2_PIX_FMT_NV21,	2, 2 },
+	{ V4L2_PIX_FMT_NV16M,	V4L2_PIX_FMT_NV16,	2, 1 },
+	{ V4L2_PIX_FMT_NV61M,	V4L2_PIX_FMT_NV61,	2, 1 },
+	{ V4L2_PIX_FMT_YUV420M,	V4L2_PIX_FMT_YUV420,	3, 2 },
+	{ V4L2_PIX_FMT_YVU420M,	V4L2_PIX_FMT_YVU420,	3, 2 },
+};
+
+static const unsigned int mplane_dest_formats[] = {
+	V4L2_PIX_FMT_RGB24,
+	V4L2_PIX_FMT_YUV420,
+};
+
+#define MPLANE_WIDTH 320
+#define MPLANE_HEIGHT 240
+#define MPLANE_PAD 32
+
+/* Converts a frame as test->mplane_fourcc and as test->fourcc, returns 0
+   when the output is the same, 1 when it differs and -1 on error */
+static int run_mplane_test(const struct mplane_test *test,
+		unsigned int dest_fourcc)
+{
+	int width = MPLANE_WIDTH, height = MPLANE_HEIGHT;
+	int uv_width = test->planes == 3 ? width / 2 : width;
+	int uv_height = height / test->uv_height_div;
+	int size = width * height + (test->planes - 1) * uv_width * uv_height;
+	int dest_size = width * height * 3;
+	struct fake_dev dev = { REGRESS_CARD, test->fourcc };
+	struct v4lconvert_data *data = NULL;
+	struct v4l2_format src_fmt, mp_fmt, dest_fmt;
+	unsigned char *src, *plane[3] = { NULL, NULL, NULL }, *dest[2];
+	int plane_size[3];
+	unsigned int seed = test->mplane_fourcc;
+	int i, y, offset = 0, res[2] = { -1, -1 }, ret = -1;
+
+	src = malloc(size);
+	dest[0] = malloc(dest_size);
+	dest[1] = malloc(dest_size);
+	if (!src || !dest[0] || !dest[1])
+		goto leave;
+	synth_pixels(src, size, width, &seed);
+
+	memset(&mp_fmt, 0, sizeof(mp_fmt));
+	mp_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	mp_fmt.fmt.pix_mp.width = width;
+	mp_fmt.fmt.pix_mp.height = height;
+	mp_fmt.fmt.pix_mp.pixelformat = test->mplane_fourcc;
+	mp_fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+	mp_fmt.fmt.pix_mp.num_planes = test->planes;
+	for (i = 0; i < test->planes; i++) {
+		int plane_width = i ? uv_width : width;
+		int plane_height = i ? uv_height : height;
+		int stride = plane_width + MPLANE_PAD;
+
+		plane_size[i] = stride * plane_height;
+		plane[i] = malloc(plane_size[i]);
+		if (!plane[i])
+			goto leave;
+		memset(plane[i], 0xaa, plane_size[i]);
+		for (y = 0; y < plane_height; y++) {
+			memcpy(plane[i] + y * stride, src + offset,
+			       plane_width);
+			offset += plane_width;
+		}
+		mp_fmt.fmt.pix_mp.plane_fmt[i].bytesperline = stride;
+		mp_fmt.fmt.pix_mp.plane_fmt[i].sizeimage = plane_size[i];
+	}
+
+	memset(&src_fmt, 0, sizeof(src_fmt));
+	src_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	src_fmt.fmt.pix.width = width;
+	src_fmt.fmt.pix.height = height;
+	src_fmt.fmt.pix.pixelformat = test->fourcc;
+	src_fmt.fmt.pix.field = V4L2_FIELD_NONE;
+	src_fmt.fmt.pix.bytesperline = width;
+	src_fmt.fmt.pix.sizeimage = size;
+	dest_fmt = src_fmt;
+	dest_fmt.fmt.pix.pixelformat = dest_fourcc;
+	dest_fmt.fmt.pix.bytesperline = 0;
+	dest_fmt.fmt.pix.sizeimage = dest_size;
+
+	data = fake_dev_create_convert(&dev);
+	if (!data)
+		goto leave;
+
+	memset(dest[0], 0x55, dest_size);
+	memset(dest[1], 0xaa, dest_size);
+	res[0] = v4lconvert_convert(data, &src_fmt, &dest_fmt, src, size,
+				    dest[0], dest_size);
+	res[1] = v4lconvert_convert_mplane(data, &mp_fmt, &dest_fmt, plane,
+					   plane_size, dest[1], dest_size);
+	if (res[0] < 0 || res[1] < 0) {
+		if (verbose)
+			fprintf(stderr, "%s",
+				v4lconvert_get_error_message(data));
+		goto leave;
+	}
+
+	ret = res[0] != res[1] || memcmp(dest[0], dest[1], res[0]);
+
+leave:
+	if (data)
+		v4lconvert_destroy(data);
+	for (i = 0; i < 3; i++)
+		free(plane[i]);
+	free(src);
+	free(dest[0]);
+	free(dest[1]);
+	return ret;
+}
+
+static int parse_test(const char *line, struct test *test)
+{
+	char src[8], dest[8];
+
+	if (sscanf(line, "%7s %dx%d %7s %d %255s %31s", src, &test->width,
+		   &test->height, dest, &test->frames, test->source,
+		   test->checksum) < 6)
+		return -1;
+
+	if (test->width <= 0 || test->height <= 0 || test->frames <= 0)
+		return -1;
+
+	test->src_fourcc = str_fourcc(src);
+	test->dest_fourcc = str_fourcc(dest);
+	return 0;
+}
+
+/*
+ * Main routine. Reads parameters via argp.h and runs the tests.
+ */
+
+const char *argp_program_version = "v4lconvert regression test version " V4L_UTILS_VERSION;
+
+static const char doc[] = "\nChecks the libv4lconvert decoders against the "
+	"outputs recorded in MANIFEST.";
+
+static const char args_doc[] = "MANIFEST";
+
+static const struct argp_option options[] = {
+	{"record",	'r',	0,	0,	"record the current output as expected output", 0},
+	{"verbose",	'v',	0,	0,	"print libv4lconvert error messages", 0},
+	{ 0, 0, 0, 0, 0, 0 }
+};
+
+static error_t parse_opt(int k, char *arg, struct argp_state *state)
+{
+	switch (k) {
+	case 'r':
+		record = 1;
+		break;
+	case 'v':
+		verbose = 1;
+		break;
+	case ARGP_KEY_ARG:
+		if (manifest_name)
+			argp_usage(state);
+		manifest_name = arg;
+		break;
+	case ARGP_KEY_END:
+		if (!manifest_name)
+			argp_usage(state);
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+static struct argp argp = {
+	.options = options,
+	.parser = parse_opt,
+	.args_doc = args_doc,
+	.doc = doc,
+};
+
+
+int main(int argc, char **argv)
+{
+	char line[MAX_LINE], result[32], threaded_result[32], dir[1024];
+	char idct_result[32], buf[5], buf2[5], buf3[5], *s;
+	const char *expected;
+	char *recorded = NULL;
+	size_t recorded_size = 0;
+	FILE *f, *out = NULL;
+	struct test test;
+	int line_nr = 0, tests = 0, failures = 0, skipped = 0, res, idct;
+	int max_diff = 0, allowed_diff, i, j;
+
+	argp_parse(&argp, argc, argv, 0, 0, 0);
+
+	/* Make sure no settings from the environment influence the output */
+	setenv("LIBV4LCONTROL_CONTROLS", "0", 1);
+	setenv("LIBV4LCONTROL_FLAGS", "0", 1);
+
+	snprintf(dir, sizeof(dir), "%s", manifest_name);
+	s = strrchr(dir, '/');
+	if (s)
+		*s = 0;
+	else
+		strcpy(dir, ".");
+
+	f = fopen(manifest_name, "r");
+	if (!f) {
+		perror(manifest_name);
+		return EXIT_FAILURE;
+	}
+
+	if (record) {
+		out = open_memstream(&recorded, &recorded_size);
+		if (!out) {
+			perror("open_memstream");
+			return EXIT_FAILURE;
+		}
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		line_nr++;
+		if (line[0] == '#' || line[0] == '\n') {
+			if (out)
+				fputs(line, out);
+			continue;
+		}
+
+		memset(&test, 0, sizeof(test));
+		if (parse_test(line, &test)) {
+			fprintf(stderr, "%s:%d: parse error\n", manifest_name,
+				line_nr);
+			return EXIT_FAILURE;
+		}
+
+		printf("%s %dx%d -> %s (%d frames, %s): ",
+		       fourcc_str(test.src_fourcc, buf), test.width,
+		       test.height, fourcc_str(test.dest_fourcc, buf2),
+		       test.frames, test.source);
+		fflush(stdout);
+
+		tests++;
+		idct = !strncmp(test.checksum, "idct:", 5);
+		if (idct)
+			res = run_idct_test(&test, dir, &max_diff, result);
+		else
+			res = run_test(&test, dir, 1, NULL, result);
+		/* The output must not depend on the number of threads */
+		if (!idct && res == 0)
+			res = run_test(&test, dir, REGRESS_THREADS, NULL,
+				       threaded_result);
+		if (res == 1) {
+			printf("skipped, not supported by this build\n");
+			skipped++;
+			strcpy(result, test.checksum);
+		} else if (res) {
+			printf("FAILED to run\n");
+			failures++;
+			strcpy(result, test.checksum);
+		} else if (idct) {
+			allowed_diff = atoi(test.checksum + 5);
+			expected = strchr(test.checksum + 5, ':');
+			expected = expected ? expected + 1 : "";
+			if (max_diff > allowed_diff) {
+				printf("FAILED, max difference %d allowed %d\n",
+				       max_diff, allowed_diff);
+				failures++;
+				strcpy(result, expected);
+			} else if (record) {
+				printf("%s, max difference %d\n", result,
+				       max_diff);
+			} else if (strcmp(result, expected)) {
+				printf("FAILED, got %s expected %s\n", result,
+				       expected[0] ? expected : "nothing");
+				failures++;
+			} else
+				printf("ok, max difference %d\n", max_diff);
+			snprintf(idct_result, sizeof(idct_result), "idct:%d:%s",
+				 allowed_diff, result);
+			strcpy(result, idct_result);
+		} else if (strcmp(threaded_result, result)) {
+			printf("FAILED, got %s with %d threads and %s without\n",
+			       threaded_result, REGRESS_THREADS, result);
+			failures++;
+			strcpy(result, test.checksum);
+		} else if (record) {
+			printf("%s\n", result);
+		} else if (strcmp(result, test.checksum)) {
+			printf("FAILED, got %s expected %s\n", result,
+			       test.checksum[0] ? test.checksum : "nothing");
+			failures++;
+		} else
+			printf("ok\n");
+
+		if (out)
+			fprintf(out, "%s\t%dx%d\t%s\t%d\t%s\t%s\n",
+				fourcc_str(test.src_fourcc, buf), test.width,
+				test.height, fourcc_str(test.dest_fourcc, buf2),
+				test.frames, test.source, result);
+	}
+	fclose(f);
+
+	for (i = 0; i < ARRAY_SIZE(mplane_tests); i++) {
+		for (j = 0; j < ARRAY_SIZE(mplane_dest_formats); j++) {
+			printf("%s %dx%d -> %s (multi planar, as %s): ",
+			       fourcc_str(mplane_tests[i].mplane_fourcc, buf),
+			       MPLANE_WIDTH, MPLANE_HEIGHT,
+			       fourcc_str(mplane_dest_formats[j], buf2),
+			       fourcc_str(mplane_tests[i].fourcc, buf3));
+			tests++;
+			res = run_mplane_test(&mplane_tests[i],
+					      mplane_dest_formats[j]);
+			if (res < 0) {
+				printf("FAILED to run\n");
+				failures++;
+			} else if (res) {
+				printf("FAILED, output differs\n");
+				failures++;
+			} else
+				printf("ok\n");
+		}
+	}
+
+	if (out) {
+		fclose(out);
+		f = fopen(manifest_name, "w");
+		if (!f || fwrite(recorded, 1, recorded_size, f) != recorded_size) {
+			perror(manifest_name);
+			return EXIT_FAILURE;
+		}
+		fclose(f);
+		free(recorded);
+	}
+
+	printf("%d tests, %d failures, %d skipped\n", tests, failures, skipped);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -32,9 +32,17 @@ struct libv4l_dev_ops {
     int (*ioctl)(void *dev_ops_priv, int fd, unsigned long int request, void *arg);
     ssize_t (*read)(void *dev_ops_priv, int fd, void *buffer, size_t n);
     ssize_t (*write)(void *dev_ops_priv, int fd, const void *buffer, size_t n);
+    /* Optional, for plugins which can be stacked on top of other plugins.
+       When set this gets called instead of init, with the dev_ops of the
+       layer below (another plugin or the default dev_ops) and its private
+       data. The plugin must pass all calls it does not handle itself on to
+       next_ops instead of accessing fd directly. libv4l2 closes each layer
+       itself, so close must not call next_ops->close. Plugins without
+       init_chain always go at the bottom of the stack. */
+    void * (*init_chain)(int fd, void *next_priv,
+                         const struct libv4l_dev_ops *next_ops);
     /* For future plugin API extension, plugins implementing the current API
        must set these all to NULL, as future versions may check for these */
-    void (*reserved1)(void);
     void (*reserved2)(void);
     void (*reserved3)(void);
     void (*reserved4)(void);
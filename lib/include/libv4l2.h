@@ -37,6 +37,14 @@ extern "C" {
    status messages to a file, when NULL errors will get send to stderr */
 LIBV4L_PUBLIC extern FILE *v4l2_log_file;
 
+/* Point this to a FILE opened for writing when you want the statistics of
+   each device (see v4l2_get_stats()) to be written to it periodically while
+   capturing, and when the device gets closed. This can also be done by
+   setting the LIBV4L2_STATS_FILENAME environment variable. The interval
+   defaults to 10 seconds, the LIBV4L2_STATS_INTERVAL environment variable
+   can be used to change it. */
+LIBV4L_PUBLIC extern FILE *v4l2_stats_file;
+
 /* Just like your regular open/close/etc, except that format conversion is
    done if necessary when capturing. That is if you (try to) set a capture
    format which is not supported by the cam, but is supported by libv4lconvert,
@@ -100,6 +108,25 @@ LIBV4L_PUBLIC int v4l2_get_control(int fd, int cid);
 /* This flag is *OBSOLETE*, since version 0.5.98 libv4l *always* reports
    emulated formats to ENUM_FMT, except when conversion is disabled. */
 #define V4L2_ENABLE_ENUM_FMT_EMULATION 0x02
+/* Scale frames to the resolution the application asks for, instead of only
+   offering the resolutions of the device (see v4lconvert_set_scaling). */
+#define V4L2_ENABLE_SCALING 0x04
+/* Convert frames from a separate thread as soon as the driver has them ready,
+   instead of in the VIDIOC_DQBUF call of the application. Only used when
+   streaming with mmap and converting, and only suitable for applications
+   which wait for frames in a blocking VIDIOC_DQBUF (or get EAGAIN back from
+   a non-blocking one) rather than with poll() / select(), as the frames get
+   taken from the driver before the application gets to see them. */
+#define V4L2_ENABLE_ASYNC_CONVERSION 0x08
+/* When emulating read() with conversion, convert frames from a separate
+   thread as soon as the driver has them ready, into a ring of converted
+   frames from which read() then copies, so that an application which stops
+   reading for a while does not lose frames until the ring is full. The ring
+   holds 8 frames, the LIBV4L2_READ_AHEAD environment variable can be used to
+   set a different size (0 - 32 frames, 0 disables read-ahead), also without
+   this flag. The frames dropped because the ring was full are counted in
+   the read_ahead_frames_dropped member of the v4l2_get_stats() statistics. */
+#define V4L2_ENABLE_READ_AHEAD 0x10
 
 /* v4l2_fd_open: open an already opened fd for further use through
    v4l2lib and possibly modify libv4l2's default behavior through the
@@ -109,6 +136,41 @@ LIBV4L_PUBLIC int v4l2_get_control(int fd, int cid);
    (note the fd is left open in this case). */
 LIBV4L_PUBLIC int v4l2_fd_open(int fd, int v4l2_flags);
 
+#define V4L2_STATS_CONVERT_TIME_BUCKETS 20
+
+/* Statistics of a device since it was opened. These only cover the frames
+   libv4l2 dequeues itself, so when converting or emulating read(). */
+struct v4l2_stats {
+	/* Frames converted */
+	unsigned long long frames_converted;
+	/* Frames which could not be converted / decoded */
+	unsigned long long convert_errors;
+	/* Frames at the start of a stream which could not be converted and got
+	   skipped without reporting an error, as some cams produce bad frames
+	   while they are still syncing */
+	unsigned long long start_frames_dropped;
+	/* Frames dropped by the driver, going by gaps in the sequence numbers of
+	   the buffers (not all drivers fill these in) */
+	unsigned long long driver_frames_dropped;
+	/* Frames dropped because the read-ahead ring was full */
+	unsigned long long read_ahead_frames_dropped;
+	/* Dequeues which left the driver without any queued buffers, so that it
+	   had to drop frames if the next buffer did not get queued in time */
+	unsigned long long queue_underruns;
+	/* Bytes written by conversion and copied out of the read-ahead ring */
+	unsigned long long bytes_copied;
+	/* Total time spent converting frames */
+	unsigned long long convert_time_us;
+	/* Conversion time histogram, bucket 0 counts the frames which took less
+	   than 2 us to convert, bucket i > 0 those which took 2^i - 2^(i+1) - 1
+	   us, and the last bucket also counts everything longer */
+	unsigned long long convert_time_hist[V4L2_STATS_CONVERT_TIME_BUCKETS];
+};
+
+/* Get the statistics of fd, returns 0 on success and -1 if fd is not a
+   libv4l2 fd. */
+LIBV4L_PUBLIC int v4l2_get_stats(int fd, struct v4l2_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -112,6 +112,20 @@ LIBV4L_PUBLIC int v4lconvert_convert(struct v4lconvert_data *data,
 		const struct v4l2_format *dest_fmt, /* in */
 		unsigned char *src, int src_size, unsigned char *dest, int dest_size);
 
+/* Like v4lconvert_convert, but for a multi planar src_fmt (using
+   src_fmt->fmt.pix_mp), with each of the pix_mp.num_planes planes passed in
+   src[] / src_size[]. The planes are read in place. Besides the formats
+   v4lconvert_convert takes, the NV12M, NV21M, NV16M, NV61M, YUV420M and
+   YVU420M formats are supported. dest_fmt is a regular single planar format
+   and must be one of the formats we can convert to.
+
+   Returns the amount of bytes written to dest and -1 on error */
+LIBV4L_PUBLIC int v4lconvert_convert_mplane(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char **src, const int *src_size,
+		unsigned char *dest, int dest_size);
+
 /* get a string describing the last error */
 LIBV4L_PUBLIC const char *v4lconvert_get_error_message(struct v4lconvert_data *data);
 
@@ -141,6 +155,70 @@ LIBV4L_PUBLIC int v4lconvert_supported_dst_format(unsigned int pixelformat);
 LIBV4L_PUBLIC int v4lconvert_get_fps(struct v4lconvert_data *data);
 LIBV4L_PUBLIC void v4lconvert_set_fps(struct v4lconvert_data *data, int fps);
 
+/* Set the number of threads (including the calling thread) used for
+   converting a frame, the frame then gets split up into horizontal bands
+   which get converted in parallel. The result is identical to converting
+   the whole frame from the calling thread, which is what happens when
+   threads is 1 (the default). The initial value can also be set through
+   the LIBV4LCONVERT_THREADS environment variable.
+   Returns 0 on success and -1 if the threads could not be started */
+LIBV4L_PUBLIC int v4lconvert_set_threads(struct v4lconvert_data *data,
+		int threads);
+
+/* Enable / disable scaling. By default a resolution the device can not do
+   is emulated by cropping a slightly larger, or adding a black border to a
+   slightly smaller resolution, and only for some well known resolutions.
+   With scaling enabled v4lconvert_try_format accepts any resolution (up to
+   the largest resolution of the device) for the formats we can convert to,
+   v4lconvert_enum_framesizes reports this as a stepwise range, and frames
+   get resampled to the requested resolution. The initial value can also be
+   set through the LIBV4LCONVERT_SCALING environment variable. */
+LIBV4L_PUBLIC void v4lconvert_set_scaling(struct v4lconvert_data *data,
+		int enable);
+
+/* Formats the row function of a processing filter can accept */
+#define V4LCONVERT_FILTER_BAYER	0x01 /* 8 bit bayer, one row of samples */
+#define V4LCONVERT_FILTER_RGB	0x02 /* rgb24 / bgr24 */
+
+/* A custom processing filter, these get applied to each frame one row at a
+   time, as part of the same pass over the frame as the builtin processing
+   (whitebalance, autogain, gamma correction) where possible, so while the row
+   is still in the cache. Filters only ever see a single row, so they are
+   meant for per pixel operations (lens shading, a color correction matrix,
+   tone curves) and horizontal filters. Kernels which need the neighbouring
+   rows, such as a 2-D denoise or sharpen, cannot be written as a row filter. */
+struct v4lconvert_filter {
+	/* Which V4LCONVERT_FILTER_* formats row() accepts. A filter gets
+	   applied once per frame, at the first point during the conversion
+	   where the frame is in one of these formats, after the builtin
+	   processing. Bayer data is only available for bayer sources (and
+	   sources decoded to bayer), so a filter accepting only bayer gets
+	   skipped for other sources. A filter accepting rgb always gets
+	   applied, if needed by converting to rgb24 and from there to the
+	   destination format. */
+	unsigned int formats;
+	/* Called from v4lconvert_convert() at the start of each frame, returns 1
+	   if the filter should be applied to this frame. May be NULL. */
+	int (*frame_start)(void *priv);
+	/* Process row y of a frame of height rows in place, for rgb24 / bgr24
+	   buf contains width pixels, for bayer width samples and pixelformat
+	   together with y tells which color each sample is. When using multiple
+	   threads this gets called from all threads at once with different
+	   bands (see v4lconvert_set_threads), a band is never processed by more
+	   then one thread at a time. */
+	void (*row)(void *priv, unsigned char *buf, int width,
+		    unsigned int pixelformat, int band, int y, int height);
+	void *priv;
+};
+
+/* Add a custom processing filter, filters get applied in the order in which
+   they were added. filter must stay valid until it is removed again.
+   Returns 0 on success and -1 if too many filters were added */
+LIBV4L_PUBLIC int v4lconvert_add_filter(struct v4lconvert_data *data,
+		const struct v4lconvert_filter *filter);
+LIBV4L_PUBLIC void v4lconvert_remove_filter(struct v4lconvert_data *data,
+		const struct v4lconvert_filter *filter);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -21,19 +21,23 @@
 
 #include <stdio.h>
 #include <pthread.h>
+#include <sys/types.h>
 #include <libv4lconvert.h> /* includes videodev2.h for us */
 
 #include "../libv4lconvert/libv4lsyscall-priv.h"
 
-#define V4L2_MAX_DEVICES 16
+#define V4L2_MAX_DEVICES 1024
 /* Warning when making this larger the frame_queued and frame_mapped members of
    the v4l2_dev_info struct can no longer be a bitfield, so the code needs to
    be adjusted! */
 #define V4L2_MAX_NO_FRAMES 32
 #define V4L2_DEFAULT_NREADBUFFERS 4
-#define V4L2_FRAME_BUF_SIZE (4096 * 4096)
+#define V4L2_DEFAULT_READ_AHEAD 8
+#define V4L2_MAX_READ_AHEAD 32
 #define V4L2_IGNORE_FIRST_FRAME_ERRORS 3
 #define V4L2_DEFAULT_FPS 30
+#define V4L2_DEFAULT_STATS_INTERVAL 10
+#define V4L2_CONVERT_ERROR_MSG_SIZE 256
 
 #define V4L2_LOG_ERR(...) 			\
 	do { 					\
@@ -47,7 +51,7 @@
 #define V4L2_PERROR(format, ...)		\
 	do { 					\
 		if (errno == ENODEV) {		\
-			devices[index].gone = 1;\
+			devices[index]->gone = 1;\
 			break;			\
 		}				\
 		V4L2_LOG_ERR(format ": %s\n", ##__VA_ARGS__, strerror(errno)); \
@@ -82,21 +86,59 @@ struct v4l2_dev_info {
 	/* fmt as seen by the application (iow after conversion) */
 	struct v4l2_format dest_fmt;
 	pthread_mutex_t stream_lock;
+	/* libv4lconvert is not thread safe, all use of convert must be done with
+	   convert_lock held. When both are needed stream_lock is taken first */
+	pthread_mutex_t convert_lock;
 	unsigned int no_frames;
 	unsigned int nreadbuffers;
 	int fps;
 	int first_frame;
 	struct v4lconvert_data *convert;
 	unsigned char *convert_mmap_buf;
+	unsigned int convert_frame_size; /* of each frame in convert_mmap_buf */
 	/* Frame bookkeeping is only done when in read or mmap-conversion mode */
 	unsigned char *frame_pointers[V4L2_MAX_NO_FRAMES];
 	int frame_sizes[V4L2_MAX_NO_FRAMES];
 	int frame_queued; /* 1 status bit per frame */
 	/* mapping tracking of our fake (converting mmap) frame buffers */
 	unsigned char frame_map_count[V4L2_MAX_NO_FRAMES];
+	/* The memory type of the app's buffers. When converting to USERPTR /
+	   DMABUF buffers the driver still gets asked for mmap buffers, which
+	   get converted into the app's buffers (mapped by us for DMABUF) */
+	unsigned int app_memory;
+	unsigned char *app_buf_start[V4L2_MAX_NO_FRAMES];
+	unsigned int app_buf_length[V4L2_MAX_NO_FRAMES];
+	int app_buf_fd[V4L2_MAX_NO_FRAMES];
+	ino_t app_buf_ino[V4L2_MAX_NO_FRAMES];
+	/* no buffers queued at the driver in read or mmap-conversion mode */
+	int queued_count;
+	/* async conversion thread (V4L2_ENABLE_ASYNC_CONVERSION) state */
+	pthread_t async_thread;
+	pthread_cond_t async_cond; /* signalled on any async state change */
+	int async_pipe[2]; /* for waking the thread from poll() */
+	int async_running;
+	int async_stop;
+	int async_exited;
+	int async_error;
+	/* converted frames waiting for a DQBUF, oldest first */
+	struct v4l2_buffer async_bufs[V4L2_MAX_NO_FRAMES];
+	int async_first;
+	int async_count;
+	/* read-ahead ring of converted frames for read(), filled by the async
+	   conversion thread, read_ahead is its size in frames (0: disabled) */
+	unsigned int read_ahead;
+	unsigned char *read_ahead_buf;
+	unsigned int read_ahead_frame_size;
+	int read_ahead_sizes[V4L2_MAX_READ_AHEAD];
+	int read_ahead_first;
+	int read_ahead_count;
 	/* buffer when doing conversion and using read() for read() */
 	int readbuf_size;
 	unsigned char *readbuf;
+	struct v4l2_stats stats;
+	__u32 stats_sequence; /* of the last dequeued buffer */
+	int stats_sequence_valid;
+	time_t stats_dump_time;
 	/* plugin info */
 	void *plugin_library;
 	void *dev_ops_priv;
@@ -112,5 +154,6 @@ void v4l2_plugin_cleanup(void *plugin_lib, void *plugin_priv,
 /* From log.c */
 extern const char *v4l2_ioctls[];
 void v4l2_log_ioctl(unsigned long int request, void *arg, int result);
+void v4l2_log_stats(int fd, const struct v4l2_stats *stats);
 
 #endif
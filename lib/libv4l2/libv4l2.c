@@ -62,10 +62,15 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#ifdef HAVE_LINUX_DMA_BUF_H
+#include <linux/dma-buf.h>
+#endif
 #include "libv4l2.h"
 #include "libv4l2-priv.h"
 #include "libv4l-plugin.h"
@@ -84,15 +89,27 @@
 #define V4L2_MMAP_OFFSET_MAGIC      0xABCDEF00u
 
 static void v4l2_adjust_src_fmt_to_fps(int index, int fps);
+static void v4l2_async_start(int index);
+static void v4l2_async_stop(int index);
 
-static pthread_mutex_t v4l2_open_mutex = PTHREAD_MUTEX_INITIALIZER;
-static struct v4l2_dev_info devices[V4L2_MAX_DEVICES] = {
-	{ .fd = -1 },
-	{ .fd = -1 }, { .fd = -1 }, { .fd = -1 }, { .fd = -1 }, { .fd = -1 },
-	{ .fd = -1 }, { .fd = -1 }, { .fd = -1 }, { .fd = -1 }, { .fd = -1 },
-	{ .fd = -1 }, { .fd = -1 }, { .fd = -1 }, { .fd = -1 }, { .fd = -1 }
+/* fd -> devices[] index lookup table, fds we don't handle map to -1 */
+struct v4l2_fd_map {
+	int size;
+	int index[];
 };
+
+/* The fd map grows as needed (under v4l2_open_mutex), a grown map gets
+   published after it has been filled and the old one is never freed. The
+   v4l2_dev_info structs are allocated on first use and never freed either (a
+   slot gets reused for the next device instead), so that v4l2_get_index() and
+   the devices[index] lookups can be done without taking any lock. An fd only
+   gets added to the fd map once its slot is fully initialized, the release
+   store publishing it pairs with the acquire load in v4l2_get_index(). */
+static pthread_mutex_t v4l2_open_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct v4l2_dev_info *devices[V4L2_MAX_DEVICES];
 static int devices_used;
+static struct v4l2_fd_map *fd_map;
+static int v4l2_stats_interval = V4L2_DEFAULT_STATS_INTERVAL;
 
 
 static int v4l2_request_read_buffers(int index)
@@ -102,12 +119,12 @@ static int v4l2_request_read_buffers(int index)
 
 	/* Note we re-request the buffers if they are already requested as the format
 	   and thus the needed buffer size may have changed. */
-	req.count = (devices[index].no_frames) ? devices[index].no_frames :
-		devices[index].nreadbuffers;
+	req.count = (devices[index]->no_frames) ? devices[index]->no_frames :
+		devices[index]->nreadbuffers;
 	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	req.memory = V4L2_MEMORY_MMAP;
-	result = devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-			devices[index].fd, VIDIOC_REQBUFS, &req);
+	result = devices[index]->dev_ops->ioctl(devices[index]->dev_ops_priv,
+			devices[index]->fd, VIDIOC_REQBUFS, &req);
 	if (result < 0) {
 		int saved_err = errno;
 
@@ -116,10 +133,10 @@ static int v4l2_request_read_buffers(int index)
 		return result;
 	}
 
-	if (!devices[index].no_frames && req.count)
-		devices[index].flags |= V4L2_BUFFERS_REQUESTED_BY_READ;
+	if (!devices[index]->no_frames && req.count)
+		devices[index]->flags |= V4L2_BUFFERS_REQUESTED_BY_READ;
 
-	devices[index].no_frames = MIN(req.count, V4L2_MAX_NO_FRAMES);
+	devices[index]->no_frames = MIN(req.count, V4L2_MAX_NO_FRAMES);
 	return 0;
 }
 
@@ -127,8 +144,8 @@ static void v4l2_unrequest_read_buffers(int index)
 {
 	struct v4l2_requestbuffers req;
 
-	if (!(devices[index].flags & V4L2_BUFFERS_REQUESTED_BY_READ) ||
-			devices[index].no_frames == 0)
+	if (!(devices[index]->flags & V4L2_BUFFERS_REQUESTED_BY_READ) ||
+			devices[index]->no_frames == 0)
 		return;
 
 	/* (Un)Request buffers, note not all driver support this, and those
@@ -136,13 +153,13 @@ static void v4l2_unrequest_read_buffers(int index)
 	req.count = 0;
 	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	req.memory = V4L2_MEMORY_MMAP;
-	if (devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-			devices[index].fd, VIDIOC_REQBUFS, &req) < 0)
+	if (devices[index]->dev_ops->ioctl(devices[index]->dev_ops_priv,
+			devices[index]->fd, VIDIOC_REQBUFS, &req) < 0)
 		return;
 
-	devices[index].no_frames = MIN(req.count, V4L2_MAX_NO_FRAMES);
-	if (devices[index].no_frames == 0)
-		devices[index].flags &= ~V4L2_BUFFERS_REQUESTED_BY_READ;
+	devices[index]->no_frames = MIN(req.count, V4L2_MAX_NO_FRAMES);
+	if (devices[index]->no_frames == 0)
+		devices[index]->flags &= ~V4L2_BUFFERS_REQUESTED_BY_READ;
 }
 
 static int v4l2_map_buffers(int index)
@@ -151,16 +168,16 @@ static int v4l2_map_buffers(int index)
 	unsigned int i;
 	struct v4l2_buffer buf;
 
-	for (i = 0; i < devices[index].no_frames; i++) {
-		if (devices[index].frame_pointers[i] != MAP_FAILED)
+	for (i = 0; i < devices[index]->no_frames; i++) {
+		if (devices[index]->frame_pointers[i] != MAP_FAILED)
 			continue;
 
 		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 		buf.memory = V4L2_MEMORY_MMAP;
 		buf.index = i;
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				devices[index].fd, VIDIOC_QUERYBUF, &buf);
+		result = devices[index]->dev_ops->ioctl(
+				devices[index]->dev_ops_priv,
+				devices[index]->fd, VIDIOC_QUERYBUF, &buf);
 		if (result) {
 			int saved_err = errno;
 
@@ -169,10 +186,10 @@ static int v4l2_map_buffers(int index)
 			break;
 		}
 
-		devices[index].frame_pointers[i] = (void *)SYS_MMAP(NULL,
-				(size_t)buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, devices[index].fd,
+		devices[index]->frame_pointers[i] = (void *)SYS_MMAP(NULL,
+				(size_t)buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, devices[index]->fd,
 				buf.m.offset);
-		if (devices[index].frame_pointers[i] == MAP_FAILED) {
+		if (devices[index]->frame_pointers[i] == MAP_FAILED) {
 			int saved_err = errno;
 
 			V4L2_PERROR("mmapping buffer %u", i);
@@ -181,9 +198,9 @@ static int v4l2_map_buffers(int index)
 			break;
 		}
 		V4L2_LOG("mapped buffer %u at %p\n", i,
-				devices[index].frame_pointers[i]);
+				devices[index]->frame_pointers[i]);
 
-		devices[index].frame_sizes[i] = buf.length;
+		devices[index]->frame_sizes[i] = buf.length;
 	}
 
 	return result;
@@ -194,11 +211,11 @@ static void v4l2_unmap_buffers(int index)
 	unsigned int i;
 
 	/* unmap the buffers */
-	for (i = 0; i < devices[index].no_frames; i++) {
-		if (devices[index].frame_pointers[i] != MAP_FAILED) {
-			SYS_MUNMAP(devices[index].frame_pointers[i],
-					devices[index].frame_sizes[i]);
-			devices[index].frame_pointers[i] = MAP_FAILED;
+	for (i = 0; i < devices[index]->no_frames; i++) {
+		if (devices[index]->frame_pointers[i] != MAP_FAILED) {
+			SYS_MUNMAP(devices[index]->frame_pointers[i],
+					devices[index]->frame_sizes[i]);
+			devices[index]->frame_pointers[i] = MAP_FAILED;
 			V4L2_LOG("unmapped buffer %u\n", i);
 		}
 	}
@@ -209,10 +226,10 @@ static int v4l2_streamon(int index)
 	int result;
 	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
-	if (!(devices[index].flags & V4L2_STREAMON)) {
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				devices[index].fd, VIDIOC_STREAMON, &type);
+	if (!(devices[index]->flags & V4L2_STREAMON)) {
+		result = devices[index]->dev_ops->ioctl(
+				devices[index]->dev_ops_priv,
+				devices[index]->fd, VIDIOC_STREAMON, &type);
 		if (result) {
 			int saved_err = errno;
 
@@ -220,8 +237,8 @@ static int v4l2_streamon(int index)
 			errno = saved_err;
 			return result;
 		}
-		devices[index].flags |= V4L2_STREAMON;
-		devices[index].first_frame = V4L2_IGNORE_FIRST_FRAME_ERRORS;
+		devices[index]->flags |= V4L2_STREAMON;
+		devices[index]->first_frame = V4L2_IGNORE_FIRST_FRAME_ERRORS;
 	}
 
 	return 0;
@@ -232,10 +249,12 @@ static int v4l2_streamoff(int index)
 	int result;
 	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
-	if (devices[index].flags & V4L2_STREAMON) {
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				devices[index].fd, VIDIOC_STREAMOFF, &type);
+	if (devices[index]->flags & V4L2_STREAMON) {
+		v4l2_async_stop(index);
+
+		result = devices[index]->dev_ops->ioctl(
+				devices[index]->dev_ops_priv,
+				devices[index]->fd, VIDIOC_STREAMOFF, &type);
 		if (result) {
 			int saved_err = errno;
 
@@ -243,10 +262,11 @@ static int v4l2_streamoff(int index)
 			errno = saved_err;
 			return result;
 		}
-		devices[index].flags &= ~V4L2_STREAMON;
+		devices[index]->flags &= ~V4L2_STREAMON;
 
 		/* Stream off also dequeues all our buffers! */
-		devices[index].frame_queued = 0;
+		devices[index]->frame_queued = 0;
+		devices[index]->queued_count = 0;
 	}
 
 	return 0;
@@ -257,15 +277,15 @@ static int v4l2_queue_read_buffer(int index, int buffer_index)
 	int result;
 	struct v4l2_buffer buf;
 
-	if (devices[index].frame_queued & (1 << buffer_index))
+	if (devices[index]->frame_queued & (1 << buffer_index))
 		return 0;
 
 	memset(&buf, 0, sizeof(buf));
 	buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	buf.memory = V4L2_MEMORY_MMAP;
 	buf.index  = buffer_index;
-	result = devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-			devices[index].fd, VIDIOC_QBUF, &buf);
+	result = devices[index]->dev_ops->ioctl(devices[index]->dev_ops_priv,
+			devices[index]->fd, VIDIOC_QBUF, &buf);
 	if (result) {
 		int saved_err = errno;
 
@@ -274,15 +294,196 @@ static int v4l2_queue_read_buffer(int index, int buffer_index)
 		return result;
 	}
 
-	devices[index].frame_queued |= 1 << buffer_index;
+	devices[index]->frame_queued |= 1 << buffer_index;
+	devices[index]->queued_count++;
 	return 0;
 }
 
+#ifndef HAVE_LINUX_DMA_BUF_H
+#define DMA_BUF_SYNC_START 0
+#define DMA_BUF_SYNC_END 0
+#endif
+
+/* Tell the exporter of a DMABUF app buffer that we are about to write to /
+   are done writing to it through our mapping. Buffers which do not need this
+   (memfd backed ones for example) fail the ioctl, which is fine. */
+static void v4l2_sync_app_buf(int index, unsigned int buffer_index,
+		unsigned long flags)
+{
+#ifdef HAVE_LINUX_DMA_BUF_H
+	struct dma_buf_sync sync = { .flags = flags | DMA_BUF_SYNC_WRITE };
+
+	if (devices[index]->app_memory == V4L2_MEMORY_DMABUF)
+		SYS_IOCTL(devices[index]->app_buf_fd[buffer_index],
+			  DMA_BUF_IOCTL_SYNC, &sync);
+#endif
+}
+
+static void v4l2_release_app_bufs(int index)
+{
+	unsigned int i;
+
+	for (i = 0; i < V4L2_MAX_NO_FRAMES; i++) {
+		if (devices[index]->app_buf_fd[i] != -1)
+			SYS_MUNMAP(devices[index]->app_buf_start[i],
+				   devices[index]->app_buf_length[i]);
+		devices[index]->app_buf_start[i] = NULL;
+		devices[index]->app_buf_length[i] = 0;
+		devices[index]->app_buf_fd[i] = -1;
+	}
+}
+
+/* Remember which app buffer to convert into for a QBUF of a USERPTR / DMABUF
+   buffer, DMABUF buffers stay mapped until a different buffer gets queued
+   with the same index, or the buffers get freed. Like the kernel we map
+   length bytes of a DMABUF buffer, or the whole buffer when length is 0.
+   Note DMABUF support has only been tested with memfd backed buffers, not
+   with buffers exported by a real (gpu / display) driver. */
+static int v4l2_set_app_buf(int index, struct v4l2_buffer *buf)
+{
+	unsigned int i = buf->index;
+	unsigned int length = buf->length;
+	unsigned char *start;
+	struct stat st;
+
+	if (buf->memory != devices[index]->app_memory ||
+			i >= devices[index]->no_frames) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (devices[index]->app_memory == V4L2_MEMORY_DMABUF) {
+		if (fstat(buf->m.fd, &st))
+			return -1;
+		if (length == 0)
+			length = st.st_size;
+	}
+
+	if (length < devices[index]->dest_fmt.fmt.pix.sizeimage) {
+		V4L2_LOG_ERR("buffer %u too small for a converted frame (%u < %u)\n",
+			     i, length, devices[index]->dest_fmt.fmt.pix.sizeimage);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (devices[index]->app_memory == V4L2_MEMORY_USERPTR) {
+		if (!buf->m.userptr) {
+			errno = EINVAL;
+			return -1;
+		}
+		devices[index]->app_buf_start[i] = (void *)buf->m.userptr;
+		devices[index]->app_buf_length[i] = length;
+		return 0;
+	}
+
+	if (devices[index]->app_buf_fd[i] == buf->m.fd &&
+			devices[index]->app_buf_ino[i] == st.st_ino &&
+			devices[index]->app_buf_length[i] == length)
+		return 0;
+
+	start = (void *)SYS_MMAP(NULL, (size_t)length,
+			PROT_READ | PROT_WRITE, MAP_SHARED, buf->m.fd, 0);
+	if (start == MAP_FAILED) {
+		int saved_err = errno;
+
+		V4L2_PERROR("mmapping dmabuf %d", buf->m.fd);
+		errno = saved_err;
+		return -1;
+	}
+
+	if (devices[index]->app_buf_fd[i] != -1)
+		SYS_MUNMAP(devices[index]->app_buf_start[i],
+			   devices[index]->app_buf_length[i]);
+	devices[index]->app_buf_start[i] = start;
+	devices[index]->app_buf_length[i] = length;
+	devices[index]->app_buf_fd[i] = buf->m.fd;
+	devices[index]->app_buf_ino[i] = st.st_ino;
+
+	return 0;
+}
+
+/* Stats bookkeeping for a buffer we've just dequeued */
+static void v4l2_stats_dequeued(int index, const struct v4l2_buffer *buf)
+{
+	struct v4l2_stats *stats = &devices[index]->stats;
+
+	if (devices[index]->stats_sequence_valid &&
+	    buf->sequence > devices[index]->stats_sequence + 1)
+		stats->driver_frames_dropped += buf->sequence -
+						devices[index]->stats_sequence - 1;
+	devices[index]->stats_sequence = buf->sequence;
+	devices[index]->stats_sequence_valid = 1;
+
+	if (devices[index]->queued_count <= 0)
+		stats->queue_underruns++;
+}
+
+/* Stats bookkeeping for a frame we've just converted, this must be called
+   before first_frame gets updated */
+static void v4l2_stats_converted(int index, const struct timespec *start,
+		const struct timespec *end, int result)
+{
+	struct v4l2_stats *stats = &devices[index]->stats;
+	unsigned long long us;
+	int i = 0;
+
+	us = (end->tv_sec - start->tv_sec) * 1000000LL +
+	     (end->tv_nsec - start->tv_nsec) / 1000;
+	while (i < V4L2_STATS_CONVERT_TIME_BUCKETS - 1 && us >= (2ULL << i))
+		i++;
+	stats->convert_time_hist[i]++;
+	stats->convert_time_us += us;
+
+	if (result >= 0) {
+		stats->frames_converted++;
+		stats->bytes_copied += result;
+	} else if (devices[index]->first_frame) {
+		stats->start_frames_dropped++;
+	} else {
+		stats->convert_errors++;
+	}
+
+	if (v4l2_stats_file &&
+	    end->tv_sec - devices[index]->stats_dump_time >=
+	    v4l2_stats_interval) {
+		v4l2_log_stats(devices[index]->fd, stats);
+		devices[index]->stats_dump_time = end->tv_sec;
+	}
+}
+
+/* Convert a frame with convert_lock held. The libv4lconvert error message is
+   only valid while holding convert_lock, so on failure it gets copied to
+   error_msg (V4L2_CONVERT_ERROR_MSG_SIZE bytes) */
+static int v4l2_convert(int index, unsigned char *src, int src_size,
+		unsigned char *dest, int dest_size, char *error_msg)
+{
+	int result, saved_err;
+
+	pthread_mutex_lock(&devices[index]->convert_lock);
+	result = v4lconvert_convert(devices[index]->convert,
+			&devices[index]->src_fmt, &devices[index]->dest_fmt,
+			src, src_size, dest, dest_size);
+	saved_err = errno;
+	if (result < 0)
+		snprintf(error_msg, V4L2_CONVERT_ERROR_MSG_SIZE, "%s",
+			 v4lconvert_get_error_message(devices[index]->convert));
+	pthread_mutex_unlock(&devices[index]->convert_lock);
+	errno = saved_err;
+
+	return result;
+}
+
+/* When called from the async conversion thread (async is set) stream_lock
+   gets dropped while converting, convert_lock still serializes the conversion
+   with the ioctls using convert */
 static int v4l2_dequeue_and_convert(int index, struct v4l2_buffer *buf,
-		unsigned char *dest, int dest_size)
+		unsigned char *dest, int dest_size, int async)
 {
 	const int max_tries = V4L2_IGNORE_FIRST_FRAME_ERRORS + 1;
-	int result, tries = max_tries;
+	int result, saved_err, tries = max_tries, frame_dest_size;
+	unsigned char *frame_dest;
+	struct timespec start, end;
+	char error_msg[V4L2_CONVERT_ERROR_MSG_SIZE];
 
 	/* Make sure we have the real v4l2 buffers mapped */
 	result = v4l2_map_buffers(index);
@@ -290,9 +491,9 @@ static int v4l2_dequeue_and_convert(int index, struct v4l2_buffer *buf,
 		return result;
 
 	do {
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				devices[index].fd, VIDIOC_DQBUF, buf);
+		result = devices[index]->dev_ops->ioctl(
+				devices[index]->dev_ops_priv,
+				devices[index]->fd, VIDIOC_DQBUF, buf);
 		if (result) {
 			if (errno != EAGAIN) {
 				int saved_err = errno;
@@ -303,21 +504,47 @@ static int v4l2_dequeue_and_convert(int index, struct v4l2_buffer *buf,
 			return result;
 		}
 
-		devices[index].frame_queued &= ~(1 << buf->index);
+		devices[index]->frame_queued &= ~(1 << buf->index);
+		devices[index]->queued_count--;
+		v4l2_stats_dequeued(index, buf);
+
+		if (dest) {
+			frame_dest = dest;
+			frame_dest_size = dest_size;
+		} else if (devices[index]->app_memory != V4L2_MEMORY_MMAP) {
+			frame_dest = devices[index]->app_buf_start[buf->index];
+			frame_dest_size = devices[index]->app_buf_length[buf->index];
+		} else {
+			frame_dest = devices[index]->convert_mmap_buf +
+				buf->index * devices[index]->convert_frame_size;
+			frame_dest_size = dest_size;
+		}
 
-		result = v4lconvert_convert(devices[index].convert,
-				&devices[index].src_fmt, &devices[index].dest_fmt,
-				devices[index].frame_pointers[buf->index],
-				buf->bytesused, dest ? dest : (devices[index].convert_mmap_buf +
-					buf->index * V4L2_FRAME_BUF_SIZE), dest_size);
+		if (async)
+			pthread_mutex_unlock(&devices[index]->stream_lock);
+		if (!dest)
+			v4l2_sync_app_buf(index, buf->index, DMA_BUF_SYNC_START);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		result = v4l2_convert(index,
+				devices[index]->frame_pointers[buf->index],
+				buf->bytesused, frame_dest, frame_dest_size,
+				error_msg);
+		saved_err = errno;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if (!dest)
+			v4l2_sync_app_buf(index, buf->index, DMA_BUF_SYNC_END);
+		if (async)
+			pthread_mutex_lock(&devices[index]->stream_lock);
+		v4l2_stats_converted(index, &start, &end, result);
+		errno = saved_err;
 
-		if (devices[index].first_frame) {
+		if (devices[index]->first_frame) {
 			/* Always treat convert errors as EAGAIN during the first few frames, as
 			   some cams produce bad frames at the start of the stream
 			   (hsync and vsync still syncing ??). */
 			if (result < 0)
 				errno = EAGAIN;
-			devices[index].first_frame--;
+			devices[index]->first_frame--;
 		}
 
 		if (result < 0) {
@@ -325,10 +552,10 @@ static int v4l2_dequeue_and_convert(int index, struct v4l2_buffer *buf,
 
 			if (errno == EAGAIN || errno == EPIPE)
 				V4L2_LOG("warning error while converting frame data: %s",
-						v4lconvert_get_error_message(devices[index].convert));
+						error_msg);
 			else
 				V4L2_LOG_ERR("converting / decoding frame data: %s",
-						v4lconvert_get_error_message(devices[index].convert));
+						error_msg);
 
 			/*
 			 * If this is the last try, and the frame is short
@@ -344,14 +571,14 @@ static int v4l2_dequeue_and_convert(int index, struct v4l2_buffer *buf,
 
 	if (result < 0 && errno == EAGAIN) {
 		V4L2_LOG_ERR("got %d consecutive frame decode errors, last error: %s",
-				max_tries, v4lconvert_get_error_message(devices[index].convert));
+				max_tries, error_msg);
 		errno = EIO;
 	}
 
 	if (result < 0 && errno == EPIPE) {
 		V4L2_LOG("got %d consecutive short frame errors, "
 			 "returning short frame", max_tries);
-		result = devices[index].dest_fmt.fmt.pix.sizeimage;
+		result = devices[index]->dest_fmt.fmt.pix.sizeimage;
 		errno = 0;
 	}
 
@@ -361,25 +588,27 @@ static int v4l2_dequeue_and_convert(int index, struct v4l2_buffer *buf,
 static int v4l2_read_and_convert(int index, unsigned char *dest, int dest_size)
 {
 	const int max_tries = V4L2_IGNORE_FIRST_FRAME_ERRORS + 1;
-	int result, buf_size, tries = max_tries;
+	int result, saved_err, buf_size, tries = max_tries;
+	struct timespec start, end;
+	char error_msg[V4L2_CONVERT_ERROR_MSG_SIZE];
 
-	buf_size = devices[index].dest_fmt.fmt.pix.sizeimage;
+	buf_size = devices[index]->dest_fmt.fmt.pix.sizeimage;
 
-	if (devices[index].readbuf_size < buf_size) {
+	if (devices[index]->readbuf_size < buf_size) {
 		unsigned char *new_buf;
 
-		new_buf = realloc(devices[index].readbuf, buf_size);
+		new_buf = realloc(devices[index]->readbuf, buf_size);
 		if (!new_buf)
 			return -1;
 
-		devices[index].readbuf = new_buf;
-		devices[index].readbuf_size = buf_size;
+		devices[index]->readbuf = new_buf;
+		devices[index]->readbuf_size = buf_size;
 	}
 
 	do {
-		result = devices[index].dev_ops->read(
-				devices[index].dev_ops_priv,
-				devices[index].fd, devices[index].readbuf,
+		result = devices[index]->dev_ops->read(
+				devices[index]->dev_ops_priv,
+				devices[index]->fd, devices[index]->readbuf,
 				buf_size);
 		if (result <= 0) {
 			if (result && errno != EAGAIN) {
@@ -391,17 +620,21 @@ static int v4l2_read_and_convert(int index, unsigned char *dest, int dest_size)
 			return result;
 		}
 
-		result = v4lconvert_convert(devices[index].convert,
-				&devices[index].src_fmt, &devices[index].dest_fmt,
-				devices[index].readbuf, result, dest, dest_size);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		result = v4l2_convert(index, devices[index]->readbuf, result,
+				dest, dest_size, error_msg);
+		saved_err = errno;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		v4l2_stats_converted(index, &start, &end, result);
+		errno = saved_err;
 
-		if (devices[index].first_frame) {
+		if (devices[index]->first_frame) {
 			/* Always treat convert errors as EAGAIN during the first few frames, as
 			   some cams produce bad frames at the start of the stream
 			   (hsync and vsync still syncing ??). */
 			if (result < 0)
 				errno = EAGAIN;
-			devices[index].first_frame--;
+			devices[index]->first_frame--;
 		}
 
 		if (result < 0) {
@@ -409,10 +642,10 @@ static int v4l2_read_and_convert(int index, unsigned char *dest, int dest_size)
 
 			if (errno == EAGAIN || errno == EPIPE)
 				V4L2_LOG("warning error while converting frame data: %s",
-						v4lconvert_get_error_message(devices[index].convert));
+						error_msg);
 			else
 				V4L2_LOG_ERR("converting / decoding frame data: %s",
-						v4lconvert_get_error_message(devices[index].convert));
+						error_msg);
 
 			errno = saved_err;
 		}
@@ -421,14 +654,14 @@ static int v4l2_read_and_convert(int index, unsigned char *dest, int dest_size)
 
 	if (result < 0 && errno == EAGAIN) {
 		V4L2_LOG_ERR("got %d consecutive frame decode errors, last error: %s",
-				max_tries, v4lconvert_get_error_message(devices[index].convert));
+				max_tries, error_msg);
 		errno = EIO;
 	}
 
 	if (result < 0 && errno == EPIPE) {
 		V4L2_LOG("got %d consecutive short frame errors, "
 			 "returning short frame", max_tries);
-		result = devices[index].dest_fmt.fmt.pix.sizeimage;
+		result = devices[index]->dest_fmt.fmt.pix.sizeimage;
 		errno = 0;
 	}
 
@@ -440,9 +673,9 @@ static int v4l2_queue_read_buffers(int index)
 	unsigned int i;
 	int last_error = EIO, queued = 0;
 
-	for (i = 0; i < devices[index].no_frames; i++) {
+	for (i = 0; i < devices[index]->no_frames; i++) {
 		/* Don't queue unmapped buffers (should never happen) */
-		if (devices[index].frame_pointers[i] != MAP_FAILED) {
+		if (devices[index]->frame_pointers[i] != MAP_FAILED) {
 			if (v4l2_queue_read_buffer(index, i)) {
 				last_error = errno;
 				continue;
@@ -462,7 +695,7 @@ static int v4l2_activate_read_stream(int index)
 {
 	int result;
 
-	if ((devices[index].flags & V4L2_STREAMON) || devices[index].frame_queued) {
+	if ((devices[index]->flags & V4L2_STREAMON) || devices[index]->frame_queued) {
 		errno = EBUSY;
 		return -1;
 	}
@@ -475,9 +708,13 @@ static int v4l2_activate_read_stream(int index)
 	if (result)
 		return result;
 
-	devices[index].flags |= V4L2_STREAM_CONTROLLED_BY_READ;
+	devices[index]->flags |= V4L2_STREAM_CONTROLLED_BY_READ;
+
+	result = v4l2_streamon(index);
+	if (!result)
+		v4l2_async_start(index);
 
-	return v4l2_streamon(index);
+	return result;
 }
 
 static int v4l2_deactivate_read_stream(int index)
@@ -494,18 +731,72 @@ static int v4l2_deactivate_read_stream(int index)
 
 	v4l2_unrequest_read_buffers(index);
 
-	devices[index].flags &= ~V4L2_STREAM_CONTROLLED_BY_READ;
+	devices[index]->flags &= ~V4L2_STREAM_CONTROLLED_BY_READ;
 
 	return 0;
 }
 
 static int v4l2_needs_conversion(int index)
 {
-	if (devices[index].convert == NULL)
+	if (devices[index]->convert == NULL)
+		return 0;
+
+	return v4lconvert_needs_conversion(devices[index]->convert,
+			&devices[index]->src_fmt, &devices[index]->dest_fmt);
+}
+
+/* The size of each of our fake (conversion) mmap buffers. While they are
+   allocated this is the size they were allocated with, otherwise it is the
+   size needed for the current dest_fmt, rounded up to whole pages. */
+static unsigned int v4l2_convert_frame_size(int index)
+{
+	unsigned int size, page_size = sysconf(_SC_PAGESIZE);
+
+	if (devices[index]->convert_mmap_buf != MAP_FAILED)
+		return devices[index]->convert_frame_size;
+
+	size = devices[index]->dest_fmt.fmt.pix.sizeimage;
+	if (size == 0)
+		size = devices[index]->dest_fmt.fmt.pix.width *
+		       devices[index]->dest_fmt.fmt.pix.height * 3;
+
+	return (size + page_size - 1) & ~(page_size - 1);
+}
+
+static int v4l2_alloc_convert_mmap_buf(int index)
+{
+	unsigned int frame_size;
+
+	if (devices[index]->convert_mmap_buf != MAP_FAILED)
 		return 0;
 
-	return v4lconvert_needs_conversion(devices[index].convert,
-			&devices[index].src_fmt, &devices[index].dest_fmt);
+	frame_size = v4l2_convert_frame_size(index);
+	devices[index]->convert_mmap_buf = (void *)SYS_MMAP(NULL,
+		(size_t)devices[index]->no_frames * frame_size,
+		PROT_READ | PROT_WRITE,
+		MAP_ANONYMOUS | MAP_PRIVATE,
+		-1, 0);
+	if (devices[index]->convert_mmap_buf == MAP_FAILED) {
+		int saved_err = errno;
+
+		V4L2_LOG_ERR("allocating conversion buffer\n");
+		errno = saved_err;
+		return -1;
+	}
+	devices[index]->convert_frame_size = frame_size;
+
+	return 0;
+}
+
+static void v4l2_free_convert_mmap_buf(int index)
+{
+	if (devices[index]->convert_mmap_buf == MAP_FAILED)
+		return;
+
+	SYS_MUNMAP(devices[index]->convert_mmap_buf,
+		   (size_t)devices[index]->no_frames *
+		   devices[index]->convert_frame_size);
+	devices[index]->convert_mmap_buf = MAP_FAILED;
 }
 
 static void v4l2_set_conversion_buf_params(int index, struct v4l2_buffer *buf)
@@ -514,12 +805,24 @@ static void v4l2_set_conversion_buf_params(int index, struct v4l2_buffer *buf)
 		return;
 
 	/* This may happen if the ioctl failed */
-	if (buf->index >= devices[index].no_frames)
+	if (buf->index >= devices[index]->no_frames)
 		buf->index = 0;
 
+	if (devices[index]->app_memory != V4L2_MEMORY_MMAP) {
+		buf->memory = devices[index]->app_memory;
+		if (buf->memory == V4L2_MEMORY_USERPTR)
+			buf->m.userptr = (unsigned long)
+				devices[index]->app_buf_start[buf->index];
+		else
+			buf->m.fd = devices[index]->app_buf_fd[buf->index];
+		buf->length = devices[index]->app_buf_length[buf->index];
+		buf->flags &= ~V4L2_BUF_FLAG_MAPPED;
+		return;
+	}
+
 	buf->m.offset = V4L2_MMAP_OFFSET_MAGIC | buf->index;
-	buf->length = V4L2_FRAME_BUF_SIZE;
-	if (devices[index].frame_map_count[buf->index])
+	buf->length = v4l2_convert_frame_size(index);
+	if (devices[index]->frame_map_count[buf->index])
 		buf->flags |= V4L2_BUF_FLAG_MAPPED;
 	else
 		buf->flags &= ~V4L2_BUF_FLAG_MAPPED;
@@ -533,13 +836,13 @@ static int v4l2_buffers_mapped(int index)
 		/* Normal (no conversion) mode */
 		struct v4l2_buffer buf;
 
-		for (i = 0; i < devices[index].no_frames; i++) {
+		for (i = 0; i < devices[index]->no_frames; i++) {
 			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 			buf.memory = V4L2_MEMORY_MMAP;
 			buf.index = i;
-			if (devices[index].dev_ops->ioctl(
-					devices[index].dev_ops_priv,
-					devices[index].fd, VIDIOC_QUERYBUF,
+			if (devices[index]->dev_ops->ioctl(
+					devices[index]->dev_ops_priv,
+					devices[index]->fd, VIDIOC_QUERYBUF,
 					&buf)) {
 				int saved_err = errno;
 
@@ -552,27 +855,415 @@ static int v4l2_buffers_mapped(int index)
 		}
 	} else {
 		/* Conversion mode */
-		for (i = 0; i < devices[index].no_frames; i++)
-			if (devices[index].frame_map_count[i])
+		for (i = 0; i < devices[index]->no_frames; i++)
+			if (devices[index]->frame_map_count[i])
 				break;
 	}
 
-	if (i != devices[index].no_frames)
+	if (i != devices[index]->no_frames)
 		V4L2_LOG("v4l2_buffers_mapped(): buffers still mapped\n");
 
-	return i != devices[index].no_frames;
+	return i != devices[index]->no_frames;
+}
+
+static int v4l2_alloc_read_ahead_buf(int index)
+{
+	unsigned int frame_size = v4l2_convert_frame_size(index);
+
+	devices[index]->read_ahead_buf = (void *)SYS_MMAP(NULL,
+		(size_t)devices[index]->read_ahead * frame_size,
+		PROT_READ | PROT_WRITE,
+		MAP_ANONYMOUS | MAP_PRIVATE,
+		-1, 0);
+	if (devices[index]->read_ahead_buf == MAP_FAILED) {
+		int saved_err = errno;
+
+		V4L2_LOG_ERR("allocating read-ahead buffer\n");
+		errno = saved_err;
+		return -1;
+	}
+	devices[index]->read_ahead_frame_size = frame_size;
+	devices[index]->read_ahead_first = 0;
+	devices[index]->read_ahead_count = 0;
+
+	return 0;
+}
+
+static void v4l2_free_read_ahead_buf(int index)
+{
+	if (devices[index]->read_ahead_buf == MAP_FAILED)
+		return;
+
+	SYS_MUNMAP(devices[index]->read_ahead_buf,
+		   (size_t)devices[index]->read_ahead *
+		   devices[index]->read_ahead_frame_size);
+	devices[index]->read_ahead_buf = MAP_FAILED;
+	devices[index]->read_ahead_count = 0;
+}
+
+/* Called from the async conversion thread when it is reading ahead for
+   read(): convert the next frame into the read-ahead ring and give the
+   buffer straight back to the driver. When the ring is full the frame gets
+   dropped instead, so that the driver keeps on capturing. */
+static int v4l2_read_ahead_frame(int index)
+{
+	struct v4l2_buffer buf;
+	unsigned int frame_size = devices[index]->read_ahead_frame_size;
+	int i, result;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+
+	if (devices[index]->read_ahead_count == devices[index]->read_ahead) {
+		result = devices[index]->dev_ops->ioctl(
+				devices[index]->dev_ops_priv,
+				devices[index]->fd, VIDIOC_DQBUF, &buf);
+		if (result)
+			return result;
+
+		devices[index]->frame_queued &= ~(1 << buf.index);
+		devices[index]->queued_count--;
+		v4l2_stats_dequeued(index, &buf);
+		devices[index]->stats.read_ahead_frames_dropped++;
+		V4L2_LOG("read-ahead ring full, dropping frame\n");
+		return v4l2_queue_read_buffer(index, buf.index);
+	}
+
+	i = (devices[index]->read_ahead_first +
+	     devices[index]->read_ahead_count) % devices[index]->read_ahead;
+	result = v4l2_dequeue_and_convert(index, &buf,
+			devices[index]->read_ahead_buf + i * frame_size,
+			frame_size, 1);
+	if (result < 0)
+		return result;
+
+	v4l2_queue_read_buffer(index, buf.index);
+	devices[index]->read_ahead_sizes[i] = result;
+	devices[index]->read_ahead_count++;
+	pthread_cond_broadcast(&devices[index]->async_cond);
+
+	return 0;
+}
+
+/* The async conversion thread (V4L2_ENABLE_ASYNC_CONVERSION) dequeues frames
+   from the driver as soon as they are ready and converts them into our fake
+   mmap buffers, so that a DQBUF can return an already converted frame, or
+   when reading ahead (V4L2_ENABLE_READ_AHEAD) into the read-ahead ring. It
+   does not hold stream_lock while waiting for the driver nor while converting:
+   the buffer being converted is not owned by the app, and the format and
+   buffers can not change while streaming. The conversion does take
+   convert_lock, as ioctls like S_CTRL and TRY_FMT use convert too. */
+static void *v4l2_async_convert_thread(void *arg)
+{
+	int index = (long)arg;
+	struct pollfd fds[2];
+	struct v4l2_buffer buf;
+	int i, result;
+
+	pthread_mutex_lock(&devices[index]->stream_lock);
+	while (!devices[index]->async_stop) {
+		/* Polling a device without queued buffers returns POLLERR */
+		if (devices[index]->queued_count <= 0) {
+			pthread_cond_wait(&devices[index]->async_cond,
+					  &devices[index]->stream_lock);
+			continue;
+		}
+		pthread_mutex_unlock(&devices[index]->stream_lock);
+
+		fds[0].fd = devices[index]->fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = devices[index]->async_pipe[0];
+		fds[1].events = POLLIN;
+		result = poll(fds, 2, -1);
+
+		pthread_mutex_lock(&devices[index]->stream_lock);
+		if (result <= 0 || !fds[0].revents || devices[index]->async_stop)
+			continue;
+
+		if (devices[index]->flags & V4L2_STREAM_CONTROLLED_BY_READ) {
+			result = v4l2_read_ahead_frame(index);
+		} else {
+			memset(&buf, 0, sizeof(buf));
+			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			buf.memory = V4L2_MEMORY_MMAP;
+			result = v4l2_dequeue_and_convert(index, &buf, NULL,
+					devices[index]->convert_frame_size, 1);
+		}
+		if (result < 0) {
+			if (errno == EAGAIN)
+				continue;
+			/* Let the next DQBUF / read() report the error, after
+			   that we fall back to converting synchronously */
+			devices[index]->async_error = errno;
+			break;
+		}
+		if (devices[index]->flags & V4L2_STREAM_CONTROLLED_BY_READ)
+			continue;
+
+		buf.bytesused = result;
+		i = (devices[index]->async_first + devices[index]->async_count) %
+		    V4L2_MAX_NO_FRAMES;
+		devices[index]->async_bufs[i] = buf;
+		devices[index]->async_count++;
+		pthread_cond_broadcast(&devices[index]->async_cond);
+	}
+	devices[index]->async_exited = 1;
+	pthread_cond_broadcast(&devices[index]->async_cond);
+	pthread_mutex_unlock(&devices[index]->stream_lock);
+
+	return NULL;
+}
+
+/* Must be called with stream_lock held, on failure we simply keep on
+   converting synchronously */
+static void v4l2_async_start(int index)
+{
+	if (devices[index]->async_running || v4l2_map_buffers(index))
+		return;
+
+	if (devices[index]->flags & V4L2_STREAM_CONTROLLED_BY_READ) {
+		if (!devices[index]->read_ahead ||
+		    v4l2_alloc_read_ahead_buf(index))
+			return;
+	} else {
+		if (!(devices[index]->flags & V4L2_ENABLE_ASYNC_CONVERSION) ||
+		    !v4l2_needs_conversion(index))
+			return;
+
+		if (devices[index]->app_memory == V4L2_MEMORY_MMAP &&
+		    v4l2_alloc_convert_mmap_buf(index))
+			return;
+	}
+
+	if (pipe(devices[index]->async_pipe)) {
+		V4L2_LOG_ERR("creating async conversion pipe: %s\n",
+			     strerror(errno));
+		v4l2_free_read_ahead_buf(index);
+		return;
+	}
+
+	devices[index]->async_stop = 0;
+	devices[index]->async_exited = 0;
+	devices[index]->async_error = 0;
+	devices[index]->async_first = 0;
+	devices[index]->async_count = 0;
+	if (pthread_create(&devices[index]->async_thread, NULL,
+			   v4l2_async_convert_thread, (void *)(long)index)) {
+		V4L2_LOG_ERR("creating async conversion thread\n");
+		SYS_CLOSE(devices[index]->async_pipe[0]);
+		SYS_CLOSE(devices[index]->async_pipe[1]);
+		v4l2_free_read_ahead_buf(index);
+		return;
+	}
+	devices[index]->async_running = 1;
+	V4L2_LOG("started async conversion thread\n");
+}
+
+/* Must be called with stream_lock held, drops it while waiting for the
+   thread to exit. Converted frames not yet dequeued / read by the app are lost,
+   which is fine as this gets called on stream off and close. */
+static void v4l2_async_stop(int index)
+{
+	char c = 0;
+	int result;
+
+	if (!devices[index]->async_running)
+		return;
+
+	devices[index]->async_stop = 1;
+	pthread_cond_broadcast(&devices[index]->async_cond);
+	result = SYS_WRITE(devices[index]->async_pipe[1], &c, 1);
+	if (result != 1)
+		V4L2_LOG_ERR("waking async conversion thread: %s\n",
+			     strerror(errno));
+	pthread_mutex_unlock(&devices[index]->stream_lock);
+	pthread_join(devices[index]->async_thread, NULL);
+	pthread_mutex_lock(&devices[index]->stream_lock);
+
+	SYS_CLOSE(devices[index]->async_pipe[0]);
+	SYS_CLOSE(devices[index]->async_pipe[1]);
+	devices[index]->async_running = 0;
+	devices[index]->async_count = 0;
+	v4l2_free_read_ahead_buf(index);
+	V4L2_LOG("stopped async conversion thread\n");
+}
+
+/* DQBUF when the async conversion thread is running */
+static int v4l2_async_dequeue(int index, struct v4l2_buffer *buf)
+{
+	while (!devices[index]->async_count && !devices[index]->async_exited) {
+		if (fcntl(devices[index]->fd, F_GETFL) & O_NONBLOCK) {
+			errno = EAGAIN;
+			return -1;
+		}
+		pthread_cond_wait(&devices[index]->async_cond,
+				  &devices[index]->stream_lock);
+	}
+
+	if (devices[index]->async_count) {
+		*buf = devices[index]->async_bufs[devices[index]->async_first];
+		devices[index]->async_first = (devices[index]->async_first + 1) %
+					      V4L2_MAX_NO_FRAMES;
+		devices[index]->async_count--;
+		return buf->bytesused;
+	}
+
+	if (devices[index]->async_error) {
+		errno = devices[index]->async_error;
+		devices[index]->async_error = 0;
+		return -1;
+	}
+
+	return v4l2_dequeue_and_convert(index, buf, NULL,
+					devices[index]->convert_frame_size, 0);
+}
+
+/* read() when streaming under the hood without reading ahead */
+static int v4l2_read_stream_frame(int index, unsigned char *dest, int dest_size)
+{
+	struct v4l2_buffer buf;
+	int result;
+
+	buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+	result = v4l2_dequeue_and_convert(index, &buf, dest, dest_size, 0);
+
+	if (result >= 0)
+		v4l2_queue_read_buffer(index, buf.index);
+
+	return result;
+}
+
+/* read() when the async conversion thread is reading ahead */
+static int v4l2_read_ahead_read(int index, unsigned char *dest, int dest_size)
+{
+	int i, size;
+
+	while (!devices[index]->read_ahead_count &&
+	       !devices[index]->async_exited) {
+		if (fcntl(devices[index]->fd, F_GETFL) & O_NONBLOCK) {
+			errno = EAGAIN;
+			return -1;
+		}
+		pthread_cond_wait(&devices[index]->async_cond,
+				  &devices[index]->stream_lock);
+	}
+
+	if (devices[index]->read_ahead_count) {
+		i = devices[index]->read_ahead_first;
+		size = devices[index]->read_ahead_sizes[i];
+		/* Like v4lconvert_convert() would when converting directly */
+		if (dest_size < size) {
+			V4L2_LOG_ERR("read buffer too small (%d < %d)\n",
+				     dest_size, size);
+			errno = EFAULT;
+			return -1;
+		}
+		memcpy(dest, devices[index]->read_ahead_buf +
+		       i * devices[index]->read_ahead_frame_size, size);
+		devices[index]->read_ahead_first = (i + 1) %
+						   devices[index]->read_ahead;
+		devices[index]->read_ahead_count--;
+		devices[index]->stats.bytes_copied += size;
+		return size;
+	}
+
+	if (devices[index]->async_error) {
+		errno = devices[index]->async_error;
+		devices[index]->async_error = 0;
+		return -1;
+	}
+
+	return v4l2_read_stream_frame(index, dest, dest_size);
 }
 
 static void v4l2_update_fps(int index, struct v4l2_streamparm *parm)
 {
-	if ((devices[index].flags & V4L2_SUPPORTS_TIMEPERFRAME) &&
+	if ((devices[index]->flags & V4L2_SUPPORTS_TIMEPERFRAME) &&
 	    parm->parm.capture.timeperframe.numerator != 0) {
 		int fps = parm->parm.capture.timeperframe.denominator;
 		fps += parm->parm.capture.timeperframe.numerator - 1;
 		fps /= parm->parm.capture.timeperframe.numerator;
-		devices[index].fps = fps;
+		devices[index]->fps = fps;
 	} else
-		devices[index].fps = 0;
+		devices[index]->fps = 0;
+}
+
+/* Claim a devices[] slot for fd and make sure the fd map is big enough for
+   fd, returns the index of the slot, or -1 with errno set on error. The fd
+   does not get added to the fd map until v4l2_publish_device() is called */
+static int v4l2_register_device(int fd, void *plugin_library,
+		void *dev_ops_priv, const struct libv4l_dev_ops *dev_ops)
+{
+	int i, index, size;
+
+	pthread_mutex_lock(&v4l2_open_mutex);
+
+	for (index = 0; index < devices_used; index++)
+		if (devices[index]->fd == -1)
+			break;
+
+	if (index == devices_used) {
+		if (devices_used == V4L2_MAX_DEVICES) {
+			V4L2_LOG_ERR("attempting to open more then %d video devices\n",
+					V4L2_MAX_DEVICES);
+			errno = EBUSY;
+			goto error;
+		}
+		devices[index] = calloc(1, sizeof(struct v4l2_dev_info));
+		if (!devices[index]) {
+			V4L2_LOG_ERR("registering video device: out of memory\n");
+			errno = ENOMEM;
+			goto error;
+		}
+		devices[index]->fd = -1;
+		devices[index]->convert_mmap_buf = MAP_FAILED;
+	}
+
+	if (fd_map == NULL || fd >= fd_map->size) {
+		struct v4l2_fd_map *new_map;
+
+		size = fd_map ? 2 * fd_map->size : 64;
+		if (size <= fd)
+			size = fd + 1;
+		new_map = malloc(sizeof(*new_map) + size * sizeof(int));
+		if (!new_map) {
+			V4L2_LOG_ERR("registering video device: out of memory\n");
+			errno = ENOMEM;
+			goto error;
+		}
+		new_map->size = size;
+		for (i = 0; i < size; i++)
+			new_map->index[i] = (fd_map && i < fd_map->size) ?
+					    fd_map->index[i] : -1;
+		__atomic_store_n(&fd_map, new_map, __ATOMIC_RELEASE);
+	}
+
+	devices[index]->fd = fd;
+	devices[index]->plugin_library = plugin_library;
+	devices[index]->dev_ops_priv = dev_ops_priv;
+	devices[index]->dev_ops = dev_ops;
+	if (index >= devices_used)
+		__atomic_store_n(&devices_used, index + 1, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&v4l2_open_mutex);
+
+	return index;
+
+error:
+	pthread_mutex_unlock(&v4l2_open_mutex);
+	return -1;
+}
+
+/* Add fd to the fd map, making the devices[] slot claimed for it by
+   v4l2_register_device() visible to the other libv4l2 functions. Must only
+   be called once the slot has been fully initialized */
+static void v4l2_publish_device(int fd, int index)
+{
+	pthread_mutex_lock(&v4l2_open_mutex);
+	__atomic_store_n(&fd_map->index[fd], index, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&v4l2_open_mutex);
 }
 
 int v4l2_open(const char *file, int oflag, ...)
@@ -612,7 +1303,8 @@ int v4l2_open(const char *file, int oflag, ...)
 int v4l2_fd_open(int fd, int v4l2_flags)
 {
 	int i, index;
-	char *lfname;
+	char *lfname, *read_ahead;
+	struct timespec ts;
 	struct v4l2_capability cap;
 	struct v4l2_format fmt = { 0, };
 	struct v4l2_streamparm parm = { 0, };
@@ -631,6 +1323,16 @@ int v4l2_fd_open(int fd, int v4l2_flags)
 			v4l2_log_file = fopen(lfname, "w");
 	}
 
+	/* Likewise for the stats file */
+	if (!v4l2_stats_file) {
+		lfname = getenv("LIBV4L2_STATS_FILENAME");
+		if (lfname)
+			v4l2_stats_file = fopen(lfname, "w");
+		lfname = getenv("LIBV4L2_STATS_INTERVAL");
+		if (lfname)
+			v4l2_stats_interval = atoi(lfname);
+	}
+
 	/* check that this is a v4l2 device */
 	if (dev_ops->ioctl(dev_ops_priv, fd, VIDIOC_QUERYCAP, &cap)) {
 		int saved_err = errno;
@@ -675,76 +1377,88 @@ int v4l2_fd_open(int fd, int v4l2_flags)
 
 no_capture:
 	/* So we have a v4l2 capture device, register it in our devices array */
-	pthread_mutex_lock(&v4l2_open_mutex);
-	for (index = 0; index < V4L2_MAX_DEVICES; index++) {
-		if (devices[index].fd == -1) {
-			devices[index].fd = fd;
-			devices[index].plugin_library = plugin_library;
-			devices[index].dev_ops_priv = dev_ops_priv;
-			devices[index].dev_ops = dev_ops;
-			break;
-		}
-	}
-	pthread_mutex_unlock(&v4l2_open_mutex);
-
-	if (index == V4L2_MAX_DEVICES) {
-		V4L2_LOG_ERR("attempting to open more then %d video devices\n",
-				V4L2_MAX_DEVICES);
+	index = v4l2_register_device(fd, plugin_library, dev_ops_priv, dev_ops);
+	if (index == -1) {
+		int saved_err = errno;
 		v4l2_plugin_cleanup(plugin_library, dev_ops_priv, dev_ops);
-		errno = EBUSY;
+		v4lconvert_destroy(convert);
+		errno = saved_err;
 		return -1;
 	}
 
-	devices[index].flags = v4l2_flags;
+	devices[index]->flags = v4l2_flags;
 	if (cap.capabilities & V4L2_CAP_READWRITE)
-		devices[index].flags |= V4L2_SUPPORTS_READ;
+		devices[index]->flags |= V4L2_SUPPORTS_READ;
 	if (!(cap.capabilities & V4L2_CAP_STREAMING)) {
-		devices[index].flags |= V4L2_USE_READ_FOR_READ;
+		devices[index]->flags |= V4L2_USE_READ_FOR_READ;
 		/* This device only supports read so the stream gets started by the
 		   driver on the first read */
-		devices[index].first_frame = V4L2_IGNORE_FIRST_FRAME_ERRORS;
+		devices[index]->first_frame = V4L2_IGNORE_FIRST_FRAME_ERRORS;
 	}
 	if ((parm.type == V4L2_BUF_TYPE_VIDEO_CAPTURE) &&
 	    (parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME))
-		devices[index].flags |= V4L2_SUPPORTS_TIMEPERFRAME;
-	devices[index].open_count = 1;
-	devices[index].src_fmt = fmt;
-	devices[index].dest_fmt = fmt;
+		devices[index]->flags |= V4L2_SUPPORTS_TIMEPERFRAME;
+	devices[index]->open_count = 1;
+	devices[index]->src_fmt = fmt;
+	devices[index]->dest_fmt = fmt;
 
 	/* When a user does a try_fmt with the current dest_fmt and the dest_fmt
 	   is a supported one we will align the resolution (see try_fmt for why).
 	   Do the same here now, so that a try_fmt on the result of a get_fmt done
 	   immediately after open leaves the fmt unchanged. */
 	if (v4lconvert_supported_dst_format(
-				devices[index].dest_fmt.fmt.pix.pixelformat)) {
-		devices[index].dest_fmt.fmt.pix.width &= ~7;
-		devices[index].dest_fmt.fmt.pix.height &= ~1;
+				devices[index]->dest_fmt.fmt.pix.pixelformat)) {
+		devices[index]->dest_fmt.fmt.pix.width &= ~7;
+		devices[index]->dest_fmt.fmt.pix.height &= ~1;
 	}
 
-	pthread_mutex_init(&devices[index].stream_lock, NULL);
+	pthread_mutex_init(&devices[index]->stream_lock, NULL);
+	pthread_mutex_init(&devices[index]->convert_lock, NULL);
+	pthread_cond_init(&devices[index]->async_cond, NULL);
 
-	devices[index].no_frames = 0;
-	devices[index].nreadbuffers = V4L2_DEFAULT_NREADBUFFERS;
-	devices[index].convert = convert;
-	devices[index].convert_mmap_buf = MAP_FAILED;
+	devices[index]->no_frames = 0;
+	devices[index]->nreadbuffers = V4L2_DEFAULT_NREADBUFFERS;
+	devices[index]->convert = convert;
+	devices[index]->convert_mmap_buf = MAP_FAILED;
 	for (i = 0; i < V4L2_MAX_NO_FRAMES; i++) {
-		devices[index].frame_pointers[i] = MAP_FAILED;
-		devices[index].frame_map_count[i] = 0;
+		devices[index]->frame_pointers[i] = MAP_FAILED;
+		devices[index]->frame_map_count[i] = 0;
 	}
-	devices[index].frame_queued = 0;
-	devices[index].readbuf = NULL;
-	devices[index].readbuf_size = 0;
-
-	if (index >= devices_used)
-		devices_used = index + 1;
+	devices[index]->frame_queued = 0;
+	devices[index]->app_memory = V4L2_MEMORY_MMAP;
+	for (i = 0; i < V4L2_MAX_NO_FRAMES; i++)
+		devices[index]->app_buf_fd[i] = -1;
+	devices[index]->queued_count = 0;
+	devices[index]->async_running = 0;
+	devices[index]->read_ahead = 0;
+	if (v4l2_flags & V4L2_ENABLE_READ_AHEAD)
+		devices[index]->read_ahead = V4L2_DEFAULT_READ_AHEAD;
+	read_ahead = getenv("LIBV4L2_READ_AHEAD");
+	if (read_ahead) {
+		i = atoi(read_ahead);
+		devices[index]->read_ahead = (i < 0) ? 0 :
+					     MIN(i, V4L2_MAX_READ_AHEAD);
+	}
+	devices[index]->read_ahead_buf = MAP_FAILED;
+	memset(&devices[index]->stats, 0, sizeof(devices[index]->stats));
+	devices[index]->stats_sequence_valid = 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	devices[index]->stats_dump_time = ts.tv_sec;
+	devices[index]->readbuf = NULL;
+	devices[index]->readbuf_size = 0;
 
 	/* Note we always tell v4lconvert to optimize src fmt selection for
 	   our default fps, the only exception is the app explicitly selecting
 	   a fram erate using the S_PARM ioctl after a S_FMT */
-	if (devices[index].convert)
-		v4lconvert_set_fps(devices[index].convert, V4L2_DEFAULT_FPS);
+	if (devices[index]->convert) {
+		v4lconvert_set_fps(devices[index]->convert, V4L2_DEFAULT_FPS);
+		if (v4l2_flags & V4L2_ENABLE_SCALING)
+			v4lconvert_set_scaling(devices[index]->convert, 1);
+	}
 	v4l2_update_fps(index, &parm);
 
+	v4l2_publish_device(fd, index);
+
 	V4L2_LOG("open: %d\n", fd);
 
 	return fd;
@@ -753,20 +1467,13 @@ no_capture:
 /* Is this an fd for which we are emulating v4l1 ? */
 static int v4l2_get_index(int fd)
 {
-	int index;
+	struct v4l2_fd_map *map = __atomic_load_n(&fd_map, __ATOMIC_ACQUIRE);
 
 	/* We never handle fd -1 */
-	if (fd == -1)
+	if (fd < 0 || map == NULL || fd >= map->size)
 		return -1;
 
-	for (index = 0; index < devices_used; index++)
-		if (devices[index].fd == fd)
-			break;
-
-	if (index == devices_used)
-		return -1;
-
-	return index;
+	return __atomic_load_n(&map->index[fd], __ATOMIC_ACQUIRE);
 }
 
 
@@ -780,39 +1487,49 @@ int v4l2_close(int fd)
 
 	/* Abuse stream_lock to stop 2 closes from racing and trying to free
 	   the resources twice */
-	pthread_mutex_lock(&devices[index].stream_lock);
-	devices[index].open_count--;
-	result = devices[index].open_count != 0;
-	pthread_mutex_unlock(&devices[index].stream_lock);
+	pthread_mutex_lock(&devices[index]->stream_lock);
+	devices[index]->open_count--;
+	result = devices[index]->open_count != 0;
+	pthread_mutex_unlock(&devices[index]->stream_lock);
 
 	if (result)
 		return 0;
 
-	v4l2_plugin_cleanup(devices[index].plugin_library,
-			devices[index].dev_ops_priv,
-			devices[index].dev_ops);
+	/* Stop the async conversion thread before it loses its device */
+	pthread_mutex_lock(&devices[index]->stream_lock);
+	v4l2_async_stop(index);
+	pthread_mutex_unlock(&devices[index]->stream_lock);
+
+	v4l2_log_stats(fd, &devices[index]->stats);
+
+	v4l2_plugin_cleanup(devices[index]->plugin_library,
+			devices[index]->dev_ops_priv,
+			devices[index]->dev_ops);
 
 	/* Free resources */
 	v4l2_unmap_buffers(index);
-	if (devices[index].convert_mmap_buf != MAP_FAILED) {
+	if (devices[index]->convert_mmap_buf != MAP_FAILED) {
 		if (v4l2_buffers_mapped(index)) {
-			if (!devices[index].gone)
+			if (!devices[index]->gone)
 				V4L2_LOG_WARN("v4l2 mmap buffers still mapped on close()\n");
+			devices[index]->convert_mmap_buf = MAP_FAILED;
 		} else {
-			SYS_MUNMAP(devices[index].convert_mmap_buf,
-					devices[index].no_frames * V4L2_FRAME_BUF_SIZE);
+			v4l2_free_convert_mmap_buf(index);
 		}
-		devices[index].convert_mmap_buf = MAP_FAILED;
 	}
-	v4lconvert_destroy(devices[index].convert);
-	free(devices[index].readbuf);
-	devices[index].readbuf = NULL;
-	devices[index].readbuf_size = 0;
+	v4l2_release_app_bufs(index);
+	v4lconvert_destroy(devices[index]->convert);
+	free(devices[index]->readbuf);
+	devices[index]->readbuf = NULL;
+	devices[index]->readbuf_size = 0;
 
 	/* Remove the fd from our list of managed fds before closing it, because as
 	   soon as we've done the actual close, the fd maybe returned by an open() in
 	   another thread and we don't want to intercept calls to this new fd. */
-	devices[index].fd = -1;
+	pthread_mutex_lock(&v4l2_open_mutex);
+	__atomic_store_n(&fd_map->index[fd], -1, __ATOMIC_RELEASE);
+	devices[index]->fd = -1;
+	pthread_mutex_unlock(&v4l2_open_mutex);
 
 	/* Since we've marked the fd as no longer used, and freed the resources,
 	   redo the close in case it was interrupted */
@@ -832,20 +1549,30 @@ int v4l2_dup(int fd)
 	if (index == -1)
 		return syscall(SYS_dup, fd);
 
-	devices[index].open_count++;
+	devices[index]->open_count++;
 
 	return fd;
 }
 
 static int v4l2_check_buffer_change_ok(int index)
 {
+	/* The async conversion thread uses our mappings of the buffers */
+	if (devices[index]->async_running) {
+		if (!(devices[index]->flags & V4L2_STREAM_CONTROLLED_BY_READ)) {
+			V4L2_LOG("v4l2_check_buffer_change_ok(): stream busy\n");
+			errno = EBUSY;
+			return -1;
+		}
+		v4l2_async_stop(index);
+	}
+
 	v4l2_unmap_buffers(index);
 
 	/* Check if the app itself still is using the stream */
 	if (v4l2_buffers_mapped(index) ||
-			(!(devices[index].flags & V4L2_STREAM_CONTROLLED_BY_READ) &&
-			 ((devices[index].flags & V4L2_STREAMON) ||
-			  devices[index].frame_queued))) {
+			(!(devices[index]->flags & V4L2_STREAM_CONTROLLED_BY_READ) &&
+			 ((devices[index]->flags & V4L2_STREAMON) ||
+			  devices[index]->frame_queued))) {
 		V4L2_LOG("v4l2_check_buffer_change_ok(): stream busy\n");
 		errno = EBUSY;
 		return -1;
@@ -854,11 +1581,9 @@ static int v4l2_check_buffer_change_ok(int index)
 	/* We may change from convert to non conversion mode and
 	   v4l2_unrequest_read_buffers may change the no_frames, so free the
 	   convert mmap buffer */
-	SYS_MUNMAP(devices[index].convert_mmap_buf,
-			devices[index].no_frames * V4L2_FRAME_BUF_SIZE);
-	devices[index].convert_mmap_buf = MAP_FAILED;
+	v4l2_free_convert_mmap_buf(index);
 
-	if (devices[index].flags & V4L2_STREAM_CONTROLLED_BY_READ) {
+	if (devices[index]->flags & V4L2_STREAM_CONTROLLED_BY_READ) {
 		V4L2_LOG("deactivating read-stream for settings change\n");
 		return v4l2_deactivate_read_stream(index);
 	}
@@ -902,8 +1627,8 @@ static void v4l2_set_src_and_dest_format(int index,
 		dest_fmt->fmt.pix.sizeimage = src_fmt->fmt.pix.sizeimage;
 	}
 
-	devices[index].src_fmt = *src_fmt;
-	devices[index].dest_fmt = *dest_fmt;
+	devices[index]->src_fmt = *src_fmt;
+	devices[index]->dest_fmt = *dest_fmt;
 }
 
 static int v4l2_s_fmt(int index, struct v4l2_format *dest_fmt)
@@ -922,8 +1647,10 @@ static int v4l2_s_fmt(int index, struct v4l2_format *dest_fmt)
 				pixfmt >> 24);
 	}
 
-	result = v4lconvert_try_format(devices[index].convert,
+	pthread_mutex_lock(&devices[index]->convert_lock);
+	result = v4lconvert_try_format(devices[index]->convert,
 				       dest_fmt, &src_fmt);
+	pthread_mutex_unlock(&devices[index]->convert_lock);
 	if (result) {
 		int saved_err = errno;
 		V4L2_LOG("S_FMT error trying format: %s\n", strerror(errno));
@@ -946,14 +1673,14 @@ static int v4l2_s_fmt(int index, struct v4l2_format *dest_fmt)
 		return result;
 
 	req_pix_fmt = src_fmt.fmt.pix;
-	result = devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-					       devices[index].fd,
+	result = devices[index]->dev_ops->ioctl(devices[index]->dev_ops_priv,
+					       devices[index]->fd,
 					       VIDIOC_S_FMT, &src_fmt);
 	if (result) {
 		int saved_err = errno;
 		V4L2_PERROR("setting pixformat");
 		/* Report to the app dest_fmt has not changed */
-		*dest_fmt = devices[index].dest_fmt;
+		*dest_fmt = devices[index]->dest_fmt;
 		errno = saved_err;
 		return result;
 	}
@@ -970,12 +1697,12 @@ static int v4l2_s_fmt(int index, struct v4l2_format *dest_fmt)
 
 	v4l2_set_src_and_dest_format(index, &src_fmt, dest_fmt);
 
-	if (devices[index].flags & V4L2_SUPPORTS_TIMEPERFRAME) {
+	if (devices[index]->flags & V4L2_SUPPORTS_TIMEPERFRAME) {
 		struct v4l2_streamparm parm = {
 			.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
 		};
-		if (devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-						  devices[index].fd,
+		if (devices[index]->dev_ops->ioctl(devices[index]->dev_ops_priv,
+						  devices[index]->fd,
 						  VIDIOC_G_PARM, &parm))
 			return 0;
 		v4l2_update_fps(index, &parm);
@@ -989,7 +1716,8 @@ int v4l2_ioctl(int fd, unsigned long int request, ...)
 	void *arg;
 	va_list ap;
 	int result, index, saved_err;
-	int is_capture_request = 0, stream_needs_locking = 0;
+	int is_capture_request = 0, stream_needs_locking = 0, stream_locked = 0;
+	int pass_through = 0;
 
 	va_start(ap, request);
 	arg = va_arg(ap, void *);
@@ -1004,7 +1732,7 @@ int v4l2_ioctl(int fd, unsigned long int request, ...)
 	   ioctl, causing it to get sign extended, depending upon this behavior */
 	request = (unsigned int)request;
 
-	if (devices[index].convert == NULL)
+	if (devices[index]->convert == NULL)
 		goto no_capture_request;
 
 	/* Is this a capture request and do we need to take the stream lock? */
@@ -1048,7 +1776,26 @@ int v4l2_ioctl(int fd, unsigned long int request, ...)
 		if (((struct v4l2_buffer *)arg)->type ==
 				V4L2_BUF_TYPE_VIDEO_CAPTURE) {
 			is_capture_request = 1;
-			stream_needs_locking = 1;
+			/* When the app streams directly from the driver's buffers
+			   these are passed straight through, without looking at
+			   our state, so there is nothing to protect (and a
+			   blocking DQBUF must not hold up QBUFs from other
+			   threads). The check itself is done under stream_lock,
+			   so that it does not race with S_FMT or close, once it
+			   passes the format can not change as buffers are
+			   allocated. */
+			pthread_mutex_lock(&devices[index]->stream_lock);
+			if ((devices[index]->flags & (V4L2_STREAM_TOUCHED |
+					V4L2_STREAM_CONTROLLED_BY_READ)) !=
+						V4L2_STREAM_TOUCHED ||
+					v4l2_needs_conversion(index)) {
+				stream_needs_locking = 1;
+				stream_locked = 1;
+			} else {
+				pthread_mutex_unlock(
+					&devices[index]->stream_lock);
+				pass_through = 1;
+			}
 		}
 		break;
 	case VIDIOC_STREAMON:
@@ -1063,7 +1810,7 @@ int v4l2_ioctl(int fd, unsigned long int request, ...)
 		if (((struct v4l2_streamparm *)arg)->type ==
 				V4L2_BUF_TYPE_VIDEO_CAPTURE) {
 			is_capture_request = 1;
-			if (devices[index].flags & V4L2_SUPPORTS_TIMEPERFRAME)
+			if (devices[index]->flags & V4L2_SUPPORTS_TIMEPERFRAME)
 				stream_needs_locking = 1;
 		}
 		break;
@@ -1075,11 +1822,16 @@ int v4l2_ioctl(int fd, unsigned long int request, ...)
 		break;		
 	}
 
-	if (!is_capture_request) {
+	if (!is_capture_request || pass_through) {
 no_capture_request:
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
+		result = devices[index]->dev_ops->ioctl(
+				devices[index]->dev_ops_priv,
 				fd, request, arg);
+		if (result && pass_through && request == VIDIOC_DQBUF) {
+			saved_err = errno;
+			V4L2_PERROR("dequeuing buf");
+			errno = saved_err;
+		}
 		saved_err = errno;
 		v4l2_log_ioctl(request, arg, result);
 		errno = saved_err;
@@ -1088,43 +1840,50 @@ no_capture_request:
 
 
 	if (stream_needs_locking) {
-		pthread_mutex_lock(&devices[index].stream_lock);
+		if (!stream_locked)
+			pthread_mutex_lock(&devices[index]->stream_lock);
 		/* If this is the first stream-related ioctl, and we should only allow
 		   libv4lconvert supported destination formats (so that it can do flipping,
 		   processing, etc.) and the current destination format is not supported,
 		   try setting the format to RGB24 (which is a supported dest. format). */
-		if (!(devices[index].flags & V4L2_STREAM_TOUCHED) &&
-				v4lconvert_supported_dst_fmt_only(devices[index].convert) &&
+		if (!(devices[index]->flags & V4L2_STREAM_TOUCHED) &&
+				v4lconvert_supported_dst_fmt_only(devices[index]->convert) &&
 				!v4lconvert_supported_dst_format(
-					devices[index].dest_fmt.fmt.pix.pixelformat)) {
-			struct v4l2_format fmt = devices[index].dest_fmt;
+					devices[index]->dest_fmt.fmt.pix.pixelformat)) {
+			struct v4l2_format fmt = devices[index]->dest_fmt;
 
 			V4L2_LOG("Setting pixelformat to RGB24 (supported_dst_fmt_only)");
 			fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
 			v4l2_s_fmt(index, &fmt);
 			V4L2_LOG("Done setting pixelformat (supported_dst_fmt_only)");
 		}
-		devices[index].flags |= V4L2_STREAM_TOUCHED;
+		devices[index]->flags |= V4L2_STREAM_TOUCHED;
 	}
 
 	switch (request) {
 	case VIDIOC_QUERYCTRL:
-		result = v4lconvert_vidioc_queryctrl(devices[index].convert, arg);
+		pthread_mutex_lock(&devices[index]->convert_lock);
+		result = v4lconvert_vidioc_queryctrl(devices[index]->convert, arg);
+		pthread_mutex_unlock(&devices[index]->convert_lock);
 		break;
 
 	case VIDIOC_G_CTRL:
-		result = v4lconvert_vidioc_g_ctrl(devices[index].convert, arg);
+		pthread_mutex_lock(&devices[index]->convert_lock);
+		result = v4lconvert_vidioc_g_ctrl(devices[index]->convert, arg);
+		pthread_mutex_unlock(&devices[index]->convert_lock);
 		break;
 
 	case VIDIOC_S_CTRL:
-		result = v4lconvert_vidioc_s_ctrl(devices[index].convert, arg);
+		pthread_mutex_lock(&devices[index]->convert_lock);
+		result = v4lconvert_vidioc_s_ctrl(devices[index]->convert, arg);
+		pthread_mutex_unlock(&devices[index]->convert_lock);
 		break;
 
 	case VIDIOC_QUERYCAP: {
 		struct v4l2_capability *cap = arg;
 
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
+		result = devices[index]->dev_ops->ioctl(
+				devices[index]->dev_ops_priv,
 				fd, VIDIOC_QUERYCAP, cap);
 		if (result == 0) {
 			/* We always support read() as we fake it using mmap mode */
@@ -1135,23 +1894,31 @@ no_capture_request:
 	}
 
 	case VIDIOC_ENUM_FMT:
-		result = v4lconvert_enum_fmt(devices[index].convert, arg);
+		pthread_mutex_lock(&devices[index]->convert_lock);
+		result = v4lconvert_enum_fmt(devices[index]->convert, arg);
+		pthread_mutex_unlock(&devices[index]->convert_lock);
 		break;
 
 	case VIDIOC_ENUM_FRAMESIZES:
-		result = v4lconvert_enum_framesizes(devices[index].convert, arg);
+		pthread_mutex_lock(&devices[index]->convert_lock);
+		result = v4lconvert_enum_framesizes(devices[index]->convert, arg);
+		pthread_mutex_unlock(&devices[index]->convert_lock);
 		break;
 
 	case VIDIOC_ENUM_FRAMEINTERVALS:
-		result = v4lconvert_enum_frameintervals(devices[index].convert, arg);
+		pthread_mutex_lock(&devices[index]->convert_lock);
+		result = v4lconvert_enum_frameintervals(devices[index]->convert, arg);
 		if (result)
 			V4L2_LOG("ENUM_FRAMEINTERVALS Error: %s",
-					v4lconvert_get_error_message(devices[index].convert));
+					v4lconvert_get_error_message(devices[index]->convert));
+		pthread_mutex_unlock(&devices[index]->convert_lock);
 		break;
 
 	case VIDIOC_TRY_FMT:
-		result = v4lconvert_try_format(devices[index].convert,
+		pthread_mutex_lock(&devices[index]->convert_lock);
+		result = v4lconvert_try_format(devices[index]->convert,
 					       arg, NULL);
+		pthread_mutex_unlock(&devices[index]->convert_lock);
 		break;
 
 	case VIDIOC_S_FMT:
@@ -1161,7 +1928,7 @@ no_capture_request:
 	case VIDIOC_G_FMT: {
 		struct v4l2_format *fmt = arg;
 
-		*fmt = devices[index].dest_fmt;
+		*fmt = devices[index]->dest_fmt;
 		result = 0;
 		break;
 	}
@@ -1171,16 +1938,16 @@ no_capture_request:
 	case VIDIOC_S_DV_TIMINGS: {
 		struct v4l2_format src_fmt;
 
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
+		result = devices[index]->dev_ops->ioctl(
+				devices[index]->dev_ops_priv,
 				fd, request, arg);
 		if (result)
 			break;
 
 		/* These ioctls may have changed the device's fmt */
 		src_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
+		result = devices[index]->dev_ops->ioctl(
+				devices[index]->dev_ops_priv,
 				fd, VIDIOC_G_FMT, &src_fmt);
 		if (result) {
 			V4L2_PERROR("getting pixformat after %s",
@@ -1189,18 +1956,18 @@ no_capture_request:
 			break;
 		}
 
-		if (v4l2_pix_fmt_compat(&devices[index].src_fmt, &src_fmt)) {
+		if (v4l2_pix_fmt_compat(&devices[index]->src_fmt, &src_fmt)) {
 			v4l2_set_src_and_dest_format(index, &src_fmt,
-						     &devices[index].dest_fmt);
+						     &devices[index]->dest_fmt);
 			break;
 		}
 
 		/* The fmt has been changed, remember the new format ... */
-		devices[index].src_fmt  = src_fmt;
-		devices[index].dest_fmt = src_fmt;
+		devices[index]->src_fmt  = src_fmt;
+		devices[index]->dest_fmt = src_fmt;
 		/* and try to restore the last set destination pixelformat. */
 		src_fmt.fmt.pix.pixelformat =
-			devices[index].dest_fmt.fmt.pix.pixelformat;
+			devices[index]->dest_fmt.fmt.pix.pixelformat;
 		result = v4l2_s_fmt(index, &src_fmt);
 		if (result) {
 			V4L2_LOG_WARN("restoring destination pixelformat after %s failed\n",
@@ -1213,9 +1980,11 @@ no_capture_request:
 
 	case VIDIOC_REQBUFS: {
 		struct v4l2_requestbuffers *req = arg;
+		unsigned int memory = req->memory;
 
-		/* IMPROVEME (maybe?) add support for userptr's? */
-		if (req->memory != V4L2_MEMORY_MMAP) {
+		if (memory != V4L2_MEMORY_MMAP &&
+		    memory != V4L2_MEMORY_USERPTR &&
+		    memory != V4L2_MEMORY_DMABUF) {
 			errno = EINVAL;
 			result = -1;
 			break;
@@ -1229,22 +1998,29 @@ no_capture_request:
 		if (req->count > V4L2_MAX_NO_FRAMES)
 			req->count = V4L2_MAX_NO_FRAMES;
 
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
+		/* We convert from mmap buffers into USERPTR / DMABUF ones */
+		if (v4l2_needs_conversion(index))
+			req->memory = V4L2_MEMORY_MMAP;
+		result = devices[index]->dev_ops->ioctl(
+				devices[index]->dev_ops_priv,
 				fd, VIDIOC_REQBUFS, req);
+		req->memory = memory;
 		if (result < 0)
 			break;
 		result = 0; /* some drivers return the number of buffers on success */
 
-		devices[index].no_frames = MIN(req->count, V4L2_MAX_NO_FRAMES);
-		devices[index].flags &= ~V4L2_BUFFERS_REQUESTED_BY_READ;
+		v4l2_release_app_bufs(index);
+		devices[index]->app_memory = v4l2_needs_conversion(index) ?
+					     memory : V4L2_MEMORY_MMAP;
+		devices[index]->no_frames = MIN(req->count, V4L2_MAX_NO_FRAMES);
+		devices[index]->flags &= ~V4L2_BUFFERS_REQUESTED_BY_READ;
 		break;
 	}
 
 	case VIDIOC_QUERYBUF: {
 		struct v4l2_buffer *buf = arg;
 
-		if (devices[index].flags & V4L2_STREAM_CONTROLLED_BY_READ) {
+		if (devices[index]->flags & V4L2_STREAM_CONTROLLED_BY_READ) {
 			result = v4l2_deactivate_read_stream(index);
 			if (result)
 				break;
@@ -1252,8 +2028,8 @@ no_capture_request:
 
 		/* Do a real query even when converting to let the driver fill in
 		   things like buf->field */
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
+		result = devices[index]->dev_ops->ioctl(
+				devices[index]->dev_ops_priv,
 				fd, VIDIOC_QUERYBUF, buf);
 
 		v4l2_set_conversion_buf_params(index, buf);
@@ -1263,7 +2039,7 @@ no_capture_request:
 	case VIDIOC_QBUF: {
 		struct v4l2_buffer *buf = arg;
 
-		if (devices[index].flags & V4L2_STREAM_CONTROLLED_BY_READ) {
+		if (devices[index]->flags & V4L2_STREAM_CONTROLLED_BY_READ) {
 			result = v4l2_deactivate_read_stream(index);
 			if (result)
 				break;
@@ -1274,11 +2050,22 @@ no_capture_request:
 			result = v4l2_map_buffers(index);
 			if (result)
 				break;
+
+			if (devices[index]->app_memory != V4L2_MEMORY_MMAP) {
+				result = v4l2_set_app_buf(index, buf);
+				if (result)
+					break;
+				buf->memory = V4L2_MEMORY_MMAP;
+			}
 		}
 
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
+		result = devices[index]->dev_ops->ioctl(
+				devices[index]->dev_ops_priv,
 				fd, VIDIOC_QBUF, arg);
+		if (result == 0 && v4l2_needs_conversion(index)) {
+			devices[index]->queued_count++;
+			pthread_cond_broadcast(&devices[index]->async_cond);
+		}
 
 		v4l2_set_conversion_buf_params(index, buf);
 		break;
@@ -1287,15 +2074,15 @@ no_capture_request:
 	case VIDIOC_DQBUF: {
 		struct v4l2_buffer *buf = arg;
 
-		if (devices[index].flags & V4L2_STREAM_CONTROLLED_BY_READ) {
+		if (devices[index]->flags & V4L2_STREAM_CONTROLLED_BY_READ) {
 			result = v4l2_deactivate_read_stream(index);
 			if (result)
 				break;
 		}
 
 		if (!v4l2_needs_conversion(index)) {
-			result = devices[index].dev_ops->ioctl(
-					devices[index].dev_ops_priv,
+			result = devices[index]->dev_ops->ioctl(
+					devices[index]->dev_ops_priv,
 					fd, VIDIOC_DQBUF, buf);
 			if (result) {
 				saved_err = errno;
@@ -1308,23 +2095,18 @@ no_capture_request:
 		/* An application can do a DQBUF before mmap-ing in the buffer,
 		   but we need the buffer _now_ to write our converted data
 		   to it! */
-		if (devices[index].convert_mmap_buf == MAP_FAILED) {
-			devices[index].convert_mmap_buf = (void *)SYS_MMAP(NULL,
-				(size_t)(devices[index].no_frames * V4L2_FRAME_BUF_SIZE),
-				PROT_READ | PROT_WRITE,
-				MAP_ANONYMOUS | MAP_PRIVATE,
-				-1, 0);
-			if (devices[index].convert_mmap_buf == MAP_FAILED) {
-				saved_err = errno;
-				V4L2_LOG_ERR("allocating conversion buffer\n");
-				errno = saved_err;
-				result = -1;
+		if (devices[index]->app_memory == V4L2_MEMORY_MMAP) {
+			result = v4l2_alloc_convert_mmap_buf(index);
+			if (result)
 				break;
-			}
-		}
+		} else
+			buf->memory = V4L2_MEMORY_MMAP;
 
-		result = v4l2_dequeue_and_convert(index, buf, 0,
-						  V4L2_FRAME_BUF_SIZE);
+		if (devices[index]->async_running)
+			result = v4l2_async_dequeue(index, buf);
+		else
+			result = v4l2_dequeue_and_convert(index, buf, 0,
+					devices[index]->convert_frame_size, 0);
 		if (result >= 0) {
 			buf->bytesused = result;
 			result = 0;
@@ -1336,15 +2118,17 @@ no_capture_request:
 
 	case VIDIOC_STREAMON:
 	case VIDIOC_STREAMOFF:
-		if (devices[index].flags & V4L2_STREAM_CONTROLLED_BY_READ) {
+		if (devices[index]->flags & V4L2_STREAM_CONTROLLED_BY_READ) {
 			result = v4l2_deactivate_read_stream(index);
 			if (result)
 				break;
 		}
 
-		if (request == VIDIOC_STREAMON)
+		if (request == VIDIOC_STREAMON) {
 			result = v4l2_streamon(index);
-		else
+			if (result == 0)
+				v4l2_async_start(index);
+		} else
 			result = v4l2_streamoff(index);
 		break;
 
@@ -1353,7 +2137,7 @@ no_capture_request:
 
 		/* See if libv4lconvert wishes to use a different src_fmt
 		   for the new frame rate and set that first */
-		if ((devices[index].flags & V4L2_SUPPORTS_TIMEPERFRAME) &&
+		if ((devices[index]->flags & V4L2_SUPPORTS_TIMEPERFRAME) &&
 		    parm->parm.capture.timeperframe.numerator != 0) {
 			int fps = parm->parm.capture.timeperframe.denominator;
 			fps += parm->parm.capture.timeperframe.numerator - 1;
@@ -1361,8 +2145,8 @@ no_capture_request:
 			v4l2_adjust_src_fmt_to_fps(index, fps);
 		}
 
-		result = devices[index].dev_ops->ioctl(
-						devices[index].dev_ops_priv,
+		result = devices[index]->dev_ops->ioctl(
+						devices[index]->dev_ops_priv,
 						fd, VIDIOC_S_PARM, parm);
 		if (result)
 			break;
@@ -1372,14 +2156,14 @@ no_capture_request:
 	}
 
 	default:
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
+		result = devices[index]->dev_ops->ioctl(
+				devices[index]->dev_ops_priv,
 				fd, request, arg);
 		break;
 	}
 
 	if (stream_needs_locking)
-		pthread_mutex_unlock(&devices[index].stream_lock);
+		pthread_mutex_unlock(&devices[index]->stream_lock);
 
 	saved_err = errno;
 	v4l2_log_ioctl(request, arg, result);
@@ -1392,20 +2176,22 @@ static void v4l2_adjust_src_fmt_to_fps(int index, int fps)
 {
 	struct v4l2_pix_format req_pix_fmt;
 	struct v4l2_format src_fmt;
-	struct v4l2_format dest_fmt = devices[index].dest_fmt;
-	struct v4l2_format orig_src_fmt = devices[index].src_fmt;
-	struct v4l2_format orig_dest_fmt = devices[index].dest_fmt;
+	struct v4l2_format dest_fmt = devices[index]->dest_fmt;
+	struct v4l2_format orig_src_fmt = devices[index]->src_fmt;
+	struct v4l2_format orig_dest_fmt = devices[index]->dest_fmt;
 	int r;
 
-	if (fps == devices[index].fps)
+	if (fps == devices[index]->fps)
 		return;
 
 	if (v4l2_check_buffer_change_ok(index))
 		return;
 
-	v4lconvert_set_fps(devices[index].convert, fps);
-	r = v4lconvert_try_format(devices[index].convert, &dest_fmt, &src_fmt);
-	v4lconvert_set_fps(devices[index].convert, V4L2_DEFAULT_FPS);
+	pthread_mutex_lock(&devices[index]->convert_lock);
+	v4lconvert_set_fps(devices[index]->convert, fps);
+	r = v4lconvert_try_format(devices[index]->convert, &dest_fmt, &src_fmt);
+	v4lconvert_set_fps(devices[index]->convert, V4L2_DEFAULT_FPS);
+	pthread_mutex_unlock(&devices[index]->convert_lock);
 	if (r)
 		return;
 
@@ -1414,8 +2200,8 @@ static void v4l2_adjust_src_fmt_to_fps(int index, int fps)
 		return;
 
 	req_pix_fmt = src_fmt.fmt.pix;
-	if (devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-			devices[index].fd, VIDIOC_S_FMT, &src_fmt))
+	if (devices[index]->dev_ops->ioctl(devices[index]->dev_ops_priv,
+			devices[index]->fd, VIDIOC_S_FMT, &src_fmt))
 		return;
 
 	v4l2_set_src_and_dest_format(index, &src_fmt, &dest_fmt);
@@ -1442,8 +2228,8 @@ static void v4l2_adjust_src_fmt_to_fps(int index, int fps)
 	src_fmt = orig_src_fmt;
 	dest_fmt = orig_dest_fmt;
 	req_pix_fmt = src_fmt.fmt.pix;
-	if (devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-			devices[index].fd, VIDIOC_S_FMT, &src_fmt)) {
+	if (devices[index]->dev_ops->ioctl(devices[index]->dev_ops_priv,
+			devices[index]->fd, VIDIOC_S_FMT, &src_fmt)) {
 		V4L2_PERROR("restoring src fmt");
 		return;
 	}
@@ -1464,20 +2250,20 @@ ssize_t v4l2_read(int fd, void *dest, size_t n)
 	if (index == -1)
 		return SYS_READ(fd, dest, n);
 
-	if (!devices[index].dev_ops->read) {
+	if (!devices[index]->dev_ops->read) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	pthread_mutex_lock(&devices[index].stream_lock);
+	pthread_mutex_lock(&devices[index]->stream_lock);
 
 	/* When not converting and the device supports read(), let the kernel handle
 	   it */
-	if (devices[index].convert == NULL ||
-	    ((devices[index].flags & V4L2_SUPPORTS_READ) &&
+	if (devices[index]->convert == NULL ||
+	    ((devices[index]->flags & V4L2_SUPPORTS_READ) &&
 			!v4l2_needs_conversion(index))) {
-		result = devices[index].dev_ops->read(
-				devices[index].dev_ops_priv,
+		result = devices[index]->dev_ops->read(
+				devices[index]->dev_ops_priv,
 				fd, dest, n);
 		goto leave;
 	}
@@ -1490,33 +2276,27 @@ ssize_t v4l2_read(int fd, void *dest, size_t n)
 	   select or poll() is done before any buffers are requested. So using mmap
 	   mode under the hood will fail if a select() or poll() is done before the
 	   first emulated read() call. */
-	if (!(devices[index].flags & V4L2_STREAM_CONTROLLED_BY_READ) &&
-			!(devices[index].flags & V4L2_USE_READ_FOR_READ)) {
+	if (!(devices[index]->flags & V4L2_STREAM_CONTROLLED_BY_READ) &&
+			!(devices[index]->flags & V4L2_USE_READ_FOR_READ)) {
 		result = v4l2_activate_read_stream(index);
 		if (result) {
 			/* Activating mmap mode failed, use read() instead */
-			devices[index].flags |= V4L2_USE_READ_FOR_READ;
+			devices[index]->flags |= V4L2_USE_READ_FOR_READ;
 			/* The read call done by v4l2_read_and_convert will start the stream */
-			devices[index].first_frame = V4L2_IGNORE_FIRST_FRAME_ERRORS;
+			devices[index]->first_frame = V4L2_IGNORE_FIRST_FRAME_ERRORS;
 		}
 	}
 
-	if (devices[index].flags & V4L2_USE_READ_FOR_READ) {
+	if (devices[index]->flags & V4L2_USE_READ_FOR_READ)
 		result = v4l2_read_and_convert(index, dest, n);
-	} else {
-		struct v4l2_buffer buf;
-
-		buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		buf.memory = V4L2_MEMORY_MMAP;
-		result = v4l2_dequeue_and_convert(index, &buf, dest, n);
-
-		if (result >= 0)
-			v4l2_queue_read_buffer(index, buf.index);
-	}
+	else if (devices[index]->async_running)
+		result = v4l2_read_ahead_read(index, dest, n);
+	else
+		result = v4l2_read_stream_frame(index, dest, n);
 
 leave:
 	saved_errno = errno;
-	pthread_mutex_unlock(&devices[index].stream_lock);
+	pthread_mutex_unlock(&devices[index]->stream_lock);
 	errno = saved_errno;
 
 	return result;
@@ -1529,13 +2309,13 @@ ssize_t v4l2_write(int fd, const void *buffer, size_t n)
 	if (index == -1)
 		return SYS_WRITE(fd, buffer, n);
 
-	if (!devices[index].dev_ops->write) {
+	if (!devices[index]->dev_ops->write) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	return devices[index].dev_ops->write(
-			devices[index].dev_ops_priv, fd, buffer, n);
+	return devices[index]->dev_ops->write(
+			devices[index]->dev_ops_priv, fd, buffer, n);
 }
 
 void *v4l2_mmap(void *start, size_t length, int prot, int flags, int fd,
@@ -1549,7 +2329,7 @@ void *v4l2_mmap(void *start, size_t length, int prot, int flags, int fd,
 	if (index == -1 ||
 			/* Check if the mmap data matches our answer to QUERY_BUF. If it doesn't,
 			   let the kernel handle it (to allow for mmap-based non capture use) */
-			start || length != V4L2_FRAME_BUF_SIZE ||
+			start ||
 			((unsigned int)offset & ~0xFFu) != V4L2_MMAP_OFFSET_MAGIC) {
 		if (index != -1)
 			V4L2_LOG("Passing mmap(%p, %d, ..., %x, through to the driver\n",
@@ -1563,80 +2343,75 @@ void *v4l2_mmap(void *start, size_t length, int prot, int flags, int fd,
 		return (void *)SYS_MMAP(start, length, prot, flags, fd, offset);
 	}
 
-	pthread_mutex_lock(&devices[index].stream_lock);
+	pthread_mutex_lock(&devices[index]->stream_lock);
 
 	buffer_index = offset & 0xff;
-	if (buffer_index >= devices[index].no_frames ||
+	if (buffer_index >= devices[index]->no_frames ||
 			/* Got magic offset and not converting ?? */
-			!v4l2_needs_conversion(index)) {
+			!v4l2_needs_conversion(index) ||
+			/* The length must match our answer to QUERY_BUF */
+			length != v4l2_convert_frame_size(index)) {
 		errno = EINVAL;
 		result = MAP_FAILED;
 		goto leave;
 	}
 
-	if (devices[index].convert_mmap_buf == MAP_FAILED) {
-		devices[index].convert_mmap_buf = (void *)SYS_MMAP(NULL,
-			(size_t)(devices[index].no_frames * V4L2_FRAME_BUF_SIZE),
-			PROT_READ | PROT_WRITE,
-			MAP_ANONYMOUS | MAP_PRIVATE,
-			-1, 0);
-		if (devices[index].convert_mmap_buf == MAP_FAILED) {
-			int saved_err = errno;
-
-			V4L2_LOG_ERR("allocating conversion buffer\n");
-			errno = saved_err;
-			result = MAP_FAILED;
-			goto leave;
-		}
+	if (v4l2_alloc_convert_mmap_buf(index)) {
+		result = MAP_FAILED;
+		goto leave;
 	}
 
-	devices[index].frame_map_count[buffer_index]++;
+	devices[index]->frame_map_count[buffer_index]++;
 
-	result = devices[index].convert_mmap_buf +
-		buffer_index * V4L2_FRAME_BUF_SIZE;
+	result = devices[index]->convert_mmap_buf +
+		buffer_index * devices[index]->convert_frame_size;
 
 	V4L2_LOG("Fake (conversion) mmap buf %u, seen by app at: %p\n",
 			buffer_index, result);
 
 leave:
-	pthread_mutex_unlock(&devices[index].stream_lock);
+	pthread_mutex_unlock(&devices[index]->stream_lock);
 
 	return result;
 }
 
 int v4l2_munmap(void *_start, size_t length)
 {
-	int index;
+	int index, used;
 	unsigned int buffer_index;
 	unsigned char *start = _start;
 
 	/* Is this memory ours? */
-	if (start != MAP_FAILED && length == V4L2_FRAME_BUF_SIZE) {
-		for (index = 0; index < devices_used; index++)
-			if (devices[index].fd != -1 &&
-					devices[index].convert_mmap_buf != MAP_FAILED &&
-					start >= devices[index].convert_mmap_buf &&
-					(start - devices[index].convert_mmap_buf) % length == 0)
+	if (start != MAP_FAILED) {
+		/* devices[] always is at least devices_used big */
+		used = __atomic_load_n(&devices_used, __ATOMIC_ACQUIRE);
+		for (index = 0; index < used; index++)
+			if (devices[index]->fd != -1 &&
+					devices[index]->convert_mmap_buf != MAP_FAILED &&
+					length == devices[index]->convert_frame_size &&
+					start >= devices[index]->convert_mmap_buf &&
+					(start - devices[index]->convert_mmap_buf) % length == 0)
 				break;
 
-		if (index != devices_used) {
+		if (index != used) {
 			int unmapped = 0;
 
-			pthread_mutex_lock(&devices[index].stream_lock);
+			pthread_mutex_lock(&devices[index]->stream_lock);
 
-			buffer_index = (start - devices[index].convert_mmap_buf) / length;
+			buffer_index = (start - devices[index]->convert_mmap_buf) / length;
 
 			/* Re-do our checks now that we have the lock, things may have changed */
-			if (devices[index].convert_mmap_buf != MAP_FAILED &&
-					start >= devices[index].convert_mmap_buf &&
-					(start - devices[index].convert_mmap_buf) % length == 0 &&
-					buffer_index < devices[index].no_frames) {
-				if (devices[index].frame_map_count[buffer_index] > 0)
-					devices[index].frame_map_count[buffer_index]--;
+			if (devices[index]->convert_mmap_buf != MAP_FAILED &&
+					length == devices[index]->convert_frame_size &&
+					start >= devices[index]->convert_mmap_buf &&
+					(start - devices[index]->convert_mmap_buf) % length == 0 &&
+					buffer_index < devices[index]->no_frames) {
+				if (devices[index]->frame_map_count[buffer_index] > 0)
+					devices[index]->frame_map_count[buffer_index]--;
 				unmapped = 1;
 			}
 
-			pthread_mutex_unlock(&devices[index].stream_lock);
+			pthread_mutex_unlock(&devices[index]->stream_lock);
 
 			if (unmapped) {
 				V4L2_LOG("v4l2 fake buffer munmap %p, %d\n", start, (int)length);
@@ -1658,15 +2433,17 @@ int v4l2_set_control(int fd, int cid, int value)
 	int index, result;
 
 	index = v4l2_get_index(fd);
-	if (index == -1 || devices[index].convert == NULL) {
+	if (index == -1 || devices[index]->convert == NULL) {
 		V4L2_LOG_ERR("v4l2_set_control called with invalid fd: %d\n", fd);
 		errno = EBADF;
 		return -1;
 	}
 
-	result = v4lconvert_vidioc_queryctrl(devices[index].convert, &qctrl);
+	pthread_mutex_lock(&devices[index]->convert_lock);
+
+	result = v4lconvert_vidioc_queryctrl(devices[index]->convert, &qctrl);
 	if (result)
-		return result;
+		goto leave;
 
 	if (!(qctrl.flags & V4L2_CTRL_FLAG_DISABLED) &&
 			!(qctrl.flags & V4L2_CTRL_FLAG_GRABBED)) {
@@ -1676,9 +2453,11 @@ int v4l2_set_control(int fd, int cid, int value)
 			ctrl.value = (value * (qctrl.maximum - qctrl.minimum) + 32767) / 65535 +
 				qctrl.minimum;
 
-		result = v4lconvert_vidioc_s_ctrl(devices[index].convert, &ctrl);
+		result = v4lconvert_vidioc_s_ctrl(devices[index]->convert, &ctrl);
 	}
 
+leave:
+	pthread_mutex_unlock(&devices[index]->convert_lock);
 	return result;
 }
 
@@ -1687,25 +2466,44 @@ int v4l2_get_control(int fd, int cid)
 	struct v4l2_queryctrl qctrl = { .id = cid };
 	struct v4l2_control ctrl = { .id = cid };
 	int index = v4l2_get_index(fd);
+	int result;
 
-	if (index == -1 || devices[index].convert == NULL) {
+	if (index == -1 || devices[index]->convert == NULL) {
 		V4L2_LOG_ERR("v4l2_set_control called with invalid fd: %d\n", fd);
 		errno = EBADF;
 		return -1;
 	}
 
-	if (v4lconvert_vidioc_queryctrl(devices[index].convert, &qctrl))
-		return -1;
-
-	if (qctrl.flags & V4L2_CTRL_FLAG_DISABLED) {
+	pthread_mutex_lock(&devices[index]->convert_lock);
+	result = v4lconvert_vidioc_queryctrl(devices[index]->convert, &qctrl);
+	if (result == 0 && (qctrl.flags & V4L2_CTRL_FLAG_DISABLED)) {
 		errno = EINVAL;
-		return -1;
+		result = -1;
 	}
-
-	if (v4lconvert_vidioc_g_ctrl(devices[index].convert, &ctrl))
+	if (result == 0)
+		result = v4lconvert_vidioc_g_ctrl(devices[index]->convert,
+						  &ctrl);
+	pthread_mutex_unlock(&devices[index]->convert_lock);
+	if (result)
 		return -1;
 
 	return ((ctrl.value - qctrl.minimum) * 65535 +
 			(qctrl.maximum - qctrl.minimum) / 2) /
 		(qctrl.maximum - qctrl.minimum);
 }
+
+int v4l2_get_stats(int fd, struct v4l2_stats *stats)
+{
+	int index = v4l2_get_index(fd);
+
+	if (index == -1) {
+		errno = EBADF;
+		return -1;
+	}
+
+	pthread_mutex_lock(&devices[index]->stream_lock);
+	*stats = devices[index]->stats;
+	pthread_mutex_unlock(&devices[index]->stream_lock);
+
+	return 0;
+}
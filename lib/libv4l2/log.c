@@ -31,6 +31,7 @@
 #define ARRAY_SIZE(x) (sizeof(x)/sizeof((x)[0]))
 
 FILE *v4l2_log_file = NULL;
+FILE *v4l2_stats_file = NULL;
 
 const char *v4l2_ioctls[] = {
 	/* start v4l2 ioctls */
@@ -254,3 +255,30 @@ void v4l2_log_ioctl(unsigned long int request, void *arg, int result)
 
 	fflush(v4l2_log_file);
 }
+
+void v4l2_log_stats(int fd, const struct v4l2_stats *stats)
+{
+	int i, saved_errno = errno;
+
+	if (!v4l2_stats_file)
+		return;
+
+	/* Keep the lines of different devices together */
+	flockfile(v4l2_stats_file);
+	fprintf(v4l2_stats_file, "libv4l2: stats fd %d: converted %llu, "
+		"convert errors %llu, start frames dropped %llu, "
+		"driver drops %llu, read-ahead drops %llu, "
+		"queue underruns %llu, bytes copied %llu, "
+		"convert time %llu us, histogram (log2 us):", fd,
+		stats->frames_converted, stats->convert_errors,
+		stats->start_frames_dropped, stats->driver_frames_dropped,
+		stats->read_ahead_frames_dropped, stats->queue_underruns,
+		stats->bytes_copied, stats->convert_time_us);
+	for (i = 0; i < V4L2_STATS_CONVERT_TIME_BUCKETS; i++)
+		fprintf(v4l2_stats_file, " %llu", stats->convert_time_hist[i]);
+	fprintf(v4l2_stats_file, "\n");
+	fflush(v4l2_stats_file);
+	funlockfile(v4l2_stats_file);
+
+	errno = saved_errno;
+}
@@ -18,6 +18,8 @@
 
 #include <config.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <pthread.h>
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <glob.h>
@@ -30,37 +32,53 @@
 /* libv4l plugin support:
    it is provided by functions v4l2_plugin_[open,close,etc].
 
-   When open() is called libv4l dlopens files in /usr/lib[64]/libv4l/plugins
-   1 at a time and call open callback passing through the applications
-   parameters unmodified.
+   The first time a device gets opened libv4l dlopens all files in
+   /usr/lib[64]/libv4l/plugins (in alphabetical order) and keeps those which
+   export a valid libv4l2_plugin around for the lifetime of the process, so
+   that opening a device does not involve any filesystem access.
 
+   When open() is called the init callback of the (non stackable) plugins gets
+   called 1 at a time passing through the applications parameters unmodified.
    If a plugin is relevant for the specified device node, it can indicate so
-   by returning a value other then -1 (the actual file descriptor).
-   As soon as a plugin returns another value then -1 plugin loading stops and
-   information about it (fd and corresponding library handle) is stored. For
-   each function v4l2_[ioctl,read,close,etc] is called corresponding
-   v4l2_plugin_* function which looks if there is loaded plugin for that file
-   and call it's callbacks.
-
-   v4l2_plugin_* function indicates by it's first argument if plugin was used,
-   and if it was not then v4l2_* functions proceed with their usual behavior.
+   by returning a value other then NULL. As soon as a plugin does so it is
+   used for that device and no further non stackable plugins are tried.
+
+   Next the init_chain callback of all stackable plugins gets called, again in
+   alphabetical order, each one passing in the dev_ops of the device so far
+   (the non stackable plugin, or the default dev_ops if there was none). Each
+   stackable plugin which accepts the device becomes the new top of the stack,
+   passing on the calls it does not handle itself to the layer below.
+
+   For each function v4l2_[ioctl,read,close,etc] the dev_ops of the top of
+   the stack get called, v4l2_plugin_cleanup closes all layers of the stack
+   from the top down.
 */
 
 #define PLUGINS_PATTERN LIBV4L2_PLUGIN_DIR "/*.so"
 
-void v4l2_plugin_init(int fd, void **plugin_lib_ret, void **plugin_priv_ret,
-		      const struct libv4l_dev_ops **dev_ops_ret)
+struct v4l2_plugin_layer {
+	void *priv;
+	const struct libv4l_dev_ops *dev_ops;
+};
+
+/* This is what gets passed around as plugin_lib for a device */
+struct v4l2_plugin_chain {
+	int count;
+	struct v4l2_plugin_layer layers[];
+};
+
+static const struct libv4l_dev_ops **plugins;
+static int plugins_count;
+static pthread_once_t plugins_once = PTHREAD_ONCE_INIT;
+
+static void v4l2_plugin_load(void)
 {
 	char *error;
 	int glob_ret, i;
-	void *plugin_library = NULL;
-	const struct libv4l_dev_ops *libv4l2_plugin = NULL;
+	void *plugin_library;
+	const struct libv4l_dev_ops *libv4l2_plugin;
 	glob_t globbuf;
 
-	*dev_ops_ret = v4lconvert_get_default_dev_ops();
-	*plugin_lib_ret = NULL;
-	*plugin_priv_ret = NULL;
-
 	glob_ret = glob(PLUGINS_PATTERN, 0, NULL, &globbuf);
 
 	if (glob_ret == GLOB_NOSPACE)
@@ -69,6 +87,12 @@ void v4l2_plugin_init(int fd, void **plugin_lib_ret, void **plugin_priv_ret,
 	if (glob_ret == GLOB_ABORTED || glob_ret == GLOB_NOMATCH)
 		goto leave;
 
+	plugins = calloc(globbuf.gl_pathc, sizeof(plugins[0]));
+	if (!plugins) {
+		V4L2_LOG_ERR("PLUGIN: out of memory\n");
+		goto leave;
+	}
+
 	for (i = 0; i < globbuf.gl_pathc; i++) {
 		V4L2_LOG("PLUGIN: dlopen(%s);\n", globbuf.gl_pathv[i]);
 
@@ -86,7 +110,7 @@ void v4l2_plugin_init(int fd, void **plugin_lib_ret, void **plugin_priv_ret,
 			continue;
 		}
 
-		if (!libv4l2_plugin->init ||
+		if ((!libv4l2_plugin->init && !libv4l2_plugin->init_chain) ||
 		    !libv4l2_plugin->close ||
 		    !libv4l2_plugin->ioctl) {
 			V4L2_LOG("PLUGIN: does not have all mandatory ops\n");
@@ -94,27 +118,96 @@ void v4l2_plugin_init(int fd, void **plugin_lib_ret, void **plugin_priv_ret,
 			continue;
 		}
 
-		*plugin_priv_ret = libv4l2_plugin->init(fd);
-		if (!*plugin_priv_ret) {
+		/* The library stays loaded, so libv4l2_plugin stays valid */
+		plugins[plugins_count++] = libv4l2_plugin;
+	}
+
+leave:
+	globfree(&globbuf);
+}
+
+void v4l2_plugin_init(int fd, void **plugin_lib_ret, void **plugin_priv_ret,
+		      const struct libv4l_dev_ops **dev_ops_ret)
+{
+	struct v4l2_plugin_chain *chain;
+	const struct libv4l_dev_ops *dev_ops;
+	void *priv;
+	int i;
+
+	*dev_ops_ret = v4lconvert_get_default_dev_ops();
+	*plugin_lib_ret = NULL;
+	*plugin_priv_ret = NULL;
+
+	pthread_once(&plugins_once, v4l2_plugin_load);
+	if (!plugins_count)
+		return;
+
+	chain = malloc(sizeof(*chain) + plugins_count * sizeof(chain->layers[0]));
+	if (!chain) {
+		V4L2_LOG_ERR("PLUGIN: out of memory\n");
+		return;
+	}
+	chain->count = 0;
+
+	/* The first non stackable plugin which accepts the device goes at the
+	   bottom of the stack */
+	for (i = 0; i < plugins_count; i++) {
+		dev_ops = plugins[i];
+		if (dev_ops->init_chain)
+			continue;
+
+		priv = dev_ops->init(fd);
+		if (!priv) {
 			V4L2_LOG("PLUGIN: plugin open() returned NULL\n");
-			dlclose(plugin_library);
 			continue;
 		}
 
-		*plugin_lib_ret = plugin_library;
-		*dev_ops_ret = libv4l2_plugin;
+		chain->layers[chain->count].priv = priv;
+		chain->layers[chain->count].dev_ops = dev_ops;
+		chain->count++;
+		*plugin_priv_ret = priv;
+		*dev_ops_ret = dev_ops;
 		break;
 	}
 
-leave:
-	globfree(&globbuf);
+	/* And all stackable plugins which accept it on top of that */
+	for (i = 0; i < plugins_count; i++) {
+		dev_ops = plugins[i];
+		if (!dev_ops->init_chain)
+			continue;
+
+		priv = dev_ops->init_chain(fd, *plugin_priv_ret, *dev_ops_ret);
+		if (!priv) {
+			V4L2_LOG("PLUGIN: plugin init_chain() returned NULL\n");
+			continue;
+		}
+
+		chain->layers[chain->count].priv = priv;
+		chain->layers[chain->count].dev_ops = dev_ops;
+		chain->count++;
+		*plugin_priv_ret = priv;
+		*dev_ops_ret = dev_ops;
+	}
+
+	if (!chain->count) {
+		free(chain);
+		return;
+	}
+
+	*plugin_lib_ret = chain;
 }
 
 void v4l2_plugin_cleanup(void *plugin_lib, void *plugin_priv,
 			 const struct libv4l_dev_ops *dev_ops)
 {
-	if (plugin_lib) {
-		dev_ops->close(plugin_priv);
-		dlclose(plugin_lib);
-	}
+	struct v4l2_plugin_chain *chain = plugin_lib;
+	int i;
+
+	if (!chain)
+		return;
+
+	for (i = chain->count - 1; i >= 0; i--)
+		chain->layers[i].dev_ops->close(chain->layers[i].priv);
+
+	free(chain);
 }
@@ -0,0 +1,424 @@
+/*
+
+# Vectorized Bayer demosaic routines
+
+#             (C) 2026 the v4l-utils contributors
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+/* These do the inner (non border) part of a line of the bilinear demosaic
+   from bayer.c. They get passed a pointer to the top left of the 3x3
+   neighbourhood of a non green pixel and the number of non green / green
+   pixel pairs the C code would render from there, and return how many pairs
+   they have done in whole vector steps. The C code does the rest of the line
+   (and the borders); the results are bit for bit identical to it.
+
+   The Bayer order does not matter here, all 4 orders have the same
+   non green / green pairs in the middle of each line, only which of the 2 non
+   green colors we are on (blue_line) differs. */
+
+#include "libv4lconvert-priv.h"
+#include "simd-priv.h"
+
+#ifdef V4LCONVERT_SIMD_X86
+
+/* Components of the 8 pixel pairs at bayer, as 16 bit values */
+struct v4lconvert_bayer_pairs_sse2 {
+	__m128i diag;	/* Sum of the 4 diagonal neighbours of the non green */
+	__m128i cross;	/* Sum of the 4 direct neighbours of the non green */
+	__m128i center;	/* The non green pixel itself */
+	__m128i vert;	/* Sum of the vertical neighbours of the green */
+	__m128i horiz;	/* Sum of the horizontal neighbours of the green */
+	__m128i green;	/* The green pixel itself */
+};
+
+static inline void v4lconvert_bayer_load_pairs_sse2(const unsigned char *bayer,
+		int stride, struct v4lconvert_bayer_pairs_sse2 *p)
+{
+	const __m128i lo_bytes = _mm_set1_epi16(0x00ff);
+	__m128i top0 = _mm_loadu_si128((const __m128i *)bayer);
+	__m128i top2 = _mm_loadu_si128((const __m128i *)(bayer + 2));
+	__m128i mid0 = _mm_loadu_si128((const __m128i *)(bayer + stride));
+	__m128i mid2 = _mm_loadu_si128((const __m128i *)(bayer + stride + 2));
+	__m128i bot0 = _mm_loadu_si128((const __m128i *)(bayer + 2 * stride));
+	__m128i bot2 = _mm_loadu_si128((const __m128i *)(bayer + 2 * stride + 2));
+	__m128i top2_even = _mm_and_si128(top2, lo_bytes);
+	__m128i bot2_even = _mm_and_si128(bot2, lo_bytes);
+	__m128i mid0_odd = _mm_srli_epi16(mid0, 8);
+	__m128i mid2_odd = _mm_srli_epi16(mid2, 8);
+
+	p->diag = _mm_add_epi16(
+		_mm_add_epi16(_mm_and_si128(top0, lo_bytes), top2_even),
+		_mm_add_epi16(_mm_and_si128(bot0, lo_bytes), bot2_even));
+	p->cross = _mm_add_epi16(
+		_mm_add_epi16(_mm_srli_epi16(top0, 8), _mm_srli_epi16(bot0, 8)),
+		_mm_add_epi16(_mm_and_si128(mid0, lo_bytes),
+			      _mm_and_si128(mid2, lo_bytes)));
+	p->center = mid0_odd;
+	p->vert = _mm_add_epi16(top2_even, bot2_even);
+	p->horiz = _mm_add_epi16(mid0_odd, mid2_odd);
+	p->green = _mm_and_si128(mid2, lo_bytes);
+}
+
+/* Interleave 8 non green and 8 green 8 bit results (in 16 bit lanes) */
+static inline __m128i v4lconvert_bayer_interleave_sse2(__m128i a, __m128i b)
+{
+	return _mm_or_si128(a, _mm_slli_epi16(b, 8));
+}
+
+static int v4lconvert_bayer_row_to_rgb24_sse2(const unsigned char *bayer,
+		unsigned char *bgr, int pairs, int stride, int blue_line)
+{
+	const __m128i two = _mm_set1_epi16(2);
+	const __m128i one = _mm_set1_epi16(1);
+	struct v4lconvert_bayer_pairs_sse2 p;
+	__m128i c0, c1, c2;
+	int i;
+
+	for (i = 0; i + 8 <= pairs; i += 8) {
+		v4lconvert_bayer_load_pairs_sse2(bayer, stride, &p);
+
+		c0 = v4lconvert_bayer_interleave_sse2(
+			_mm_srli_epi16(_mm_add_epi16(p.diag, two), 2),
+			_mm_srli_epi16(_mm_add_epi16(p.vert, one), 1));
+		c1 = v4lconvert_bayer_interleave_sse2(
+			_mm_srli_epi16(_mm_add_epi16(p.cross, two), 2),
+			p.green);
+		c2 = v4lconvert_bayer_interleave_sse2(p.center,
+			_mm_srli_epi16(_mm_add_epi16(p.horiz, one), 1));
+
+		if (blue_line)
+			v4lconvert_store_rgb24_sse2(bgr, c0, c1, c2);
+		else
+			v4lconvert_store_rgb24_sse2(bgr, c2, c1, c0);
+		bayer += 16;
+		bgr += 48;
+	}
+
+	return i;
+}
+
+/* (c0 * k0 + c1 * k1 + c2 * k2 + 524288) >> 15 for 8 16 bit lanes */
+static inline __m128i v4lconvert_bayer_y_sse2(__m128i c0, __m128i c1,
+		__m128i c2, short k0, short k1, short k2)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i offset = _mm_set1_epi32(524288);
+	const __m128i k01 = _mm_setr_epi16(k0, k1, k0, k1, k0, k1, k0, k1);
+	const __m128i k2x = _mm_setr_epi16(k2, 0, k2, 0, k2, 0, k2, 0);
+	__m128i lo, hi;
+
+	lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(c0, c1), k01),
+			   _mm_madd_epi16(_mm_unpacklo_epi16(c2, zero), k2x));
+	hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(c0, c1), k01),
+			   _mm_madd_epi16(_mm_unpackhi_epi16(c2, zero), k2x));
+	lo = _mm_srai_epi32(_mm_add_epi32(lo, offset), 15);
+	hi = _mm_srai_epi32(_mm_add_epi32(hi, offset), 15);
+
+	return _mm_packs_epi32(lo, hi);
+}
+
+static int v4lconvert_bayer_row_to_y_sse2(const unsigned char *bayer,
+		unsigned char *ydst, int pairs, int stride, int blue_line)
+{
+	struct v4lconvert_bayer_pairs_sse2 p;
+	__m128i a, b;
+	int i;
+
+	for (i = 0; i + 8 <= pairs; i += 8) {
+		v4lconvert_bayer_load_pairs_sse2(bayer, stride, &p);
+
+		if (blue_line) {
+			a = v4lconvert_bayer_y_sse2(p.center, p.cross, p.diag,
+						    8453, 4148, 806);
+			b = v4lconvert_bayer_y_sse2(p.horiz, p.green, p.vert,
+						    4226, 16594, 1611);
+		} else {
+			a = v4lconvert_bayer_y_sse2(p.diag, p.cross, p.center,
+						    2113, 4148, 3223);
+			b = v4lconvert_bayer_y_sse2(p.vert, p.green, p.horiz,
+						    4226, 16594, 1611);
+		}
+		_mm_storeu_si128((__m128i *)ydst,
+				 v4lconvert_bayer_interleave_sse2(a, b));
+		bayer += 16;
+		ydst += 16;
+	}
+
+	return i;
+}
+
+/* 16 bit little endian raw bayer pixels to 8 bit, saturating */
+static int v4lconvert_bayer16_row_to_bayer8_sse2(const unsigned char *src,
+		unsigned char *dest, int width, int shift)
+{
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+
+		_mm_storeu_si128((__m128i *)dest, _mm_packus_epi16(
+			_mm_srl_epi16(a, count), _mm_srl_epi16(b, count)));
+		src += 32;
+		dest += 16;
+	}
+
+	return x;
+}
+
+/* MIPI packed 10 bit, take the first 4 bytes of each 5 byte group. SSE2 has
+   no byte shuffle, this needs SSSE3. */
+__attribute__((target("ssse3")))
+static int v4lconvert_bayer10p_row_to_bayer8_ssse3(const unsigned char *src,
+		unsigned char *dest, int width)
+{
+	/* Groups 0 - 2 are in the first 16 bytes, group 3 is at 11 - 14 in
+	   the 16 bytes starting at src + 4 */
+	const __m128i shuf_a = _mm_setr_epi8(0, 1, 2, 3, 5, 6, 7, 8,
+					     10, 11, 12, 13, -1, -1, -1, -1);
+	const __m128i shuf_b = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+					     -1, -1, -1, -1, 11, 12, 13, 14);
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 4));
+
+		_mm_storeu_si128((__m128i *)dest, _mm_or_si128(
+			_mm_shuffle_epi8(a, shuf_a), _mm_shuffle_epi8(b, shuf_b)));
+		src += 20;
+		dest += 16;
+	}
+
+	return x;
+}
+
+#endif /* V4LCONVERT_SIMD_X86 */
+
+#ifdef V4LCONVERT_SIMD_NEON
+
+/* Components of the 8 pixel pairs at bayer, see the SSE2 version */
+struct v4lconvert_bayer_pairs_neon {
+	uint16x8_t diag;
+	uint16x8_t cross;
+	uint8x8_t center;
+	uint16x8_t vert;
+	uint16x8_t horiz;
+	uint8x8_t green;
+};
+
+static inline void v4lconvert_bayer_load_pairs_neon(const unsigned char *bayer,
+		int stride, struct v4lconvert_bayer_pairs_neon *p)
+{
+	/* even bytes in val[0], odd bytes in val[1] */
+	uint8x8x2_t top0 = vld2_u8(bayer);
+	uint8x8x2_t top2 = vld2_u8(bayer + 2);
+	uint8x8x2_t mid0 = vld2_u8(bayer + stride);
+	uint8x8x2_t mid2 = vld2_u8(bayer + stride + 2);
+	uint8x8x2_t bot0 = vld2_u8(bayer + 2 * stride);
+	uint8x8x2_t bot2 = vld2_u8(bayer + 2 * stride + 2);
+
+	p->vert = vaddl_u8(top2.val[0], bot2.val[0]);
+	p->diag = vaddq_u16(vaddl_u8(top0.val[0], bot0.val[0]), p->vert);
+	p->cross = vaddq_u16(vaddl_u8(top0.val[1], bot0.val[1]),
+			     vaddl_u8(mid0.val[0], mid2.val[0]));
+	p->center = mid0.val[1];
+	p->horiz = vaddl_u8(mid0.val[1], mid2.val[1]);
+	p->green = mid2.val[0];
+}
+
+static int v4lconvert_bayer_row_to_rgb24_neon(const unsigned char *bayer,
+		unsigned char *bgr, int pairs, int stride, int blue_line)
+{
+	struct v4lconvert_bayer_pairs_neon p;
+	uint8x8x2_t c0, c1, c2;
+	uint8x16x3_t out;
+	int i;
+
+	for (i = 0; i + 8 <= pairs; i += 8) {
+		v4lconvert_bayer_load_pairs_neon(bayer, stride, &p);
+
+		c0 = vzip_u8(vrshrn_n_u16(p.diag, 2), vrshrn_n_u16(p.vert, 1));
+		c1 = vzip_u8(vrshrn_n_u16(p.cross, 2), p.green);
+		c2 = vzip_u8(p.center, vrshrn_n_u16(p.horiz, 1));
+
+		out.val[1] = vcombine_u8(c1.val[0], c1.val[1]);
+		if (blue_line) {
+			out.val[0] = vcombine_u8(c0.val[0], c0.val[1]);
+			out.val[2] = vcombine_u8(c2.val[0], c2.val[1]);
+		} else {
+			out.val[0] = vcombine_u8(c2.val[0], c2.val[1]);
+			out.val[2] = vcombine_u8(c0.val[0], c0.val[1]);
+		}
+		vst3q_u8(bgr, out);
+		bayer += 16;
+		bgr += 48;
+	}
+
+	return i;
+}
+
+/* (c0 * k0 + c1 * k1 + c2 * k2 + 524288) >> 15 for 8 pixels */
+static inline uint8x8_t v4lconvert_bayer_y_neon(uint16x8_t c0, uint16x8_t c1,
+		uint16x8_t c2, uint16_t k0, uint16_t k1, uint16_t k2)
+{
+	const uint32x4_t offset = vdupq_n_u32(524288);
+	uint32x4_t lo, hi;
+
+	lo = vmlal_n_u16(offset, vget_low_u16(c0), k0);
+	lo = vmlal_n_u16(lo, vget_low_u16(c1), k1);
+	lo = vmlal_n_u16(lo, vget_low_u16(c2), k2);
+	hi = vmlal_n_u16(offset, vget_high_u16(c0), k0);
+	hi = vmlal_n_u16(hi, vget_high_u16(c1), k1);
+	hi = vmlal_n_u16(hi, vget_high_u16(c2), k2);
+
+	return vmovn_u16(vcombine_u16(vshrn_n_u32(lo, 15),
+				      vshrn_n_u32(hi, 15)));
+}
+
+static int v4lconvert_bayer_row_to_y_neon(const unsigned char *bayer,
+		unsigned char *ydst, int pairs, int stride, int blue_line)
+{
+	struct v4lconvert_bayer_pairs_neon p;
+	uint16x8_t center, green;
+	uint8x8x2_t y;
+	int i;
+
+	for (i = 0; i + 8 <= pairs; i += 8) {
+		v4lconvert_bayer_load_pairs_neon(bayer, stride, &p);
+		center = vmovl_u8(p.center);
+		green = vmovl_u8(p.green);
+
+		if (blue_line)
+			y = vzip_u8(
+				v4lconvert_bayer_y_neon(center, p.cross, p.diag,
+							8453, 4148, 806),
+				v4lconvert_bayer_y_neon(p.horiz, green, p.vert,
+							4226, 16594, 1611));
+		else
+			y = vzip_u8(
+				v4lconvert_bayer_y_neon(p.diag, p.cross, center,
+							2113, 4148, 3223),
+				v4lconvert_bayer_y_neon(p.vert, green, p.horiz,
+							4226, 16594, 1611));
+		vst1q_u8(ydst, vcombine_u8(y.val[0], y.val[1]));
+		bayer += 16;
+		ydst += 16;
+	}
+
+	return i;
+}
+
+static int v4lconvert_bayer16_row_to_bayer8_neon(const unsigned char *src,
+		unsigned char *dest, int width, int shift)
+{
+	const int16x8_t count = vdupq_n_s16(-shift);
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		uint16x8_t a = vreinterpretq_u16_u8(vld1q_u8(src));
+		uint16x8_t b = vreinterpretq_u16_u8(vld1q_u8(src + 16));
+
+		vst1q_u8(dest, vcombine_u8(vqmovn_u16(vshlq_u16(a, count)),
+					   vqmovn_u16(vshlq_u16(b, count))));
+		src += 32;
+		dest += 16;
+	}
+
+	return x;
+}
+
+#ifdef __aarch64__
+static int v4lconvert_bayer10p_row_to_bayer8_neon(const unsigned char *src,
+		unsigned char *dest, int width)
+{
+	static const uint8_t idx_a[16] = { 0, 1, 2, 3, 5, 6, 7, 8,
+					   10, 11, 12, 13, 255, 255, 255, 255 };
+	static const uint8_t idx_b[16] = { 255, 255, 255, 255, 255, 255, 255, 255,
+					   255, 255, 255, 255, 11, 12, 13, 14 };
+	const uint8x16_t shuf_a = vld1q_u8(idx_a);
+	const uint8x16_t shuf_b = vld1q_u8(idx_b);
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		vst1q_u8(dest, vorrq_u8(vqtbl1q_u8(vld1q_u8(src), shuf_a),
+					vqtbl1q_u8(vld1q_u8(src + 4), shuf_b)));
+		src += 20;
+		dest += 16;
+	}
+
+	return x;
+}
+#endif
+
+#endif /* V4LCONVERT_SIMD_NEON */
+
+int v4lconvert_bayer_row_to_rgb24_simd(const unsigned char *bayer,
+		unsigned char *bgr, int pairs, int stride, int blue_line)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	return v4lconvert_bayer_row_to_rgb24_sse2(bayer, bgr, pairs, stride,
+						  blue_line);
+#elif defined(V4LCONVERT_SIMD_NEON)
+	return v4lconvert_bayer_row_to_rgb24_neon(bayer, bgr, pairs, stride,
+						  blue_line);
+#else
+	return 0;
+#endif
+}
+
+int v4lconvert_bayer_row_to_y_simd(const unsigned char *bayer,
+		unsigned char *ydst, int pairs, int stride, int blue_line)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	return v4lconvert_bayer_row_to_y_sse2(bayer, ydst, pairs, stride,
+					      blue_line);
+#elif defined(V4LCONVERT_SIMD_NEON)
+	return v4lconvert_bayer_row_to_y_neon(bayer, ydst, pairs, stride,
+					      blue_line);
+#else
+	return 0;
+#endif
+}
+
+int v4lconvert_bayer16_row_to_bayer8_simd(const unsigned char *src,
+		unsigned char *dest, int width, int shift)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	return v4lconvert_bayer16_row_to_bayer8_sse2(src, dest, width, shift);
+#elif defined(V4LCONVERT_SIMD_NEON)
+	return v4lconvert_bayer16_row_to_bayer8_neon(src, dest, width, shift);
+#else
+	return 0;
+#endif
+}
+
+int v4lconvert_bayer10p_row_to_bayer8_simd(const unsigned char *src,
+		unsigned char *dest, int width)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	if (__builtin_cpu_supports("ssse3"))
+		return v4lconvert_bayer10p_row_to_bayer8_ssse3(src, dest, width);
+	return 0;
+#elif defined(V4LCONVERT_SIMD_NEON) && defined(__aarch64__)
+	return v4lconvert_bayer10p_row_to_bayer8_neon(src, dest, width);
+#else
+	return 0;
+#endif
+}
@@ -165,16 +165,35 @@ static void v4lconvert_border_bayer_line_to_bgr24(
 /* From libdc1394, which on turn was based on OpenCV's Bayer decoding */
 static void bayer_to_rgbbgr24(const unsigned char *bayer,
 		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt,
-		int start_with_green, int blue_line)
+		int start_with_green, int blue_line, int start, int end)
 {
-	/* render the first line */
-	v4lconvert_border_bayer_line_to_bgr24(bayer, bayer + stride, bgr, width,
-			start_with_green, blue_line);
-	bgr += width * 3;
-
-	/* reduce height by 2 because of the special case top/bottom line */
-	for (height -= 2; height; height--) {
-		int t0, t1;
+	int last_line = 0;
+
+	bgr += start * width * 3;
+
+	if (start == 0) {
+		/* render the first line */
+		v4lconvert_border_bayer_line_to_bgr24(bayer, bayer + stride, bgr, width,
+				start_with_green, blue_line);
+		bgr += width * 3;
+		start = 1;
+	}
+
+	/* the special case bottom line gets rendered after the loop */
+	if (end == height) {
+		last_line = 1;
+		end--;
+	}
+
+	/* line y gets interpolated from bayer lines y - 1, y and y + 1 */
+	bayer += (start - 1) * stride;
+	if (!(start & 1)) {
+		blue_line = !blue_line;
+		start_with_green = !start_with_green;
+	}
+
+	for (height = end - start; height > 0; height--) {
+		int t0, t1, n;
 		/* (width - 2) because of the border */
 		const unsigned char *bayer_end = bayer + (width - 2);
 
@@ -219,6 +238,11 @@ static void bayer_to_rgbbgr24(const unsigned char *bayer,
 			}
 		}
 
+		n = v4lconvert_bayer_row_to_rgb24_simd(bayer, bgr,
+				(bayer_end - bayer) / 2, stride, blue_line);
+		bayer += 2 * n;
+		bgr += 6 * n;
+
 		if (blue_line) {
 			for (; bayer <= bayer_end - 2; bayer += 2) {
 				t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
@@ -306,28 +330,161 @@ static void bayer_to_rgbbgr24(const unsigned char *bayer,
 	}
 
 	/* render the last line */
-	v4lconvert_border_bayer_line_to_bgr24(bayer + stride, bayer, bgr, width,
-			!start_with_green, !blue_line);
+	if (last_line)
+		v4lconvert_border_bayer_line_to_bgr24(bayer + stride, bayer, bgr, width,
+				!start_with_green, !blue_line);
 }
 
-void v4lconvert_bayer_to_rgb24(const unsigned char *bayer,
-		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
+/* Demosaic lines start - end of the frame, this allows splitting up a frame
+   in bands which can be demosaiced independently */
+void v4lconvert_bayer_rows_to_rgb24(const unsigned char *bayer,
+		unsigned char *bgr, int width, int height, const unsigned int stride,
+		unsigned int pixfmt, int start, int end)
 {
 	bayer_to_rgbbgr24(bayer, bgr, width, height, stride, pixfmt,
 			pixfmt == V4L2_PIX_FMT_SGBRG8		/* start with green */
 			|| pixfmt == V4L2_PIX_FMT_SGRBG8,
 			pixfmt != V4L2_PIX_FMT_SBGGR8		/* blue line */
-			&& pixfmt != V4L2_PIX_FMT_SGBRG8);
+			&& pixfmt != V4L2_PIX_FMT_SGBRG8, start, end);
 }
 
-void v4lconvert_bayer_to_bgr24(const unsigned char *bayer,
-		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
+void v4lconvert_bayer_rows_to_bgr24(const unsigned char *bayer,
+		unsigned char *bgr, int width, int height, const unsigned int stride,
+		unsigned int pixfmt, int start, int end)
 {
 	bayer_to_rgbbgr24(bayer, bgr, width, height, stride, pixfmt,
 			pixfmt == V4L2_PIX_FMT_SGBRG8		/* start with green */
 			|| pixfmt == V4L2_PIX_FMT_SGRBG8,
 			pixfmt == V4L2_PIX_FMT_SBGGR8		/* blue line */
-			|| pixfmt == V4L2_PIX_FMT_SGBRG8);
+			|| pixfmt == V4L2_PIX_FMT_SGBRG8, start, end);
+}
+
+void v4lconvert_bayer_to_rgb24(const unsigned char *bayer,
+		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
+{
+	v4lconvert_bayer_rows_to_rgb24(bayer, bgr, width, height, stride, pixfmt,
+			0, height);
+}
+
+void v4lconvert_bayer_to_bgr24(const unsigned char *bayer,
+		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
+{
+	v4lconvert_bayer_rows_to_bgr24(bayer, bgr, width, height, stride, pixfmt,
+			0, height);
+}
+
+#define CLIP(color) (unsigned char)(((color) > 0xFF) ? 0xff : (((color) < 0) ? 0 : (color)))
+
+/* Gradient corrected bilinear interpolation, from "High-quality linear
+   interpolation for demosaicing of Bayer-patterned color images" by Malvar,
+   He and Cutler. This corrects the bilinear estimate of the missing colors
+   with the gradient (laplacian) of the color known at the pixel, which gives
+   much less color fringing along edges. It needs a 5x5 neighbourhood, so the
+   2 pixel border around the frame is left to the regular bilinear code. */
+static void bayer_to_rgbbgr24_edge_aware(const unsigned char *bayer,
+		unsigned char *bgr, int width, int height, const unsigned int stride,
+		unsigned int pixfmt, int rgb)
+{
+	/* signed, so that we can index backwards with it */
+	const int s = stride;
+	int x, y, red_x, red_y, t0, t1, t2;
+
+	/* Do the whole frame bilinear first, this takes care of the border */
+	if (rgb)
+		v4lconvert_bayer_to_rgb24(bayer, bgr, width, height, stride, pixfmt);
+	else
+		v4lconvert_bayer_to_bgr24(bayer, bgr, width, height, stride, pixfmt);
+
+	/* Position of the red pixel in the 2x2 Bayer pattern */
+	switch (pixfmt) {
+	case V4L2_PIX_FMT_SBGGR8:
+		red_x = 1;
+		red_y = 1;
+		break;
+	case V4L2_PIX_FMT_SGBRG8:
+		red_x = 0;
+		red_y = 1;
+		break;
+	case V4L2_PIX_FMT_SGRBG8:
+		red_x = 1;
+		red_y = 0;
+		break;
+	default: /* V4L2_PIX_FMT_SRGGB8 */
+		red_x = 0;
+		red_y = 0;
+	}
+
+	for (y = 2; y < height - 2; y++) {
+		const unsigned char *p = bayer + y * s + 2;
+		unsigned char *d = bgr + (y * width + 2) * 3;
+		int red_row = (y & 1) == red_y;
+
+		for (x = 2; x < width - 2; x++, p++, d += 3) {
+			int red_col = (x & 1) == red_x;
+			int r, g, b;
+			/* Sums of the 4 direct / diagonal neighbours and of the
+			   4 pixels 2 away horizontally and vertically */
+			int cross = p[-1] + p[1] + p[-s] + p[s];
+			int diag = p[-s - 1] + p[-s + 1] +
+				   p[s - 1] + p[s + 1];
+			int horiz2 = p[-2] + p[2];
+			int vert2 = p[-2 * s] + p[2 * s];
+
+			if (red_row == red_col) {
+				/* Red or blue pixel */
+				t0 = p[0];
+				t1 = (8 * p[0] + 4 * cross -
+				      2 * (horiz2 + vert2) + 8) >> 4;
+				t2 = (12 * p[0] + 4 * diag -
+				      3 * (horiz2 + vert2) + 8) >> 4;
+				if (red_row) {
+					r = t0;
+					b = t2;
+				} else {
+					r = t2;
+					b = t0;
+				}
+				g = t1;
+			} else {
+				/* Green pixel, t0 is the color horizontally next
+				   to it, t1 the one vertically next to it */
+				t0 = (10 * p[0] + 8 * (p[-1] + p[1]) - 2 * horiz2 -
+				      2 * diag + vert2 + 8) >> 4;
+				t1 = (10 * p[0] + 8 * (p[-s] + p[s]) -
+				      2 * vert2 - 2 * diag + horiz2 + 8) >> 4;
+				if (red_row) {
+					r = t0;
+					b = t1;
+				} else {
+					r = t1;
+					b = t0;
+				}
+				g = p[0];
+			}
+
+			if (rgb) {
+				d[0] = CLIP(r);
+				d[1] = CLIP(g);
+				d[2] = CLIP(b);
+			} else {
+				d[0] = CLIP(b);
+				d[1] = CLIP(g);
+				d[2] = CLIP(r);
+			}
+		}
+	}
+}
+
+void v4lconvert_bayer_edge_aware_to_rgb24(const unsigned char *bayer,
+		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
+{
+	bayer_to_rgbbgr24_edge_aware(bayer, bgr, width, height, stride, pixfmt, 1);
+}
+
+void v4lconvert_bayer_edge_aware_to_bgr24(const unsigned char *bayer,
+		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
+{
+	bayer_to_rgbbgr24_edge_aware(bayer, bgr, width, height, stride, pixfmt, 0);
 }
 
 static void v4lconvert_border_bayer_line_to_y(
@@ -429,11 +586,15 @@ static void v4lconvert_border_bayer_line_to_y(
 	}
 }
 
-void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
-		int width, int height, const unsigned int stride, unsigned int src_pixfmt, int yvu)
+/* Convert lines start - end of the frame, start must be even and so must end
+   unless it is the height of the frame */
+void v4lconvert_bayer_rows_to_yuv420(const unsigned char *bayer,
+		unsigned char *yuv, int width, int height, const unsigned int stride,
+		unsigned int src_pixfmt, int yvu, int start, int end)
 {
-	int blue_line = 0, start_with_green = 0, x, y;
-	unsigned char *ydst = yuv;
+	int blue_line = 0, start_with_green = 0, last_line = 0, x, y;
+	const unsigned char *frame = bayer;
+	unsigned char *ydst = yuv + start * width;
 	unsigned char *udst, *vdst;
 
 	if (yvu) {
@@ -443,11 +604,14 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 		udst = yuv + width * height;
 		vdst = udst + width * height / 4;
 	}
+	udst += start / 2 * (width / 2);
+	vdst += start / 2 * (width / 2);
+	bayer += start * stride;
 
 	/* First calculate the u and v planes 2x2 pixels at a time */
 	switch (src_pixfmt) {
 	case V4L2_PIX_FMT_SBGGR8:
-		for (y = 0; y < height; y += 2) {
+		for (y = start; y < end; y += 2) {
 			for (x = 0; x < width; x += 2) {
 				int b, g, r;
 
@@ -464,7 +628,7 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 		break;
 
 	case V4L2_PIX_FMT_SRGGB8:
-		for (y = 0; y < height; y += 2) {
+		for (y = start; y < end; y += 2) {
 			for (x = 0; x < width; x += 2) {
 				int b, g, r;
 
@@ -480,7 +644,7 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 		break;
 
 	case V4L2_PIX_FMT_SGBRG8:
-		for (y = 0; y < height; y += 2) {
+		for (y = start; y < end; y += 2) {
 			for (x = 0; x < width; x += 2) {
 				int b, g, r;
 
@@ -498,7 +662,7 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 		break;
 
 	case V4L2_PIX_FMT_SGRBG8:
-		for (y = 0; y < height; y += 2) {
+		for (y = start; y < end; y += 2) {
 			for (x = 0; x < width; x += 2) {
 				int b, g, r;
 
@@ -516,16 +680,31 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 	}
 
 	/* Point bayer back to start of frame */
-	bayer -= stride * height;
+	bayer = frame;
+
+	if (start == 0) {
+		/* render the first line */
+		v4lconvert_border_bayer_line_to_y(bayer, bayer + stride, ydst, width,
+				start_with_green, blue_line);
+		ydst += width;
+		start = 1;
+	}
+
+	/* the bottom border line gets rendered after the loop */
+	if (end == height) {
+		last_line = 1;
+		end--;
+	}
 
-	/* render the first line */
-	v4lconvert_border_bayer_line_to_y(bayer, bayer + stride, ydst, width,
-			start_with_green, blue_line);
-	ydst += width;
+	/* line y gets interpolated from bayer lines y - 1, y and y + 1 */
+	bayer += (start - 1) * stride;
+	if (!(start & 1)) {
+		blue_line = !blue_line;
+		start_with_green = !start_with_green;
+	}
 
-	/* reduce height by 2 because of the border */
-	for (height -= 2; height; height--) {
-		int t0, t1;
+	for (height = end - start; height > 0; height--) {
+		int t0, t1, n;
 		/* (width - 2) because of the border */
 		const unsigned char *bayer_end = bayer + (width - 2);
 
@@ -561,6 +740,11 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 			}
 		}
 
+		n = v4lconvert_bayer_row_to_y_simd(bayer, ydst,
+				(bayer_end - bayer) / 2, stride, blue_line);
+		bayer += 2 * n;
+		ydst += 2 * n;
+
 		if (blue_line) {
 			for (; bayer <= bayer_end - 2; bayer += 2) {
 				t0 = bayer[0] + bayer[2] + bayer[stride * 2] + bayer[stride * 2 + 2];
@@ -628,6 +812,101 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 	}
 
 	/* render the last line */
-	v4lconvert_border_bayer_line_to_y(bayer + stride, bayer, ydst, width,
-			!start_with_green, !blue_line);
+	if (last_line)
+		v4lconvert_border_bayer_line_to_y(bayer + stride, bayer, ydst, width,
+				!start_with_green, !blue_line);
+}
+
+void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
+		int width, int height, const unsigned int stride, unsigned int src_pixfmt, int yvu)
+{
+	v4lconvert_bayer_rows_to_yuv420(bayer, yuv, width, height, stride,
+			src_pixfmt, yvu, 0, height);
+}
+
+/* High bit depth and MIPI CSI-2 packed (4 pixels in 5 bytes, the 8 most
+   significant bits of each pixel followed by a byte with the low bits) raw
+   bayer formats. The demosaic and the processing code work on 8 bit bayer,
+   so these get unpacked to the 8 most significant bits of each pixel. */
+static const struct {
+	unsigned int fmt;
+	unsigned int bayer8_fmt;
+	int shift;	/* for 16 bit little endian pixels, 0 for packed */
+} v4lconvert_raw_bayer_fmts[] = {
+	{ V4L2_PIX_FMT_SBGGR10,  V4L2_PIX_FMT_SBGGR8, 2 },
+	{ V4L2_PIX_FMT_SGBRG10,  V4L2_PIX_FMT_SGBRG8, 2 },
+	{ V4L2_PIX_FMT_SGRBG10,  V4L2_PIX_FMT_SGRBG8, 2 },
+	{ V4L2_PIX_FMT_SRGGB10,  V4L2_PIX_FMT_SRGGB8, 2 },
+	{ V4L2_PIX_FMT_SBGGR10P, V4L2_PIX_FMT_SBGGR8, 0 },
+	{ V4L2_PIX_FMT_SGBRG10P, V4L2_PIX_FMT_SGBRG8, 0 },
+	{ V4L2_PIX_FMT_SGRBG10P, V4L2_PIX_FMT_SGRBG8, 0 },
+	{ V4L2_PIX_FMT_SRGGB10P, V4L2_PIX_FMT_SRGGB8, 0 },
+	{ V4L2_PIX_FMT_SBGGR12,  V4L2_PIX_FMT_SBGGR8, 4 },
+	{ V4L2_PIX_FMT_SGBRG12,  V4L2_PIX_FMT_SGBRG8, 4 },
+	{ V4L2_PIX_FMT_SGRBG12,  V4L2_PIX_FMT_SGRBG8, 4 },
+	{ V4L2_PIX_FMT_SRGGB12,  V4L2_PIX_FMT_SRGGB8, 4 },
+	{ V4L2_PIX_FMT_SBGGR16,  V4L2_PIX_FMT_SBGGR8, 8 },
+	{ V4L2_PIX_FMT_SGBRG16,  V4L2_PIX_FMT_SGBRG8, 8 },
+	{ V4L2_PIX_FMT_SGRBG16,  V4L2_PIX_FMT_SGRBG8, 8 },
+	{ V4L2_PIX_FMT_SRGGB16,  V4L2_PIX_FMT_SRGGB8, 8 },
+};
+
+static int v4lconvert_raw_bayer_index(unsigned int raw_pix_fmt)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(v4lconvert_raw_bayer_fmts); i++)
+		if (v4lconvert_raw_bayer_fmts[i].fmt == raw_pix_fmt)
+			return i;
+
+	return 0;
+}
+
+/* The minimum bytesperline for width pixels */
+int v4lconvert_raw_bayer_stride(unsigned int raw_pix_fmt, int width)
+{
+	int i = v4lconvert_raw_bayer_index(raw_pix_fmt);
+
+	if (v4lconvert_raw_bayer_fmts[i].shift == 0)
+		return (width + 3) / 4 * 5;
+
+	return width * 2;
+}
+
+unsigned int v4lconvert_raw_bayer_to_bayer8_fmt(unsigned int raw_pix_fmt)
+{
+	int i = v4lconvert_raw_bayer_index(raw_pix_fmt);
+
+	return v4lconvert_raw_bayer_fmts[i].bayer8_fmt;
+}
+
+/* Unpack lines start - end of the frame, dest gets a stride of width */
+void v4lconvert_raw_bayer_rows_to_bayer8(const unsigned char *src,
+		unsigned char *dest, int width, int stride, unsigned int raw_pix_fmt,
+		int start, int end)
+{
+	int x, y, shift;
+
+	shift = v4lconvert_raw_bayer_fmts[v4lconvert_raw_bayer_index(raw_pix_fmt)].shift;
+	src += start * stride;
+	dest += start * width;
+
+	for (y = start; y < end; y++) {
+		if (shift) {
+			x = v4lconvert_bayer16_row_to_bayer8_simd(src, dest, width,
+								  shift);
+			for (; x < width; x++) {
+				int v = (src[2 * x] | (src[2 * x + 1] << 8)) >> shift;
+
+				/* Out of range values (for 10 and 12 bit) */
+				dest[x] = v > 255 ? 255 : v;
+			}
+		} else {
+			x = v4lconvert_bayer10p_row_to_bayer8_simd(src, dest, width);
+			for (; x < width; x++)
+				dest[x] = src[x / 4 * 5 + x % 4];
+		}
+		src += stride;
+		dest += width;
+	}
 }
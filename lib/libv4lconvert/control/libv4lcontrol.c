@@ -32,6 +32,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <pwd.h>
+#include <pthread.h>
 #include "libv4lcontrol.h"
 #include "libv4lcontrol-priv.h"
 #include "../libv4lsyscall-priv.h"
@@ -356,6 +357,55 @@ static void v4lcontrol_get_dmi_string(const char *sysfs_prefix, const char *stri
 	fclose(f);
 }
 
+struct v4lcontrol_dmi {
+	char system_vendor[512];
+	char system_name[512];
+	char system_version[512];
+	char board_vendor[512];
+	char board_name[512];
+	char board_version[512];
+};
+
+/* The DMI strings do not change while we are running, so they only get
+   read from sysfs once per process (per sysfs prefix) */
+static struct v4lcontrol_dmi v4lcontrol_dmi_cache;
+static char v4lcontrol_dmi_cache_prefix[256];
+static int v4lcontrol_dmi_cache_valid;
+static pthread_mutex_t v4lcontrol_dmi_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void v4lcontrol_get_dmi(const char *sysfs_prefix,
+		struct v4lcontrol_dmi *dmi)
+{
+	pthread_mutex_lock(&v4lcontrol_dmi_mutex);
+
+	if (!v4lcontrol_dmi_cache_valid ||
+			strcmp(v4lcontrol_dmi_cache_prefix, sysfs_prefix)) {
+		struct v4lcontrol_dmi *c = &v4lcontrol_dmi_cache;
+
+		v4lcontrol_get_dmi_string(sysfs_prefix, "sys_vendor",
+				c->system_vendor, sizeof(c->system_vendor));
+		v4lcontrol_get_dmi_string(sysfs_prefix, "product_name",
+				c->system_name, sizeof(c->system_name));
+		v4lcontrol_get_dmi_string(sysfs_prefix, "product_version",
+				c->system_version, sizeof(c->system_version));
+		v4lcontrol_get_dmi_string(sysfs_prefix, "board_vendor",
+				c->board_vendor, sizeof(c->board_vendor));
+		v4lcontrol_get_dmi_string(sysfs_prefix, "board_name",
+				c->board_name, sizeof(c->board_name));
+		v4lcontrol_get_dmi_string(sysfs_prefix, "board_version",
+				c->board_version, sizeof(c->board_version));
+
+		/* Prefixes which do not fit simply do not get cached */
+		v4lcontrol_dmi_cache_valid = strlen(sysfs_prefix) <
+					     sizeof(v4lcontrol_dmi_cache_prefix);
+		if (v4lcontrol_dmi_cache_valid)
+			strcpy(v4lcontrol_dmi_cache_prefix, sysfs_prefix);
+	}
+	*dmi = v4lcontrol_dmi_cache;
+
+	pthread_mutex_unlock(&v4lcontrol_dmi_mutex);
+}
+
 static int v4lcontrol_get_usb_info(struct v4lcontrol_data *data,
 		const char *sysfs_prefix,
 		unsigned short *vendor_id, unsigned short *product_id,
@@ -364,7 +414,7 @@ static int v4lcontrol_get_usb_info(struct v4lcontrol_data *data,
 	FILE *f;
 	int i, minor;
 	struct stat st;
-	char sysfs_name[512];
+	char sysfs_name[512], dev_path[480];
 	char c, *s, buf[32];
 
 	snprintf(sysfs_name, sizeof(sysfs_name),
@@ -377,27 +427,36 @@ static int v4lcontrol_get_usb_info(struct v4lcontrol_data *data,
 	if (fstat(data->fd, &st) || !S_ISCHR(st.st_mode))
 		return 0; /* Should never happen */
 
-	/* <Sigh> find ourselve in sysfs */
-	for (i = 0; i < 256; i++) {
-		snprintf(sysfs_name, sizeof(sysfs_name),
-			 "%s/sys/class/video4linux/video%d/dev", sysfs_prefix, i);
-		f = fopen(sysfs_name, "r");
-		if (!f)
-			continue;
-
-		s = fgets(buf, sizeof(buf), f);
-		fclose(f);
+	/* Find ourselve in sysfs, through the /sys/dev/char link if possible */
+	snprintf(dev_path, sizeof(dev_path), "%s/sys/dev/char/%u:%u",
+		 sysfs_prefix, (unsigned int)major(st.st_rdev),
+		 (unsigned int)minor(st.st_rdev));
+	if (access(dev_path, F_OK) != 0) {
+		/* <Sigh> no such link, search all video devices */
+		for (i = 0; i < 256; i++) {
+			snprintf(sysfs_name, sizeof(sysfs_name),
+				 "%s/sys/class/video4linux/video%d/dev", sysfs_prefix, i);
+			f = fopen(sysfs_name, "r");
+			if (!f)
+				continue;
+
+			s = fgets(buf, sizeof(buf), f);
+			fclose(f);
+
+			if (s && sscanf(buf, "%*d:%d%c", &minor, &c) == 2 &&
+			    c == '\n' && minor == minor(st.st_rdev))
+				break;
+		}
+		if (i == 256)
+			return 0; /* Not found, sysfs not mounted? */
 
-		if (s && sscanf(buf, "%*d:%d%c", &minor, &c) == 2 &&
-		    c == '\n' && minor == minor(st.st_rdev))
-			break;
+		snprintf(dev_path, sizeof(dev_path),
+			 "%s/sys/class/video4linux/video%d", sysfs_prefix, i);
 	}
-	if (i == 256)
-		return 0; /* Not found, sysfs not mounted? */
 
 	/* Get vendor and product ID */
 	snprintf(sysfs_name, sizeof(sysfs_name),
-		 "%s/sys/class/video4linux/video%d/device/modalias", sysfs_prefix, i);
+		 "%s/device/modalias", dev_path);
 	f = fopen(sysfs_name, "r");
 	if (f) {
 		s = fgets(buf, sizeof(buf), f);
@@ -408,7 +467,7 @@ static int v4lcontrol_get_usb_info(struct v4lcontrol_data *data,
 			return 0; /* Not an USB device */
 
 		snprintf(sysfs_name, sizeof(sysfs_name),
-			 "%s/sys/class/video4linux/video%d/device/../speed", sysfs_prefix, i);
+			 "%s/device/../speed", dev_path);
 	} else {
 		/* Try again assuming the device link points to the usb
 		   device instead of the usb interface (bug in older versions
@@ -416,7 +475,7 @@ static int v4lcontrol_get_usb_info(struct v4lcontrol_data *data,
 
 		/* Get vendor ID */
 		snprintf(sysfs_name, sizeof(sysfs_name),
-			 "%s/sys/class/video4linux/video%d/device/idVendor", sysfs_prefix, i);
+			 "%s/device/idVendor", dev_path);
 		f = fopen(sysfs_name, "r");
 		if (!f)
 			return 0; /* Not an USB device (or no sysfs) */
@@ -430,7 +489,7 @@ static int v4lcontrol_get_usb_info(struct v4lcontrol_data *data,
 
 		/* Get product ID */
 		snprintf(sysfs_name, sizeof(sysfs_name),
-			 "%s/sys/class/video4linux/video%d/device/idProduct", sysfs_prefix, i);
+			 "%s/device/idProduct", dev_path);
 		f = fopen(sysfs_name, "r");
 		if (!f)
 			return 0; /* Should never happen */
@@ -443,7 +502,7 @@ static int v4lcontrol_get_usb_info(struct v4lcontrol_data *data,
 			return 0; /* Should never happen */
 
 		snprintf(sysfs_name, sizeof(sysfs_name),
-			 "%s/sys/class/video4linux/video%d/device/speed", sysfs_prefix, i);
+			 "%s/device/speed", dev_path);
 	}
 
 	f = fopen(sysfs_name, "r");
@@ -509,62 +568,156 @@ static int find_usb_id(const struct v4lcontrol_usb_id *table_entries,
 	return 0;
 }
 
+/* Index of the v4lcontrol_flags table sorted by vendor id, product id and
+   table position, and the different product_mask-s used in the table,
+   built on first use */
+static unsigned short v4lcontrol_flags_index[ARRAY_SIZE(v4lcontrol_flags)];
+static unsigned short v4lcontrol_flags_masks[ARRAY_SIZE(v4lcontrol_flags)];
+static int v4lcontrol_flags_mask_count;
+static pthread_once_t v4lcontrol_flags_index_once = PTHREAD_ONCE_INIT;
+
+static int v4lcontrol_flags_index_cmp(const void *a, const void *b)
+{
+	const struct v4lcontrol_flags_info *fa =
+		&v4lcontrol_flags[*(const unsigned short *)a];
+	const struct v4lcontrol_flags_info *fb =
+		&v4lcontrol_flags[*(const unsigned short *)b];
+
+	if (fa->vendor_id != fb->vendor_id)
+		return fa->vendor_id - fb->vendor_id;
+	if (fa->product_id != fb->product_id)
+		return fa->product_id - fb->product_id;
+	return *(const unsigned short *)a - *(const unsigned short *)b;
+}
+
+static void v4lcontrol_build_flags_index(void)
+{
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(v4lcontrol_flags); i++) {
+		v4lcontrol_flags_index[i] = i;
+
+		for (j = 0; j < v4lcontrol_flags_mask_count; j++)
+			if (v4lcontrol_flags_masks[j] ==
+					v4lcontrol_flags[i].product_mask)
+				break;
+		if (j == v4lcontrol_flags_mask_count)
+			v4lcontrol_flags_masks[v4lcontrol_flags_mask_count++] =
+				v4lcontrol_flags[i].product_mask;
+	}
+
+	qsort(v4lcontrol_flags_index, ARRAY_SIZE(v4lcontrol_flags),
+	      sizeof(v4lcontrol_flags_index[0]), v4lcontrol_flags_index_cmp);
+}
+
+/* Returns the position in v4lcontrol_flags_index of the first entry with
+   vendor_id and product_id (or of the next higher entry) */
+static int v4lcontrol_flags_index_find(unsigned short vendor_id,
+		unsigned short product_id)
+{
+	int lo = 0, hi = ARRAY_SIZE(v4lcontrol_flags);
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		const struct v4lcontrol_flags_info *f =
+			&v4lcontrol_flags[v4lcontrol_flags_index[mid]];
+
+		if (f->vendor_id < vendor_id ||
+				(f->vendor_id == vendor_id && f->product_id < product_id))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static int v4lcontrol_flags_dmi_match(const struct v4lcontrol_flags_info *f,
+		const struct v4lcontrol_dmi *dmi)
+{
+	return (f->dmi_system_vendor == NULL ||
+		!strcmp(f->dmi_system_vendor, dmi->system_vendor)) &&
+	       (f->dmi_system_name == NULL ||
+		!strcmp(f->dmi_system_name, dmi->system_name)) &&
+	       (f->dmi_system_version == NULL ||
+		!strcmp(f->dmi_system_version, dmi->system_version)) &&
+
+	       (f->dmi_board_vendor == NULL ||
+		!strcmp(f->dmi_board_vendor, dmi->board_vendor)) &&
+	       (f->dmi_board_name == NULL ||
+		!strcmp(f->dmi_board_name, dmi->board_name)) &&
+	       (f->dmi_board_version == NULL ||
+		!strcmp(f->dmi_board_version, dmi->board_version));
+}
+
+static int v4lcontrol_flags_need_dmi(const struct v4lcontrol_flags_info *f)
+{
+	return f->dmi_system_vendor || f->dmi_system_name ||
+	       f->dmi_system_version || f->dmi_board_vendor ||
+	       f->dmi_board_name || f->dmi_board_version;
+}
+
 static void v4lcontrol_get_flags_from_db(struct v4lcontrol_data *data,
 		const char *sysfs_prefix,
 		unsigned short vendor_id, unsigned short product_id)
 {
-	char dmi_system_vendor[512], dmi_system_name[512], dmi_system_version[512];
-	char dmi_board_vendor[512], dmi_board_name[512], dmi_board_version[512];
-	int i;
-
-	/* Get DMI board and system strings */
-	v4lcontrol_get_dmi_string(sysfs_prefix, "sys_vendor", dmi_system_vendor,
-			sizeof(dmi_system_vendor));
-	v4lcontrol_get_dmi_string(sysfs_prefix, "product_name", dmi_system_name,
-			sizeof(dmi_system_name));
-	v4lcontrol_get_dmi_string(sysfs_prefix, "product_version", dmi_system_version,
-			sizeof(dmi_system_version));
-
-	v4lcontrol_get_dmi_string(sysfs_prefix, "board_vendor", dmi_board_vendor,
-			sizeof(dmi_board_vendor));
-	v4lcontrol_get_dmi_string(sysfs_prefix, "board_name", dmi_board_name,
-			sizeof(dmi_board_name));
-	v4lcontrol_get_dmi_string(sysfs_prefix, "board_version", dmi_board_version,
-			sizeof(dmi_board_version));
-
-	for (i = 0; i < ARRAY_SIZE(v4lcontrol_flags); i++)
-		if (v4lcontrol_flags[i].vendor_id == vendor_id &&
-				v4lcontrol_flags[i].product_id ==
-				(product_id & ~v4lcontrol_flags[i].product_mask) &&
-
-				(v4lcontrol_flags[i].dmi_system_vendor == NULL ||
-				 !strcmp(v4lcontrol_flags[i].dmi_system_vendor, dmi_system_vendor)) &&
-				(v4lcontrol_flags[i].dmi_system_name == NULL ||
-				 !strcmp(v4lcontrol_flags[i].dmi_system_name, dmi_system_name)) &&
-				(v4lcontrol_flags[i].dmi_system_version == NULL ||
-				 !strcmp(v4lcontrol_flags[i].dmi_system_version, dmi_system_version)) &&
-
-				(v4lcontrol_flags[i].dmi_board_vendor == NULL ||
-				 !strcmp(v4lcontrol_flags[i].dmi_board_vendor, dmi_board_vendor)) &&
-				(v4lcontrol_flags[i].dmi_board_name == NULL ||
-				 !strcmp(v4lcontrol_flags[i].dmi_board_name, dmi_board_name)) &&
-				(v4lcontrol_flags[i].dmi_board_version == NULL ||
-				 !strcmp(v4lcontrol_flags[i].dmi_board_version, dmi_board_version))) {
-			data->flags |= v4lcontrol_flags[i].flags;
-			data->flags_info = &v4lcontrol_flags[i];
-			/* Entries in the v4lcontrol_flags table override
-			   wildcard matches in the upside_down table. */
-			return;
+	const struct v4lcontrol_flags_info *f;
+	struct v4lcontrol_dmi dmi;
+	int i, j, k, mask, best = -1, got_dmi = 0;
+
+	pthread_once(&v4lcontrol_flags_index_once, v4lcontrol_build_flags_index);
+
+	/* The first matching entry in the table wins, look up the candidates
+	   for each product_mask used in the table, all entries for a single
+	   vendor_id / product_id pair are sorted by table position */
+	for (k = 0; k < v4lcontrol_flags_mask_count; k++) {
+		mask = v4lcontrol_flags_masks[k];
+		for (j = v4lcontrol_flags_index_find(vendor_id, product_id & ~mask);
+				j < ARRAY_SIZE(v4lcontrol_flags); j++) {
+			i = v4lcontrol_flags_index[j];
+			f = &v4lcontrol_flags[i];
+			if (f->vendor_id != vendor_id ||
+					f->product_id != (product_id & ~mask) ||
+					(best != -1 && i > best))
+				break;
+			if (f->product_mask != mask)
+				continue;
+
+			if (v4lcontrol_flags_need_dmi(f) && !got_dmi) {
+				v4lcontrol_get_dmi(sysfs_prefix, &dmi);
+				got_dmi = 1;
+			}
+			if (!v4lcontrol_flags_need_dmi(f) ||
+					v4lcontrol_flags_dmi_match(f, &dmi)) {
+				best = i;
+				break;
+			}
 		}
+	}
 
-	for (i = 0; i < ARRAY_SIZE(upside_down); i++)
-		if (find_dmi_string(upside_down[i].board_vendor, dmi_board_vendor) &&
-		    find_dmi_string(upside_down[i].board_name, dmi_board_name) &&
-		    find_usb_id(upside_down[i].camera_id, vendor_id, product_id)) {
+	if (best != -1) {
+		data->flags |= v4lcontrol_flags[best].flags;
+		data->flags_info = &v4lcontrol_flags[best];
+		/* Entries in the v4lcontrol_flags table override
+		   wildcard matches in the upside_down table. */
+		return;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(upside_down); i++) {
+		if (!find_usb_id(upside_down[i].camera_id, vendor_id, product_id))
+			continue;
+
+		if (!got_dmi) {
+			v4lcontrol_get_dmi(sysfs_prefix, &dmi);
+			got_dmi = 1;
+		}
+		if (find_dmi_string(upside_down[i].board_vendor, dmi.board_vendor) &&
+		    find_dmi_string(upside_down[i].board_name, dmi.board_name)) {
 			/* found entry */
 			data->flags |= V4LCONTROL_HFLIPPED | V4LCONTROL_VFLIPPED;
 			break;
 		}
+	}
 }
 
 struct v4lcontrol_data *v4lcontrol_create(int fd, void *dev_ops_priv,
@@ -31,6 +31,8 @@
 #define V4LCONTROL_WANTS_WB              0x08
 #define V4LCONTROL_WANTS_AUTOGAIN        0x10
 #define V4LCONTROL_FORCE_TINYJPEG        0x20
+#define V4LCONTROL_BAYER_EDGE_AWARE      0x40
+#define V4LCONTROL_FLOAT_IDCT            0x80
 
 /* Masks */
 #define V4LCONTROL_WANTS_WB_AUTOGAIN     (V4LCONTROL_WANTS_WB | V4LCONTROL_WANTS_AUTOGAIN)
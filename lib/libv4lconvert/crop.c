@@ -26,15 +26,17 @@
 
 static void v4lconvert_reduceandcrop_rgbbgr24(
 		unsigned char *src, unsigned char *dest,
-		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt)
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		int start, int end)
 {
 	int x, y;
 	int startx = src_fmt->fmt.pix.width / 2 - dest_fmt->fmt.pix.width;
 	int starty = src_fmt->fmt.pix.height / 2 - dest_fmt->fmt.pix.height;
 
-	src += starty * src_fmt->fmt.pix.bytesperline + 3 * startx;
+	src += (starty + 2 * start) * src_fmt->fmt.pix.bytesperline + 3 * startx;
+	dest += start * dest_fmt->fmt.pix.width * 3;
 
-	for (y = 0; y < dest_fmt->fmt.pix.height; y++) {
+	for (y = start; y < end; y++) {
 		unsigned char *mysrc = src;
 		for (x = 0; x < dest_fmt->fmt.pix.width; x++) {
 			*(dest++) = *(mysrc++);
@@ -47,15 +49,17 @@ static void v4lconvert_reduceandcrop_rgbbgr24(
 }
 
 static void v4lconvert_crop_rgbbgr24(unsigned char *src, unsigned char *dest,
-		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt)
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		int start, int end)
 {
 	int x;
 	int startx = (src_fmt->fmt.pix.width - dest_fmt->fmt.pix.width) / 2;
 	int starty = (src_fmt->fmt.pix.height - dest_fmt->fmt.pix.height) / 2;
 
-	src += starty * src_fmt->fmt.pix.bytesperline + 3 * startx;
+	src += (starty + start) * src_fmt->fmt.pix.bytesperline + 3 * startx;
+	dest += start * dest_fmt->fmt.pix.bytesperline;
 
-	for (x = 0; x < dest_fmt->fmt.pix.height; x++) {
+	for (x = start; x < end; x++) {
 		memcpy(dest, src, dest_fmt->fmt.pix.width * 3);
 		src += src_fmt->fmt.pix.bytesperline;
 		dest += dest_fmt->fmt.pix.bytesperline;
@@ -257,20 +261,47 @@ static void v4lconvert_add_border_yuv420(
 	}
 }
 
-void v4lconvert_crop(unsigned char *src, unsigned char *dest,
+struct v4lconvert_crop_job {
+	unsigned char *src;
+	unsigned char *dest;
+	const struct v4l2_format *src_fmt;
+	const struct v4l2_format *dest_fmt;
+	int reduce;
+};
+
+static void v4lconvert_crop_rgbbgr24_rows(void *arg, int band, int start,
+		int end)
+{
+	struct v4lconvert_crop_job *job = arg;
+
+	if (job->reduce)
+		v4lconvert_reduceandcrop_rgbbgr24(job->src, job->dest, job->src_fmt,
+						  job->dest_fmt, start, end);
+	else
+		v4lconvert_crop_rgbbgr24(job->src, job->dest, job->src_fmt,
+					 job->dest_fmt, start, end);
+}
+
+void v4lconvert_crop(struct v4lconvert_threads *threads,
+		unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt)
 {
+	struct v4lconvert_crop_job job = {
+		.src = src, .dest = dest, .src_fmt = src_fmt, .dest_fmt = dest_fmt,
+	};
+
 	switch (dest_fmt->fmt.pix.pixelformat) {
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
 		if (src_fmt->fmt.pix.width  <= dest_fmt->fmt.pix.width &&
-				src_fmt->fmt.pix.height <= dest_fmt->fmt.pix.height)
+				src_fmt->fmt.pix.height <= dest_fmt->fmt.pix.height) {
 			v4lconvert_add_border_rgbbgr24(src, dest, src_fmt, dest_fmt);
-		else if (src_fmt->fmt.pix.width  >= 2 * dest_fmt->fmt.pix.width &&
-				src_fmt->fmt.pix.height >= 2 * dest_fmt->fmt.pix.height)
-			v4lconvert_reduceandcrop_rgbbgr24(src, dest, src_fmt, dest_fmt);
-		else
-			v4lconvert_crop_rgbbgr24(src, dest, src_fmt, dest_fmt);
+			break;
+		}
+		job.reduce = src_fmt->fmt.pix.width  >= 2 * dest_fmt->fmt.pix.width &&
+			     src_fmt->fmt.pix.height >= 2 * dest_fmt->fmt.pix.height;
+		v4lconvert_threads_run(threads, v4lconvert_crop_rgbbgr24_rows, &job,
+				       dest_fmt->fmt.pix.height, 1);
 		break;
 
 	case V4L2_PIX_FMT_YUV420:
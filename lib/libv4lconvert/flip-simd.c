@@ -0,0 +1,262 @@
+/*
+
+# Vectorized flip / rotate routines
+
+#             (C) 2026 the v4l-utils contributors
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+/* These do the bulk of a line (or of a strip of 8 lines for rotate90) for
+   flip.c in whole vector steps and return how many pixels they have done,
+   the C code does the rest.
+
+   The reverse functions write the first pixels of dest from the last
+   pixels of the src line. The rotate90 function writes the first pixels of
+   8 dest lines, src points to the first of the 8 source columns these come
+   from, in the last source line. */
+
+#include "libv4lconvert-priv.h"
+#include "simd-priv.h"
+
+#ifdef V4LCONVERT_SIMD_X86
+
+static int v4lconvert_reverse_row_sse2(const unsigned char *src,
+		unsigned char *dest, int width)
+{
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i v = _mm_loadu_si128(
+				(const __m128i *)(src + width - 16 - x));
+
+		/* Reverse the dwords, then the words in each dword and last
+		   the bytes in each word */
+		v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		v = _mm_or_si128(_mm_srli_epi16(v, 8), _mm_slli_epi16(v, 8));
+		_mm_storeu_si128((__m128i *)(dest + x), v);
+	}
+
+	return x;
+}
+
+/* 5 pixels per step, SSE2 has no byte shuffle, this needs SSSE3. The load
+   starts 1 byte before the 5 pixels so that it does not read beyond the end
+   of the line, the store writes 1 byte beyond them, which the next step (or
+   the C code) overwrites. */
+__attribute__((target("ssse3")))
+static int v4lconvert_reverse_rgb24_row_ssse3(const unsigned char *src,
+		unsigned char *dest, int width)
+{
+	const __m128i shuf = _mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8,
+					   9, 4, 5, 6, 1, 2, 3, -1);
+	int x;
+
+	for (x = 0; x + 6 <= width; x += 5) {
+		__m128i v = _mm_loadu_si128(
+			(const __m128i *)(src + (width - 5 - x) * 3 - 1));
+
+		_mm_storeu_si128((__m128i *)(dest + x * 3),
+				 _mm_shuffle_epi8(v, shuf));
+	}
+
+	return x;
+}
+
+/* 8x8 blocks of bytes get transposed by interleaving the rows, first the
+   bytes, then pairs of bytes and last groups of 4 bytes */
+static int v4lconvert_rotate90_strip_sse2(const unsigned char *src,
+		int src_stride, unsigned char *dest, int dest_stride,
+		int destwidth)
+{
+	int x, j;
+
+	for (x = 0; x + 8 <= destwidth; x += 8) {
+		const unsigned char *s = src - x * src_stride;
+		__m128i a01, a23, a45, a67, b0, b1, b2, b3, c[4];
+
+		a01 = _mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)s),
+			_mm_loadl_epi64((const __m128i *)(s - src_stride)));
+		a23 = _mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)(s - 2 * src_stride)),
+			_mm_loadl_epi64((const __m128i *)(s - 3 * src_stride)));
+		a45 = _mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)(s - 4 * src_stride)),
+			_mm_loadl_epi64((const __m128i *)(s - 5 * src_stride)));
+		a67 = _mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)(s - 6 * src_stride)),
+			_mm_loadl_epi64((const __m128i *)(s - 7 * src_stride)));
+		b0 = _mm_unpacklo_epi16(a01, a23);
+		b1 = _mm_unpackhi_epi16(a01, a23);
+		b2 = _mm_unpacklo_epi16(a45, a67);
+		b3 = _mm_unpackhi_epi16(a45, a67);
+		c[0] = _mm_unpacklo_epi32(b0, b2);
+		c[1] = _mm_unpackhi_epi32(b0, b2);
+		c[2] = _mm_unpacklo_epi32(b1, b3);
+		c[3] = _mm_unpackhi_epi32(b1, b3);
+
+		for (j = 0; j < 4; j++) {
+			unsigned char *d = dest + 2 * j * dest_stride + x;
+
+			_mm_storel_epi64((__m128i *)d, c[j]);
+			_mm_storel_epi64((__m128i *)(d + dest_stride),
+					 _mm_srli_si128(c[j], 8));
+		}
+	}
+
+	return x;
+}
+
+#endif /* V4LCONVERT_SIMD_X86 */
+
+#ifdef V4LCONVERT_SIMD_NEON
+
+static inline uint8x16_t v4lconvert_reverse_neon(uint8x16_t v)
+{
+	v = vrev64q_u8(v);
+	return vcombine_u8(vget_high_u8(v), vget_low_u8(v));
+}
+
+static int v4lconvert_reverse_row_neon(const unsigned char *src,
+		unsigned char *dest, int width)
+{
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16)
+		vst1q_u8(dest + x, v4lconvert_reverse_neon(
+				vld1q_u8(src + width - 16 - x)));
+
+	return x;
+}
+
+static int v4lconvert_reverse_rgb24_row_neon(const unsigned char *src,
+		unsigned char *dest, int width)
+{
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		uint8x16x3_t v = vld3q_u8(src + (width - 16 - x) * 3);
+
+		v.val[0] = v4lconvert_reverse_neon(v.val[0]);
+		v.val[1] = v4lconvert_reverse_neon(v.val[1]);
+		v.val[2] = v4lconvert_reverse_neon(v.val[2]);
+		vst3q_u8(dest + x * 3, v);
+	}
+
+	return x;
+}
+
+static int v4lconvert_rotate90_strip_neon(const unsigned char *src,
+		int src_stride, unsigned char *dest, int dest_stride,
+		int destwidth)
+{
+	int x;
+
+	for (x = 0; x + 8 <= destwidth; x += 8) {
+		const unsigned char *s = src - x * src_stride;
+		uint8x8x2_t t01, t23, t45, t67;
+		uint16x4x2_t u02, u13, u46, u57;
+		uint32x2x2_t w04, w15, w26, w37;
+
+		t01 = vtrn_u8(vld1_u8(s), vld1_u8(s - src_stride));
+		t23 = vtrn_u8(vld1_u8(s - 2 * src_stride),
+			      vld1_u8(s - 3 * src_stride));
+		t45 = vtrn_u8(vld1_u8(s - 4 * src_stride),
+			      vld1_u8(s - 5 * src_stride));
+		t67 = vtrn_u8(vld1_u8(s - 6 * src_stride),
+			      vld1_u8(s - 7 * src_stride));
+		u02 = vtrn_u16(vreinterpret_u16_u8(t01.val[0]),
+			       vreinterpret_u16_u8(t23.val[0]));
+		u13 = vtrn_u16(vreinterpret_u16_u8(t01.val[1]),
+			       vreinterpret_u16_u8(t23.val[1]));
+		u46 = vtrn_u16(vreinterpret_u16_u8(t45.val[0]),
+			       vreinterpret_u16_u8(t67.val[0]));
+		u57 = vtrn_u16(vreinterpret_u16_u8(t45.val[1]),
+			       vreinterpret_u16_u8(t67.val[1]));
+		w04 = vtrn_u32(vreinterpret_u32_u16(u02.val[0]),
+			       vreinterpret_u32_u16(u46.val[0]));
+		w26 = vtrn_u32(vreinterpret_u32_u16(u02.val[1]),
+			       vreinterpret_u32_u16(u46.val[1]));
+		w15 = vtrn_u32(vreinterpret_u32_u16(u13.val[0]),
+			       vreinterpret_u32_u16(u57.val[0]));
+		w37 = vtrn_u32(vreinterpret_u32_u16(u13.val[1]),
+			       vreinterpret_u32_u16(u57.val[1]));
+
+		vst1_u8(dest + x, vreinterpret_u8_u32(w04.val[0]));
+		vst1_u8(dest + dest_stride + x,
+			vreinterpret_u8_u32(w15.val[0]));
+		vst1_u8(dest + 2 * dest_stride + x,
+			vreinterpret_u8_u32(w26.val[0]));
+		vst1_u8(dest + 3 * dest_stride + x,
+			vreinterpret_u8_u32(w37.val[0]));
+		vst1_u8(dest + 4 * dest_stride + x,
+			vreinterpret_u8_u32(w04.val[1]));
+		vst1_u8(dest + 5 * dest_stride + x,
+			vreinterpret_u8_u32(w15.val[1]));
+		vst1_u8(dest + 6 * dest_stride + x,
+			vreinterpret_u8_u32(w26.val[1]));
+		vst1_u8(dest + 7 * dest_stride + x,
+			vreinterpret_u8_u32(w37.val[1]));
+	}
+
+	return x;
+}
+
+#endif /* V4LCONVERT_SIMD_NEON */
+
+int v4lconvert_reverse_row_simd(const unsigned char *src,
+		unsigned char *dest, int width)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	return v4lconvert_reverse_row_sse2(src, dest, width);
+#elif defined(V4LCONVERT_SIMD_NEON)
+	return v4lconvert_reverse_row_neon(src, dest, width);
+#else
+	return 0;
+#endif
+}
+
+int v4lconvert_reverse_rgb24_row_simd(const unsigned char *src,
+		unsigned char *dest, int width)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	if (__builtin_cpu_supports("ssse3"))
+		return v4lconvert_reverse_rgb24_row_ssse3(src, dest, width);
+	return 0;
+#elif defined(V4LCONVERT_SIMD_NEON)
+	return v4lconvert_reverse_rgb24_row_neon(src, dest, width);
+#else
+	return 0;
+#endif
+}
+
+int v4lconvert_rotate90_strip_simd(const unsigned char *src,
+		int src_stride, unsigned char *dest, int dest_stride,
+		int destwidth)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	return v4lconvert_rotate90_strip_sse2(src, src_stride, dest,
+					      dest_stride, destwidth);
+#elif defined(V4LCONVERT_SIMD_NEON)
+	return v4lconvert_rotate90_strip_neon(src, src_stride, dest,
+					      dest_stride, destwidth);
+#else
+	return 0;
+#endif
+}
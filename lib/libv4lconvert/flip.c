@@ -23,184 +23,147 @@
 #include <string.h>
 #include "libv4lconvert-priv.h"
 
-static void v4lconvert_vflip_rgbbgr24(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt)
+/* dest[x] = src[width - 1 - x] */
+static void v4lconvert_reverse_row(const unsigned char *src,
+		unsigned char *dest, int width)
 {
-	int y;
-
-	src += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline;
-	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		src -= fmt->fmt.pix.bytesperline;
-		memcpy(dest, src, fmt->fmt.pix.width * 3);
-		dest += fmt->fmt.pix.width * 3;
-	}
-}
-
-static void v4lconvert_vflip_yuv420(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt)
-{
-	int y;
+	int x = v4lconvert_reverse_row_simd(src, dest, width);
 
-	/* First flip the Y plane */
-	src += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline;
-	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		src -= fmt->fmt.pix.bytesperline;
-		memcpy(dest, src, fmt->fmt.pix.width);
-		dest += fmt->fmt.pix.width;
-	}
-
-	/* Now flip the U plane */
-	src += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline * 5 / 4;
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src -= fmt->fmt.pix.bytesperline / 2;
-		memcpy(dest, src, fmt->fmt.pix.width / 2);
-		dest += fmt->fmt.pix.width / 2;
-	}
-
-	/* Last flip the V plane */
-	src += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline / 2;
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src -= fmt->fmt.pix.bytesperline / 2;
-		memcpy(dest, src, fmt->fmt.pix.width / 2);
-		dest += fmt->fmt.pix.width / 2;
-	}
+	for (; x < width; x++)
+		dest[x] = src[width - 1 - x];
 }
 
-static void v4lconvert_hflip_rgbbgr24(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt)
+static void v4lconvert_reverse_rgb24_row(const unsigned char *src,
+		unsigned char *dest, int width)
 {
-	int x, y;
+	int x = v4lconvert_reverse_rgb24_row_simd(src, dest, width);
 
-	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		src += fmt->fmt.pix.width * 3;
-		for (x = 0; x < fmt->fmt.pix.width; x++) {
-			src -= 3;
-			dest[0] = src[0];
-			dest[1] = src[1];
-			dest[2] = src[2];
-			dest += 3;
-		}
-		src += fmt->fmt.pix.bytesperline;
+	src += (width - x) * 3;
+	dest += x * 3;
+	for (; x < width; x++) {
+		src -= 3;
+		dest[0] = src[0];
+		dest[1] = src[1];
+		dest[2] = src[2];
+		dest += 3;
 	}
 }
 
-static void v4lconvert_hflip_yuv420(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt)
+/* Flip lines start to end of a plane of width x height pixels of bpp (1 or 3)
+   bytes, hflip + vflip is a 180 degree rotation */
+static void v4lconvert_flip_plane(const unsigned char *src,
+		unsigned char *dest, int width, int height, int stride, int bpp,
+		int hflip, int vflip, int start, int end)
 {
-	int x, y;
-
-	/* First flip the Y plane */
-	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		src += fmt->fmt.pix.width;
-		for (x = 0; x < fmt->fmt.pix.width; x++)
-			*dest++ = *--src;
-		src += fmt->fmt.pix.bytesperline;
-	}
-
-	/* Now flip the U plane */
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src += fmt->fmt.pix.width / 2;
-		for (x = 0; x < fmt->fmt.pix.width / 2; x++)
-			*dest++ = *--src;
-		src += fmt->fmt.pix.bytesperline / 2;
-	}
+	int y;
 
-	/* Last flip the V plane */
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src += fmt->fmt.pix.width / 2;
-		for (x = 0; x < fmt->fmt.pix.width / 2; x++)
-			*dest++ = *--src;
-		src += fmt->fmt.pix.bytesperline / 2;
+	for (y = start; y < end; y++) {
+		const unsigned char *s =
+			src + (vflip ? height - 1 - y : y) * stride;
+		unsigned char *d = dest + y * width * bpp;
+
+		if (!hflip)
+			memcpy(d, s, width * bpp);
+		else if (bpp == 3)
+			v4lconvert_reverse_rgb24_row(s, d, width);
+		else
+			v4lconvert_reverse_row(s, d, width);
 	}
 }
 
-static void v4lconvert_rotate180_rgbbgr24(const unsigned char *src,
-		unsigned char *dst, int width, int height)
+/* Rotate lines start to end of dest 90 degrees clockwise, dest line y is
+   source column y read from the bottom up. Going through the source column by
+   column touches a different cache line for every pixel, so this is done in
+   strips of 8 dest lines, which use the same source cache lines. start must
+   be a multiple of 8. */
+static void v4lconvert_rotate90_plane(const unsigned char *src,
+		unsigned char *dest, int destwidth, int destheight, int bpp,
+		int start, int end)
 {
-	int i;
-
-	src += 3 * width * height - 3;
-
-	for (i = 0; i < width * height; i++) {
-		dst[0] = src[0];
-		dst[1] = src[1];
-		dst[2] = src[2];
-		dst += 3;
-		src -= 3;
+	int srcwidth = destheight;
+	int srcheight = destwidth;
+	int x, y, j, first, lines;
+
+	for (y = start; y < end; y += lines) {
+		const unsigned char *s = src +
+					 ((srcheight - 1) * srcwidth + y) * bpp;
+
+		lines = end - y < 8 ? end - y : 8;
+		first = 0;
+		if (bpp == 1 && lines == 8)
+			first = v4lconvert_rotate90_strip_simd(s, srcwidth,
+					dest + y * destwidth, destwidth,
+					destwidth);
+
+		for (j = 0; j < lines; j++) {
+			const unsigned char *p = s +
+						 (j - first * srcwidth) * bpp;
+			unsigned char *d = dest +
+					   ((y + j) * destwidth + first) * bpp;
+
+			if (bpp == 3) {
+				for (x = first; x < destwidth; x++) {
+					d[0] = p[0];
+					d[1] = p[1];
+					d[2] = p[2];
+					d += 3;
+					p -= srcwidth * 3;
+				}
+			} else {
+				for (x = first; x < destwidth; x++) {
+					*d++ = *p;
+					p -= srcwidth;
+				}
+			}
+		}
 	}
 }
 
-static void v4lconvert_rotate180_yuv420(const unsigned char *src,
-		unsigned char *dst, int width, int height)
-{
-	int i;
-
-	/* First flip x and y of the Y plane */
-	src += width * height - 1;
-	for (i = 0; i < width * height; i++)
-		*dst++ = *src--;
-
-	/* Now flip the U plane */
-	src += width * height * 5 / 4;
-	for (i = 0; i < width * height / 4; i++)
-		*dst++ = *src--;
-
-	/* Last flip the V plane */
-	src += width * height / 2;
-	for (i = 0; i < width * height / 4; i++)
-		*dst++ = *src--;
-}
-
-static void v4lconvert_rotate90_rgbbgr24(const unsigned char *src,
-		unsigned char *dst, int destwidth, int destheight)
-{
-	int x, y;
-#define srcwidth destheight
-#define srcheight destwidth
-
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = ((srcheight - x - 1) * srcwidth + y) * 3;
-			*dst++ = src[offset++];
-			*dst++ = src[offset++];
-			*dst++ = src[offset];
-		}
-}
+struct v4lconvert_flip_job {
+	unsigned char *src;
+	unsigned char *dest;
+	struct v4l2_format *fmt;
+	int hflip;
+	int vflip;
+};
 
-static void v4lconvert_rotate90_yuv420(const unsigned char *src,
-		unsigned char *dst, int destwidth, int destheight)
+static void v4lconvert_rotate90_rows(void *arg, int band, int start, int end)
 {
-	int x, y;
+	struct v4lconvert_flip_job *job = arg;
+	int width = job->fmt->fmt.pix.width;
+	int height = job->fmt->fmt.pix.height;
 
-	/* Y-plane */
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = (srcheight - x - 1) * srcwidth + y;
-			*dst++ = src[offset];
-		}
-
-	/* U-plane */
-	src += srcwidth * srcheight;
-	destwidth /= 2;
-	destheight /= 2;
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = (srcheight - x - 1) * srcwidth + y;
-			*dst++ = src[offset];
-		}
-
-	/* V-plane */
-	src += srcwidth * srcheight;
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = (srcheight - x - 1) * srcwidth + y;
-			*dst++ = src[offset];
-		}
+	switch (job->fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		v4lconvert_rotate90_plane(job->src, job->dest, width, height, 3,
+					  start, end);
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		/* The bands are aligned to 16 lines, so that the chroma bands
+		   are aligned to 8 lines */
+		v4lconvert_rotate90_plane(job->src, job->dest, width, height, 1,
+					  start, end);
+		v4lconvert_rotate90_plane(job->src + width * height,
+					  job->dest + width * height,
+					  width / 2, height / 2, 1,
+					  start / 2, end / 2);
+		v4lconvert_rotate90_plane(job->src + width * height * 5 / 4,
+					  job->dest + width * height * 5 / 4,
+					  width / 2, height / 2, 1,
+					  start / 2, end / 2);
+		break;
+	}
 }
 
-void v4lconvert_rotate90(unsigned char *src, unsigned char *dest,
+void v4lconvert_rotate90(struct v4lconvert_threads *threads,
+		unsigned char *src, unsigned char *dest,
 		struct v4l2_format *fmt)
 {
+	struct v4lconvert_flip_job job = {
+		.src = src, .dest = dest, .fmt = fmt,
+	};
 	int tmp;
 
 	tmp = fmt->fmt.pix.width;
@@ -210,56 +173,75 @@ void v4lconvert_rotate90(unsigned char *src, unsigned char *dest,
 	switch (fmt->fmt.pix.pixelformat) {
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
-		v4lconvert_rotate90_rgbbgr24(src, dest, fmt->fmt.pix.width,
-				fmt->fmt.pix.height);
+		v4lconvert_threads_run(threads, v4lconvert_rotate90_rows, &job,
+				       fmt->fmt.pix.height, 8);
 		break;
 	case V4L2_PIX_FMT_YUV420:
 	case V4L2_PIX_FMT_YVU420:
-		v4lconvert_rotate90_yuv420(src, dest, fmt->fmt.pix.width,
-				fmt->fmt.pix.height);
+		v4lconvert_threads_run(threads, v4lconvert_rotate90_rows, &job,
+				       fmt->fmt.pix.height, 16);
 		break;
 	}
 	v4lconvert_fixup_fmt(fmt);
 }
 
-void v4lconvert_flip(unsigned char *src, unsigned char *dest,
+static void v4lconvert_flip_rows(void *arg, int band, int start, int end)
+{
+	struct v4lconvert_flip_job *job = arg;
+	const unsigned char *src = job->src;
+	unsigned char *dest = job->dest;
+	int width = job->fmt->fmt.pix.width;
+	int height = job->fmt->fmt.pix.height;
+	int stride = job->fmt->fmt.pix.bytesperline;
+
+	switch (job->fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		v4lconvert_flip_plane(src, dest, width, height, stride, 3,
+				      job->hflip, job->vflip, start, end);
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		/* The Y plane, followed by the 2 chroma planes, the bands are
+		   aligned to 2 lines, so that they map to whole chroma lines */
+		v4lconvert_flip_plane(src, dest, width, height, stride, 1,
+				      job->hflip, job->vflip, start, end);
+		src += height * stride;
+		dest += width * height;
+		v4lconvert_flip_plane(src, dest, width / 2, height / 2,
+				      stride / 2, 1, job->hflip, job->vflip,
+				      start / 2, end / 2);
+		src += height * stride / 4;
+		dest += width * height / 4;
+		v4lconvert_flip_plane(src, dest, width / 2, height / 2,
+				      stride / 2, 1, job->hflip, job->vflip,
+				      start / 2, end / 2);
+		break;
+	}
+}
+
+void v4lconvert_flip(struct v4lconvert_threads *threads,
+		unsigned char *src, unsigned char *dest,
 		struct v4l2_format *fmt, int hflip, int vflip)
 {
-	if (vflip && hflip) {
-		switch (fmt->fmt.pix.pixelformat) {
-		case V4L2_PIX_FMT_RGB24:
-		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_rotate180_rgbbgr24(src, dest, fmt->fmt.pix.width,
-					fmt->fmt.pix.height);
-			break;
-		case V4L2_PIX_FMT_YUV420:
-		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_rotate180_yuv420(src, dest, fmt->fmt.pix.width,
-					fmt->fmt.pix.height);
-			break;
-		}
-	} else if (hflip) {
-		switch (fmt->fmt.pix.pixelformat) {
-		case V4L2_PIX_FMT_RGB24:
-		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_hflip_rgbbgr24(src, dest, fmt);
-			break;
-		case V4L2_PIX_FMT_YUV420:
-		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_hflip_yuv420(src, dest, fmt);
-			break;
-		}
-	} else if (vflip) {
-		switch (fmt->fmt.pix.pixelformat) {
-		case V4L2_PIX_FMT_RGB24:
-		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_vflip_rgbbgr24(src, dest, fmt);
-			break;
-		case V4L2_PIX_FMT_YUV420:
-		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_vflip_yuv420(src, dest, fmt);
-			break;
-		}
+	struct v4lconvert_flip_job job = {
+		.src = src, .dest = dest, .fmt = fmt, .hflip = hflip,
+		.vflip = vflip,
+	};
+
+	switch (fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		if (hflip || vflip)
+			v4lconvert_threads_run(threads, v4lconvert_flip_rows,
+					       &job, fmt->fmt.pix.height, 1);
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		if (hflip || vflip)
+			v4lconvert_threads_run(threads, v4lconvert_flip_rows,
+					       &job, fmt->fmt.pix.height, 2);
+		break;
 	}
 
 	/* Our newly written data has no padding */
@@ -0,0 +1,307 @@
+/*
+
+# Single pass convert / process / flip / crop routines
+
+#             (C) 2026 the v4l-utils contributors
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <string.h>
+#include "libv4lconvert-priv.h"
+
+/* The regular v4lconvert_convert() path runs every step (convert_pixfmt ->
+   processing -> rotate -> flip -> crop) over a whole frame, writing each
+   intermediate result to its own scratch buffer. For the common case of a
+   packed source format converted to rgb / bgr, optionally with lookup table
+   processing, flipping and / or plain cropping, we instead produce the
+   destination one line at a time: convert only the needed part of the source
+   line into a single line buffer, apply the lookup tables to it (gathering the
+   statistics for the next lookup table update at the same time) and copy it
+   (mirrored if necessary) into place. When scaling, the converted lines are
+   fed straight into the scaler instead. */
+
+static int v4lconvert_fused_src_bpp(unsigned int pixelformat)
+{
+	switch (pixelformat) {
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+		return 2;
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		return 3;
+	case V4L2_PIX_FMT_RGB32:
+	case V4L2_PIX_FMT_BGR32:
+		return 4;
+	}
+	return 0;
+}
+
+int v4lconvert_fused_supported(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		int src_size, int rotate90)
+{
+	unsigned int src_width = src_fmt->fmt.pix.width;
+	unsigned int src_height = src_fmt->fmt.pix.height;
+	unsigned int dest_width = dest_fmt->fmt.pix.width;
+	unsigned int dest_height = dest_fmt->fmt.pix.height;
+	int bpp = v4lconvert_fused_src_bpp(src_fmt->fmt.pix.pixelformat);
+
+	if (rotate90 || !bpp)
+		return 0;
+
+	switch (dest_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		break;
+	default:
+		return 0;
+	}
+
+	/* Short frames go through the regular path, so that they get reported */
+	if (src_fmt->fmt.pix.bytesperline < src_width * bpp ||
+			src_size < src_fmt->fmt.pix.bytesperline * src_height)
+		return 0;
+
+	/* We only do scaling and plain (centered) cropping, not adding borders
+	   or the 2x reduce and crop */
+	if (src_width != dest_width || src_height != dest_height) {
+		if (!(data->flags & V4LCONVERT_SCALE)) {
+			if (src_width < dest_width || src_height < dest_height)
+				return 0;
+			if (src_width >= 2 * dest_width &&
+					src_height >= 2 * dest_height)
+				return 0;
+		}
+		if (dest_fmt->fmt.pix.bytesperline < dest_width * 3)
+			return 0;
+	}
+
+	return v4lprocessing_rows_supported(data->processing, bpp == 3 ?
+					    src_fmt->fmt.pix.pixelformat :
+					    dest_fmt->fmt.pix.pixelformat,
+					    src_width == dest_width &&
+					    src_height == dest_height);
+}
+
+/* Convert width pixels from a single line of src to rgb24 / bgr24, for the
+   packed yuv formats width must be even. rgb24 / bgr24 sources are copied
+   as is. */
+static void v4lconvert_fused_convert_line(const unsigned char *src,
+		unsigned char *dest, int width, unsigned int src_pix_fmt,
+		unsigned int dest_pix_fmt)
+{
+	int rgb = dest_pix_fmt == V4L2_PIX_FMT_RGB24;
+
+	switch (src_pix_fmt) {
+	case V4L2_PIX_FMT_YUYV:
+		if (rgb)
+			v4lconvert_yuyv_to_rgb24(src, dest, width, 1, width * 2);
+		else
+			v4lconvert_yuyv_to_bgr24(src, dest, width, 1, width * 2);
+		break;
+	case V4L2_PIX_FMT_YVYU:
+		if (rgb)
+			v4lconvert_yvyu_to_rgb24(src, dest, width, 1, width * 2);
+		else
+			v4lconvert_yvyu_to_bgr24(src, dest, width, 1, width * 2);
+		break;
+	case V4L2_PIX_FMT_UYVY:
+		if (rgb)
+			v4lconvert_uyvy_to_rgb24(src, dest, width, 1, width * 2);
+		else
+			v4lconvert_uyvy_to_bgr24(src, dest, width, 1, width * 2);
+		break;
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		/* Processing is done in the source component order, the
+		   caller swaps the components afterwards if necessary */
+		memcpy(dest, src, width * 3);
+		break;
+	case V4L2_PIX_FMT_RGB32:
+		v4lconvert_rgb32_to_rgb24(src, dest, width, 1, !rgb);
+		break;
+	case V4L2_PIX_FMT_BGR32:
+		v4lconvert_rgb32_to_rgb24(src, dest, width, 1, rgb);
+		break;
+	}
+}
+
+static void v4lconvert_fused_hflip_line(const unsigned char *src,
+		unsigned char *dest, int width)
+{
+	int x = v4lconvert_reverse_rgb24_row_simd(src, dest, width);
+
+	src += (width - x) * 3;
+	dest += x * 3;
+	for (; x < width; x++) {
+		src -= 3;
+		dest[0] = src[0];
+		dest[1] = src[1];
+		dest[2] = src[2];
+		dest += 3;
+	}
+}
+
+struct v4lconvert_fused_job {
+	struct v4lconvert_data *data;
+	const unsigned char *src;
+	unsigned char *dest;
+	unsigned char *lines;
+	unsigned int src_pix_fmt;
+	unsigned int dest_pix_fmt;
+	int src_width;
+	int src_height;
+	int src_stride;
+	int dest_stride;
+	int width;
+	int bpp;
+	int starty;
+	int first;
+	int x0;
+	int x1;
+	int hflip;
+	int vflip;
+};
+
+static void v4lconvert_fused_convert_rows(void *arg, int band, int start,
+		int end)
+{
+	struct v4lconvert_fused_job *job = arg;
+	unsigned char *line = job->lines + band * job->src_width * 3;
+	unsigned char *dest = job->dest + start * job->dest_stride;
+	int width = job->width;
+	int y;
+
+	for (y = start; y < end; y++) {
+		int src_y = job->vflip ? job->src_height - 1 - (job->starty + y) :
+					 job->starty + y;
+		unsigned char *pixels;
+
+		v4lconvert_fused_convert_line(job->src + src_y * job->src_stride +
+					      job->x0 * job->bpp,
+					      line + job->x0 * 3, job->x1 - job->x0,
+					      job->src_pix_fmt, job->dest_pix_fmt);
+
+		pixels = line + job->first * 3;
+		v4lprocessing_processing_row(job->data->processing, pixels, width,
+					     band, src_y, job->src_height);
+		if (job->bpp == 3 && job->src_pix_fmt != job->dest_pix_fmt)
+			v4lconvert_swap_rgb(pixels, pixels, width, 1);
+
+		if (job->hflip)
+			v4lconvert_fused_hflip_line(pixels, dest, width);
+		else
+			memcpy(dest, pixels, width * 3);
+		dest += job->dest_stride;
+	}
+}
+
+/* Source lines for scaling, these get converted and processed on demand. The
+   scaler may fetch a line more than once (from different bands), this is
+   fine as v4lprocessing_rows_supported() only lets us do the processing when
+   scaling if it is limited to applying the lookup tables. */
+static const unsigned char *v4lconvert_fused_scale_line(void *arg, int band,
+		int y)
+{
+	struct v4lconvert_fused_job *job = arg;
+	unsigned char *line = job->lines + band * job->src_width * 3;
+
+	v4lconvert_fused_convert_line(job->src + y * job->src_stride,
+				      line, job->x1, job->src_pix_fmt,
+				      job->dest_pix_fmt);
+	v4lprocessing_processing_row(job->data->processing, line,
+				     job->src_width, band, y, job->src_height);
+	if (job->bpp == 3 && job->src_pix_fmt != job->dest_pix_fmt)
+		v4lconvert_swap_rgb(line, line, job->src_width, 1);
+
+	return line;
+}
+
+int v4lconvert_fused_convert(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		const unsigned char *src, unsigned char *dest, int hflip, int vflip)
+{
+	struct v4lconvert_fused_job job = {
+		.data = data,
+		.src = src,
+		.dest = dest,
+		.src_pix_fmt = src_fmt->fmt.pix.pixelformat,
+		.dest_pix_fmt = dest_fmt->fmt.pix.pixelformat,
+		.src_width = src_fmt->fmt.pix.width,
+		.src_height = src_fmt->fmt.pix.height,
+		.src_stride = src_fmt->fmt.pix.bytesperline,
+		.width = dest_fmt->fmt.pix.width,
+		.bpp = v4lconvert_fused_src_bpp(src_fmt->fmt.pix.pixelformat),
+		.hflip = hflip,
+		.vflip = vflip,
+	};
+	int height = dest_fmt->fmt.pix.height;
+	int startx, res;
+
+	/* One line buffer per band */
+	job.lines = v4lconvert_alloc_buffer(job.src_width * 3 *
+					    v4lconvert_threads_count(data->threads),
+					    &data->fused_line_buf,
+					    &data->fused_line_buf_size);
+	if (!job.lines)
+		return v4lconvert_oom_error(data);
+
+	/* When scaling the scaler pulls in the source lines it needs, the
+	   whole line gets converted as the scaler may need all of it */
+	if ((data->flags & V4LCONVERT_SCALE) &&
+			(job.src_width != job.width || job.src_height != height)) {
+		job.x1 = job.bpp == 2 ? job.src_width & ~1 : job.src_width;
+		res = v4lconvert_scale_plane(data, v4lconvert_fused_scale_line,
+					     &job, job.src_width, job.src_height,
+					     dest, job.width, height,
+					     dest_fmt->fmt.pix.bytesperline, 3,
+					     hflip, vflip);
+		v4lprocessing_processing_rows_done(data->processing);
+		return res;
+	}
+
+	if (job.src_width != job.width || job.src_height != height) {
+		job.dest_stride = dest_fmt->fmt.pix.bytesperline;
+		startx = (job.src_width - job.width) / 2;
+		job.starty = (job.src_height - height) / 2;
+	} else {
+		job.dest_stride = job.width * 3;
+		startx = 0;
+		job.starty = 0;
+	}
+
+	/* Flipping is done before cropping, so with hflip the columns we need
+	   are mirrored around the center of the source line */
+	job.first = hflip ? job.src_width - startx - job.width : startx;
+	job.x0 = job.first;
+	job.x1 = job.first + job.width;
+	/* Packed yuv stores 2 pixels per macropixel, convert whole macropixels */
+	if (job.bpp == 2) {
+		job.x0 &= ~1;
+		job.x1 = (job.x1 + 1) & ~1;
+		if (job.x1 > job.src_width)
+			job.x1 = job.src_width & ~1;
+	}
+
+	v4lconvert_threads_run(data->threads, v4lconvert_fused_convert_rows, &job,
+			       height, 1);
+
+	v4lprocessing_processing_rows_done(data->processing);
+
+	return 0;
+}
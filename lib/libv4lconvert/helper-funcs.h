@@ -29,6 +29,18 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
+#include "helper-shm.h"
+#ifdef V4LCONVERT_HELPER_SHM
+#include <poll.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#endif
+
+/* Decompress src_size bytes from src to width x height yuv420 into dest,
+   returns 0 on success */
+typedef int (*v4lconvert_helper_decompress_fn)(unsigned char *src,
+  unsigned char *dest, int width, int height, int yvu, int src_size);
 
 static int v4lconvert_helper_write(int fd, const void *b, size_t count,
   char *progname)
@@ -77,3 +89,166 @@ static int v4lconvert_helper_read(int fd, void *b, size_t count,
 
   return 0;
 }
+
+/* Decompress a single frame into dest, which is dest_max bytes large,
+   returns the size of the decompressed frame or -1 on error */
+static int v4lconvert_helper_frame(v4lconvert_helper_decompress_fn decompress,
+  unsigned char *src, int src_size, unsigned char *dest, int dest_max,
+  int width, int height, int yvu, char *progname)
+{
+  int dest_size;
+
+  if (width <= 0 || width > SHRT_MAX || height <= 0 || height > SHRT_MAX) {
+    fprintf(stderr, "%s: error: width or height out of bounds\n", progname);
+    return -1;
+  }
+
+  dest_size = width * height * 3 / 2;
+  if (dest_size > dest_max) {
+    fprintf(stderr, "%s: error: dest_buf too small, need: %d\n", progname,
+	    dest_size);
+    return -1;
+  }
+
+  if (decompress(src, dest, width, height, yvu, src_size))
+    return -1;
+
+  return dest_size;
+}
+
+#ifdef V4LCONVERT_HELPER_SHM
+/* Wait for fd (an eventfd) to become readable and reset it, exits when
+   libv4lconvert has gone away (stdin got closed) */
+static int v4lconvert_helper_shm_wait(int fd, char *progname)
+{
+  struct pollfd pfd[2] = {
+    { .fd = fd, .events = POLLIN },
+    { .fd = STDIN_FILENO, .events = POLLIN },
+  };
+  uint64_t count;
+
+  while (1) {
+    if (poll(pfd, 2, -1) == -1) {
+      if (errno == EINTR)
+	continue;
+
+      fprintf(stderr, "%s: error polling: %s\n", progname, strerror(errno));
+      return -1;
+    }
+    if (pfd[1].revents) /* EOF or hangup, main program has quited */
+      exit(0);
+    if (pfd[0].revents)
+      return v4lconvert_helper_read(fd, &count, sizeof(count), progname);
+  }
+}
+
+static int v4lconvert_helper_shm_loop(char *argv[],
+  v4lconvert_helper_decompress_fn decompress)
+{
+  int shm_fd = atoi(argv[2]), request_fd = atoi(argv[3]);
+  int done_fd = atoi(argv[4]);
+  struct v4lconvert_helper_ring *ring;
+  struct v4lconvert_helper_slot *slot;
+  uint64_t one = 1;
+  size_t size;
+  unsigned int i;
+
+  ring = mmap(NULL, V4LCONVERT_HELPER_DATA_OFFSET, PROT_READ | PROT_WRITE,
+	      MAP_SHARED, shm_fd, 0);
+  if (ring == MAP_FAILED) {
+    fprintf(stderr, "%s: error mapping shm: %s\n", argv[0], strerror(errno));
+    return 1;
+  }
+  size = v4lconvert_helper_ring_size(ring->src_max, ring->dest_max);
+  munmap(ring, V4LCONVERT_HELPER_DATA_OFFSET);
+
+  ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+  if (ring == MAP_FAILED) {
+    fprintf(stderr, "%s: error mapping shm: %s\n", argv[0], strerror(errno));
+    return 1;
+  }
+  close(shm_fd);
+
+  while (1) {
+    if (v4lconvert_helper_shm_wait(request_fd, argv[0]))
+      return 1;
+
+    /* Handle all frames submitted so far */
+    while (ring->tail != ring->head) {
+      __sync_synchronize();
+      i = ring->tail % ring->slot_count;
+      slot = &ring->slot[i];
+      if (slot->src_size < 0 || slot->src_size > ring->src_max)
+	slot->dest_size = -1;
+      else
+	slot->dest_size = v4lconvert_helper_frame(decompress,
+			    v4lconvert_helper_slot_src(ring, i), slot->src_size,
+			    v4lconvert_helper_slot_dest(ring, i), ring->dest_max,
+			    slot->width, slot->height, slot->flags, argv[0]);
+      __sync_synchronize();
+      ring->tail++;
+    }
+
+    if (v4lconvert_helper_write(done_fd, &one, sizeof(one), argv[0]))
+      return 1;
+  }
+}
+#endif
+
+/* The helper main loop, src_max and dest_max are the maximum sizes of
+   compressed and decompressed frames when using the pipe protocol */
+static int v4lconvert_helper_main(int argc, char *argv[], int src_max,
+  int dest_max, v4lconvert_helper_decompress_fn decompress)
+{
+  int width, height, yvu, src_size, dest_size;
+  unsigned char *src_buf, *dest_buf;
+
+#ifdef V4LCONVERT_HELPER_SHM
+  if (argc == 5 && !strcmp(argv[1], "--shm"))
+    return v4lconvert_helper_shm_loop(argv, decompress);
+#endif
+
+  src_buf = malloc(src_max);
+  dest_buf = malloc(dest_max);
+  if (!src_buf || !dest_buf) {
+    fprintf(stderr, "%s: error: out of memory!\n", argv[0]);
+    return 2;
+  }
+
+  while (1) {
+    if (v4lconvert_helper_read(STDIN_FILENO, &width, sizeof(int), argv[0]))
+      return 1; /* Erm, no way to recover without loosing sync with libv4l */
+
+    if (v4lconvert_helper_read(STDIN_FILENO, &height, sizeof(int), argv[0]))
+      return 1; /* Erm, no way to recover without loosing sync with libv4l */
+
+    if (v4lconvert_helper_read(STDIN_FILENO, &yvu, sizeof(int), argv[0]))
+      return 1; /* Erm, no way to recover without loosing sync with libv4l */
+
+    if (v4lconvert_helper_read(STDIN_FILENO, &src_size, sizeof(int), argv[0]))
+      return 1; /* Erm, no way to recover without loosing sync with libv4l */
+
+    if (src_size < 0 || src_size > src_max) {
+      fprintf(stderr, "%s: error: src_buf too small, need: %d\n",
+	      argv[0], src_size);
+      return 2;
+    }
+
+    if (v4lconvert_helper_read(STDIN_FILENO, src_buf, src_size, argv[0]))
+      return 1; /* Erm, no way to recover without loosing sync with libv4l */
+
+    dest_size = v4lconvert_helper_frame(decompress, src_buf, src_size,
+					dest_buf, dest_max, width, height,
+					yvu, argv[0]);
+
+    if (v4lconvert_helper_write(STDOUT_FILENO, &dest_size, sizeof(int),
+				argv[0]))
+      return 1; /* Erm, no way to recover without loosing sync with libv4l */
+
+    if (dest_size == -1)
+      continue;
+
+    if (v4lconvert_helper_write(STDOUT_FILENO, dest_buf, dest_size, argv[0]))
+      return 1; /* Erm, no way to recover without loosing sync with libv4l */
+  }
+}
@@ -0,0 +1,85 @@
+/*
+#             (C) 2026 the v4l-utils contributors
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+#ifndef __LIBV4LCONVERT_HELPER_SHM_H
+#define __LIBV4LCONVERT_HELPER_SHM_H
+
+/* Shared memory transport between libv4lconvert and the decompression
+   helpers, used instead of pushing the frame data through the pipes.
+
+   libv4lconvert creates a shared memory object containing a
+   struct v4lconvert_helper_ring followed by slot_count slots of
+   src_max + dest_max bytes, and 2 eventfd-s, and starts the helper as:
+
+   helper --shm <shm fd> <request eventfd> <done eventfd>
+
+   To decompress a frame libv4lconvert fills in slot[head % slot_count] and
+   the first src_size bytes of the slot data, increments head and writes 1
+   to the request eventfd. The helper decompresses all slots between tail
+   and head, storing the result in the last dest_max bytes of the slot data
+   and the result size (-1 on error) in dest_size, increments tail for each
+   slot and then writes 1 to the done eventfd. Frames are always completed
+   in order. The pipes stay connected, but are only used to notice the
+   other side going away. */
+
+#ifdef __linux__
+#define V4LCONVERT_HELPER_SHM 1
+#endif
+
+#define V4LCONVERT_HELPER_SLOTS 4
+
+struct v4lconvert_helper_slot {
+	int width;
+	int height;
+	int flags;
+	int src_size;
+	int dest_size;
+};
+
+struct v4lconvert_helper_ring {
+	volatile unsigned int head; /* Frames submitted, written by libv4lconvert */
+	volatile unsigned int tail; /* Frames done, written by the helper */
+	int slot_count;
+	int src_max;
+	int dest_max;
+	struct v4lconvert_helper_slot slot[V4LCONVERT_HELPER_SLOTS];
+};
+
+/* Offset of the slot data from the start of the shared memory object */
+#define V4LCONVERT_HELPER_DATA_OFFSET 4096
+
+static inline unsigned char *v4lconvert_helper_slot_src(
+		struct v4lconvert_helper_ring *ring, unsigned int slot)
+{
+	return (unsigned char *)ring + V4LCONVERT_HELPER_DATA_OFFSET +
+		(size_t)slot * (ring->src_max + ring->dest_max);
+}
+
+static inline unsigned char *v4lconvert_helper_slot_dest(
+		struct v4lconvert_helper_ring *ring, unsigned int slot)
+{
+	return v4lconvert_helper_slot_src(ring, slot) + ring->src_max;
+}
+
+static inline size_t v4lconvert_helper_ring_size(int src_max, int dest_max)
+{
+	return V4LCONVERT_HELPER_DATA_OFFSET +
+		(size_t)V4LCONVERT_HELPER_SLOTS * (src_max + dest_max);
+}
+
+#endif
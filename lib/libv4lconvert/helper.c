@@ -18,12 +18,20 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
 #include <signal.h>
 #include <sys/wait.h>
 #include "libv4lconvert-priv.h"
+#include "helper-shm.h"
+#ifdef V4LCONVERT_HELPER_SHM
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#endif
 
 #define READ_END  0
 #define WRITE_END 1
@@ -46,11 +54,92 @@
    From the helper to libv4l the following is send:
    int			data length (-1 in case of a decompression error)
    unsigned char[]	data (not present when a decompression error happened)
+
+   Where possible the frames are not send through the pipes, but passed
+   through a ring of frame slots in shared memory instead, see helper-shm.h.
+   This saves copying the data into and out of the pipes on both sides and
+   a number of context switches per frame.
  */
 
+#ifdef V4LCONVERT_HELPER_SHM
+/* Create the shared memory frame ring and eventfd-s, returns the fd of the
+   shared memory object, or -1 on failure, in which case we fall back to
+   sending the frames through the pipes */
+static int v4lconvert_helper_shm_create(struct v4lconvert_data *data,
+		int src_max, int dest_max)
+{
+	struct v4lconvert_helper_ring *ring;
+	size_t size = v4lconvert_helper_ring_size(src_max, dest_max);
+	char name[64];
+	int fd;
+
+	snprintf(name, sizeof(name), "/libv4lconvert-%d-%lx", (int)getpid(),
+		 (unsigned long)data);
+	fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+	if (fd == -1)
+		return -1;
+	/* The helper inherits the fd, so the name is not needed anymore */
+	shm_unlink(name);
+
+	if (ftruncate(fd, size))
+		goto error_close;
+
+	ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ring == MAP_FAILED)
+		goto error_close;
+
+	data->decompress_request_fd = eventfd(0, EFD_CLOEXEC);
+	if (data->decompress_request_fd == -1)
+		goto error_unmap;
+
+	data->decompress_done_fd = eventfd(0, EFD_CLOEXEC);
+	if (data->decompress_done_fd == -1)
+		goto error_close_request_fd;
+
+	ring->head = 0;
+	ring->tail = 0;
+	ring->slot_count = V4LCONVERT_HELPER_SLOTS;
+	ring->src_max = src_max;
+	ring->dest_max = dest_max;
+	data->decompress_ring = ring;
+	data->decompress_ring_size = size;
+
+	return fd;
+
+error_close_request_fd:
+	close(data->decompress_request_fd);
+error_unmap:
+	munmap(ring, size);
+error_close:
+	close(fd);
+	return -1;
+}
+
+static void v4lconvert_helper_shm_destroy(struct v4lconvert_data *data)
+{
+	if (!data->decompress_ring)
+		return;
+
+	munmap(data->decompress_ring, data->decompress_ring_size);
+	close(data->decompress_request_fd);
+	close(data->decompress_done_fd);
+	data->decompress_ring = NULL;
+}
+
+/* Clear close-on-exec on fd and return it as a string in buf */
+static char *v4lconvert_helper_shm_fd_arg(int fd, char *buf)
+{
+	fcntl(fd, F_SETFD, 0);
+	sprintf(buf, "%d", fd);
+	return buf;
+}
+#endif
+
 static int v4lconvert_helper_start(struct v4lconvert_data *data,
-		const char *helper)
+		const char *helper, int src_max, int dest_max)
 {
+	int shm_fd = -1;
+
 	if (pipe(data->decompress_in_pipe)) {
 		V4LCONVERT_ERR("with helper pipe: %s\n", strerror(errno));
 		goto error;
@@ -61,6 +150,10 @@ static int v4lconvert_helper_start(struct v4lconvert_data *data,
 		goto error_close_in_pipe;
 	}
 
+#ifdef V4LCONVERT_HELPER_SHM
+	shm_fd = v4lconvert_helper_shm_create(data, src_max, dest_max);
+#endif
+
 	data->decompress_pid = fork();
 	if (data->decompress_pid == -1) {
 		V4LCONVERT_ERR("with helper fork: %s\n", strerror(errno));
@@ -85,7 +178,20 @@ static int v4lconvert_helper_start(struct v4lconvert_data *data,
 		}
 
 		/* And execute the helper */
-		execl(helper, helper, NULL);
+#ifdef V4LCONVERT_HELPER_SHM
+		if (shm_fd != -1) {
+			char arg[3][16];
+
+			execl(helper, helper, "--shm",
+			      v4lconvert_helper_shm_fd_arg(shm_fd, arg[0]),
+			      v4lconvert_helper_shm_fd_arg(
+					data->decompress_request_fd, arg[1]),
+			      v4lconvert_helper_shm_fd_arg(
+					data->decompress_done_fd, arg[2]),
+			      NULL);
+		} else
+#endif
+			execl(helper, helper, NULL);
 
 		/* We should never get here */
 		perror("libv4lconvert: error starting helper");
@@ -96,9 +202,18 @@ static int v4lconvert_helper_start(struct v4lconvert_data *data,
 		close(data->decompress_in_pipe[WRITE_END]);
 	}
 
+	if (shm_fd != -1)
+		close(shm_fd);
+
 	return 0;
 
 error_close_out_pipe:
+#ifdef V4LCONVERT_HELPER_SHM
+	if (shm_fd != -1) {
+		close(shm_fd);
+		v4lconvert_helper_shm_destroy(data);
+	}
+#endif
 	close(data->decompress_out_pipe[READ_END]);
 	close(data->decompress_out_pipe[WRITE_END]);
 error_close_in_pipe:
@@ -165,17 +280,122 @@ static int v4lconvert_helper_read(struct v4lconvert_data *data, void *b,
 	return 0;
 }
 
+#ifdef V4LCONVERT_HELPER_SHM
+/* Wait till the helper signals it has completed 1 or more frames */
+static int v4lconvert_helper_shm_wait(struct v4lconvert_data *data)
+{
+	struct pollfd pfd[2] = {
+		{ .fd = data->decompress_done_fd, .events = POLLIN },
+		{ .fd = data->decompress_in_pipe[READ_END], .events = POLLIN },
+	};
+	uint64_t count;
+
+	while (1) {
+		if (poll(pfd, 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+
+			V4LCONVERT_ERR("waiting for helper: %s\n", strerror(errno));
+			return -1;
+		}
+		/* The helper never writes to the pipe, so it has exited */
+		if (pfd[1].revents) {
+			V4LCONVERT_ERR("waiting for helper: unexpected EOF\n");
+			v4lconvert_helper_cleanup(data);
+			return -1;
+		}
+		if (pfd[0].revents)
+			break;
+	}
+
+	if (read(data->decompress_done_fd, &count, sizeof(count)) == -1 &&
+			errno != EINTR && errno != EAGAIN) {
+		V4LCONVERT_ERR("reading from helper: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+static int v4lconvert_helper_shm_decompress(struct v4lconvert_data *data,
+		const unsigned char *src, int src_size,
+		unsigned char *dest, int dest_size, int width, int height, int flags)
+{
+	struct v4lconvert_helper_ring *ring = data->decompress_ring;
+	unsigned int seq = ring->head;
+	unsigned int i = seq % ring->slot_count;
+	struct v4lconvert_helper_slot *slot = &ring->slot[i];
+	uint64_t one = 1;
+	int r;
+
+	/* We only have 1 frame in flight at a time, so the slot is free */
+	memcpy(v4lconvert_helper_slot_src(ring, i), src, src_size);
+	slot->width = width;
+	slot->height = height;
+	slot->flags = flags;
+	slot->src_size = src_size;
+	__sync_synchronize();
+	ring->head = seq + 1;
+
+	if (write(data->decompress_request_fd, &one, sizeof(one)) == -1) {
+		V4LCONVERT_ERR("writing to helper: %s\n", strerror(errno));
+		return -1;
+	}
+
+	while ((int)(ring->tail - (seq + 1)) < 0) {
+		if (v4lconvert_helper_shm_wait(data))
+			return -1;
+	}
+	__sync_synchronize();
+
+	r = slot->dest_size;
+	if (r < 0) {
+		V4LCONVERT_ERR("decompressing frame data\n");
+		return -1;
+	}
+
+	if (dest_size < r) {
+		V4LCONVERT_ERR("destination buffer to small\n");
+		return -1;
+	}
+
+	memcpy(dest, v4lconvert_helper_slot_dest(ring, i), r);
+	return 0;
+}
+#endif
+
 int v4lconvert_helper_decompress(struct v4lconvert_data *data,
 		const char *helper, const unsigned char *src, int src_size,
 		unsigned char *dest, int dest_size, int width, int height, int flags)
 {
-	int r;
+	int r, src_max, dest_max;
+
+	if (width <= 0 || width > SHRT_MAX || height <= 0 || height > SHRT_MAX) {
+		V4LCONVERT_ERR("decompressing frame data: invalid size\n");
+		return -1;
+	}
+	dest_max = width * height * 3 / 2;
+	/* Leave some room for compressed frames being larger then usual */
+	src_max = (src_size > dest_max ? src_size : dest_max) * 5 / 4;
+
+#ifdef V4LCONVERT_HELPER_SHM
+	/* Restart the helper with a larger frame ring if necessary */
+	if (data->decompress_ring && (src_size > data->decompress_ring->src_max ||
+			dest_max > data->decompress_ring->dest_max))
+		v4lconvert_helper_cleanup(data);
+#endif
 
 	if (data->decompress_pid == -1) {
-		if (v4lconvert_helper_start(data, helper))
+		if (v4lconvert_helper_start(data, helper, src_max, dest_max))
 			return -1;
 	}
 
+#ifdef V4LCONVERT_HELPER_SHM
+	if (data->decompress_ring)
+		return v4lconvert_helper_shm_decompress(data, src, src_size,
+				dest, dest_size, width, height, flags);
+#endif
+
 	if (v4lconvert_helper_write(data, &width, sizeof(int)))
 		return -1;
 
@@ -216,5 +436,8 @@ void v4lconvert_helper_cleanup(struct v4lconvert_data *data)
 		close(data->decompress_in_pipe[READ_END]);
 		waitpid(data->decompress_pid, &status, 0);
 		data->decompress_pid = -1;
+#ifdef V4LCONVERT_HELPER_SHM
+		v4lconvert_helper_shm_destroy(data);
+#endif
 	}
 }
@@ -39,8 +39,10 @@ int v4lconvert_decode_jpeg_tinyjpeg(struct v4lconvert_data *data,
 		if (!data->tinyjpeg)
 			return v4lconvert_oom_error(data);
 	}
-	flags |= TINYJPEG_FLAGS_MJPEG_TABLE;
+	if (data->control_flags & V4LCONTROL_FLOAT_IDCT)
+		flags |= TINYJPEG_FLAGS_FLOAT_IDCT;
 	tinyjpeg_set_flags(data->tinyjpeg, flags);
+	tinyjpeg_set_threads(data->tinyjpeg, data->threads);
 	if (tinyjpeg_parse_header(data->tinyjpeg, src, src_size)) {
 		V4LCONVERT_ERR("parsing JPEG header: %s",
 				tinyjpeg_get_errorstring(data->tinyjpeg));
@@ -234,15 +236,32 @@ static int decode_libjpeg_h_samp2(struct v4lconvert_data *data,
 	struct jpeg_decompress_struct *cinfo = &data->cinfo;
 	int y;
 	unsigned int width = cinfo->image_width;
+	unsigned char *uv_buf = NULL;
 	JSAMPROW y_rows[16], u_rows[8], v_rows[8];
 	JSAMPARRAY rows[3] = { y_rows, u_rows, v_rows };
 
+	/* With v_samp == 1 we get a row of u and v values for each line, but
+	   our output has v_samp == 2. Let libjpeg write the even rows straight
+	   into dest and throw away the odd rows */
+	if (v_samp == 1) {
+		uv_buf = v4lconvert_alloc_buffer(width,
+						 &data->convert_pixfmt_buf,
+						 &data->convert_pixfmt_buf_size);
+		if (!uv_buf)
+			return v4lconvert_oom_error(data);
+	}
+
 	while (cinfo->output_scanline < cinfo->image_height) {
 		for (y = 0; y < 8 * v_samp; y++) {
 			y_rows[y] = ydest;
 			ydest += width;
 		}
 		for (y = 0; y < 8; y++) {
+			if (v_samp == 1 && (y & 1)) {
+				u_rows[y] = uv_buf;
+				v_rows[y] = uv_buf + width / 2;
+				continue;
+			}
 			u_rows[y] = udest;
 			v_rows[y] = vdest;
 			udest += width / 2;
@@ -251,14 +270,6 @@ static int decode_libjpeg_h_samp2(struct v4lconvert_data *data,
 		y = jpeg_read_raw_data(cinfo, rows, 8 * v_samp);
 		if (y != 8 * v_samp)
 			return -1;
-
-		/* For v_samp == 1 were going to get another set of uv values,
-		   but we need only 1 set since our output has v_samp == 2, so
-		   rewind u and vdest and overwrite the previous set. */
-		if (cinfo->output_scanline % 16) {
-			udest -= width * 8 / 2;
-			vdest -= width * 8 / 2;
-		}
 	}
 	return 0;
 }
@@ -305,19 +316,28 @@ int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 
 	if (dest_pix_fmt == V4L2_PIX_FMT_RGB24 ||
 	    dest_pix_fmt == V4L2_PIX_FMT_BGR24) {
-		JSAMPROW row_pointer[1];
+		JSAMPROW row_pointers[16];
+		unsigned int y, rows;
 
 #ifdef JCS_EXTENSIONS
 		if (dest_pix_fmt == V4L2_PIX_FMT_BGR24)
 			data->cinfo.out_color_space = JCS_EXT_BGR;
 #endif
-		row_pointer[0] = dest;
 		jpeg_start_decompress(&data->cinfo);
 		/* Make libjpeg errors report that we've got some data */
 		data->jerr_errno = EPIPE;
+		/* Hand libjpeg the dest rows for (at least) a whole iMCU row at a
+		   time, so that it writes all of them directly, rather then
+		   going through its spare row buffer when it upsamples 2 rows
+		   at once */
 		while (data->cinfo.output_scanline < height) {
-			jpeg_read_scanlines(&data->cinfo, row_pointer, 1);
-			row_pointer[0] += 3 * width;
+			rows = height - data->cinfo.output_scanline;
+			if (rows > ARRAY_SIZE(row_pointers))
+				rows = ARRAY_SIZE(row_pointers);
+			for (y = 0; y < rows; y++)
+				row_pointers[y] = dest + 3 * width *
+					(data->cinfo.output_scanline + y);
+			jpeg_read_scanlines(&data->cinfo, row_pointers, rows);
 		}
 		jpeg_finish_decompress(&data->cinfo);
 #ifndef JCS_EXTENSIONS
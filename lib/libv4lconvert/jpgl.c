@@ -467,14 +467,14 @@ int v4lconvert_decode_jpgl(const unsigned char *inp, int src_size,
 	case V4L2_PIX_FMT_YUV420:
 		mainbuffer = NULL;
 		Yline_baseptr = fb;
-		Uline_baseptr = fb + img_width * img_height * 16;
-		Vline_baseptr = Uline_baseptr + img_width * img_height * 4;
+		Uline_baseptr = fb + img_width * img_height * 4;
+		Vline_baseptr = Uline_baseptr + img_width * img_height;
 		break;
 	case V4L2_PIX_FMT_YVU420:
 		mainbuffer = NULL;
 		Yline_baseptr = fb;
-		Vline_baseptr = fb + img_width * img_height * 16;
-		Uline_baseptr = Vline_baseptr + img_width * img_height * 4;
+		Vline_baseptr = fb + img_width * img_height * 4;
+		Uline_baseptr = Vline_baseptr + img_width * img_height;
 		break;
 	}
 
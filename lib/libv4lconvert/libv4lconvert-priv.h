@@ -37,6 +37,21 @@
 
 #define V4LCONVERT_ERROR_MSG_SIZE 256
 #define V4LCONVERT_MAX_FRAMESIZES 256
+#define V4LCONVERT_MAX_THREADS 64
+
+/* MIPI CSI-2 packed 10 bit bayer and the 16 bit bayer orders other than
+   BGGR, these are not in our copy of videodev2.h yet */
+#ifndef V4L2_PIX_FMT_SBGGR10P
+#define V4L2_PIX_FMT_SBGGR10P v4l2_fourcc('p', 'B', 'A', 'A')
+#define V4L2_PIX_FMT_SGBRG10P v4l2_fourcc('p', 'G', 'A', 'A')
+#define V4L2_PIX_FMT_SGRBG10P v4l2_fourcc('p', 'g', 'A', 'A')
+#define V4L2_PIX_FMT_SRGGB10P v4l2_fourcc('p', 'R', 'A', 'A')
+#endif
+#ifndef V4L2_PIX_FMT_SGBRG16
+#define V4L2_PIX_FMT_SGBRG16 v4l2_fourcc('G', 'B', '1', '6')
+#define V4L2_PIX_FMT_SGRBG16 v4l2_fourcc('G', 'R', '1', '6')
+#define V4L2_PIX_FMT_SRGGB16 v4l2_fourcc('R', 'G', '1', '6')
+#endif
 
 #define V4LCONVERT_ERR(...) \
 	snprintf(data->error_msg, V4LCONVERT_ERROR_MSG_SIZE, \
@@ -45,6 +60,9 @@
 /* Card flags */
 #define V4LCONVERT_IS_UVC                0x01
 #define V4LCONVERT_USE_TINYJPEG          0x02
+#define V4LCONVERT_SCALE                 0x04
+
+struct v4lconvert_helper_ring;
 
 struct v4lconvert_data {
 	int fd;
@@ -70,13 +88,20 @@ struct v4lconvert_data {
 	int rotate90_buf_size;
 	int flip_buf_size;
 	int convert_pixfmt_buf_size;
+	int fused_line_buf_size;
+	int scale_buf_size;
+	int demosaic_buf_size;
 	unsigned char *convert1_buf;
 	unsigned char *convert2_buf;
 	unsigned char *rotate90_buf;
 	unsigned char *flip_buf;
 	unsigned char *convert_pixfmt_buf;
+	unsigned char *fused_line_buf;
+	unsigned char *scale_buf;
+	unsigned char *demosaic_buf;
 	struct v4lcontrol_data *control;
 	struct v4lprocessing_data *processing;
+	struct v4lconvert_threads *threads;
 	void *dev_ops_priv;
 	const struct libv4l_dev_ops *dev_ops;
 
@@ -84,12 +109,35 @@ struct v4lconvert_data {
 	pid_t decompress_pid;
 	int decompress_in_pipe[2];  /* Data from helper to us */
 	int decompress_out_pipe[2]; /* Data from us to helper */
+	/* Shared memory frame ring, if NULL the frames go through the pipes */
+	struct v4lconvert_helper_ring *decompress_ring;
+	size_t decompress_ring_size;
+	int decompress_request_fd;  /* eventfd us -> helper */
+	int decompress_done_fd;     /* eventfd helper -> us */
 
 	/* For mr97310a decoder */
 	int frames_dropped;
 
 	/* For cpia1 decoder */
 	unsigned char *previous_frame;
+
+	/* The planes of the frame v4lconvert_convert_mplane is converting */
+	const struct v4l2_pix_format_mplane *mplane_fmt;
+	unsigned char **mplane_src;
+	const int *mplane_size;
+};
+
+/* The planes of a planar or semi planar (NV12 and friends) yuv frame, these
+   are read in place, so they need not be contiguous. For semi planar frames
+   u and v point to their first value in the interleaved chroma plane. */
+struct v4lconvert_yuv_planes {
+	const unsigned char *y;
+	const unsigned char *u;
+	const unsigned char *v;
+	int y_stride;
+	int uv_stride;
+	int uv_step;		/* 1 for planar, 2 for semi planar */
+	int v_shift;		/* 1 for 4:2:0, 0 for 4:2:2 */
 };
 
 struct v4lconvert_pixfmt {
@@ -107,15 +155,82 @@ unsigned char *v4lconvert_alloc_buffer(int needed,
 
 int v4lconvert_oom_error(struct v4lconvert_data *data);
 
+/* Called for each band of lines start - end of a frame by the worker
+   threads, band is the index of the band */
+typedef void (*v4lconvert_rows_func)(void *arg, int band, int start, int end);
+
+struct v4lconvert_threads *v4lconvert_threads_create(int count);
+
+void v4lconvert_threads_destroy(struct v4lconvert_threads *threads);
+
+int v4lconvert_threads_count(struct v4lconvert_threads *threads);
+
+/* Call func for each band of rows lines, band starts are a multiple of align */
+void v4lconvert_threads_run(struct v4lconvert_threads *threads,
+		v4lconvert_rows_func func, void *arg, int rows, int align);
+
+/* Split rows into (at most) bands equally sized bands regardless of their
+   size, each band gets run from its own thread, so the bands run
+   concurrently */
+void v4lconvert_threads_run_bands(struct v4lconvert_threads *threads,
+		v4lconvert_rows_func func, void *arg, int rows, int bands);
+
+void v4lconvert_threads_yuv420_to_rgb24(struct v4lconvert_threads *threads,
+		const unsigned char *src, unsigned char *dest, int width, int height,
+		int yvu, int bgr);
+
+void v4lconvert_threads_yuv_planes_to_rgb24(struct v4lconvert_threads *threads,
+		const struct v4lconvert_yuv_planes *planes, unsigned char *dest,
+		int width, int height, int bgr);
+
+void v4lconvert_threads_rgb24_to_yuv420(struct v4lconvert_threads *threads,
+		const unsigned char *src, unsigned char *dest,
+		const struct v4l2_format *src_fmt, int bgr, int yvu, int bpp);
+
+void v4lconvert_threads_packed_yuv_to_rgb24(struct v4lconvert_threads *threads,
+		const unsigned char *src, unsigned char *dest, int width, int height,
+		int stride, unsigned int src_pix_fmt, int bgr);
+
+void v4lconvert_threads_bayer_to_rgb24(struct v4lconvert_threads *threads,
+		const unsigned char *bayer, unsigned char *dest, int width, int height,
+		int stride, unsigned int src_pix_fmt, int bgr);
+
+void v4lconvert_threads_raw_bayer_to_bayer8(struct v4lconvert_threads *threads,
+		const unsigned char *src, unsigned char *dest, int width, int height,
+		int stride, unsigned int raw_pix_fmt);
+
+void v4lconvert_threads_bayer_to_yuv420(struct v4lconvert_threads *threads,
+		const unsigned char *bayer, unsigned char *dest, int width, int height,
+		int stride, unsigned int src_pix_fmt, int yvu);
+
 void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, int bgr, int yvu, int bpp);
 
+void v4lconvert_rgb24_rows_to_yuv420(const unsigned char *src,
+		unsigned char *dest, const struct v4l2_format *src_fmt, int bgr,
+		int yvu, int bpp, int start, int end);
+
 void v4lconvert_yuv420_to_rgb24(const unsigned char *src, unsigned char *dst,
 		int width, int height, int yvu);
 
 void v4lconvert_yuv420_to_bgr24(const unsigned char *src, unsigned char *dst,
 		int width, int height, int yvu);
 
+void v4lconvert_yuv_planes_rows_to_rgb24(
+		const struct v4lconvert_yuv_planes *planes, unsigned char *dest,
+		int width, int bgr, int start, int end);
+
+void v4lconvert_yuv_planes_to_yuv420(const struct v4lconvert_yuv_planes *planes,
+		unsigned char *dest, int width, int height, int yvu);
+
+void v4lconvert_yuv420_rows_to_rgb24(const unsigned char *src,
+		unsigned char *dest, int width, int height, int yvu, int start,
+		int end);
+
+void v4lconvert_yuv420_rows_to_bgr24(const unsigned char *src,
+		unsigned char *dest, int width, int height, int yvu, int start,
+		int end);
+
 void v4lconvert_yuyv_to_rgb24(const unsigned char *src, unsigned char *dst,
 		int width, int height, int stride);
 
@@ -161,6 +276,27 @@ void v4lconvert_y16_to_yuv420(const unsigned char *src, unsigned char *dest,
 void v4lconvert_rgb32_to_rgb24(const unsigned char *src, unsigned char *dest,
 		int width, int height, int bgr);
 
+int v4lconvert_packed_yuv_to_rgb24_simd(const unsigned char *src,
+		unsigned char *dest, int width, unsigned int src_pixfmt, int bgr);
+
+int v4lconvert_yuv420_to_rgb24_simd(const unsigned char *ysrc,
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *dest, int width, int bgr);
+
+int v4lconvert_nv12_to_rgb24_simd(const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width, int vu,
+		int bgr);
+
+int v4lconvert_split_uv_simd(const unsigned char *src, unsigned char *dest0,
+		unsigned char *dest1, int count);
+
+int v4lconvert_rgb24_to_y_simd(const unsigned char *src, unsigned char *dest,
+		int width, int bpp, int bgr);
+
+int v4lconvert_rgb24_to_uv_simd(const unsigned char *src, int stride,
+		unsigned char *udest, unsigned char *vdest, int blocks, int bpp,
+		int bgr);
+
 int v4lconvert_y10b_to_rgb24(struct v4lconvert_data *data,
 	const unsigned char *src, unsigned char *dest, int width, int height);
 
@@ -219,7 +355,7 @@ int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 int v4lconvert_decode_jpgl(const unsigned char *src, int src_size,
 	unsigned int dest_pix_fmt, unsigned char *dest, int width, int height);
 
-void v4lconvert_decode_spca561(const unsigned char *src, unsigned char *dst,
+int v4lconvert_decode_spca561(const unsigned char *src, unsigned char *dst,
 		int width, int height);
 
 void v4lconvert_decode_sn9c10x(const unsigned char *src, unsigned char *dst,
@@ -255,6 +391,54 @@ void v4lconvert_bayer_to_bgr24(const unsigned char *bayer,
 void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 		int width, int height, const unsigned int stride, unsigned int src_pixfmt, int yvu);
 
+void v4lconvert_bayer_rows_to_rgb24(const unsigned char *bayer,
+		unsigned char *bgr, int width, int height, const unsigned int stride,
+		unsigned int pixfmt, int start, int end);
+
+void v4lconvert_bayer_rows_to_bgr24(const unsigned char *bayer,
+		unsigned char *bgr, int width, int height, const unsigned int stride,
+		unsigned int pixfmt, int start, int end);
+
+void v4lconvert_bayer_rows_to_yuv420(const unsigned char *bayer,
+		unsigned char *yuv, int width, int height, const unsigned int stride,
+		unsigned int src_pixfmt, int yvu, int start, int end);
+
+void v4lconvert_bayer_edge_aware_to_rgb24(const unsigned char *bayer,
+		unsigned char *rgb, int width, int height, const unsigned int stride, unsigned int pixfmt);
+
+void v4lconvert_bayer_edge_aware_to_bgr24(const unsigned char *bayer,
+		unsigned char *rgb, int width, int height, const unsigned int stride, unsigned int pixfmt);
+
+int v4lconvert_raw_bayer_stride(unsigned int raw_pix_fmt, int width);
+
+unsigned int v4lconvert_raw_bayer_to_bayer8_fmt(unsigned int raw_pix_fmt);
+
+void v4lconvert_raw_bayer_rows_to_bayer8(const unsigned char *src,
+		unsigned char *dest, int width, int stride, unsigned int raw_pix_fmt,
+		int start, int end);
+
+int v4lconvert_bayer16_row_to_bayer8_simd(const unsigned char *src,
+		unsigned char *dest, int width, int shift);
+
+int v4lconvert_bayer10p_row_to_bayer8_simd(const unsigned char *src,
+		unsigned char *dest, int width);
+
+int v4lconvert_bayer_row_to_rgb24_simd(const unsigned char *bayer,
+		unsigned char *bgr, int pairs, int stride, int blue_line);
+
+int v4lconvert_bayer_row_to_y_simd(const unsigned char *bayer,
+		unsigned char *ydst, int pairs, int stride, int blue_line);
+
+int v4lconvert_reverse_row_simd(const unsigned char *src,
+		unsigned char *dest, int width);
+
+int v4lconvert_reverse_rgb24_row_simd(const unsigned char *src,
+		unsigned char *dest, int width);
+
+int v4lconvert_rotate90_strip_simd(const unsigned char *src,
+		int src_stride, unsigned char *dest, int dest_stride,
+		int destwidth);
+
 void v4lconvert_hm12_to_rgb24(const unsigned char *src,
 		unsigned char *dst, int width, int height);
 
@@ -264,15 +448,41 @@ void v4lconvert_hm12_to_bgr24(const unsigned char *src,
 void v4lconvert_hm12_to_yuv420(const unsigned char *src,
 		unsigned char *dst, int width, int height, int yvu);
 
-void v4lconvert_rotate90(unsigned char *src, unsigned char *dest,
+void v4lconvert_rotate90(struct v4lconvert_threads *threads,
+		unsigned char *src, unsigned char *dest,
 		struct v4l2_format *fmt);
 
-void v4lconvert_flip(unsigned char *src, unsigned char *dest,
+void v4lconvert_flip(struct v4lconvert_threads *threads,
+		unsigned char *src, unsigned char *dest,
 		struct v4l2_format *fmt, int hflip, int vflip);
 
-void v4lconvert_crop(unsigned char *src, unsigned char *dest,
+void v4lconvert_crop(struct v4lconvert_threads *threads,
+		unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt);
 
+/* Returns source line y (of width * channels samples) for scaling, called
+   from the thread handling band */
+typedef const unsigned char *(*v4lconvert_scale_src_func)(void *arg, int band,
+		int y);
+
+int v4lconvert_scale_plane(struct v4lconvert_data *data,
+		v4lconvert_scale_src_func get_line, void *arg,
+		int src_width, int src_height, unsigned char *dest,
+		int dest_width, int dest_height, int dest_stride, int channels,
+		int hflip, int vflip);
+
+int v4lconvert_scale(struct v4lconvert_data *data,
+		unsigned char *src, unsigned char *dest,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt);
+
+int v4lconvert_fused_supported(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		int src_size, int rotate90);
+
+int v4lconvert_fused_convert(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		const unsigned char *src, unsigned char *dest, int hflip, int vflip);
+
 int v4lconvert_helper_decompress(struct v4lconvert_data *data,
 		const char *helper, const unsigned char *src, int src_size,
 		unsigned char *dest, int dest_size, int width, int height, int command);
@@ -90,7 +90,11 @@ static const struct v4lconvert_pixfmt supported_src_pixfmts[] = {
 	{ V4L2_PIX_FMT_YUYV,		16,	 5,	 4,	0 },
 	{ V4L2_PIX_FMT_YVYU,		16,	 5,	 4,	0 },
 	{ V4L2_PIX_FMT_UYVY,		16,	 5,	 4,	0 },
+	{ V4L2_PIX_FMT_NV16,		16,	 5,	 4,	0 },
+	{ V4L2_PIX_FMT_NV61,		16,	 5,	 4,	0 },
 	/* yuv 4:2:0 formats */
+	{ V4L2_PIX_FMT_NV12,		12,	 6,	 2,	0 },
+	{ V4L2_PIX_FMT_NV21,		12,	 6,	 2,	0 },
 	{ V4L2_PIX_FMT_SPCA501,		12,      6,	 3,	1 },
 	{ V4L2_PIX_FMT_SPCA505,		12,	 6,	 3,	1 },
 	{ V4L2_PIX_FMT_SPCA508,		12,	 6,	 3,	1 },
@@ -113,6 +117,23 @@ static const struct v4lconvert_pixfmt supported_src_pixfmts[] = {
 	{ V4L2_PIX_FMT_SGRBG8,		 8,	 8,	 8,	1 },
 	{ V4L2_PIX_FMT_SRGGB8,		 8,	 8,	 8,	1 },
 	{ V4L2_PIX_FMT_STV0680,		 8,	 8,	 8,	1 },
+	/* high bit depth and packed raw bayer */
+	{ V4L2_PIX_FMT_SBGGR10P,	10,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGBRG10P,	10,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGRBG10P,	10,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SRGGB10P,	10,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SBGGR10,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGBRG10,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGRBG10,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SRGGB10,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SBGGR12,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGBRG12,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGRBG12,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SRGGB12,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SBGGR16,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGBRG16,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGRBG16,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SRGGB16,		16,	 8,	 8,	1 },
 	/* compressed bayer */
 	{ V4L2_PIX_FMT_SPCA561,		 0,	 9,	 9,	1 },
 	{ V4L2_PIX_FMT_SN9C10X,		 0,	 9,	 9,	1 },
@@ -161,6 +182,7 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 	int i, j;
 	struct v4lconvert_data *data = calloc(1, sizeof(struct v4lconvert_data));
 	struct v4l2_capability cap;
+	char *env;
 	/* This keeps tracks of devices which have only formats for which apps
 	   most likely will need conversion and we can thus safely add software
 	   processing controls without a performance impact. */
@@ -232,6 +254,16 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 		return NULL;
 	}
 
+	/* Failing to start the worker threads is not fatal, we then simply
+	   do everything from the calling thread */
+	env = getenv("LIBV4LCONVERT_THREADS");
+	if (env)
+		v4lconvert_set_threads(data, atoi(env));
+
+	env = getenv("LIBV4LCONVERT_SCALING");
+	if (env)
+		v4lconvert_set_scaling(data, atoi(env));
+
 	return data;
 }
 
@@ -240,6 +272,7 @@ void v4lconvert_destroy(struct v4lconvert_data *data)
 	if (!data)
 		return;
 
+	v4lconvert_threads_destroy(data->threads);
 	v4lprocessing_destroy(data->processing);
 	v4lcontrol_destroy(data->control);
 	if (data->tinyjpeg) {
@@ -258,6 +291,9 @@ void v4lconvert_destroy(struct v4lconvert_data *data)
 	free(data->rotate90_buf);
 	free(data->flip_buf);
 	free(data->convert_pixfmt_buf);
+	free(data->fused_line_buf);
+	free(data->scale_buf);
+	free(data->demosaic_buf);
 	free(data->previous_frame);
 	free(data);
 }
@@ -508,6 +544,90 @@ void v4lconvert_fixup_fmt(struct v4l2_format *fmt)
 	}
 }
 
+/* The largest resolution the device can do (in any of the formats we can
+   convert from), or 0x0 if the device does not enumerate its resolutions */
+static void v4lconvert_max_framesize(struct v4lconvert_data *data,
+		unsigned int *width, unsigned int *height)
+{
+	int i;
+
+	*width = 0;
+	*height = 0;
+	for (i = 0; i < data->no_framesizes; i++) {
+		unsigned int w, h;
+
+		if (data->framesizes[i].type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+			w = data->framesizes[i].discrete.width;
+			h = data->framesizes[i].discrete.height;
+		} else {
+			w = data->framesizes[i].stepwise.max_width;
+			h = data->framesizes[i].stepwise.max_height;
+		}
+		if (w > *width)
+			*width = w;
+		if (h > *height)
+			*height = h;
+	}
+}
+
+/* When scaling, we can deliver any resolution. Pick the smallest resolution
+   the device can do which is at least as large as the desired one, so that
+   we only need to scale down, and scale to the desired resolution, within
+   the limits of what the device can do. */
+static void v4lconvert_try_format_scaled(struct v4lconvert_data *data,
+		unsigned int desired_width, unsigned int desired_height,
+		struct v4l2_format *try_dest, struct v4l2_format *try_src)
+{
+	int i;
+	unsigned int max_width, max_height;
+	unsigned int best_width = 0, best_height = 0;
+	struct v4l2_format try2_dest, try2_src;
+
+	for (i = 0; i < data->no_framesizes; i++) {
+		unsigned int w, h;
+
+		if (data->framesizes[i].type != V4L2_FRMSIZE_TYPE_DISCRETE)
+			continue;
+
+		w = data->framesizes[i].discrete.width;
+		h = data->framesizes[i].discrete.height;
+		if (w >= desired_width && h >= desired_height &&
+				(!best_width || w * h < best_width * best_height)) {
+			best_width = w;
+			best_height = h;
+		}
+	}
+
+	if (best_width && (try_src->fmt.pix.width < desired_width ||
+			   try_src->fmt.pix.height < desired_height)) {
+		try2_dest = *try_dest;
+		try2_dest.fmt.pix.width = best_width;
+		try2_dest.fmt.pix.height = best_height;
+		if (v4lconvert_do_try_format(data, &try2_dest, &try2_src) == 0 &&
+				try2_src.fmt.pix.width >= desired_width &&
+				try2_src.fmt.pix.height >= desired_height) {
+			*try_dest = try2_dest;
+			*try_src = try2_src;
+		}
+	}
+
+	v4lconvert_max_framesize(data, &max_width, &max_height);
+	if (max_width < try_src->fmt.pix.width)
+		max_width = try_src->fmt.pix.width;
+	if (max_height < try_src->fmt.pix.height)
+		max_height = try_src->fmt.pix.height;
+
+	try_dest->fmt.pix.width = desired_width < max_width ?
+				  desired_width : max_width;
+	try_dest->fmt.pix.height = desired_height < max_height ?
+				   desired_height : max_height;
+	/* Stay above the minimum size of the rounding done by try_format */
+	if (try_dest->fmt.pix.width < 8)
+		try_dest->fmt.pix.width = 8;
+	if (try_dest->fmt.pix.height < 2)
+		try_dest->fmt.pix.height = 2;
+}
+
 /* See libv4lconvert.h for description of in / out parameters */
 int v4lconvert_try_format(struct v4lconvert_data *data,
 		struct v4l2_format *dest_fmt, struct v4l2_format *src_fmt)
@@ -558,6 +678,13 @@ int v4lconvert_try_format(struct v4lconvert_data *data,
 		}
 	}
 
+	/* In case of a non exact resolution match, scale if enabled */
+	if ((data->flags & V4LCONVERT_SCALE) &&
+			(try_dest.fmt.pix.width != desired_width ||
+			 try_dest.fmt.pix.height != desired_height))
+		v4lconvert_try_format_scaled(data, desired_width, desired_height,
+					     &try_dest, &try_src);
+
 	/* In case of a non exact resolution match, see if this is a well known
 	   resolution some apps are hardcoded too and try to give the app what it
 	   asked for by cropping a slightly larger resolution or adding a small
@@ -637,12 +764,15 @@ int v4lconvert_needs_conversion(struct v4lconvert_data *data,
 	return 0;
 }
 
-static int v4lconvert_processing_needs_double_conversion(
-		unsigned int src_pix_fmt, unsigned int dest_pix_fmt)
+/* Returns the format processing can be done on before src_pix_fmt gets
+   converted: src_pix_fmt itself for rgb24 / bgr24, a bayer format for sources
+   which are (or get decoded to) bayer and 0 for all other sources */
+static unsigned int v4lconvert_processing_src_fmt(unsigned int src_pix_fmt)
 {
 	switch (src_pix_fmt) {
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
+		return src_pix_fmt;
 	case V4L2_PIX_FMT_SPCA561:
 	case V4L2_PIX_FMT_SN9C10X:
 	case V4L2_PIX_FMT_PAC207:
@@ -657,15 +787,26 @@ static int v4lconvert_processing_needs_double_conversion(
 	case V4L2_PIX_FMT_SGRBG8:
 	case V4L2_PIX_FMT_SRGGB8:
 	case V4L2_PIX_FMT_STV0680:
-		return 0;
-	}
-	switch (dest_pix_fmt) {
-	case V4L2_PIX_FMT_RGB24:
-	case V4L2_PIX_FMT_BGR24:
-		return 0;
+	case V4L2_PIX_FMT_SBGGR10:
+	case V4L2_PIX_FMT_SGBRG10:
+	case V4L2_PIX_FMT_SGRBG10:
+	case V4L2_PIX_FMT_SRGGB10:
+	case V4L2_PIX_FMT_SBGGR10P:
+	case V4L2_PIX_FMT_SGBRG10P:
+	case V4L2_PIX_FMT_SGRBG10P:
+	case V4L2_PIX_FMT_SRGGB10P:
+	case V4L2_PIX_FMT_SBGGR12:
+	case V4L2_PIX_FMT_SGBRG12:
+	case V4L2_PIX_FMT_SGRBG12:
+	case V4L2_PIX_FMT_SRGGB12:
+	case V4L2_PIX_FMT_SBGGR16:
+	case V4L2_PIX_FMT_SGBRG16:
+	case V4L2_PIX_FMT_SGRBG16:
+	case V4L2_PIX_FMT_SRGGB16:
+		return V4L2_PIX_FMT_SBGGR8;
 	}
 
-	return 1;
+	return 0;
 }
 
 unsigned char *v4lconvert_alloc_buffer(int needed,
@@ -690,6 +831,151 @@ int v4lconvert_oom_error(struct v4lconvert_data *data)
 	return -1;
 }
 
+/* Edge aware demosaic, there is no direct yuv version of this, for yuv
+   we demosaic to rgb24 first */
+static int v4lconvert_bayer_edge_aware(struct v4lconvert_data *data,
+	const unsigned char *src, unsigned char *dest, unsigned int width,
+	unsigned int height, unsigned int bytesperline, unsigned int src_pix_fmt,
+	unsigned int dest_pix_fmt)
+{
+	struct v4l2_format tmpfmt;
+	unsigned char *tmpbuf;
+
+	switch (dest_pix_fmt) {
+	case V4L2_PIX_FMT_RGB24:
+		v4lconvert_bayer_edge_aware_to_rgb24(src, dest, width, height,
+				bytesperline, src_pix_fmt);
+		return 0;
+	case V4L2_PIX_FMT_BGR24:
+		v4lconvert_bayer_edge_aware_to_bgr24(src, dest, width, height,
+				bytesperline, src_pix_fmt);
+		return 0;
+	}
+
+	tmpbuf = v4lconvert_alloc_buffer(width * height * 3,
+			&data->demosaic_buf, &data->demosaic_buf_size);
+	if (!tmpbuf)
+		return v4lconvert_oom_error(data);
+
+	v4lconvert_bayer_edge_aware_to_rgb24(src, tmpbuf, width, height,
+			bytesperline, src_pix_fmt);
+
+	tmpfmt.fmt.pix.width = width;
+	tmpfmt.fmt.pix.height = height;
+	tmpfmt.fmt.pix.bytesperline = width * 3;
+	v4lconvert_threads_rgb24_to_yuv420(data->threads, tmpbuf, dest, &tmpfmt,
+			0, dest_pix_fmt == V4L2_PIX_FMT_YVU420, 3);
+	return 0;
+}
+
+/* Get the planes of a planar or semi planar yuv frame, for the multi planar
+   formats these come from v4lconvert_convert_mplane */
+static int v4lconvert_get_yuv_planes(struct v4lconvert_data *data,
+	const unsigned char *src, int src_size, const struct v4l2_format *fmt,
+	struct v4lconvert_yuv_planes *planes)
+{
+	unsigned int width = fmt->fmt.pix.width;
+	unsigned int height = fmt->fmt.pix.height;
+	const unsigned char *plane[3] = { NULL, NULL, NULL };
+	int i, count, uv_height, stride[3];
+
+	planes->uv_step = 2;
+	planes->v_shift = 1;
+	count = 1;
+	switch (fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_NV16:
+	case V4L2_PIX_FMT_NV61:
+		planes->v_shift = 0;
+		break;
+	case V4L2_PIX_FMT_NV16M:
+	case V4L2_PIX_FMT_NV61M:
+		planes->v_shift = 0;
+		/* fall through */
+	case V4L2_PIX_FMT_NV12M:
+	case V4L2_PIX_FMT_NV21M:
+		count = 2;
+		break;
+	case V4L2_PIX_FMT_YUV420M:
+	case V4L2_PIX_FMT_YVU420M:
+		planes->uv_step = 1;
+		count = 3;
+		break;
+	}
+	uv_height = (height + planes->v_shift) >> planes->v_shift;
+
+	if (count == 1) {
+		stride[0] = stride[1] = fmt->fmt.pix.bytesperline;
+		if (stride[0] < width)
+			stride[0] = stride[1] = width;
+		if (src_size < stride[0] * (height + uv_height))
+			goto short_frame;
+		plane[0] = src;
+		plane[1] = src + stride[0] * height;
+	} else {
+		const struct v4l2_pix_format_mplane *mp = data->mplane_fmt;
+
+		if (mp == NULL || mp->num_planes < count) {
+			V4LCONVERT_ERR("multi planar format needs %d planes\n",
+				       count);
+			errno = EINVAL;
+			return -1;
+		}
+		for (i = 0; i < count; i++) {
+			unsigned int min_stride = width;
+
+			if (i && planes->uv_step == 1)
+				min_stride = width / 2;
+			stride[i] = mp->plane_fmt[i].bytesperline;
+			if (stride[i] < min_stride)
+				stride[i] = min_stride;
+			if (data->mplane_size[i] <
+					stride[i] * (i ? uv_height : height))
+				goto short_frame;
+			plane[i] = data->mplane_src[i];
+		}
+	}
+
+	planes->y = plane[0];
+	planes->y_stride = stride[0];
+	planes->uv_stride = stride[1];
+	switch (fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV16:
+	case V4L2_PIX_FMT_NV12M:
+	case V4L2_PIX_FMT_NV16M:
+		planes->u = plane[1];
+		planes->v = plane[1] + 1;
+		break;
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_NV61:
+	case V4L2_PIX_FMT_NV21M:
+	case V4L2_PIX_FMT_NV61M:
+		planes->u = plane[1] + 1;
+		planes->v = plane[1];
+		break;
+	case V4L2_PIX_FMT_YUV420M:
+		planes->u = plane[1];
+		planes->v = plane[2];
+		break;
+	case V4L2_PIX_FMT_YVU420M:
+		planes->u = plane[2];
+		planes->v = plane[1];
+		break;
+	}
+	if (count == 3 && stride[2] != stride[1]) {
+		V4LCONVERT_ERR("chroma planes with different strides\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+
+short_frame:
+	V4LCONVERT_ERR("short planar yuv data frame\n");
+	errno = EPIPE;
+	return -1;
+}
+
 static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	unsigned char *src, int src_size, unsigned char *dest, int dest_size,
 	struct v4l2_format *fmt, unsigned int dest_pix_fmt)
@@ -817,12 +1103,14 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_yuv420_to_rgb24(data->convert_pixfmt_buf, dest, width,
-					height, yvu);
+			v4lconvert_threads_yuv420_to_rgb24(data->threads,
+					data->convert_pixfmt_buf, dest, width, height,
+					yvu, 0);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_yuv420_to_bgr24(data->convert_pixfmt_buf, dest, width,
-					height, yvu);
+			v4lconvert_threads_yuv420_to_rgb24(data->threads,
+					data->convert_pixfmt_buf, dest, width, height,
+					yvu, 1);
 			break;
 		}
 		break;
@@ -856,7 +1144,25 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 #endif
 	case V4L2_PIX_FMT_SN9C2028:
 	case V4L2_PIX_FMT_SQ905C:
-	case V4L2_PIX_FMT_STV0680: { /* Not compressed but needs some shuffling */
+	case V4L2_PIX_FMT_STV0680: /* Not compressed but needs some shuffling */
+	/* Neither are these, they need unpacking to 8 bits */
+	case V4L2_PIX_FMT_SBGGR10:
+	case V4L2_PIX_FMT_SGBRG10:
+	case V4L2_PIX_FMT_SGRBG10:
+	case V4L2_PIX_FMT_SRGGB10:
+	case V4L2_PIX_FMT_SBGGR10P:
+	case V4L2_PIX_FMT_SGBRG10P:
+	case V4L2_PIX_FMT_SGRBG10P:
+	case V4L2_PIX_FMT_SRGGB10P:
+	case V4L2_PIX_FMT_SBGGR12:
+	case V4L2_PIX_FMT_SGBRG12:
+	case V4L2_PIX_FMT_SGRBG12:
+	case V4L2_PIX_FMT_SRGGB12:
+	case V4L2_PIX_FMT_SBGGR16:
+	case V4L2_PIX_FMT_SGBRG16:
+	case V4L2_PIX_FMT_SGRBG16:
+	case V4L2_PIX_FMT_SRGGB16: {
+
 		unsigned char *tmpbuf;
 		struct v4l2_format tmpfmt = *fmt;
 
@@ -867,7 +1173,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 
 		switch (src_pix_fmt) {
 		case V4L2_PIX_FMT_SPCA561:
-			v4lconvert_decode_spca561(src, tmpbuf, width, height);
+			if (v4lconvert_decode_spca561(src, tmpbuf,
+						width, height)) {
+				/* Corrupt frame, better get another one */
+				errno = EAGAIN;
+				return -1;
+			}
 			tmpfmt.fmt.pix.pixelformat = V4L2_PIX_FMT_SGBRG8;
 			break;
 		case V4L2_PIX_FMT_SN9C10X:
@@ -916,6 +1227,22 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			v4lconvert_decode_stv0680(src, tmpbuf, width, height);
 			tmpfmt.fmt.pix.pixelformat = V4L2_PIX_FMT_SRGGB8;
 			break;
+		default: /* High bit depth / packed raw bayer */
+			if (bytesperline < v4lconvert_raw_bayer_stride(src_pix_fmt,
+								       width))
+				bytesperline = v4lconvert_raw_bayer_stride(
+							src_pix_fmt, width);
+			if (src_size < bytesperline * height) {
+				V4LCONVERT_ERR("short raw bayer data frame\n");
+				errno = EPIPE;
+				return -1;
+			}
+			v4lconvert_threads_raw_bayer_to_bayer8(data->threads, src,
+					tmpbuf, width, height, bytesperline,
+					src_pix_fmt);
+			tmpfmt.fmt.pix.pixelformat =
+				v4lconvert_raw_bayer_to_bayer8_fmt(src_pix_fmt);
+			break;
 		}
 		/* Do processing on the tmp buffer, because doing it on bayer data is
 		   cheaper, and bayer == rgb and our dest_fmt may be yuv */
@@ -926,6 +1253,7 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		src_pix_fmt = tmpfmt.fmt.pix.pixelformat;
 		src = tmpbuf;
 		src_size = width * height;
+		bytesperline = width;
 		/* fall through */
 	}
 
@@ -939,18 +1267,29 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			errno = EPIPE;
 			result = -1;
 		}
+		if (data->control_flags & V4LCONTROL_BAYER_EDGE_AWARE) {
+			if (v4lconvert_bayer_edge_aware(data, src, dest, width,
+					height, bytesperline, src_pix_fmt,
+					dest_pix_fmt))
+				result = -1;
+			break;
+		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_bayer_to_rgb24(src, dest, width, height, bytesperline, src_pix_fmt);
+			v4lconvert_threads_bayer_to_rgb24(data->threads, src, dest, width,
+					height, bytesperline, src_pix_fmt, 0);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_bayer_to_bgr24(src, dest, width, height, bytesperline, src_pix_fmt);
+			v4lconvert_threads_bayer_to_rgb24(data->threads, src, dest, width,
+					height, bytesperline, src_pix_fmt, 1);
 			break;
 		case V4L2_PIX_FMT_YUV420:
-			v4lconvert_bayer_to_yuv420(src, dest, width, height, bytesperline, src_pix_fmt, 0);
+			v4lconvert_threads_bayer_to_yuv420(data->threads, src, dest, width,
+					height, bytesperline, src_pix_fmt, 0);
 			break;
 		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_bayer_to_yuv420(src, dest, width, height, bytesperline, src_pix_fmt, 1);
+			v4lconvert_threads_bayer_to_yuv420(data->threads, src, dest, width,
+					height, bytesperline, src_pix_fmt, 1);
 			break;
 		}
 		break;
@@ -1039,6 +1378,7 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			V4LCONVERT_ERR("short y10b data frame\n");
 			errno = EPIPE;
 			result = -1;
+			break;
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
@@ -1052,7 +1392,7 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 							   width, height);
 			break;
 		}
-		if (result == 0) {
+		if (result) {
 			V4LCONVERT_ERR("y10b conversion failed\n");
 			errno = EPIPE;
 			result = -1;
@@ -1095,10 +1435,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			v4lconvert_swap_rgb(src, dest, width, height);
 			break;
 		case V4L2_PIX_FMT_YUV420:
-			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 0, 0, 3);
+			v4lconvert_threads_rgb24_to_yuv420(data->threads, src, dest,
+					fmt, 0, 0, 3);
 			break;
 		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 0, 1, 3);
+			v4lconvert_threads_rgb24_to_yuv420(data->threads, src, dest,
+					fmt, 0, 1, 3);
 			break;
 		}
 		break;
@@ -1117,10 +1459,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			memcpy(dest, src, width * height * 3);
 			break;
 		case V4L2_PIX_FMT_YUV420:
-			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 1, 0, 3);
+			v4lconvert_threads_rgb24_to_yuv420(data->threads, src, dest,
+					fmt, 1, 0, 3);
 			break;
 		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 1, 1, 3);
+			v4lconvert_threads_rgb24_to_yuv420(data->threads, src, dest,
+					fmt, 1, 1, 3);
 			break;
 		}
 		break;
@@ -1139,10 +1483,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			v4lconvert_rgb32_to_rgb24(src, dest, width, height, 1);
 			break;
 		case V4L2_PIX_FMT_YUV420:
-			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 0, 0, 4);
+			v4lconvert_threads_rgb24_to_yuv420(data->threads, src, dest,
+					fmt, 0, 0, 4);
 			break;
 		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 0, 1, 4);
+			v4lconvert_threads_rgb24_to_yuv420(data->threads, src, dest,
+					fmt, 0, 1, 4);
 			break;
 		}
 		break;
@@ -1161,10 +1507,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			v4lconvert_rgb32_to_rgb24(src, dest, width, height, 0);
 			break;
 		case V4L2_PIX_FMT_YUV420:
-			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 1, 0, 4);
+			v4lconvert_threads_rgb24_to_yuv420(data->threads, src, dest,
+					fmt, 1, 0, 4);
 			break;
 		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 1, 1, 4);
+			v4lconvert_threads_rgb24_to_yuv420(data->threads, src, dest,
+					fmt, 1, 1, 4);
 			break;
 		}
 		break;
@@ -1177,12 +1525,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_yuv420_to_rgb24(src, dest, width,
-					height, 0);
+			v4lconvert_threads_yuv420_to_rgb24(data->threads, src, dest,
+					width, height, 0, 0);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_yuv420_to_bgr24(src, dest, width,
-					height, 0);
+			v4lconvert_threads_yuv420_to_rgb24(data->threads, src, dest,
+					width, height, 0, 1);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			memcpy(dest, src, width * height * 3 / 2);
@@ -1201,12 +1549,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_yuv420_to_rgb24(src, dest, width,
-					height, 1);
+			v4lconvert_threads_yuv420_to_rgb24(data->threads, src, dest,
+					width, height, 1, 0);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_yuv420_to_bgr24(src, dest, width,
-					height, 1);
+			v4lconvert_threads_yuv420_to_rgb24(data->threads, src, dest,
+					width, height, 1, 1);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_swap_uv(src, dest, fmt);
@@ -1217,6 +1565,43 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		break;
 
+	/* Planar and semi planar yuv, read in place from the planes */
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_NV16:
+	case V4L2_PIX_FMT_NV61:
+	case V4L2_PIX_FMT_NV12M:
+	case V4L2_PIX_FMT_NV21M:
+	case V4L2_PIX_FMT_NV16M:
+	case V4L2_PIX_FMT_NV61M:
+	case V4L2_PIX_FMT_YUV420M:
+	case V4L2_PIX_FMT_YVU420M: {
+		struct v4lconvert_yuv_planes planes;
+
+		if (v4lconvert_get_yuv_planes(data, src, src_size, fmt, &planes))
+			return -1;
+
+		switch (dest_pix_fmt) {
+		case V4L2_PIX_FMT_RGB24:
+			v4lconvert_threads_yuv_planes_to_rgb24(data->threads,
+					&planes, dest, width, height, 0);
+			break;
+		case V4L2_PIX_FMT_BGR24:
+			v4lconvert_threads_yuv_planes_to_rgb24(data->threads,
+					&planes, dest, width, height, 1);
+			break;
+		case V4L2_PIX_FMT_YUV420:
+			v4lconvert_yuv_planes_to_yuv420(&planes, dest, width,
+							height, 0);
+			break;
+		case V4L2_PIX_FMT_YVU420:
+			v4lconvert_yuv_planes_to_yuv420(&planes, dest, width,
+							height, 1);
+			break;
+		}
+		break;
+	}
+
 	case V4L2_PIX_FMT_YUYV:
 		if (src_size < (width * height * 2)) {
 			V4LCONVERT_ERR("short yuyv data frame\n");
@@ -1225,10 +1610,14 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_yuyv_to_rgb24(src, dest, width, height, bytesperline);
+			v4lconvert_threads_packed_yuv_to_rgb24(data->threads, src, dest,
+					width, height, bytesperline,
+					V4L2_PIX_FMT_YUYV, 0);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_yuyv_to_bgr24(src, dest, width, height, bytesperline);
+			v4lconvert_threads_packed_yuv_to_rgb24(data->threads, src, dest,
+					width, height, bytesperline,
+					V4L2_PIX_FMT_YUYV, 1);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_yuyv_to_yuv420(src, dest, width, height, bytesperline, 0);
@@ -1247,10 +1636,14 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_yvyu_to_rgb24(src, dest, width, height, bytesperline);
+			v4lconvert_threads_packed_yuv_to_rgb24(data->threads, src, dest,
+					width, height, bytesperline,
+					V4L2_PIX_FMT_YVYU, 0);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_yvyu_to_bgr24(src, dest, width, height, bytesperline);
+			v4lconvert_threads_packed_yuv_to_rgb24(data->threads, src, dest,
+					width, height, bytesperline,
+					V4L2_PIX_FMT_YVYU, 1);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			/* Note we use yuyv_to_yuv420 not v4lconvert_yvyu_to_yuv420,
@@ -1271,10 +1664,14 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_uyvy_to_rgb24(src, dest, width, height, bytesperline);
+			v4lconvert_threads_packed_yuv_to_rgb24(data->threads, src, dest,
+					width, height, bytesperline,
+					V4L2_PIX_FMT_UYVY, 0);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_uyvy_to_bgr24(src, dest, width, height, bytesperline);
+			v4lconvert_threads_packed_yuv_to_rgb24(data->threads, src, dest,
+					width, height, bytesperline,
+					V4L2_PIX_FMT_UYVY, 1);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_uyvy_to_yuv420(src, dest, width, height, bytesperline, 0);
@@ -1359,11 +1756,23 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		return -1;
 	}
 
+	/* Try to do everything in a single pass without intermediate buffers */
+	if (v4lconvert_fused_supported(data, &my_src_fmt, &my_dest_fmt,
+				       src_size, rotate90)) {
+		res = v4lconvert_fused_convert(data, &my_src_fmt, &my_dest_fmt,
+					       src, dest, hflip, vflip);
+		if (res)
+			return res;
+
+		return dest_needed;
+	}
 
 	/* Sometimes we need foo -> rgb -> bar as video processing (whitebalance,
-	   etc.) can only be done on rgb data */
-	if (processing && v4lconvert_processing_needs_double_conversion(
-				my_src_fmt.fmt.pix.pixelformat,
+	   etc.) can only be done on bayer or rgb data, and custom filters may
+	   only accept rgb */
+	if (processing && v4lprocessing_plan_frame(data->processing,
+				v4lconvert_processing_src_fmt(
+					my_src_fmt.fmt.pix.pixelformat),
 				my_dest_fmt.fmt.pix.pixelformat))
 		convert = 2;
 	else if (my_dest_fmt.fmt.pix.pixelformat !=
@@ -1420,6 +1829,12 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 	/* Done setting sources / dest and allocating intermediate buffers,
 	   real conversion / processing / ... starts here. */
 	if (convert == 2) {
+		/* Bayer sources get the lookup tables (and bayer filters)
+		   applied before the conversion to rgb */
+		if (processing)
+			v4lprocessing_processing(data->processing, src,
+						 &my_src_fmt);
+
 		res = v4lconvert_convert_pixfmt(data, src, src_size,
 				convert1_dest, convert1_dest_size,
 				&my_src_fmt,
@@ -1451,17 +1866,77 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 	}
 
 	if (rotate90)
-		v4lconvert_rotate90(rotate90_src, rotate90_dest, &my_src_fmt);
+		v4lconvert_rotate90(data->threads, rotate90_src, rotate90_dest,
+				    &my_src_fmt);
 
 	if (hflip || vflip)
-		v4lconvert_flip(flip_src, flip_dest, &my_src_fmt, hflip, vflip);
+		v4lconvert_flip(data->threads, flip_src, flip_dest, &my_src_fmt,
+				hflip, vflip);
 
-	if (crop)
-		v4lconvert_crop(crop_src, dest, &my_src_fmt, &my_dest_fmt);
+	if (crop && (data->flags & V4LCONVERT_SCALE)) {
+		res = v4lconvert_scale(data, crop_src, dest, &my_src_fmt,
+				       &my_dest_fmt);
+		if (res)
+			return res;
+	} else if (crop)
+		v4lconvert_crop(data->threads, crop_src, dest, &my_src_fmt,
+				&my_dest_fmt);
 
 	return dest_needed;
 }
 
+int v4lconvert_convert_mplane(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char **src, const int *src_size,
+		unsigned char *dest, int dest_size)
+{
+	const struct v4l2_pix_format_mplane *mp = &src_fmt->fmt.pix_mp;
+	struct v4l2_format fmt;
+	int i, res;
+
+	if (mp->num_planes < 1 || mp->num_planes > VIDEO_MAX_PLANES) {
+		V4LCONVERT_ERR("invalid number of planes: %d\n",
+			       mp->num_planes);
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt.fmt.pix.width = mp->width;
+	fmt.fmt.pix.height = mp->height;
+	fmt.fmt.pix.pixelformat = mp->pixelformat;
+	fmt.fmt.pix.field = mp->field;
+	fmt.fmt.pix.colorspace = mp->colorspace;
+	fmt.fmt.pix.bytesperline = mp->plane_fmt[0].bytesperline;
+	for (i = 0; i < mp->num_planes; i++)
+		fmt.fmt.pix.sizeimage += mp->plane_fmt[i].sizeimage;
+
+	/* A single plane is no different from a regular frame */
+	if (mp->num_planes == 1)
+		return v4lconvert_convert(data, &fmt, dest_fmt, src[0],
+					  src_size[0], dest, dest_size);
+
+	/* Do not let v4lconvert_convert fall back to copying the 1st plane */
+	if (!v4lconvert_supported_dst_format(dest_fmt->fmt.pix.pixelformat)) {
+		V4LCONVERT_ERR("cannot copy multi planar frames\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	data->mplane_fmt = mp;
+	data->mplane_src = src;
+	data->mplane_size = src_size;
+	res = v4lconvert_convert(data, &fmt, dest_fmt, src[0], src_size[0],
+				 dest, dest_size);
+	data->mplane_fmt = NULL;
+	data->mplane_src = NULL;
+	data->mplane_size = NULL;
+
+	return res;
+}
+
 const char *v4lconvert_get_error_message(struct v4lconvert_data *data)
 {
 	return data->error_msg;
@@ -1540,6 +2015,28 @@ int v4lconvert_enum_framesizes(struct v4lconvert_data *data,
 				VIDIOC_ENUM_FRAMESIZES, frmsize);
 	}
 
+	/* When scaling we can do any size up to the largest one of the device
+	   (with the same rounding as v4lconvert_try_format) */
+	if (data->flags & V4LCONVERT_SCALE) {
+		unsigned int max_width, max_height;
+
+		v4lconvert_max_framesize(data, &max_width, &max_height);
+		if (frmsize->index != 0 || max_width < 8 || max_height < 2) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		frmsize->type = V4L2_FRMSIZE_TYPE_STEPWISE;
+		memset(frmsize->reserved, 0, sizeof(frmsize->reserved));
+		frmsize->stepwise.min_width = 8;
+		frmsize->stepwise.max_width = max_width & ~7;
+		frmsize->stepwise.step_width = 8;
+		frmsize->stepwise.min_height = 2;
+		frmsize->stepwise.max_height = max_height & ~1;
+		frmsize->stepwise.step_height = 2;
+		return 0;
+	}
+
 	if (frmsize->index >= data->no_framesizes) {
 		errno = EINVAL;
 		return -1;
@@ -1664,6 +2161,23 @@ int v4lconvert_vidioc_s_ctrl(struct v4lconvert_data *data, void *arg)
 	return v4lcontrol_vidioc_s_ctrl(data->control, arg);
 }
 
+int v4lconvert_add_filter(struct v4lconvert_data *data,
+		const struct v4lconvert_filter *filter)
+{
+	if (v4lprocessing_add_filter(data->processing, filter)) {
+		V4LCONVERT_ERR("too many processing filters\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+void v4lconvert_remove_filter(struct v4lconvert_data *data,
+		const struct v4lconvert_filter *filter)
+{
+	v4lprocessing_remove_filter(data->processing, filter);
+}
+
 int v4lconvert_get_fps(struct v4lconvert_data *data)
 {
 	return data->fps;
@@ -1673,3 +2187,39 @@ void v4lconvert_set_fps(struct v4lconvert_data *data, int fps)
 {
 	data->fps = fps;
 }
+
+void v4lconvert_set_scaling(struct v4lconvert_data *data, int enable)
+{
+	if (enable)
+		data->flags |= V4LCONVERT_SCALE;
+	else
+		data->flags &= ~V4LCONVERT_SCALE;
+}
+
+int v4lconvert_set_threads(struct v4lconvert_data *data, int threads)
+{
+	struct v4lconvert_threads *new_threads = NULL;
+
+	if (threads > V4LCONVERT_MAX_THREADS)
+		threads = V4LCONVERT_MAX_THREADS;
+	if (threads < 1)
+		threads = 1;
+
+	if (threads == v4lconvert_threads_count(data->threads))
+		return 0;
+
+	if (threads > 1) {
+		new_threads = v4lconvert_threads_create(threads);
+		if (!new_threads) {
+			V4LCONVERT_ERR("starting %d worker threads: %s\n", threads,
+					strerror(errno));
+			return -1;
+		}
+	}
+
+	v4lprocessing_set_threads(data->processing, new_threads);
+	v4lconvert_threads_destroy(data->threads);
+	data->threads = new_threads;
+
+	return 0;
+}
@@ -149,7 +149,9 @@ int v4lconvert_decode_mr97310a(struct v4lconvert_data *data,
 				val = table[code].val;
 				lp = outp[-2];
 				if (row > 1) {
-					tlp = outp[-2 * width - 2];
+					/* tlp is not used in the left column */
+					if (col > 1)
+						tlp = outp[-2 * width - 2];
 					tp  = outp[-2 * width];
 					trp = outp[-2 * width + 2];
 				}
@@ -31,7 +31,7 @@ static int gamma_active(struct v4lprocessing_data *data)
 
 static int gamma_calculate_lookup_tables(
 		struct v4lprocessing_data *data,
-		unsigned char *buf, const struct v4l2_format *fmt)
+		const struct v4lprocessing_stats *stats)
 {
 	int i, x, gamma;
 
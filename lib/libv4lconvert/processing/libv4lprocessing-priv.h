@@ -21,15 +21,35 @@
 #ifndef __LIBV4LPROCESSING_PRIV_H
 #define __LIBV4LPROCESSING_PRIV_H
 
+#include <stdint.h>
 #include "../control/libv4lcontrol.h"
 #include "../libv4lsyscall-priv.h"
 
 #define V4L2PROCESSING_UPDATE_RATE 10
+#define V4L2PROCESSING_MAX_FILTERS 16
+
+struct v4lconvert_filter;
+
+/* Statistics gathered while applying the lookup tables to a frame, from
+   which the lookup tables for the next frames get calculated. The sum and
+   count arrays are indexed 0 for comp1, 1 for green and 2 for comp2. For
+   bayer data 1 only holds the green samples on the rows with comp1, and 3
+   those on the rows with comp2 */
+struct v4lprocessing_stats {
+	uint64_t sum[4];
+	uint64_t count[4];
+	/* Histogram of all component values in the center of the frame (the
+	   middle half of the rows and columns) */
+	unsigned int histogram[256];
+};
 
 struct v4lprocessing_data {
 	struct v4lcontrol_data *control;
+	struct v4lconvert_threads *threads;
 	int fd;
 	int do_process;
+	/* True if any of the lookup table filters below is active */
+	int lookup_filters_active;
 	int controls_changed;
 	/* True if any of the lookup tables does not contain
 	   linear 0-255 */
@@ -37,6 +57,28 @@ struct v4lprocessing_data {
 	/* Counts the number of processed frames until a
 	   V4L2PROCESSING_UPDATE_RATE overflow happens */
 	int lookup_table_update_counter;
+	/* True if the current frame should be used to update the lookup tables */
+	int gather_stats;
+	/* Statistics of the current frame, one set per band so that threads
+	   do not need to lock, merged into stats at the end of the frame */
+	struct v4lprocessing_stats *band_stats;
+	int band_stats_count;
+	struct v4lprocessing_stats stats;
+	/* Custom row filters (v4lconvert_add_filter()) and a bitmask of which
+	   of them are active for the current frame */
+	const struct v4lconvert_filter *row_filters[V4L2PROCESSING_MAX_FILTERS];
+	int row_filter_count;
+	unsigned int row_filters_active;
+	/* Active row filters which have not been applied to the current frame
+	   yet, and if the lookup tables have been applied already */
+	unsigned int row_filters_pending;
+	int lookup_done;
+	/* What the current stage (processing call) of the frame does: apply
+	   the lookup tables and / or the row filters in the bitmask */
+	int stage_lookup;
+	unsigned int stage_filters;
+	/* Pixelformat of the rows passed to v4lprocessing_processing_row() */
+	unsigned int row_pixelformat;
 	/* RGB/BGR lookup tables */
 	unsigned char comp1[256];
 	unsigned char green[256];
@@ -58,7 +100,7 @@ struct v4lprocessing_filter {
 	int (*active)(struct v4lprocessing_data *data);
 	/* Returns 1 if any of the lookup tables was changed */
 	int (*calculate_lookup_tables)(struct v4lprocessing_data *data,
-			unsigned char *buf, const struct v4l2_format *fmt);
+			const struct v4lprocessing_stats *stats);
 };
 
 extern struct v4lprocessing_filter whitebalance_filter;
@@ -33,6 +33,17 @@ static struct v4lprocessing_filter *filters[] = {
 	&gamma_filter,
 };
 
+static void v4lprocessing_reset_lookup_tables(struct v4lprocessing_data *data)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		data->comp1[i] = i;
+		data->green[i] = i;
+		data->comp2[i] = i;
+	}
+}
+
 struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *control)
 {
 	struct v4lprocessing_data *data =
@@ -45,144 +56,505 @@ struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *
 
 	data->fd = fd;
 	data->control = control;
+	/* The first frame gets processed with these, while gathering the
+	   statistics for calculating the real lookup tables */
+	v4lprocessing_reset_lookup_tables(data);
 
 	return data;
 }
 
 void v4lprocessing_destroy(struct v4lprocessing_data *data)
 {
+	free(data->band_stats);
 	free(data);
 }
 
+void v4lprocessing_set_threads(struct v4lprocessing_data *data,
+		struct v4lconvert_threads *threads)
+{
+	data->threads = threads;
+}
+
+/* Make sure we have a set of statistics for each band and clear them */
+static int v4lprocessing_reset_stats(struct v4lprocessing_data *data)
+{
+	int count = v4lconvert_threads_count(data->threads);
+
+	if (data->band_stats_count < count) {
+		struct v4lprocessing_stats *band_stats =
+			realloc(data->band_stats, count * sizeof(*band_stats));
+
+		if (!band_stats) {
+			fprintf(stderr, "libv4lprocessing: error: out of memory!\n");
+			return -1;
+		}
+		data->band_stats = band_stats;
+		data->band_stats_count = count;
+	}
+	memset(data->band_stats, 0, count * sizeof(*data->band_stats));
+
+	return 0;
+}
+
+int v4lprocessing_add_filter(struct v4lprocessing_data *data,
+		const struct v4lconvert_filter *filter)
+{
+	if (data->row_filter_count == V4L2PROCESSING_MAX_FILTERS) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	data->row_filters[data->row_filter_count++] = filter;
+	return 0;
+}
+
+void v4lprocessing_remove_filter(struct v4lprocessing_data *data,
+		const struct v4lconvert_filter *filter)
+{
+	int i;
+
+	for (i = 0; i < data->row_filter_count; i++) {
+		if (data->row_filters[i] == filter) {
+			data->row_filter_count--;
+			memmove(&data->row_filters[i], &data->row_filters[i + 1],
+				(data->row_filter_count - i) *
+				sizeof(data->row_filters[0]));
+			return;
+		}
+	}
+}
+
 int v4lprocessing_pre_processing(struct v4lprocessing_data *data)
 {
+	const struct v4lconvert_filter *filter;
 	int i;
 
-	data->do_process = 0;
+	data->lookup_filters_active = 0;
 	for (i = 0; i < ARRAY_SIZE(filters); i++) {
 		if (filters[i]->active(data))
-			data->do_process = 1;
+			data->lookup_filters_active = 1;
+	}
+
+	/* Stale lookup tables get recalculated once a filter gets enabled
+	   again, as that changes the controls */
+	if (!data->lookup_filters_active)
+		data->lookup_table_active = 0;
+
+	data->row_filters_active = 0;
+	for (i = 0; i < data->row_filter_count; i++) {
+		filter = data->row_filters[i];
+		if (!filter->frame_start || filter->frame_start(filter->priv))
+			data->row_filters_active |= 1 << i;
 	}
+	data->row_filters_pending = data->row_filters_active;
+	data->lookup_done = !data->lookup_filters_active;
+
+	data->do_process = data->lookup_filters_active ||
+			   data->row_filters_active;
 
 	data->controls_changed |= v4lcontrol_controls_changed(data->control);
 
+	/* Gather the statistics for updating the lookup tables while applying
+	   the current ones, when this fails we simply try again next frame */
+	data->gather_stats = data->lookup_filters_active &&
+		(data->controls_changed ||
+		 data->lookup_table_update_counter == V4L2PROCESSING_UPDATE_RATE) &&
+		v4lprocessing_reset_stats(data) == 0;
+
 	return data->do_process;
 }
 
-static void v4lprocessing_update_lookup_tables(struct v4lprocessing_data *data,
-		unsigned char *buf, const struct v4l2_format *fmt)
+/* Returns the V4LCONVERT_FILTER_* format flag for pixelformat */
+static unsigned int v4lprocessing_filter_format(unsigned int pixelformat)
+{
+	switch (pixelformat) {
+	case V4L2_PIX_FMT_SGBRG8:
+	case V4L2_PIX_FMT_SGRBG8:
+	case V4L2_PIX_FMT_SBGGR8:
+	case V4L2_PIX_FMT_SRGGB8:
+		return V4LCONVERT_FILTER_BAYER;
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		return V4LCONVERT_FILTER_RGB;
+	}
+	return 0;
+}
+
+/* Run the row filters of the current stage over row y of a frame of height
+   rows */
+static void v4lprocessing_row_filters(struct v4lprocessing_data *data,
+		unsigned char *buf, int width, unsigned int pixelformat,
+		int band, int y, int height)
 {
+	const struct v4lconvert_filter *filter;
 	int i;
 
-	for (i = 0; i < 256; i++) {
-		data->comp1[i] = i;
-		data->green[i] = i;
-		data->comp2[i] = i;
+	for (i = 0; i < data->row_filter_count; i++) {
+		if (!(data->stage_filters & (1 << i)))
+			continue;
+
+		filter = data->row_filters[i];
+		filter->row(filter->priv, buf, width, pixelformat, band, y, height);
 	}
+}
+
+static void v4lprocessing_update_lookup_tables(struct v4lprocessing_data *data)
+{
+	struct v4lprocessing_stats *stats = &data->stats;
+	int i, j, count = v4lconvert_threads_count(data->threads);
+
+	*stats = data->band_stats[0];
+	for (i = 1; i < count; i++) {
+		for (j = 0; j < 4; j++) {
+			stats->sum[j] += data->band_stats[i].sum[j];
+			stats->count[j] += data->band_stats[i].count[j];
+		}
+		for (j = 0; j < 256; j++)
+			stats->histogram[j] += data->band_stats[i].histogram[j];
+	}
+
+	v4lprocessing_reset_lookup_tables(data);
 
 	data->lookup_table_active = 0;
 	for (i = 0; i < ARRAY_SIZE(filters); i++) {
 		if (filters[i]->active(data)) {
-			if (filters[i]->calculate_lookup_tables(data, buf, fmt))
+			if (filters[i]->calculate_lookup_tables(data, stats))
 				data->lookup_table_active = 1;
 		}
 	}
 }
 
-static void v4lprocessing_do_processing(struct v4lprocessing_data *data,
-		unsigned char *buf, const struct v4l2_format *fmt)
+/* Called at the end of each frame, the lookup tables calculated from the
+   statistics of this frame get used starting with the next frame */
+static void v4lprocessing_frame_done(struct v4lprocessing_data *data)
 {
-	int x, y;
+	if (data->gather_stats) {
+		data->controls_changed = 0;
+		data->lookup_table_update_counter = 0;
+		/* Do this after resetting lookup_table_update_counter so that filters can
+		   force the next update to be sooner when they changed camera settings */
+		v4lprocessing_update_lookup_tables(data);
+		data->gather_stats = 0;
+	} else if (data->lookup_table_update_counter < V4L2PROCESSING_UPDATE_RATE)
+		data->lookup_table_update_counter++;
 
-	switch (fmt->fmt.pix.pixelformat) {
-	case V4L2_PIX_FMT_SGBRG8:
-	case V4L2_PIX_FMT_SGRBG8: /* Bayer patterns starting with green */
-		for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
-				*buf = data->green[*buf];
-				buf++;
-				*buf = data->comp1[*buf];
-				buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
-				*buf = data->comp2[*buf];
-				buf++;
-				*buf = data->green[*buf];
-				buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
-		}
-		break;
+	data->do_process = 0;
+}
 
-	case V4L2_PIX_FMT_SBGGR8:
-	case V4L2_PIX_FMT_SRGGB8: /* Bayer patterns *NOT* starting with green */
-		for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
+/* Apply the lookup tables to a single row of width samples, with the even
+   samples being of component c0 and the odd samples of component c1 (0 for
+   comp1, 1 for green, 2 for comp2, 3 for green on the comp2 rows of bayer
+   data), and if stats is not NULL add the row to the statistics. For rgb / bgr rows use c0 = -1 and width in pixels. If
+   histogram is not NULL the row lies in the center of the frame and the
+   samples between x0 and x1 are added to the histogram too. */
+static void v4lprocessing_row(struct v4lprocessing_data *data,
+		struct v4lprocessing_stats *stats, unsigned int *histogram,
+		unsigned char *buf, int width, int c0, int c1, int x0, int x1)
+{
+	unsigned char *lut[4] = {
+		data->comp1, data->green, data->comp2, data->green
+	};
+	unsigned int sum[4] = { 0, 0, 0, 0 };
+	int x;
+
+	if (!stats) {
+		if (!data->stage_lookup || !data->lookup_table_active)
+			return;
+
+		if (c0 == -1) {
+			for (x = 0; x < width; x++) {
 				*buf = data->comp1[*buf];
 				buf++;
 				*buf = data->green[*buf];
 				buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
-				*buf = data->green[*buf];
-				buf++;
 				*buf = data->comp2[*buf];
 				buf++;
 			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
+			return;
 		}
-		break;
 
-	case V4L2_PIX_FMT_RGB24:
-	case V4L2_PIX_FMT_BGR24:
-		for (y = 0; y < fmt->fmt.pix.height; y++) {
-			for (x = 0; x < fmt->fmt.pix.width; x++) {
-				*buf = data->comp1[*buf];
-				buf++;
-				*buf = data->green[*buf];
-				buf++;
-				*buf = data->comp2[*buf];
-				buf++;
+		for (x = 0; x + 1 < width; x += 2) {
+			*buf = lut[c0][*buf];
+			buf++;
+			*buf = lut[c1][*buf];
+			buf++;
+		}
+		return;
+	}
+
+	if (!histogram)
+		x0 = x1 = width;
+
+	if (c0 == -1) {
+		for (x = 0; x < width; x++) {
+			sum[0] += buf[0];
+			sum[1] += buf[1];
+			sum[2] += buf[2];
+			if (x >= x0 && x < x1) {
+				histogram[buf[0]]++;
+				histogram[buf[1]]++;
+				histogram[buf[2]]++;
 			}
-			buf += fmt->fmt.pix.bytesperline - 3 * fmt->fmt.pix.width;
+			buf[0] = data->comp1[buf[0]];
+			buf[1] = data->green[buf[1]];
+			buf[2] = data->comp2[buf[2]];
+			buf += 3;
 		}
+		for (x = 0; x < 3; x++) {
+			stats->sum[x] += sum[x];
+			stats->count[x] += width;
+		}
+		return;
+	}
+
+	for (x = 0; x + 1 < width; x += 2) {
+		sum[c0] += buf[0];
+		sum[c1] += buf[1];
+		if (x >= x0 && x < x1)
+			histogram[buf[0]]++;
+		if (x + 1 >= x0 && x + 1 < x1)
+			histogram[buf[1]]++;
+		buf[0] = lut[c0][buf[0]];
+		buf[1] = lut[c1][buf[1]];
+		buf += 2;
+	}
+	stats->sum[c0] += sum[c0];
+	stats->count[c0] += width / 2;
+	stats->sum[c1] += sum[c1];
+	stats->count[c1] += width / 2;
+}
+
+/* Returns the histogram to use for row y of a frame of height rows */
+static unsigned int *v4lprocessing_row_histogram(
+		struct v4lprocessing_stats *stats, int y, int height)
+{
+	if (!stats || y < height / 4 || y >= height / 4 + height / 2)
+		return NULL;
+
+	return stats->histogram;
+}
+
+struct v4lprocessing_job {
+	struct v4lprocessing_data *data;
+	unsigned char *buf;
+	const struct v4l2_format *fmt;
+};
+
+/* For bayer formats start and end are in units of 2 lines */
+static void v4lprocessing_do_processing_rows(void *arg, int band,
+		int start, int end)
+{
+	struct v4lprocessing_job *job = arg;
+	struct v4lprocessing_data *data = job->data;
+	struct v4lprocessing_stats *stats =
+		data->stage_lookup && data->gather_stats ?
+		&data->band_stats[band] : NULL;
+	const struct v4l2_format *fmt = job->fmt;
+	unsigned int width = fmt->fmt.pix.width;
+	unsigned int height = fmt->fmt.pix.height;
+	unsigned int stride = fmt->fmt.pix.bytesperline;
+	unsigned int pixelformat = fmt->fmt.pix.pixelformat;
+	unsigned char *buf = job->buf;
+	int y, c0, c1, c2, c3;
+
+	switch (pixelformat) {
+	case V4L2_PIX_FMT_SGBRG8:
+	case V4L2_PIX_FMT_SGRBG8: /* Bayer patterns starting with green */
+		c0 = 1; c1 = 0; c2 = 2; c3 = 3;
 		break;
+	case V4L2_PIX_FMT_SBGGR8:
+	case V4L2_PIX_FMT_SRGGB8: /* Bayer patterns *NOT* starting with green */
+		c0 = 0; c1 = 1; c2 = 3; c3 = 2;
+		break;
+	default: /* RGB24 / BGR24 */
+		buf += start * stride;
+		for (y = start; y < end; y++) {
+			v4lprocessing_row(data, stats,
+				v4lprocessing_row_histogram(stats, y, height),
+				buf, width, -1, -1, width / 4, width / 4 + width / 2);
+			v4lprocessing_row_filters(data, buf, width, pixelformat,
+						  band, y, height);
+			buf += stride;
+		}
+		return;
+	}
+
+	buf += start * 2 * stride;
+	for (y = 2 * start; y < 2 * end; y += 2) {
+		v4lprocessing_row(data, stats,
+			v4lprocessing_row_histogram(stats, y, height),
+			buf, width, c0, c1, width / 4, width / 4 + width / 2);
+		v4lprocessing_row_filters(data, buf, width, pixelformat,
+					  band, y, height);
+		buf += stride;
+		v4lprocessing_row(data, stats,
+			v4lprocessing_row_histogram(stats, y + 1, height),
+			buf, width, c2, c3, width / 4, width / 4 + width / 2);
+		v4lprocessing_row_filters(data, buf, width, pixelformat,
+					  band, y + 1, height);
+		buf += stride;
 	}
 }
 
-void v4lprocessing_processing(struct v4lprocessing_data *data,
+static void v4lprocessing_do_processing(struct v4lprocessing_data *data,
 		unsigned char *buf, const struct v4l2_format *fmt)
 {
-	if (!data->do_process)
-		return;
+	struct v4lprocessing_job job = { data, buf, fmt };
+	int rows = fmt->fmt.pix.height;
 
-	/* Do we support the current pixformat? */
 	switch (fmt->fmt.pix.pixelformat) {
 	case V4L2_PIX_FMT_SGBRG8:
 	case V4L2_PIX_FMT_SGRBG8:
 	case V4L2_PIX_FMT_SBGGR8:
 	case V4L2_PIX_FMT_SRGGB8:
-	case V4L2_PIX_FMT_RGB24:
-	case V4L2_PIX_FMT_BGR24:
+		rows /= 2;
 		break;
-	default:
-		return; /* Non supported pix format */
 	}
 
-	if (data->controls_changed ||
-			data->lookup_table_update_counter == V4L2PROCESSING_UPDATE_RATE) {
-		data->controls_changed = 0;
-		data->lookup_table_update_counter = 0;
-		/* Do this after resetting lookup_table_update_counter so that filters can
-		   force the next update to be sooner when they changed camera settings */
-		v4lprocessing_update_lookup_tables(data, buf, fmt);
-	} else
-		data->lookup_table_update_counter++;
+	v4lconvert_threads_run(data->threads, v4lprocessing_do_processing_rows,
+			       &job, rows, 1);
+}
+
+/* Active row filters which do not accept any of the formats in the
+   V4LCONVERT_FILTER_* mask formats cannot be applied to the current frame */
+static void v4lprocessing_skip_row_filters(struct v4lprocessing_data *data,
+		unsigned int formats)
+{
+	int i;
+
+	for (i = 0; i < data->row_filter_count; i++) {
+		if (!(data->row_filters[i]->formats & formats))
+			data->row_filters_pending &= ~(1 << i);
+	}
+}
 
-	if (data->lookup_table_active)
+int v4lprocessing_plan_frame(struct v4lprocessing_data *data,
+		unsigned int src_pixelformat, unsigned int dest_pixelformat)
+{
+	unsigned int formats = v4lprocessing_filter_format(src_pixelformat) |
+			       v4lprocessing_filter_format(dest_pixelformat);
+	int i, needs_rgb = 0;
+
+	if (!data->do_process)
+		return 0;
+
+	/* The lookup tables can be applied to both bayer and rgb data */
+	if (!data->lookup_done && !formats)
+		needs_rgb = 1;
+
+	for (i = 0; i < data->row_filter_count; i++) {
+		if ((data->row_filters_pending & (1 << i)) &&
+				!(data->row_filters[i]->formats & formats) &&
+				(data->row_filters[i]->formats &
+				 V4LCONVERT_FILTER_RGB))
+			needs_rgb = 1;
+	}
+	if (needs_rgb)
+		formats |= V4LCONVERT_FILTER_RGB;
+
+	v4lprocessing_skip_row_filters(data, formats);
+	if (data->lookup_done && !data->row_filters_pending)
+		v4lprocessing_frame_done(data);
+
+	return needs_rgb;
+}
+
+/* Select what to do in the current stage: the lookup tables get applied
+   to the first bayer or rgb data of a frame, each row filter to the first
+   data of the frame in a format it accepts */
+static void v4lprocessing_start_stage(struct v4lprocessing_data *data,
+		unsigned int format)
+{
+	int i;
+
+	data->stage_lookup = !data->lookup_done;
+	data->stage_filters = 0;
+	for (i = 0; i < data->row_filter_count; i++) {
+		if ((data->row_filters_pending & (1 << i)) &&
+				(data->row_filters[i]->formats & format))
+			data->stage_filters |= 1 << i;
+	}
+}
+
+static void v4lprocessing_end_stage(struct v4lprocessing_data *data)
+{
+	data->lookup_done = 1;
+	data->row_filters_pending &= ~data->stage_filters;
+	if (!data->row_filters_pending)
+		v4lprocessing_frame_done(data);
+}
+
+void v4lprocessing_processing(struct v4lprocessing_data *data,
+		unsigned char *buf, const struct v4l2_format *fmt)
+{
+	unsigned int format;
+
+	if (!data->do_process)
+		return;
+
+	/* Do we support the current pixformat? If not we get called again
+	   after conversion to rgb */
+	format = v4lprocessing_filter_format(fmt->fmt.pix.pixelformat);
+	if (!format)
+		return;
+
+	v4lprocessing_start_stage(data, format);
+
+	/* Applying the lookup tables and gathering the statistics for the
+	   next update is done in a single pass over the frame */
+	if ((data->stage_lookup &&
+	     (data->lookup_table_active || data->gather_stats)) ||
+			data->stage_filters)
 		v4lprocessing_do_processing(data, buf, fmt);
 
-	data->do_process = 0;
+	v4lprocessing_end_stage(data);
+}
+
+int v4lprocessing_rows_supported(struct v4lprocessing_data *data,
+		unsigned int pixelformat, int whole_frame)
+{
+	if (!data->do_process)
+		return 1;
+
+	if (v4lprocessing_filter_format(pixelformat) != V4LCONVERT_FILTER_RGB)
+		return 0;
+
+	/* The rows are all the processing gets to see of this frame */
+	v4lprocessing_skip_row_filters(data, V4LCONVERT_FILTER_RGB);
+
+	/* The statistics must cover the whole (uncropped) frame, and row
+	   filters must get the same whole source rows as on the regular path
+	   (they may depend on the position within the frame), let the regular
+	   path process the whole frame before cropping / scaling */
+	if (!whole_frame && (data->gather_stats || data->row_filters_pending))
+		return 0;
+
+	v4lprocessing_start_stage(data, V4LCONVERT_FILTER_RGB);
+	data->row_pixelformat = pixelformat;
+	return 1;
+}
+
+void v4lprocessing_processing_row(struct v4lprocessing_data *data,
+		unsigned char *buf, int width, int band, int y, int height)
+{
+	struct v4lprocessing_stats *stats;
+
+	if (!data->do_process)
+		return;
+
+	stats = data->stage_lookup && data->gather_stats ?
+		&data->band_stats[band] : NULL;
+	v4lprocessing_row(data, stats,
+			  v4lprocessing_row_histogram(stats, y, height),
+			  buf, width, -1, -1, width / 4, width / 4 + width / 2);
+	v4lprocessing_row_filters(data, buf, width, data->row_pixelformat,
+				  band, y, height);
+}
+
+void v4lprocessing_processing_rows_done(struct v4lprocessing_data *data)
+{
+	if (!data->do_process)
+		return;
+
+	v4lprocessing_end_stage(data);
 }
@@ -26,18 +26,69 @@
 
 struct v4lprocessing_data;
 struct v4lcontrol_data;
+struct v4lconvert_threads;
+struct v4lconvert_filter;
 
 struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *data);
 void v4lprocessing_destroy(struct v4lprocessing_data *data);
 
+/* Use the passed in worker threads for applying the lookup tables, NULL
+   means do everything from the calling thread */
+void v4lprocessing_set_threads(struct v4lprocessing_data *data,
+  struct v4lconvert_threads *threads);
+
+/* Add / remove a custom row filter, see v4lconvert_add_filter() */
+int v4lprocessing_add_filter(struct v4lprocessing_data *data,
+  const struct v4lconvert_filter *filter);
+void v4lprocessing_remove_filter(struct v4lprocessing_data *data,
+  const struct v4lconvert_filter *filter);
+
 /* Prepare to process 1 frame, returns 1 if processing is necesary,
    return 0 if no processing will be done */
 int v4lprocessing_pre_processing(struct v4lprocessing_data *data);
 
-/* Do the actual processing, this is a nop if v4lprocessing_pre_processing()
-   returned 0, or if called more then 1 time after a single
-   v4lprocessing_pre_processing() call. */
+/* Do the actual processing, this applies the lookup tables and gathers the
+   statistics the lookup tables for the next frames are calculated from in a
+   single pass over buf, together with the row filters which accept the
+   format of buf. This may be called at several stages of the conversion of
+   a frame, the lookup tables get applied at the first stage with bayer or rgb
+   data and each row filter at the first stage with a format it accepts, so
+   that everything is done once. This is a nop if
+   v4lprocessing_pre_processing() returned 0, or for formats other then
+   bayer and rgb24 / bgr24. */
 void v4lprocessing_processing(struct v4lprocessing_data *data,
   unsigned char *buf, const struct v4l2_format *fmt);
 
+/* Plan the processing of the current frame, which is available as
+   src_pixelformat before and as dest_pixelformat after conversion (either
+   can be a format processing cannot be done on). Row filters which cannot
+   be applied to either get skipped for this frame, unless they accept rgb.
+   Returns 1 if the frame must be converted to rgb24 in between, because the
+   lookup tables or such a filter need it. */
+int v4lprocessing_plan_frame(struct v4lprocessing_data *data,
+  unsigned int src_pixelformat, unsigned int dest_pixelformat);
+
+/* Check if the processing for the current frame can be done one row at a
+   time with v4lprocessing_processing_row() on rows of pixelformat (which must
+   be rgb24 or bgr24). whole_frame must be 0 if not every pixel of the frame
+   gets passed exactly once (cropping or scaling), as the statistics are
+   gathered over the whole frame and row filters get whole source rows.
+   Returns 1 if row processing is possible, after which the frame must be
+   processed with v4lprocessing_processing_row(), row filters which do not
+   accept rgb get skipped for this frame. */
+int v4lprocessing_rows_supported(struct v4lprocessing_data *data,
+  unsigned int pixelformat, int whole_frame);
+
+/* Apply the lookup tables to a single row of width rgb24 / bgr24 pixels,
+   only to be used after v4lprocessing_rows_supported() returned 1. y is the
+   row number within a frame of height rows, this is used (together with the
+   band, see v4lconvert_threads_run()) to gather the statistics for updating
+   the lookup tables while applying them. */
+void v4lprocessing_processing_row(struct v4lprocessing_data *data,
+  unsigned char *buf, int width, int band, int y, int height);
+
+/* Signal all rows of the current frame have been processed, this takes the
+   place of the v4lprocessing_processing() call for this frame */
+void v4lprocessing_processing_rows_done(struct v4lprocessing_data *data);
+
 #endif
@@ -120,89 +120,26 @@ static int whitebalance_calculate_lookup_tables_generic(
 	return 1;
 }
 
-static int whitebalance_calculate_lookup_tables_bayer(
-		struct v4lprocessing_data *data, unsigned char *buf,
-		const struct v4l2_format *fmt, int starts_with_green)
-{
-	int x, y, a1 = 0, a2 = 0, b1 = 0, b2 = 0;
-	int green_avg, comp1_avg, comp2_avg;
-
-	for (y = 0; y < fmt->fmt.pix.height; y += 2) {
-		for (x = 0; x < fmt->fmt.pix.width; x += 2) {
-			a1 += *buf++;
-			a2 += *buf++;
-		}
-		buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
-		for (x = 0; x < fmt->fmt.pix.width; x += 2) {
-			b1 += *buf++;
-			b2 += *buf++;
-		}
-		buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
-	}
-
-	if (starts_with_green) {
-		green_avg = a1 / 2 + b2 / 2;
-		comp1_avg = a2;
-		comp2_avg = b1;
-	} else {
-		green_avg = a2 / 2 + b1 / 2;
-		comp1_avg = a1;
-		comp2_avg = b2;
-	}
-
-	/* Norm avg to ~ 0 - 4095 */
-	green_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 64;
-	comp1_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 64;
-	comp2_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 64;
-
-	return whitebalance_calculate_lookup_tables_generic(data, green_avg,
-			comp1_avg, comp2_avg);
-}
-
-static int whitebalance_calculate_lookup_tables_rgb(
-		struct v4lprocessing_data *data, unsigned char *buf,
-		const struct v4l2_format *fmt)
-{
-	int x, y, green_avg = 0, comp1_avg = 0, comp2_avg = 0;
-
-	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		for (x = 0; x < fmt->fmt.pix.width; x++) {
-			comp1_avg += *buf++;
-			green_avg += *buf++;
-			comp2_avg += *buf++;
-		}
-		buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width * 3;
-	}
-
-	/* Norm avg to ~ 0 - 4095 */
-	green_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 16;
-	comp1_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 16;
-	comp2_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 16;
-
-	return whitebalance_calculate_lookup_tables_generic(data, green_avg,
-			comp1_avg, comp2_avg);
-}
-
-
 static int whitebalance_calculate_lookup_tables(
 		struct v4lprocessing_data *data,
-		unsigned char *buf, const struct v4l2_format *fmt)
+		const struct v4lprocessing_stats *stats)
 {
-	switch (fmt->fmt.pix.pixelformat) {
-	case V4L2_PIX_FMT_SGBRG8:
-	case V4L2_PIX_FMT_SGRBG8: /* Bayer patterns starting with green */
-		return whitebalance_calculate_lookup_tables_bayer(data, buf, fmt, 1);
-
-	case V4L2_PIX_FMT_SBGGR8:
-	case V4L2_PIX_FMT_SRGGB8: /* Bayer patterns *NOT* starting with green */
-		return whitebalance_calculate_lookup_tables_bayer(data, buf, fmt, 0);
-
-	case V4L2_PIX_FMT_RGB24:
-	case V4L2_PIX_FMT_BGR24:
-		return whitebalance_calculate_lookup_tables_rgb(data, buf, fmt);
-	}
+	uint64_t green, norm;
+
+	/* Norm avg to ~ 0 - 4095, by dividing by width * height / 64 for bayer
+	   and width * height / 16 for rgb, both of which are the number of
+	   comp1 samples / 16 */
+	norm = stats->count[0] / 16;
+	if (norm == 0)
+		return 0;
+
+	if (stats->count[3]) /* Bayer, average the green of both rows */
+		green = stats->sum[1] / 2 + stats->sum[3] / 2;
+	else
+		green = stats->sum[1];
 
-	return 0; /* Should never happen */
+	return whitebalance_calculate_lookup_tables_generic(data, green / norm,
+			stats->sum[0] / norm, stats->sum[2] / norm);
 }
 
 struct v4lprocessing_filter whitebalance_filter = {
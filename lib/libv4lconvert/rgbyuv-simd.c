@@ -0,0 +1,838 @@
+/*
+
+# Vectorized RGB <-> YUV conversion routines
+
+#             (C) 2026 the v4l-utils contributors
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+/* These functions convert the start of a single line, as many pixels as
+   they can do in whole vector steps, and return the number of pixels (or for
+   the yuv420 chroma planes 2x2 blocks) done. The plain C code in rgbyuv.c
+   does the rest of the line, and all of it when no vector unit is available,
+   so it stays the reference implementation; the results here are bit for bit
+   identical to it. */
+
+#include "libv4lconvert-priv.h"
+#include "simd-priv.h"
+
+/* Positions of the Y, U and V bytes within a 4 byte / 2 pixel macropixel */
+static void v4lconvert_packed_yuv_layout(unsigned int pixfmt, int *y_pos,
+		int *u_pos, int *v_pos)
+{
+	switch (pixfmt) {
+	case V4L2_PIX_FMT_YVYU:
+		*y_pos = 0;
+		*u_pos = 3;
+		*v_pos = 1;
+		break;
+	case V4L2_PIX_FMT_UYVY:
+		*y_pos = 1;
+		*u_pos = 0;
+		*v_pos = 2;
+		break;
+	default: /* V4L2_PIX_FMT_YUYV */
+		*y_pos = 0;
+		*u_pos = 1;
+		*v_pos = 3;
+	}
+}
+
+#ifdef V4LCONVERT_SIMD_X86
+
+/* Calculate the r, g and b difference terms for 8 u and v values (16 bit,
+   0 - 255), using the same multiplication free formulas as rgbyuv.c */
+static inline void v4lconvert_uv_terms_sse2(__m128i u, __m128i v,
+		__m128i *u1, __m128i *rg, __m128i *v1)
+{
+	const __m128i c128 = _mm_set1_epi16(128);
+
+	u = _mm_sub_epi16(u, c128);
+	v = _mm_sub_epi16(v, c128);
+	*u1 = _mm_srai_epi16(_mm_add_epi16(_mm_slli_epi16(u, 7), u), 6);
+	*rg = _mm_srai_epi16(_mm_add_epi16(
+			_mm_add_epi16(_mm_slli_epi16(u, 1), u),
+			_mm_add_epi16(_mm_slli_epi16(v, 2), _mm_slli_epi16(v, 1))), 3);
+	*v1 = _mm_srai_epi16(_mm_add_epi16(_mm_slli_epi16(v, 1), v), 1);
+}
+
+/* Convert 16 pixels, y_lo / y_hi hold the 16 bit Y values of pixels 0-7 and
+   8-15, u and v the 16 bit chroma values for the 8 pixel pairs */
+static inline void v4lconvert_yuv_to_rgb24_16px_sse2(unsigned char *dest,
+		__m128i y_lo, __m128i y_hi, __m128i u, __m128i v, int bgr)
+{
+	__m128i u1, rg, v1, r, g, b;
+
+	v4lconvert_uv_terms_sse2(u, v, &u1, &rg, &v1);
+
+	r = _mm_packus_epi16(
+		_mm_add_epi16(y_lo, _mm_unpacklo_epi16(v1, v1)),
+		_mm_add_epi16(y_hi, _mm_unpackhi_epi16(v1, v1)));
+	g = _mm_packus_epi16(
+		_mm_sub_epi16(y_lo, _mm_unpacklo_epi16(rg, rg)),
+		_mm_sub_epi16(y_hi, _mm_unpackhi_epi16(rg, rg)));
+	b = _mm_packus_epi16(
+		_mm_add_epi16(y_lo, _mm_unpacklo_epi16(u1, u1)),
+		_mm_add_epi16(y_hi, _mm_unpackhi_epi16(u1, u1)));
+
+	if (bgr)
+		v4lconvert_store_rgb24_sse2(dest, b, g, r);
+	else
+		v4lconvert_store_rgb24_sse2(dest, r, g, b);
+}
+
+static int v4lconvert_packed_yuv_to_rgb24_sse2(const unsigned char *src,
+		unsigned char *dest, int width, int y_pos, int u_pos, int bgr)
+{
+	const __m128i mask = _mm_set1_epi32(0x0000ffff);
+	const __m128i lo_bytes = _mm_set1_epi16(0x00ff);
+	int j;
+
+	for (j = 0; j + 16 < width; j += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+		__m128i y_lo, y_hi, c_a, c_b, c0, c1;
+
+		if (y_pos == 0) {
+			y_lo = _mm_and_si128(a, lo_bytes);
+			y_hi = _mm_and_si128(b, lo_bytes);
+			c_a = _mm_srli_epi16(a, 8);
+			c_b = _mm_srli_epi16(b, 8);
+		} else {
+			y_lo = _mm_srli_epi16(a, 8);
+			y_hi = _mm_srli_epi16(b, 8);
+			c_a = _mm_and_si128(a, lo_bytes);
+			c_b = _mm_and_si128(b, lo_bytes);
+		}
+		/* c_a / c_b now hold (first chroma, second chroma) 16 bit pairs */
+		c0 = _mm_packs_epi32(_mm_and_si128(c_a, mask),
+				     _mm_and_si128(c_b, mask));
+		c1 = _mm_packs_epi32(_mm_srli_epi32(c_a, 16),
+				     _mm_srli_epi32(c_b, 16));
+
+		if (u_pos < 2)
+			v4lconvert_yuv_to_rgb24_16px_sse2(dest, y_lo, y_hi,
+							  c0, c1, bgr);
+		else
+			v4lconvert_yuv_to_rgb24_16px_sse2(dest, y_lo, y_hi,
+							  c1, c0, bgr);
+		src += 32;
+		dest += 48;
+	}
+
+	return j;
+}
+
+static int v4lconvert_yuv420_to_rgb24_sse2(const unsigned char *ysrc,
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *dest, int width, int bgr)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int j;
+
+	for (j = 0; j + 16 < width; j += 16) {
+		__m128i y = _mm_loadu_si128((const __m128i *)ysrc);
+		__m128i u = _mm_loadl_epi64((const __m128i *)usrc);
+		__m128i v = _mm_loadl_epi64((const __m128i *)vsrc);
+
+		v4lconvert_yuv_to_rgb24_16px_sse2(dest,
+			_mm_unpacklo_epi8(y, zero), _mm_unpackhi_epi8(y, zero),
+			_mm_unpacklo_epi8(u, zero), _mm_unpacklo_epi8(v, zero),
+			bgr);
+		ysrc += 16;
+		usrc += 8;
+		vsrc += 8;
+		dest += 48;
+	}
+
+	return j;
+}
+
+/* Semi planar (NV12 and friends), u and v are interleaved in a single plane,
+   with vu set v comes first */
+static int v4lconvert_nv12_to_rgb24_sse2(const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width, int vu,
+		int bgr)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lo_bytes = _mm_set1_epi16(0x00ff);
+	int j;
+
+	for (j = 0; j + 16 < width; j += 16) {
+		__m128i y = _mm_loadu_si128((const __m128i *)ysrc);
+		__m128i uv = _mm_loadu_si128((const __m128i *)uvsrc);
+		__m128i c0 = _mm_and_si128(uv, lo_bytes);
+		__m128i c1 = _mm_srli_epi16(uv, 8);
+		__m128i y_lo = _mm_unpacklo_epi8(y, zero);
+		__m128i y_hi = _mm_unpackhi_epi8(y, zero);
+
+		if (vu)
+			v4lconvert_yuv_to_rgb24_16px_sse2(dest, y_lo, y_hi,
+							  c1, c0, bgr);
+		else
+			v4lconvert_yuv_to_rgb24_16px_sse2(dest, y_lo, y_hi,
+							  c0, c1, bgr);
+		ysrc += 16;
+		uvsrc += 16;
+		dest += 48;
+	}
+
+	return j;
+}
+
+/* Split count interleaved pairs into 2 planes */
+static int v4lconvert_split_uv_sse2(const unsigned char *src,
+		unsigned char *dest0, unsigned char *dest1, int count)
+{
+	const __m128i lo_bytes = _mm_set1_epi16(0x00ff);
+	int j;
+
+	for (j = 0; j + 16 <= count; j += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+
+		_mm_storeu_si128((__m128i *)dest0, _mm_packus_epi16(
+			_mm_and_si128(a, lo_bytes), _mm_and_si128(b, lo_bytes)));
+		_mm_storeu_si128((__m128i *)dest1, _mm_packus_epi16(
+			_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+		src += 32;
+		dest0 += 16;
+		dest1 += 16;
+	}
+
+	return j;
+}
+
+/* Multiply the 4 (16 bit) components of 2 pixels with coef and sum them,
+   leaving the result for the 2 pixels in 32 bit lanes 0 and 2 */
+static inline __m128i v4lconvert_dot_2px_sse2(__m128i px, __m128i coef)
+{
+	__m128i m = _mm_madd_epi16(px, coef);
+
+	return _mm_add_epi32(m, _mm_srli_epi64(m, 32));
+}
+
+/* Apply (dot(4 pixels, coef) + offset) >> 15, given 2 vectors of 2 pixels */
+static inline __m128i v4lconvert_dot_4px_sse2(__m128i px01, __m128i px23,
+		__m128i coef, __m128i offset)
+{
+	__m128i d01 = _mm_shuffle_epi32(v4lconvert_dot_2px_sse2(px01, coef),
+					_MM_SHUFFLE(3, 1, 2, 0));
+	__m128i d23 = _mm_shuffle_epi32(v4lconvert_dot_2px_sse2(px23, coef),
+					_MM_SHUFFLE(3, 1, 2, 0));
+
+	return _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi64(d01, d23),
+					    offset), 15);
+}
+
+static int v4lconvert_rgb24_to_y_sse2(const unsigned char *src,
+		unsigned char *dest, int width, int bpp, int bgr)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i offset = _mm_set1_epi32(524288);
+	const __m128i coef = bgr ?
+		_mm_setr_epi16(3223, 16594, 8453, 0, 3223, 16594, 8453, 0) :
+		_mm_setr_epi16(8453, 16594, 3223, 0, 8453, 16594, 3223, 0);
+	int i, j;
+
+	/* Loading a pixel reads 4 bytes, so with bpp 3 we need 1 byte beyond
+	   the last pixel we do */
+	for (j = 0; j + 16 < width; j += 16) {
+		__m128i y[4];
+
+		for (i = 0; i < 4; i++) {
+			__m128i px = _mm_setr_epi32(
+				v4lconvert_load32(src),
+				v4lconvert_load32(src + bpp),
+				v4lconvert_load32(src + 2 * bpp),
+				v4lconvert_load32(src + 3 * bpp));
+
+			y[i] = v4lconvert_dot_4px_sse2(
+					_mm_unpacklo_epi8(px, zero),
+					_mm_unpackhi_epi8(px, zero),
+					coef, offset);
+			src += 4 * bpp;
+		}
+		_mm_storeu_si128((__m128i *)dest, _mm_packus_epi16(
+				_mm_packs_epi32(y[0], y[1]),
+				_mm_packs_epi32(y[2], y[3])));
+		dest += 16;
+	}
+
+	return j;
+}
+
+static int v4lconvert_rgb24_to_uv_sse2(const unsigned char *src, int stride,
+		unsigned char *udest, unsigned char *vdest, int blocks, int bpp,
+		int bgr)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i offset = _mm_set1_epi32(4210688);
+	const __m128i ucoef = bgr ?
+		_mm_setr_epi16(14456, -9578, -4878, 0, 14456, -9578, -4878, 0) :
+		_mm_setr_epi16(-4878, -9578, 14456, 0, -4878, -9578, 14456, 0);
+	const __m128i vcoef = bgr ?
+		_mm_setr_epi16(-2351, -12105, 14456, 0, -2351, -12105, 14456, 0) :
+		_mm_setr_epi16(14456, -12105, -2351, 0, 14456, -12105, -2351, 0);
+	int i, j;
+
+	/* 8 blocks (of 2x2 pixels) per step, again with bpp 3 we read 1 byte
+	   beyond the last pixel */
+	for (j = 0; j + 8 < blocks; j += 8) {
+		__m128i avg[4], u[2], v[2];
+
+		for (i = 0; i < 8; i++) {
+			__m128i px = _mm_setr_epi32(
+				v4lconvert_load32(src),
+				v4lconvert_load32(src + bpp),
+				v4lconvert_load32(src + stride),
+				v4lconvert_load32(src + stride + bpp));
+			__m128i sum = _mm_add_epi16(_mm_unpacklo_epi8(px, zero),
+						    _mm_unpackhi_epi8(px, zero));
+
+			/* Lanes 0-3 now hold the sums over the 2x2 block */
+			sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+			if (i & 1)
+				avg[i / 2] = _mm_unpacklo_epi64(avg[i / 2], sum);
+			else
+				avg[i / 2] = sum;
+			src += 2 * bpp;
+		}
+
+		for (i = 0; i < 4; i++)
+			avg[i] = _mm_srli_epi16(avg[i], 2);
+
+		u[0] = v4lconvert_dot_4px_sse2(avg[0], avg[1], ucoef, offset);
+		u[1] = v4lconvert_dot_4px_sse2(avg[2], avg[3], ucoef, offset);
+		v[0] = v4lconvert_dot_4px_sse2(avg[0], avg[1], vcoef, offset);
+		v[1] = v4lconvert_dot_4px_sse2(avg[2], avg[3], vcoef, offset);
+
+		_mm_storel_epi64((__m128i *)udest, _mm_packus_epi16(
+				_mm_packs_epi32(u[0], u[1]), zero));
+		_mm_storel_epi64((__m128i *)vdest, _mm_packus_epi16(
+				_mm_packs_epi32(v[0], v[1]), zero));
+		udest += 8;
+		vdest += 8;
+	}
+
+	return j;
+}
+
+/* The AVX2 versions do 32 pixels per step. To avoid lane crossing shuffles
+   in the inner part the 16 bit Y vectors are kept in the order pixels 0-7,
+   16-23 (lo) and 8-15, 24-31 (hi), which is what unpacking the chroma
+   values gives us. */
+__attribute__((target("avx2")))
+static inline void v4lconvert_yuv_to_rgb24_32px_avx2(unsigned char *dest,
+		__m256i y_lo, __m256i y_hi, __m256i u, __m256i v, int bgr)
+{
+	const __m256i c128 = _mm256_set1_epi16(128);
+	__m256i u1, rg, v1, r, g, b;
+
+	u = _mm256_sub_epi16(u, c128);
+	v = _mm256_sub_epi16(v, c128);
+	u1 = _mm256_srai_epi16(_mm256_add_epi16(_mm256_slli_epi16(u, 7), u), 6);
+	rg = _mm256_srai_epi16(_mm256_add_epi16(
+			_mm256_add_epi16(_mm256_slli_epi16(u, 1), u),
+			_mm256_add_epi16(_mm256_slli_epi16(v, 2),
+					 _mm256_slli_epi16(v, 1))), 3);
+	v1 = _mm256_srai_epi16(_mm256_add_epi16(_mm256_slli_epi16(v, 1), v), 1);
+
+	r = _mm256_packus_epi16(
+		_mm256_add_epi16(y_lo, _mm256_unpacklo_epi16(v1, v1)),
+		_mm256_add_epi16(y_hi, _mm256_unpackhi_epi16(v1, v1)));
+	g = _mm256_packus_epi16(
+		_mm256_sub_epi16(y_lo, _mm256_unpacklo_epi16(rg, rg)),
+		_mm256_sub_epi16(y_hi, _mm256_unpackhi_epi16(rg, rg)));
+	b = _mm256_packus_epi16(
+		_mm256_add_epi16(y_lo, _mm256_unpacklo_epi16(u1, u1)),
+		_mm256_add_epi16(y_hi, _mm256_unpackhi_epi16(u1, u1)));
+
+	if (bgr) {
+		__m256i tmp = r;
+
+		r = b;
+		b = tmp;
+	}
+	v4lconvert_store_rgb24_sse2(dest, _mm256_castsi256_si128(r),
+				    _mm256_castsi256_si128(g),
+				    _mm256_castsi256_si128(b));
+	v4lconvert_store_rgb24_sse2(dest + 48, _mm256_extracti128_si256(r, 1),
+				    _mm256_extracti128_si256(g, 1),
+				    _mm256_extracti128_si256(b, 1));
+}
+
+__attribute__((target("avx2")))
+static int v4lconvert_packed_yuv_to_rgb24_avx2(const unsigned char *src,
+		unsigned char *dest, int width, int y_pos, int u_pos, int bgr)
+{
+	const __m256i mask = _mm256_set1_epi32(0x0000ffff);
+	const __m256i lo_bytes = _mm256_set1_epi16(0x00ff);
+	int j;
+
+	for (j = 0; j + 32 < width; j += 32) {
+		__m256i in0 = _mm256_loadu_si256((const __m256i *)src);
+		__m256i in1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+		/* pixels 0-7, 16-23 resp. 8-15, 24-31 */
+		__m256i a = _mm256_permute2x128_si256(in0, in1, 0x20);
+		__m256i b = _mm256_permute2x128_si256(in0, in1, 0x31);
+		__m256i y_lo, y_hi, c_a, c_b, c0, c1;
+
+		if (y_pos == 0) {
+			y_lo = _mm256_and_si256(a, lo_bytes);
+			y_hi = _mm256_and_si256(b, lo_bytes);
+			c_a = _mm256_srli_epi16(a, 8);
+			c_b = _mm256_srli_epi16(b, 8);
+		} else {
+			y_lo = _mm256_srli_epi16(a, 8);
+			y_hi = _mm256_srli_epi16(b, 8);
+			c_a = _mm256_and_si256(a, lo_bytes);
+			c_b = _mm256_and_si256(b, lo_bytes);
+		}
+		/* Packing per 128 bit lane puts the chroma values of the 16
+		   pixel pairs in order */
+		c0 = _mm256_packs_epi32(_mm256_and_si256(c_a, mask),
+					_mm256_and_si256(c_b, mask));
+		c1 = _mm256_packs_epi32(_mm256_srli_epi32(c_a, 16),
+					_mm256_srli_epi32(c_b, 16));
+
+		if (u_pos < 2)
+			v4lconvert_yuv_to_rgb24_32px_avx2(dest, y_lo, y_hi,
+							  c0, c1, bgr);
+		else
+			v4lconvert_yuv_to_rgb24_32px_avx2(dest, y_lo, y_hi,
+							  c1, c0, bgr);
+		src += 64;
+		dest += 96;
+	}
+
+	return j;
+}
+
+__attribute__((target("avx2")))
+static int v4lconvert_yuv420_to_rgb24_avx2(const unsigned char *ysrc,
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *dest, int width, int bgr)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	int j;
+
+	for (j = 0; j + 32 < width; j += 32) {
+		__m256i y = _mm256_loadu_si256((const __m256i *)ysrc);
+		__m128i u = _mm_loadu_si128((const __m128i *)usrc);
+		__m128i v = _mm_loadu_si128((const __m128i *)vsrc);
+
+		v4lconvert_yuv_to_rgb24_32px_avx2(dest,
+			_mm256_unpacklo_epi8(y, zero),
+			_mm256_unpackhi_epi8(y, zero),
+			_mm256_cvtepu8_epi16(u), _mm256_cvtepu8_epi16(v), bgr);
+		ysrc += 32;
+		usrc += 16;
+		vsrc += 16;
+		dest += 96;
+	}
+
+	return j;
+}
+
+__attribute__((target("avx2")))
+static int v4lconvert_nv12_to_rgb24_avx2(const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width, int vu,
+		int bgr)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i lo_bytes = _mm256_set1_epi16(0x00ff);
+	int j;
+
+	for (j = 0; j + 32 < width; j += 32) {
+		__m256i y = _mm256_loadu_si256((const __m256i *)ysrc);
+		__m256i uv = _mm256_loadu_si256((const __m256i *)uvsrc);
+		__m256i c0 = _mm256_and_si256(uv, lo_bytes);
+		__m256i c1 = _mm256_srli_epi16(uv, 8);
+		__m256i y_lo = _mm256_unpacklo_epi8(y, zero);
+		__m256i y_hi = _mm256_unpackhi_epi8(y, zero);
+
+		if (vu)
+			v4lconvert_yuv_to_rgb24_32px_avx2(dest, y_lo, y_hi,
+							  c1, c0, bgr);
+		else
+			v4lconvert_yuv_to_rgb24_32px_avx2(dest, y_lo, y_hi,
+							  c0, c1, bgr);
+		ysrc += 32;
+		uvsrc += 32;
+		dest += 96;
+	}
+
+	return j;
+}
+
+#endif /* V4LCONVERT_SIMD_X86 */
+
+#ifdef V4LCONVERT_SIMD_NEON
+
+/* Calculate the r, g and b difference terms for 8 u and v values, using the
+   same multiplication free formulas as rgbyuv.c */
+static inline void v4lconvert_uv_terms_neon(uint8x8_t u8, uint8x8_t v8,
+		int16x8_t *u1, int16x8_t *rg, int16x8_t *v1)
+{
+	const uint8x8_t c128 = vdup_n_u8(128);
+	int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(u8, c128));
+	int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(v8, c128));
+
+	*u1 = vshrq_n_s16(vaddq_s16(vshlq_n_s16(u, 7), u), 6);
+	*rg = vshrq_n_s16(vaddq_s16(vaddq_s16(vshlq_n_s16(u, 1), u),
+			vaddq_s16(vshlq_n_s16(v, 2), vshlq_n_s16(v, 1))), 3);
+	*v1 = vshrq_n_s16(vaddq_s16(vshlq_n_s16(v, 1), v), 1);
+}
+
+/* Convert 16 pixels, y holds their Y values, u and v the chroma values for
+   the 8 pixel pairs */
+static inline void v4lconvert_yuv_to_rgb24_16px_neon(unsigned char *dest,
+		uint8x16_t y, uint8x8_t u, uint8x8_t v, int bgr)
+{
+	int16x8_t y_lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y)));
+	int16x8_t y_hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y)));
+	int16x8_t u1, rg, v1;
+	int16x8x2_t d;
+	uint8x16x3_t out;
+	uint8x16_t tmp;
+
+	v4lconvert_uv_terms_neon(u, v, &u1, &rg, &v1);
+
+	d = vzipq_s16(v1, v1);
+	out.val[0] = vcombine_u8(vqmovun_s16(vaddq_s16(y_lo, d.val[0])),
+				 vqmovun_s16(vaddq_s16(y_hi, d.val[1])));
+	d = vzipq_s16(rg, rg);
+	out.val[1] = vcombine_u8(vqmovun_s16(vsubq_s16(y_lo, d.val[0])),
+				 vqmovun_s16(vsubq_s16(y_hi, d.val[1])));
+	d = vzipq_s16(u1, u1);
+	out.val[2] = vcombine_u8(vqmovun_s16(vaddq_s16(y_lo, d.val[0])),
+				 vqmovun_s16(vaddq_s16(y_hi, d.val[1])));
+
+	if (bgr) {
+		tmp = out.val[0];
+		out.val[0] = out.val[2];
+		out.val[2] = tmp;
+	}
+	vst3q_u8(dest, out);
+}
+
+static int v4lconvert_packed_yuv_to_rgb24_neon(const unsigned char *src,
+		unsigned char *dest, int width, int y_pos, int u_pos, int v_pos,
+		int bgr)
+{
+	int j;
+
+	for (j = 0; j + 16 <= width; j += 16) {
+		/* 8 macropixels, byte n of each in val[n] */
+		uint8x8x4_t in = vld4_u8(src);
+		uint8x8x2_t y = vzip_u8(in.val[y_pos], in.val[y_pos + 2]);
+
+		v4lconvert_yuv_to_rgb24_16px_neon(dest,
+				vcombine_u8(y.val[0], y.val[1]),
+				in.val[u_pos], in.val[v_pos], bgr);
+		src += 32;
+		dest += 48;
+	}
+
+	return j;
+}
+
+static int v4lconvert_yuv420_to_rgb24_neon(const unsigned char *ysrc,
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *dest, int width, int bgr)
+{
+	int j;
+
+	for (j = 0; j + 16 <= width; j += 16) {
+		v4lconvert_yuv_to_rgb24_16px_neon(dest, vld1q_u8(ysrc),
+				vld1_u8(usrc), vld1_u8(vsrc), bgr);
+		ysrc += 16;
+		usrc += 8;
+		vsrc += 8;
+		dest += 48;
+	}
+
+	return j;
+}
+
+static int v4lconvert_nv12_to_rgb24_neon(const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width, int vu,
+		int bgr)
+{
+	int j;
+
+	for (j = 0; j + 16 <= width; j += 16) {
+		uint8x8x2_t uv = vld2_u8(uvsrc);
+
+		v4lconvert_yuv_to_rgb24_16px_neon(dest, vld1q_u8(ysrc),
+				uv.val[vu], uv.val[!vu], bgr);
+		ysrc += 16;
+		uvsrc += 16;
+		dest += 48;
+	}
+
+	return j;
+}
+
+static int v4lconvert_split_uv_neon(const unsigned char *src,
+		unsigned char *dest0, unsigned char *dest1, int count)
+{
+	int j;
+
+	for (j = 0; j + 16 <= count; j += 16) {
+		uint8x16x2_t uv = vld2q_u8(src);
+
+		vst1q_u8(dest0, uv.val[0]);
+		vst1q_u8(dest1, uv.val[1]);
+		src += 32;
+		dest0 += 16;
+		dest1 += 16;
+	}
+
+	return j;
+}
+
+/* (8453 * r + 16594 * g + 3223 * b + 524288) >> 15 for 8 pixels */
+static inline uint8x8_t v4lconvert_rgb_to_y_8px_neon(uint8x8_t r8,
+		uint8x8_t g8, uint8x8_t b8)
+{
+	uint16x8_t r = vmovl_u8(r8), g = vmovl_u8(g8), b = vmovl_u8(b8);
+	uint32x4_t lo, hi;
+
+	lo = vmull_n_u16(vget_low_u16(r), 8453);
+	lo = vmlal_n_u16(lo, vget_low_u16(g), 16594);
+	lo = vmlal_n_u16(lo, vget_low_u16(b), 3223);
+	hi = vmull_n_u16(vget_high_u16(r), 8453);
+	hi = vmlal_n_u16(hi, vget_high_u16(g), 16594);
+	hi = vmlal_n_u16(hi, vget_high_u16(b), 3223);
+	lo = vshrq_n_u32(vaddq_u32(lo, vdupq_n_u32(524288)), 15);
+	hi = vshrq_n_u32(vaddq_u32(hi, vdupq_n_u32(524288)), 15);
+
+	return vqmovn_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+}
+
+static int v4lconvert_rgb24_to_y_neon(const unsigned char *src,
+		unsigned char *dest, int width, int bpp, int bgr)
+{
+	int j;
+
+	for (j = 0; j + 8 <= width; j += 8) {
+		uint8x8_t c0, c1, c2;
+
+		if (bpp == 3) {
+			uint8x8x3_t in = vld3_u8(src);
+
+			c0 = in.val[0];
+			c1 = in.val[1];
+			c2 = in.val[2];
+		} else {
+			uint8x8x4_t in = vld4_u8(src);
+
+			c0 = in.val[0];
+			c1 = in.val[1];
+			c2 = in.val[2];
+		}
+		if (bgr)
+			vst1_u8(dest, v4lconvert_rgb_to_y_8px_neon(c2, c1, c0));
+		else
+			vst1_u8(dest, v4lconvert_rgb_to_y_8px_neon(c0, c1, c2));
+		src += 8 * bpp;
+		dest += 8;
+	}
+
+	return j;
+}
+
+/* (cr * r + cg * g + cb * b + 4210688) >> 15 for 4 2x2 block averages */
+static inline uint16x4_t v4lconvert_rgb_to_uv_4blk_neon(int16x4_t r,
+		int16x4_t g, int16x4_t b, int16_t cr, int16_t cg, int16_t cb)
+{
+	int32x4_t acc = vmull_n_s16(r, cr);
+
+	acc = vmlal_n_s16(acc, g, cg);
+	acc = vmlal_n_s16(acc, b, cb);
+	acc = vshrq_n_s32(vaddq_s32(acc, vdupq_n_s32(4210688)), 15);
+
+	return vreinterpret_u16_s16(vmovn_s32(acc));
+}
+
+/* Store 4 u or v values, these are always within 0 - 255 */
+static inline void v4lconvert_store_4blk_neon(unsigned char *dest,
+		uint16x4_t val)
+{
+	uint32_t v = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(
+				vcombine_u16(val, vdup_n_u16(0)))), 0);
+
+	memcpy(dest, &v, 4);
+}
+
+static int v4lconvert_rgb24_to_uv_neon(const unsigned char *src, int stride,
+		unsigned char *udest, unsigned char *vdest, int blocks, int bpp,
+		int bgr)
+{
+	int i, j;
+
+	for (j = 0; j + 4 <= blocks; j += 4) {
+		uint8x8_t row0[3], row1[3];
+		int16x4_t avg[3];
+
+		if (bpp == 3) {
+			uint8x8x3_t in0 = vld3_u8(src);
+			uint8x8x3_t in1 = vld3_u8(src + stride);
+
+			for (i = 0; i < 3; i++) {
+				row0[i] = in0.val[i];
+				row1[i] = in1.val[i];
+			}
+		} else {
+			uint8x8x4_t in0 = vld4_u8(src);
+			uint8x8x4_t in1 = vld4_u8(src + stride);
+
+			for (i = 0; i < 3; i++) {
+				row0[i] = in0.val[i];
+				row1[i] = in1.val[i];
+			}
+		}
+
+		for (i = 0; i < 3; i++) {
+			uint16x4_t sum = vadd_u16(vpaddl_u8(row0[i]),
+						  vpaddl_u8(row1[i]));
+
+			avg[i] = vreinterpret_s16_u16(vshr_n_u16(sum, 2));
+		}
+		if (bgr) {
+			int16x4_t tmp = avg[0];
+
+			avg[0] = avg[2];
+			avg[2] = tmp;
+		}
+
+		v4lconvert_store_4blk_neon(udest,
+			v4lconvert_rgb_to_uv_4blk_neon(avg[0], avg[1], avg[2],
+						       -4878, -9578, 14456));
+		v4lconvert_store_4blk_neon(vdest,
+			v4lconvert_rgb_to_uv_4blk_neon(avg[0], avg[1], avg[2],
+						       14456, -12105, -2351));
+		src += 8 * bpp;
+		udest += 4;
+		vdest += 4;
+	}
+
+	return j;
+}
+
+#endif /* V4LCONVERT_SIMD_NEON */
+
+int v4lconvert_packed_yuv_to_rgb24_simd(const unsigned char *src,
+		unsigned char *dest, int width, unsigned int src_pixfmt, int bgr)
+{
+	int y_pos, u_pos, v_pos;
+
+	v4lconvert_packed_yuv_layout(src_pixfmt, &y_pos, &u_pos, &v_pos);
+	/* Never leave a single (half macropixel) pixel for the C code, the
+	   x86 store helper may write 1 byte into the pixel after the ones done */
+	width &= ~1;
+
+#if defined(V4LCONVERT_SIMD_X86)
+	if (__builtin_cpu_supports("avx2"))
+		return v4lconvert_packed_yuv_to_rgb24_avx2(src, dest, width,
+							   y_pos, u_pos, bgr);
+	return v4lconvert_packed_yuv_to_rgb24_sse2(src, dest, width,
+						   y_pos, u_pos, bgr);
+#elif defined(V4LCONVERT_SIMD_NEON)
+	return v4lconvert_packed_yuv_to_rgb24_neon(src, dest, width,
+						   y_pos, u_pos, v_pos, bgr);
+#else
+	return 0;
+#endif
+}
+
+int v4lconvert_yuv420_to_rgb24_simd(const unsigned char *ysrc,
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *dest, int width, int bgr)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	if (__builtin_cpu_supports("avx2"))
+		return v4lconvert_yuv420_to_rgb24_avx2(ysrc, usrc, vsrc, dest,
+						       width, bgr);
+	return v4lconvert_yuv420_to_rgb24_sse2(ysrc, usrc, vsrc, dest,
+					       width, bgr);
+#elif defined(V4LCONVERT_SIMD_NEON)
+	return v4lconvert_yuv420_to_rgb24_neon(ysrc, usrc, vsrc, dest,
+					       width, bgr);
+#else
+	return 0;
+#endif
+}
+
+int v4lconvert_nv12_to_rgb24_simd(const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width, int vu,
+		int bgr)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	if (__builtin_cpu_supports("avx2"))
+		return v4lconvert_nv12_to_rgb24_avx2(ysrc, uvsrc, dest, width,
+						     vu, bgr);
+	return v4lconvert_nv12_to_rgb24_sse2(ysrc, uvsrc, dest, width, vu,
+					     bgr);
+#elif defined(V4LCONVERT_SIMD_NEON)
+	return v4lconvert_nv12_to_rgb24_neon(ysrc, uvsrc, dest, width, vu,
+					     bgr);
+#else
+	return 0;
+#endif
+}
+
+int v4lconvert_split_uv_simd(const unsigned char *src, unsigned char *dest0,
+		unsigned char *dest1, int count)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	return v4lconvert_split_uv_sse2(src, dest0, dest1, count);
+#elif defined(V4LCONVERT_SIMD_NEON)
+	return v4lconvert_split_uv_neon(src, dest0, dest1, count);
+#else
+	return 0;
+#endif
+}
+
+int v4lconvert_rgb24_to_y_simd(const unsigned char *src, unsigned char *dest,
+		int width, int bpp, int bgr)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	return v4lconvert_rgb24_to_y_sse2(src, dest, width, bpp, bgr);
+#elif defined(V4LCONVERT_SIMD_NEON)
+	return v4lconvert_rgb24_to_y_neon(src, dest, width, bpp, bgr);
+#else
+	return 0;
+#endif
+}
+
+int v4lconvert_rgb24_to_uv_simd(const unsigned char *src, int stride,
+		unsigned char *udest, unsigned char *vdest, int blocks, int bpp,
+		int bgr)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	return v4lconvert_rgb24_to_uv_sse2(src, stride, udest, vdest, blocks,
+					   bpp, bgr);
+#elif defined(V4LCONVERT_SIMD_NEON)
+	return v4lconvert_rgb24_to_uv_neon(src, stride, udest, vdest, blocks,
+					   bpp, bgr);
+#else
+	return 0;
+#endif
+}
@@ -34,15 +34,25 @@
 		(v) = ((14456 * (r) - 12105 * (g) - 2351 * (b) + 4210688) >> 15); \
 	} while (0)
 
-void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
-		const struct v4l2_format *src_fmt, int bgr, int yvu, int bpp)
+/* Convert lines start - end of the frame, start must be even and so must end
+   unless it is the height of the frame */
+void v4lconvert_rgb24_rows_to_yuv420(const unsigned char *src,
+		unsigned char *dest, const struct v4l2_format *src_fmt, int bgr,
+		int yvu, int bpp, int start, int end)
 {
 	int x, y;
 	unsigned char *udest, *vdest;
+	const unsigned char *frame = src;
 
 	/* Y */
-	for (y = 0; y < src_fmt->fmt.pix.height; y++) {
-		for (x = 0; x < src_fmt->fmt.pix.width; x++) {
+	src += start * src_fmt->fmt.pix.bytesperline;
+	dest += start * src_fmt->fmt.pix.width;
+	for (y = start; y < end; y++) {
+		x = v4lconvert_rgb24_to_y_simd(src, dest, src_fmt->fmt.pix.width,
+					       bpp, bgr);
+		src += x * bpp;
+		dest += x;
+		for (; x < src_fmt->fmt.pix.width; x++) {
 			if (bgr)
 				RGB2Y(src[2], src[1], src[0], *dest++);
 			else
@@ -52,7 +62,9 @@ void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
 
 		src += src_fmt->fmt.pix.bytesperline - bpp * src_fmt->fmt.pix.width;
 	}
-	src -= src_fmt->fmt.pix.height * src_fmt->fmt.pix.bytesperline;
+	src = frame + start * src_fmt->fmt.pix.bytesperline;
+	dest += (src_fmt->fmt.pix.height - end) * src_fmt->fmt.pix.width +
+		start / 2 * (src_fmt->fmt.pix.width / 2);
 
 	/* U + V */
 	if (yvu) {
@@ -63,8 +75,14 @@ void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
 		vdest = dest + src_fmt->fmt.pix.width * src_fmt->fmt.pix.height / 4;
 	}
 
-	for (y = 0; y < src_fmt->fmt.pix.height / 2; y++) {
-		for (x = 0; x < src_fmt->fmt.pix.width / 2; x++) {
+	for (y = start / 2; y < end / 2; y++) {
+		x = v4lconvert_rgb24_to_uv_simd(src, src_fmt->fmt.pix.bytesperline,
+						udest, vdest,
+						src_fmt->fmt.pix.width / 2, bpp, bgr);
+		src += 2 * x * bpp;
+		udest += x;
+		vdest += x;
+		for (; x < src_fmt->fmt.pix.width / 2; x++) {
 			int avg_src[3];
 
 			avg_src[0] = (src[0] + src[bpp] + src[src_fmt->fmt.pix.bytesperline] +
@@ -83,6 +101,13 @@ void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
 	}
 }
 
+void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
+		const struct v4l2_format *src_fmt, int bgr, int yvu, int bpp)
+{
+	v4lconvert_rgb24_rows_to_yuv420(src, dest, src_fmt, bgr, yvu, bpp, 0,
+					src_fmt->fmt.pix.height);
+}
+
 #define YUV2R(y, u, v) ({ \
 		int r = (y) + ((((v) - 128) * 1436) >> 10); r > 255 ? 255 : r < 0 ? 0 : r; })
 #define YUV2G(y, u, v) ({ \
@@ -92,12 +117,14 @@ void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
 
 #define CLIP(color) (unsigned char)(((color) > 0xFF) ? 0xff : (((color) < 0) ? 0 : (color)))
 
-void v4lconvert_yuv420_to_bgr24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int yvu)
+/* Convert lines start - end of the frame, start must be even */
+void v4lconvert_yuv420_rows_to_bgr24(const unsigned char *src,
+		unsigned char *dest, int width, int height, int yvu, int start,
+		int end)
 {
 	int i, j;
 
-	const unsigned char *ysrc = src;
+	const unsigned char *ysrc = src + start * width;
 	const unsigned char *usrc, *vsrc;
 
 	if (yvu) {
@@ -107,9 +134,18 @@ void v4lconvert_yuv420_to_bgr24(const unsigned char *src, unsigned char *dest,
 		usrc = src + width * height;
 		vsrc = usrc + (width * height) / 4;
 	}
-
-	for (i = 0; i < height; i++) {
-		for (j = 0; j < width; j += 2) {
+	usrc += start / 2 * (width / 2);
+	vsrc += start / 2 * (width / 2);
+	dest += start * width * 3;
+
+	for (i = start; i < end; i++) {
+		j = v4lconvert_yuv420_to_rgb24_simd(ysrc, usrc, vsrc, dest, width,
+						    1);
+		ysrc += j;
+		usrc += j / 2;
+		vsrc += j / 2;
+		dest += 3 * j;
+		for (; j < width; j += 2) {
 #if 1 /* fast slightly less accurate multiplication free code */
 			int u1 = (((*usrc - 128) << 7) +  (*usrc - 128)) >> 6;
 			int rg = (((*usrc - 128) << 1) +  (*usrc - 128) +
@@ -146,12 +182,14 @@ void v4lconvert_yuv420_to_bgr24(const unsigned char *src, unsigned char *dest,
 	}
 }
 
-void v4lconvert_yuv420_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int yvu)
+/* Convert lines start - end of the frame, start must be even */
+void v4lconvert_yuv420_rows_to_rgb24(const unsigned char *src,
+		unsigned char *dest, int width, int height, int yvu, int start,
+		int end)
 {
 	int i, j;
 
-	const unsigned char *ysrc = src;
+	const unsigned char *ysrc = src + start * width;
 	const unsigned char *usrc, *vsrc;
 
 	if (yvu) {
@@ -161,9 +199,18 @@ void v4lconvert_yuv420_to_rgb24(const unsigned char *src, unsigned char *dest,
 		usrc = src + width * height;
 		vsrc = usrc + (width * height) / 4;
 	}
-
-	for (i = 0; i < height; i++) {
-		for (j = 0; j < width; j += 2) {
+	usrc += start / 2 * (width / 2);
+	vsrc += start / 2 * (width / 2);
+	dest += start * width * 3;
+
+	for (i = start; i < end; i++) {
+		j = v4lconvert_yuv420_to_rgb24_simd(ysrc, usrc, vsrc, dest, width,
+						    0);
+		ysrc += j;
+		usrc += j / 2;
+		vsrc += j / 2;
+		dest += 3 * j;
+		for (; j < width; j += 2) {
 #if 1 /* fast slightly less accurate multiplication free code */
 			int u1 = (((*usrc - 128) << 7) +  (*usrc - 128)) >> 6;
 			int rg = (((*usrc - 128) << 1) +  (*usrc - 128) +
@@ -200,13 +247,139 @@ void v4lconvert_yuv420_to_rgb24(const unsigned char *src, unsigned char *dest,
 	}
 }
 
+void v4lconvert_yuv420_to_bgr24(const unsigned char *src, unsigned char *dest,
+		int width, int height, int yvu)
+{
+	v4lconvert_yuv420_rows_to_bgr24(src, dest, width, height, yvu, 0,
+					height);
+}
+
+void v4lconvert_yuv420_to_rgb24(const unsigned char *src, unsigned char *dest,
+		int width, int height, int yvu)
+{
+	v4lconvert_yuv420_rows_to_rgb24(src, dest, width, height, yvu, 0,
+					height);
+}
+
+/* Convert lines start - end of a frame given as separate planes */
+void v4lconvert_yuv_planes_rows_to_rgb24(
+		const struct v4lconvert_yuv_planes *planes, unsigned char *dest,
+		int width, int bgr, int start, int end)
+{
+	int i, j, step = planes->uv_step;
+
+	dest += start * width * 3;
+
+	for (i = start; i < end; i++) {
+		const unsigned char *ysrc = planes->y + i * planes->y_stride;
+		const unsigned char *usrc = planes->u +
+			(i >> planes->v_shift) * planes->uv_stride;
+		const unsigned char *vsrc = planes->v +
+			(i >> planes->v_shift) * planes->uv_stride;
+
+		if (step == 2)
+			j = v4lconvert_nv12_to_rgb24_simd(ysrc,
+					usrc < vsrc ? usrc : vsrc, dest, width,
+					vsrc < usrc, bgr);
+		else
+			j = v4lconvert_yuv420_to_rgb24_simd(ysrc, usrc, vsrc,
+					dest, width, bgr);
+		ysrc += j;
+		usrc += j / 2 * step;
+		vsrc += j / 2 * step;
+		dest += 3 * j;
+		for (; j + 1 < width; j += 2) {
+			int u1 = (((*usrc - 128) << 7) +  (*usrc - 128)) >> 6;
+			int rg = (((*usrc - 128) << 1) +  (*usrc - 128) +
+					((*vsrc - 128) << 2) + ((*vsrc - 128) << 1)) >> 3;
+			int v1 = (((*vsrc - 128) << 1) +  (*vsrc - 128)) >> 1;
+
+			if (bgr) {
+				*dest++ = CLIP(ysrc[0] + u1);
+				*dest++ = CLIP(ysrc[0] - rg);
+				*dest++ = CLIP(ysrc[0] + v1);
+				*dest++ = CLIP(ysrc[1] + u1);
+				*dest++ = CLIP(ysrc[1] - rg);
+				*dest++ = CLIP(ysrc[1] + v1);
+			} else {
+				*dest++ = CLIP(ysrc[0] + v1);
+				*dest++ = CLIP(ysrc[0] - rg);
+				*dest++ = CLIP(ysrc[0] + u1);
+				*dest++ = CLIP(ysrc[1] + v1);
+				*dest++ = CLIP(ysrc[1] - rg);
+				*dest++ = CLIP(ysrc[1] + u1);
+			}
+			ysrc += 2;
+			usrc += step;
+			vsrc += step;
+		}
+	}
+}
+
+void v4lconvert_yuv_planes_to_yuv420(const struct v4lconvert_yuv_planes *planes,
+		unsigned char *dest, int width, int height, int yvu)
+{
+	int i, j, step = planes->uv_step;
+	unsigned char *udest, *vdest;
+
+	/* copy the Y values */
+	for (i = 0; i < height; i++) {
+		memcpy(dest, planes->y + i * planes->y_stride, width);
+		dest += width;
+	}
+
+	/* copy the U and V values, for 4:2:2 average each 2 lines */
+	if (yvu) {
+		vdest = dest;
+		udest = dest + width * height / 4;
+	} else {
+		udest = dest;
+		vdest = dest + width * height / 4;
+	}
+	for (i = 0; i < height / 2; i++) {
+		int offset = (2 * i >> planes->v_shift) * planes->uv_stride;
+		const unsigned char *usrc = planes->u + offset;
+		const unsigned char *vsrc = planes->v + offset;
+
+		if (!planes->v_shift) {
+			const unsigned char *usrc1 = usrc + planes->uv_stride;
+			const unsigned char *vsrc1 = vsrc + planes->uv_stride;
+
+			for (j = 0; j < width / 2; j++) {
+				udest[j] = ((int) usrc[j * step] + usrc1[j * step]) / 2;
+				vdest[j] = ((int) vsrc[j * step] + vsrc1[j * step]) / 2;
+			}
+		} else if (step == 2) {
+			if (usrc < vsrc)
+				j = v4lconvert_split_uv_simd(usrc, udest, vdest,
+							     width / 2);
+			else
+				j = v4lconvert_split_uv_simd(vsrc, vdest, udest,
+							     width / 2);
+			for (; j < width / 2; j++) {
+				udest[j] = usrc[2 * j];
+				vdest[j] = vsrc[2 * j];
+			}
+		} else {
+			memcpy(udest, usrc, width / 2);
+			memcpy(vdest, vsrc, width / 2);
+		}
+		udest += width / 2;
+		vdest += width / 2;
+	}
+}
+
 void v4lconvert_yuyv_to_bgr24(const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride)
 {
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = v4lconvert_packed_yuv_to_rgb24_simd(src, dest, width,
+							V4L2_PIX_FMT_YUYV, 1);
+		src += 2 * j;
+		dest += 3 * j;
+		for (; j + 1 < width; j += 2) {
 			int u = src[1];
 			int v = src[3];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -233,7 +406,11 @@ void v4lconvert_yuyv_to_rgb24(const unsigned char *src, unsigned char *dest,
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = v4lconvert_packed_yuv_to_rgb24_simd(src, dest, width,
+							V4L2_PIX_FMT_YUYV, 0);
+		src += 2 * j;
+		dest += 3 * j;
+		for (; j + 1 < width; j += 2) {
 			int u = src[1];
 			int v = src[3];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -301,7 +478,11 @@ void v4lconvert_yvyu_to_bgr24(const unsigned char *src, unsigned char *dest,
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = v4lconvert_packed_yuv_to_rgb24_simd(src, dest, width,
+							V4L2_PIX_FMT_YVYU, 1);
+		src += 2 * j;
+		dest += 3 * j;
+		for (; j + 1 < width; j += 2) {
 			int u = src[3];
 			int v = src[1];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -328,7 +509,11 @@ void v4lconvert_yvyu_to_rgb24(const unsigned char *src, unsigned char *dest,
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = v4lconvert_packed_yuv_to_rgb24_simd(src, dest, width,
+							V4L2_PIX_FMT_YVYU, 0);
+		src += 2 * j;
+		dest += 3 * j;
+		for (; j + 1 < width; j += 2) {
 			int u = src[3];
 			int v = src[1];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -355,7 +540,11 @@ void v4lconvert_uyvy_to_bgr24(const unsigned char *src, unsigned char *dest,
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = v4lconvert_packed_yuv_to_rgb24_simd(src, dest, width,
+							V4L2_PIX_FMT_UYVY, 1);
+		src += 2 * j;
+		dest += 3 * j;
+		for (; j + 1 < width; j += 2) {
 			int u = src[0];
 			int v = src[2];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -382,7 +571,11 @@ void v4lconvert_uyvy_to_rgb24(const unsigned char *src, unsigned char *dest,
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = v4lconvert_packed_yuv_to_rgb24_simd(src, dest, width,
+							V4L2_PIX_FMT_UYVY, 0);
+		src += 2 * j;
+		dest += 3 * j;
+		for (; j + 1 < width; j += 2) {
 			int u = src[0];
 			int v = src[2];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -0,0 +1,435 @@
+/*
+
+# RGB and YUV scaling routines
+
+#             (C) 2026 the v4l-utils contributors
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <string.h>
+#include "libv4lconvert-priv.h"
+#include "simd-priv.h"
+
+/* Scaling is done separable: each source line which is needed is first
+   scaled horizontally into a line of 16 bit fixed point samples, the
+   destination lines are then a weighted sum of these. Horizontally scaled
+   lines are kept in a small per band ring, so that each source line only
+   gets scaled once per band, no matter how many destination lines use it.
+
+   When scaling down a box filter is used (each destination pixel is the
+   average of the source pixels it covers), when scaling up we interpolate
+   bilinearly. Both only have positive weights, so no clamping is needed. */
+
+/* Filter weights have 14 fraction bits */
+#define SCALE_SHIFT 14
+/* Horizontally scaled samples have 7 fraction bits, so that 255 << 7 still
+   fits in a signed 16 bit value for the SSE2 multiply-add */
+#define SCALE_LINE_SHIFT 7
+#define SCALE_ALIGN(x) (((x) + 15) & ~15)
+
+struct v4lconvert_scale_filter {
+	int taps;	/* number of source samples per destination sample */
+	int *start;	/* first source sample of each destination sample */
+	short *weight;	/* taps weights for each destination sample */
+	int src;	/* number of source samples */
+};
+
+/* The number of taps needed to scale src samples to dest samples */
+static int v4lconvert_scale_taps(int src, int dest)
+{
+	int taps;
+
+	if (dest >= src)
+		taps = 2;
+	else
+		taps = (src + dest - 1) / dest + 1;
+
+	return taps < src ? taps : src;
+}
+
+/* Calculate the filter for scaling src samples to dest samples, the edges
+   of the first and last samples are kept aligned. With mirror the
+   destination is mirrored (for hflip), by giving destination sample i the
+   filter of sample dest - 1 - i. */
+static void v4lconvert_scale_init_filter(struct v4lconvert_scale_filter *f,
+		int src, int dest, int mirror)
+{
+	int i, j, k, taps = f->taps;
+
+	for (i = 0; i < dest; i++) {
+		int d = mirror ? dest - 1 - i : i;
+		short *weight = f->weight + i * taps;
+		int sum = 0, start, max = 0;
+
+		if (dest >= src) {
+			/* Position of the center of destination sample d in
+			   source samples, with SCALE_SHIFT fraction bits */
+			long long pos = ((long long)(2 * d + 1) * src - dest) *
+					(1 << SCALE_SHIFT) / (2 * dest);
+			int x0, frac;
+
+			if (pos < 0)
+				pos = 0;
+			x0 = pos >> SCALE_SHIFT;
+			frac = pos & ((1 << SCALE_SHIFT) - 1);
+			if (x0 >= src - 1) {
+				x0 = src - 1;
+				frac = 0;
+			}
+			start = x0 < src - taps ? x0 : src - taps;
+			memset(weight, 0, taps * sizeof(short));
+			weight[x0 - start] = (1 << SCALE_SHIFT) - frac;
+			if (frac)
+				weight[x0 - start + 1] = frac;
+		} else {
+			/* Destination sample d covers [d * src, (d + 1) * src)
+			   and source sample j covers [j * dest, (j + 1) * dest)
+			   in units of 1 / dest source samples */
+			int first = d * src / dest;
+
+			start = first < src - taps ? first : src - taps;
+			for (k = 0; k < taps; k++) {
+				int lo, hi;
+
+				j = start + k;
+				lo = j * dest > d * src ? j * dest : d * src;
+				hi = (j + 1) * dest < (d + 1) * src ?
+				     (j + 1) * dest : (d + 1) * src;
+				weight[k] = hi > lo ? ((hi - lo) << SCALE_SHIFT) / src :
+						      0;
+			}
+		}
+
+		/* Make the weights add up to exactly 1, by giving the rounding
+		   error to the largest one */
+		for (k = 0; k < taps; k++) {
+			sum += weight[k];
+			if (weight[k] > weight[max])
+				max = k;
+		}
+		weight[max] += (1 << SCALE_SHIFT) - sum;
+
+		f->start[i] = start;
+	}
+
+	f->src = src;
+}
+
+static void v4lconvert_scale_line(const unsigned char *src, short *dest,
+		const struct v4lconvert_scale_filter *f, int width, int channels)
+{
+	const int round = 1 << (SCALE_SHIFT - SCALE_LINE_SHIFT - 1);
+	const int shift = SCALE_SHIFT - SCALE_LINE_SHIFT;
+	int i, k, taps = f->taps;
+#ifdef V4LCONVERT_SIMD_X86
+	const __m128i zero = _mm_setzero_si128();
+#endif
+
+	if (channels == 1) {
+		for (i = 0; i < width; i++) {
+			const unsigned char *s = src + f->start[i];
+			const short *w = f->weight + i * taps;
+			int v = round;
+
+			for (k = 0; k < taps; k++)
+				v += w[k] * s[k];
+			*dest++ = v >> shift;
+		}
+		return;
+	}
+
+	for (i = 0; i < width; i++) {
+		const unsigned char *s = src + f->start[i] * 3;
+		const short *w = f->weight + i * taps;
+		int r = round, g = round, b = round;
+
+#ifdef V4LCONVERT_SIMD_X86
+		/* Each pixel gets loaded as 4 bytes (its r, g and b and the r of
+		   the next pixel) and 2 taps are done at once by interleaving 2
+		   pixels, so that a single _mm_madd_epi16 gives the r, g and b
+		   sums for both taps. This reads 1 byte beyond the last tap and
+		   writes 1 sample beyond the pixel, so it can not be used for the
+		   last source or destination pixel. */
+		if (f->start[i] + taps < f->src && i < width - 1) {
+			__m128i sum = _mm_set1_epi32(round);
+
+			for (k = 0; k < taps; k += 2) {
+				__m128i p0 = _mm_cvtsi32_si128(
+						v4lconvert_load32(s + k * 3));
+				__m128i p1, wk;
+
+				if (k + 1 < taps) {
+					p1 = _mm_cvtsi32_si128(
+						v4lconvert_load32(s + k * 3 + 3));
+					wk = _mm_set1_epi32((w[k + 1] << 16) |
+							    (unsigned short)w[k]);
+				} else {
+					p1 = zero;
+					wk = _mm_set1_epi32((unsigned short)w[k]);
+				}
+				p0 = _mm_unpacklo_epi8(p0, zero);
+				p1 = _mm_unpacklo_epi8(p1, zero);
+				sum = _mm_add_epi32(sum, _mm_madd_epi16(
+						_mm_unpacklo_epi16(p0, p1), wk));
+			}
+			sum = _mm_srai_epi32(sum, shift);
+			_mm_storel_epi64((__m128i *)dest,
+					 _mm_packs_epi32(sum, sum));
+			dest += 3;
+			continue;
+		}
+#endif
+		for (k = 0; k < taps; k++) {
+			r += w[k] * s[0];
+			g += w[k] * s[1];
+			b += w[k] * s[2];
+			s += 3;
+		}
+		dest[0] = r >> shift;
+		dest[1] = g >> shift;
+		dest[2] = b >> shift;
+		dest += 3;
+	}
+}
+
+/* dest[x] = sum of weight[k] * lines[k][x] for x < n */
+static void v4lconvert_scale_column(const short **lines, const short *weight,
+		int taps, unsigned char *dest, int n)
+{
+	const int shift = SCALE_SHIFT + SCALE_LINE_SHIFT;
+	int x = 0, k;
+
+#ifdef V4LCONVERT_SIMD_X86
+	/* Taps are handled in pairs, with _mm_madd_epi16 multiplying
+	   interleaved samples of 2 lines with their 2 weights and adding
+	   the products in one go */
+	for (; x + 8 <= n; x += 8) {
+		__m128i lo = _mm_set1_epi32(1 << (shift - 1));
+		__m128i hi = lo, out;
+
+		for (k = 0; k < taps; k += 2) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(lines[k] + x));
+			__m128i b, w;
+
+			if (k + 1 < taps) {
+				b = _mm_loadu_si128((const __m128i *)(lines[k + 1] + x));
+				w = _mm_set1_epi32((weight[k + 1] << 16) |
+						   (unsigned short)weight[k]);
+			} else {
+				b = _mm_setzero_si128();
+				w = _mm_set1_epi32((unsigned short)weight[k]);
+			}
+			lo = _mm_add_epi32(lo,
+				_mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+			hi = _mm_add_epi32(hi,
+				_mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+		}
+		out = _mm_packs_epi32(_mm_srai_epi32(lo, shift),
+				      _mm_srai_epi32(hi, shift));
+		_mm_storel_epi64((__m128i *)(dest + x),
+				 _mm_packus_epi16(out, out));
+	}
+#endif
+
+	for (; x < n; x++) {
+		int v = 1 << (shift - 1);
+
+		for (k = 0; k < taps; k++)
+			v += weight[k] * lines[k][x];
+		dest[x] = v >> shift;
+	}
+}
+
+struct v4lconvert_scale_job {
+	v4lconvert_scale_src_func get_line;
+	void *arg;
+	struct v4lconvert_scale_filter xf;
+	struct v4lconvert_scale_filter yf;
+	unsigned char *dest;
+	int dest_width;
+	int dest_stride;
+	int channels;
+	/* Per band ring of yf.taps horizontally scaled lines */
+	short *rings;
+	int *ring_lines;
+};
+
+static void v4lconvert_scale_rows(void *arg, int band, int start, int end)
+{
+	struct v4lconvert_scale_job *job = arg;
+	int taps = job->yf.taps, n = job->dest_width * job->channels;
+	short *ring = job->rings + band * taps * SCALE_ALIGN(n);
+	int *ring_line = job->ring_lines + band * taps;
+	const short *lines[taps];
+	int y, k;
+
+	for (k = 0; k < taps; k++)
+		ring_line[k] = -1;
+
+	for (y = start; y < end; y++) {
+		for (k = 0; k < taps; k++) {
+			int line = job->yf.start[y] + k;
+			short *dst = ring + (line % taps) * SCALE_ALIGN(n);
+
+			if (ring_line[line % taps] != line) {
+				v4lconvert_scale_line(job->get_line(job->arg, band,
+								    line),
+						      dst, &job->xf, job->dest_width,
+						      job->channels);
+				ring_line[line % taps] = line;
+			}
+			lines[k] = dst;
+		}
+		v4lconvert_scale_column(lines, job->yf.weight + y * taps, taps,
+					job->dest + y * job->dest_stride, n);
+	}
+}
+
+int v4lconvert_scale_plane(struct v4lconvert_data *data,
+		v4lconvert_scale_src_func get_line, void *arg,
+		int src_width, int src_height, unsigned char *dest,
+		int dest_width, int dest_height, int dest_stride, int channels,
+		int hflip, int vflip)
+{
+	struct v4lconvert_scale_job job = {
+		.get_line = get_line,
+		.arg = arg,
+		.dest = dest,
+		.dest_width = dest_width,
+		.dest_stride = dest_stride,
+		.channels = channels,
+	};
+	int bands = v4lconvert_threads_count(data->threads);
+	int xtaps = v4lconvert_scale_taps(src_width, dest_width);
+	int ytaps = v4lconvert_scale_taps(src_height, dest_height);
+	int xstart_size = SCALE_ALIGN(dest_width * sizeof(int));
+	int xweight_size = SCALE_ALIGN(dest_width * xtaps * sizeof(short));
+	int ystart_size = SCALE_ALIGN(dest_height * sizeof(int));
+	int yweight_size = SCALE_ALIGN(dest_height * ytaps * sizeof(short));
+	int rings_size = bands * ytaps *
+			 SCALE_ALIGN(dest_width * channels) * sizeof(short);
+	int ring_lines_size = bands * ytaps * sizeof(int);
+	unsigned char *buf;
+
+	if (src_width < 1 || src_height < 1 || dest_width < 1 ||
+			dest_height < 1)
+		return 0;
+
+	buf = v4lconvert_alloc_buffer(xstart_size + xweight_size + ystart_size +
+				      yweight_size + rings_size + ring_lines_size,
+				      &data->scale_buf, &data->scale_buf_size);
+	if (!buf)
+		return v4lconvert_oom_error(data);
+
+	job.xf.taps = xtaps;
+	job.xf.start = (int *)buf;
+	buf += xstart_size;
+	job.xf.weight = (short *)buf;
+	buf += xweight_size;
+	job.yf.taps = ytaps;
+	job.yf.start = (int *)buf;
+	buf += ystart_size;
+	job.yf.weight = (short *)buf;
+	buf += yweight_size;
+	job.rings = (short *)buf;
+	buf += rings_size;
+	job.ring_lines = (int *)buf;
+
+	v4lconvert_scale_init_filter(&job.xf, src_width, dest_width, hflip);
+	v4lconvert_scale_init_filter(&job.yf, src_height, dest_height, 0);
+
+	/* For vflip write the lines bottom up, rather then mirroring the source,
+	   so that the result is the mirror image of the unflipped result */
+	if (vflip) {
+		job.dest += (dest_height - 1) * dest_stride;
+		job.dest_stride = -dest_stride;
+	}
+
+	/* Each band keeps its own ring, so use at most one band per thread */
+	v4lconvert_threads_run_bands(data->threads, v4lconvert_scale_rows, &job,
+				     dest_height, bands);
+
+	return 0;
+}
+
+struct v4lconvert_scale_src {
+	const unsigned char *src;
+	int stride;
+};
+
+static const unsigned char *v4lconvert_scale_src_line(void *arg, int band,
+		int y)
+{
+	struct v4lconvert_scale_src *src = arg;
+
+	return src->src + y * src->stride;
+}
+
+int v4lconvert_scale(struct v4lconvert_data *data,
+		unsigned char *src, unsigned char *dest,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt)
+{
+	int src_width = src_fmt->fmt.pix.width;
+	int src_height = src_fmt->fmt.pix.height;
+	int src_stride = src_fmt->fmt.pix.bytesperline;
+	int dest_width = dest_fmt->fmt.pix.width;
+	int dest_height = dest_fmt->fmt.pix.height;
+	int dest_stride = dest_fmt->fmt.pix.bytesperline;
+	struct v4lconvert_scale_src plane;
+	int i, res;
+
+	switch (dest_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		plane.src = src;
+		plane.stride = src_stride;
+		return v4lconvert_scale_plane(data, v4lconvert_scale_src_line,
+					      &plane, src_width, src_height, dest,
+					      dest_width, dest_height, dest_stride,
+					      3, 0, 0);
+
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		/* Y, followed by the 2 chroma planes, both planes get scaled
+		   the same, so we do not care which one is U and which V */
+		for (i = 0; i < 3; i++) {
+			plane.src = src;
+			plane.stride = src_stride;
+			res = v4lconvert_scale_plane(data,
+					v4lconvert_scale_src_line, &plane,
+					src_width, src_height, dest,
+					dest_width, dest_height, dest_stride,
+					1, 0, 0);
+			if (res)
+				return res;
+
+			src += src_height * src_stride;
+			dest += dest_height * dest_stride;
+			if (i == 0) {
+				src_width /= 2;
+				src_height /= 2;
+				src_stride /= 2;
+				dest_width /= 2;
+				dest_height /= 2;
+				dest_stride /= 2;
+			}
+		}
+		return 0;
+	}
+
+	return 0;
+}
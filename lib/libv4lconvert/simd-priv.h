@@ -0,0 +1,81 @@
+/*
+#             (C) 2026 the v4l-utils contributors
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+/* Helpers shared by the vectorized conversion routines. On x86 SSE2 is used
+   when compiled in (it always is on x86_64), routines which have an AVX2
+   version select it at runtime. On ARM NEON is used when the compiler
+   targets it (it always does on aarch64). */
+
+#ifndef __LIBV4LCONVERT_SIMD_PRIV_H
+#define __LIBV4LCONVERT_SIMD_PRIV_H
+
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define V4LCONVERT_SIMD_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#elif defined(__GNUC__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define V4LCONVERT_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef V4LCONVERT_SIMD_X86
+
+static inline unsigned int v4lconvert_load32(const unsigned char *p)
+{
+	unsigned int v;
+
+	memcpy(&v, p, 4);
+	return v;
+}
+
+/* Store 16 pixels given as r, g and b vectors as rgb24. This writes each
+   pixel as 4 bytes, overlapping the next pixel, so it writes 1 byte beyond
+   the 48 bytes of pixel data: the caller must write at least 1 more pixel
+   after these. */
+static inline void v4lconvert_store_rgb24_sse2(unsigned char *dest,
+		__m128i r, __m128i g, __m128i b)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i rg, bx, px[4];
+	int i, j;
+
+	rg = _mm_unpacklo_epi8(r, g);
+	bx = _mm_unpacklo_epi8(b, zero);
+	px[0] = _mm_unpacklo_epi16(rg, bx);
+	px[1] = _mm_unpackhi_epi16(rg, bx);
+	rg = _mm_unpackhi_epi8(r, g);
+	bx = _mm_unpackhi_epi8(b, zero);
+	px[2] = _mm_unpacklo_epi16(rg, bx);
+	px[3] = _mm_unpackhi_epi16(rg, bx);
+
+	for (i = 0; i < 4; i++) {
+		for (j = 0; j < 4; j++) {
+			unsigned int v = _mm_cvtsi128_si32(px[i]);
+
+			memcpy(dest, &v, 4);
+			dest += 3;
+			px[i] = _mm_srli_si128(px[i], 4);
+		}
+	}
+}
+
+#endif /* V4LCONVERT_SIMD_X86 */
+
+#endif
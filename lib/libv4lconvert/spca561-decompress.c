@@ -81,7 +81,8 @@ static int fun_B(int *bitfill)
 	static int tab[] = {
 		4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, -5,
 		-6, -7, -8, -9, -10, -11, -12, -13, -14, -15, -16, -17,
-		-18, -19
+		-18, -19,
+		0xff	/* unused codes */
 	};
 	unsigned int tmp;
 
@@ -103,7 +104,8 @@ static int fun_C(int *bitfill, int gkw)
 	};
 	static int tab[] = {
 		8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, -9, -10, -11,
-		-12, -13, -14, -15, -16, -17, -18, -19
+		-12, -13, -14, -15, -16, -17, -18, -19,
+		0xff	/* unused codes */
 	};
 	unsigned int tmp;
 
@@ -163,7 +165,7 @@ static int fun_D(int *bitfill, int gkw)
 		case 7:
 			return -18;
 		case 2:
-			return _nbits(bitfill, 1) ? 0xed : 0x12;
+			return _nbits(bitfill, 1) ? -19 : 18;
 		case 3:
 			(*bitfill)--;
 			return 18;
@@ -688,7 +690,7 @@ static int internal_spca561_decode(int width, int height,
 		15, 15, 15, 15, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3,
 		2, 1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
 		15, 15,
-		15
+		15, 15
 	};
 	/* diff_encoding[256 + i] = ... */
 	static const int diff_encoding[] = {
@@ -861,7 +863,7 @@ static int internal_spca561_decode(int width, int height,
 				return -3;
 
 			{
-				int tmp1, tmp2;
+				int tmp1, tmp2, idx;
 
 				tmp1 =
 					(pixel_U + pixel_L) * 3 - pixel_UL * 2;
@@ -869,9 +871,15 @@ static int internal_spca561_decode(int width, int height,
 				tmp2 = a_curve[19 + gkw] * multiplier;
 				tmp2 += (tmp2 < 0) ? 1 : 0;
 
-				*(output_ptr++) =
-					clamp0_255[0x100 + (tmp1 >> 2) -
-					(tmp2 >> 1)];
+				/* Large steps can go past the ends of the
+				   table, which saturates at both ends */
+				idx = 0x100 + (tmp1 >> 2) - (tmp2 >> 1);
+				if (idx < 0)
+					idx = 0;
+				else if (idx >= (int)sizeof(clamp0_255))
+					idx = sizeof(clamp0_255) - 1;
+
+				*(output_ptr++) = clamp0_255[idx];
 			}
 			pixel_U = saved_pixel_UR;
 			saved_pixel_UR = pixel_UR;
@@ -895,17 +903,18 @@ static int internal_spca561_decode(int width, int height,
 
 /* FIXME, change internal_spca561_decode not to need the extra border
    around its dest buffer */
-void v4lconvert_decode_spca561(const unsigned char *inbuf,
+int v4lconvert_decode_spca561(const unsigned char *inbuf,
 		unsigned char *outbuf, int width, int height)
 {
 	int i;
 	static unsigned char tmpbuf[650 * 490];
 
 	if (internal_spca561_decode(width, height, inbuf, tmpbuf) != 0)
-		return;
+		return -1;
 	for (i = 0; i < height; i++)
 		memcpy(outbuf + i * width,
 				tmpbuf + (i + 2) * (width + 6) + 3, width);
+	return 0;
 }
 
 /*************** License Change Permission Notice ***************
@@ -0,0 +1,440 @@
+/*
+
+# Worker threads for doing conversions on horizontal bands of a frame
+
+#             (C) 2026 the v4l-utils contributors
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include "libv4lconvert-priv.h"
+
+/* Bands smaller than this are not worth waking up a thread for */
+#define V4LCONVERT_MIN_BAND_ROWS 16
+
+/* The frame gets split into one band per thread, where the calling thread
+   does the first band and worker n does band n. Which rows end up in which
+   band only depends on the number of rows and threads, and the bands do
+   not overlap, so the result is always the same as when doing the whole
+   frame in one go. */
+struct v4lconvert_threads {
+	int count; /* Including the calling thread */
+	pthread_t *workers;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	/* Increased for each job, so that the workers know there is new work */
+	unsigned int job;
+	int pending;
+	int quit;
+	/* The current job */
+	v4lconvert_rows_func func;
+	void *arg;
+	int bands;
+	int band_rows;
+	int rows;
+};
+
+struct v4lconvert_worker {
+	struct v4lconvert_threads *threads;
+	int band;
+};
+
+static void v4lconvert_threads_do_band(struct v4lconvert_threads *threads,
+		int band)
+{
+	int start = band * threads->band_rows;
+	int end = (band == threads->bands - 1) ? threads->rows :
+		  start + threads->band_rows;
+
+	threads->func(threads->arg, band, start, end);
+}
+
+static void *v4lconvert_worker_main(void *arg)
+{
+	struct v4lconvert_worker *worker = arg;
+	struct v4lconvert_threads *threads = worker->threads;
+	int band = worker->band;
+	unsigned int job = 0;
+
+	free(worker);
+
+	pthread_mutex_lock(&threads->lock);
+	while (1) {
+		while (threads->job == job && !threads->quit)
+			pthread_cond_wait(&threads->work_cond, &threads->lock);
+		if (threads->quit)
+			break;
+		job = threads->job;
+		if (band >= threads->bands)
+			continue;
+		pthread_mutex_unlock(&threads->lock);
+
+		v4lconvert_threads_do_band(threads, band);
+
+		pthread_mutex_lock(&threads->lock);
+		threads->pending--;
+		if (threads->pending == 0)
+			pthread_cond_signal(&threads->done_cond);
+	}
+	pthread_mutex_unlock(&threads->lock);
+
+	return NULL;
+}
+
+struct v4lconvert_threads *v4lconvert_threads_create(int count)
+{
+	struct v4lconvert_threads *threads;
+	int i;
+
+	threads = calloc(1, sizeof(*threads));
+	if (!threads)
+		return NULL;
+
+	threads->workers = calloc(count - 1, sizeof(pthread_t));
+	if (!threads->workers) {
+		free(threads);
+		return NULL;
+	}
+
+	pthread_mutex_init(&threads->lock, NULL);
+	pthread_cond_init(&threads->work_cond, NULL);
+	pthread_cond_init(&threads->done_cond, NULL);
+
+	/* We are worker 0 */
+	threads->count = 1;
+	for (i = 1; i < count; i++) {
+		struct v4lconvert_worker *worker = malloc(sizeof(*worker));
+
+		if (!worker)
+			goto error;
+		worker->threads = threads;
+		worker->band = i;
+		errno = pthread_create(&threads->workers[i - 1], NULL,
+				       v4lconvert_worker_main, worker);
+		if (errno) {
+			free(worker);
+			goto error;
+		}
+		threads->count++;
+	}
+
+	return threads;
+
+error:
+	v4lconvert_threads_destroy(threads);
+	return NULL;
+}
+
+void v4lconvert_threads_destroy(struct v4lconvert_threads *threads)
+{
+	int i;
+
+	if (!threads)
+		return;
+
+	pthread_mutex_lock(&threads->lock);
+	threads->quit = 1;
+	pthread_cond_broadcast(&threads->work_cond);
+	pthread_mutex_unlock(&threads->lock);
+
+	for (i = 0; i < threads->count - 1; i++)
+		pthread_join(threads->workers[i], NULL);
+
+	pthread_cond_destroy(&threads->done_cond);
+	pthread_cond_destroy(&threads->work_cond);
+	pthread_mutex_destroy(&threads->lock);
+	free(threads->workers);
+	free(threads);
+}
+
+int v4lconvert_threads_count(struct v4lconvert_threads *threads)
+{
+	return threads ? threads->count : 1;
+}
+
+static void v4lconvert_threads_do_job(struct v4lconvert_threads *threads,
+		v4lconvert_rows_func func, void *arg, int rows, int bands,
+		int band_rows)
+{
+	pthread_mutex_lock(&threads->lock);
+	threads->func = func;
+	threads->arg = arg;
+	threads->rows = rows;
+	threads->bands = bands;
+	threads->band_rows = band_rows;
+	threads->pending = bands - 1;
+	threads->job++;
+	pthread_cond_broadcast(&threads->work_cond);
+	pthread_mutex_unlock(&threads->lock);
+
+	v4lconvert_threads_do_band(threads, 0);
+
+	pthread_mutex_lock(&threads->lock);
+	while (threads->pending)
+		pthread_cond_wait(&threads->done_cond, &threads->lock);
+	pthread_mutex_unlock(&threads->lock);
+}
+
+void v4lconvert_threads_run(struct v4lconvert_threads *threads,
+		v4lconvert_rows_func func, void *arg, int rows, int align)
+{
+	int bands, band_rows;
+
+	if (!threads) {
+		func(arg, 0, 0, rows);
+		return;
+	}
+
+	bands = threads->count;
+	band_rows = (rows / bands) & ~(align - 1);
+	if (band_rows < V4LCONVERT_MIN_BAND_ROWS) {
+		band_rows = (V4LCONVERT_MIN_BAND_ROWS + align - 1) & ~(align - 1);
+		bands = rows / band_rows;
+	}
+	if (bands < 2) {
+		func(arg, 0, 0, rows);
+		return;
+	}
+
+	v4lconvert_threads_do_job(threads, func, arg, rows, bands, band_rows);
+}
+
+void v4lconvert_threads_run_bands(struct v4lconvert_threads *threads,
+		v4lconvert_rows_func func, void *arg, int rows, int bands)
+{
+	if (bands > v4lconvert_threads_count(threads))
+		bands = v4lconvert_threads_count(threads);
+	if (bands > rows)
+		bands = rows;
+	if (bands < 2) {
+		func(arg, 0, 0, rows);
+		return;
+	}
+
+	v4lconvert_threads_do_job(threads, func, arg, rows, bands, rows / bands);
+}
+
+/* Band parallel versions of the row independent conversions */
+
+struct v4lconvert_threads_job {
+	const unsigned char *src;
+	const struct v4lconvert_yuv_planes *planes;
+	unsigned char *dest;
+	const struct v4l2_format *fmt;
+	int width;
+	int height;
+	int stride;
+	unsigned int src_pix_fmt;
+	int bgr;
+	int yvu;
+	int bpp;
+};
+
+static void v4lconvert_yuv420_to_rgb24_rows(void *arg, int band, int start,
+		int end)
+{
+	struct v4lconvert_threads_job *job = arg;
+
+	if (job->bgr)
+		v4lconvert_yuv420_rows_to_bgr24(job->src, job->dest, job->width,
+				job->height, job->yvu, start, end);
+	else
+		v4lconvert_yuv420_rows_to_rgb24(job->src, job->dest, job->width,
+				job->height, job->yvu, start, end);
+}
+
+void v4lconvert_threads_yuv420_to_rgb24(struct v4lconvert_threads *threads,
+		const unsigned char *src, unsigned char *dest, int width, int height,
+		int yvu, int bgr)
+{
+	struct v4lconvert_threads_job job = {
+		.src = src, .dest = dest, .width = width, .height = height,
+		.yvu = yvu, .bgr = bgr,
+	};
+
+	v4lconvert_threads_run(threads, v4lconvert_yuv420_to_rgb24_rows, &job,
+			       height, 2);
+}
+
+static void v4lconvert_yuv_planes_to_rgb24_rows(void *arg, int band,
+		int start, int end)
+{
+	struct v4lconvert_threads_job *job = arg;
+
+	v4lconvert_yuv_planes_rows_to_rgb24(job->planes, job->dest, job->width,
+					    job->bgr, start, end);
+}
+
+void v4lconvert_threads_yuv_planes_to_rgb24(struct v4lconvert_threads *threads,
+		const struct v4lconvert_yuv_planes *planes, unsigned char *dest,
+		int width, int height, int bgr)
+{
+	struct v4lconvert_threads_job job = {
+		.planes = planes, .dest = dest, .width = width, .bgr = bgr,
+	};
+
+	v4lconvert_threads_run(threads, v4lconvert_yuv_planes_to_rgb24_rows,
+			       &job, height, 1);
+}
+
+static void v4lconvert_rgb24_to_yuv420_rows(void *arg, int band, int start,
+		int end)
+{
+	struct v4lconvert_threads_job *job = arg;
+
+	v4lconvert_rgb24_rows_to_yuv420(job->src, job->dest, job->fmt, job->bgr,
+					job->yvu, job->bpp, start, end);
+}
+
+void v4lconvert_threads_rgb24_to_yuv420(struct v4lconvert_threads *threads,
+		const unsigned char *src, unsigned char *dest,
+		const struct v4l2_format *src_fmt, int bgr, int yvu, int bpp)
+{
+	struct v4lconvert_threads_job job = {
+		.src = src, .dest = dest, .fmt = src_fmt, .bgr = bgr, .yvu = yvu,
+		.bpp = bpp,
+	};
+
+	v4lconvert_threads_run(threads, v4lconvert_rgb24_to_yuv420_rows, &job,
+			       src_fmt->fmt.pix.height, 2);
+}
+
+static void v4lconvert_packed_yuv_to_rgb24_rows(void *arg, int band,
+		int start, int end)
+{
+	struct v4lconvert_threads_job *job = arg;
+	const unsigned char *src = job->src + start * job->stride;
+	/* Only whole macropixels get converted */
+	unsigned char *dest = job->dest + start * (job->width & ~1) * 3;
+	int height = end - start;
+
+	switch (job->src_pix_fmt) {
+	case V4L2_PIX_FMT_YUYV:
+		if (job->bgr)
+			v4lconvert_yuyv_to_bgr24(src, dest, job->width, height,
+						 job->stride);
+		else
+			v4lconvert_yuyv_to_rgb24(src, dest, job->width, height,
+						 job->stride);
+		break;
+	case V4L2_PIX_FMT_YVYU:
+		if (job->bgr)
+			v4lconvert_yvyu_to_bgr24(src, dest, job->width, height,
+						 job->stride);
+		else
+			v4lconvert_yvyu_to_rgb24(src, dest, job->width, height,
+						 job->stride);
+		break;
+	case V4L2_PIX_FMT_UYVY:
+		if (job->bgr)
+			v4lconvert_uyvy_to_bgr24(src, dest, job->width, height,
+						 job->stride);
+		else
+			v4lconvert_uyvy_to_rgb24(src, dest, job->width, height,
+						 job->stride);
+		break;
+	}
+}
+
+void v4lconvert_threads_packed_yuv_to_rgb24(struct v4lconvert_threads *threads,
+		const unsigned char *src, unsigned char *dest, int width, int height,
+		int stride, unsigned int src_pix_fmt, int bgr)
+{
+	struct v4lconvert_threads_job job = {
+		.src = src, .dest = dest, .width = width, .stride = stride,
+		.src_pix_fmt = src_pix_fmt, .bgr = bgr,
+	};
+
+	v4lconvert_threads_run(threads, v4lconvert_packed_yuv_to_rgb24_rows, &job,
+			       height, 1);
+}
+
+static void v4lconvert_bayer_to_rgb24_rows(void *arg, int band, int start,
+		int end)
+{
+	struct v4lconvert_threads_job *job = arg;
+
+	if (job->bgr)
+		v4lconvert_bayer_rows_to_bgr24(job->src, job->dest, job->width,
+				job->height, job->stride, job->src_pix_fmt,
+				start, end);
+	else
+		v4lconvert_bayer_rows_to_rgb24(job->src, job->dest, job->width,
+				job->height, job->stride, job->src_pix_fmt,
+				start, end);
+}
+
+void v4lconvert_threads_bayer_to_rgb24(struct v4lconvert_threads *threads,
+		const unsigned char *bayer, unsigned char *dest, int width, int height,
+		int stride, unsigned int src_pix_fmt, int bgr)
+{
+	struct v4lconvert_threads_job job = {
+		.src = bayer, .dest = dest, .width = width, .height = height,
+		.stride = stride, .src_pix_fmt = src_pix_fmt, .bgr = bgr,
+	};
+
+	v4lconvert_threads_run(threads, v4lconvert_bayer_to_rgb24_rows, &job,
+			       height, 1);
+}
+
+static void v4lconvert_raw_bayer_to_bayer8_rows(void *arg, int band,
+		int start, int end)
+{
+	struct v4lconvert_threads_job *job = arg;
+
+	v4lconvert_raw_bayer_rows_to_bayer8(job->src, job->dest, job->width,
+			job->stride, job->src_pix_fmt, start, end);
+}
+
+void v4lconvert_threads_raw_bayer_to_bayer8(struct v4lconvert_threads *threads,
+		const unsigned char *src, unsigned char *dest, int width, int height,
+		int stride, unsigned int raw_pix_fmt)
+{
+	struct v4lconvert_threads_job job = {
+		.src = src, .dest = dest, .width = width, .stride = stride,
+		.src_pix_fmt = raw_pix_fmt,
+	};
+
+	v4lconvert_threads_run(threads, v4lconvert_raw_bayer_to_bayer8_rows, &job,
+			       height, 1);
+}
+
+static void v4lconvert_bayer_to_yuv420_rows(void *arg, int band, int start,
+		int end)
+{
+	struct v4lconvert_threads_job *job = arg;
+
+	v4lconvert_bayer_rows_to_yuv420(job->src, job->dest, job->width,
+			job->height, job->stride, job->src_pix_fmt, job->yvu,
+			start, end);
+}
+
+void v4lconvert_threads_bayer_to_yuv420(struct v4lconvert_threads *threads,
+		const unsigned char *bayer, unsigned char *dest, int width, int height,
+		int stride, unsigned int src_pix_fmt, int yvu)
+{
+	struct v4lconvert_threads_job job = {
+		.src = bayer, .dest = dest, .width = width, .height = height,
+		.stride = stride, .src_pix_fmt = src_pix_fmt, .yvu = yvu,
+	};
+
+	v4lconvert_threads_run(threads, v4lconvert_bayer_to_yuv420_rows, &job,
+			       height, 2);
+}
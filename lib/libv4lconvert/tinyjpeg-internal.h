@@ -36,6 +36,7 @@
 #define __TINYJPEG_INTERNAL_H_
 
 #include <setjmp.h>
+#include "simd-priv.h"
 
 #define SANITY_CHECK 1
 
@@ -60,12 +61,18 @@ struct huffman_table {
 	 * IMPROVEME: Calculate if 256 value is enough to store all values
 	 */
 	uint16_t slowtable[16 - HUFFMAN_HASH_NBITS][256];
+	/* The bits and vals this table was built from, so that we can skip
+	 * rebuilding it when the next frame contains the same table */
+	unsigned int hash;
+	unsigned int src_len;	/* 0 if the table is not built (yet) */
+	unsigned char src[16 + 256];
 };
 
 struct component {
 	unsigned int Hfactor;
 	unsigned int Vfactor;
 	float *Q_table;		/* Pointer to the quantisation table to use */
+	short int *IQ_table;	/* Same for the integer IDCT */
 	struct huffman_table *AC_table;
 	struct huffman_table *DC_table;
 	short int previous_DC;	/* Previous DC coefficient */
@@ -94,9 +101,13 @@ struct jdec_private {
 
 	struct component component_infos[COMPONENTS];
 	float Q_tables[COMPONENTS][64];		/* quantization tables */
+	short int IQ_tables[COMPONENTS][64];	/* integer quantization tables */
 	struct huffman_table HTDC[HUFFMAN_TABLES];	/* DC huffman tables   */
 	struct huffman_table HTAC[HUFFMAN_TABLES];	/* AC huffman tables   */
-	int default_huffman_table_initialized;
+	/* The raw quantization tables, so that we can skip rebuilding them */
+	unsigned int Q_tables_hash[COMPONENTS];
+	unsigned char Q_tables_src[COMPONENTS][64];
+	unsigned int Q_tables_valid;		/* Bitmask of built tables */
 	int restart_interval;
 	int restarts_to_go;				/* MCUs left in this restart interval */
 	int last_rst_marker_seen;			/* Rst marker is incremented each time */
@@ -118,10 +129,37 @@ struct jdec_private {
 	/* Temp buffers for multipass planar JPG -> RGB decoding */
 	int tmp_buf_y_size;
 	uint8_t *tmp_buf[COMPONENTS];
+
+	/* Multi threaded decoding, each thread gets its own decoder context */
+	struct v4lconvert_threads *threads;
+	struct jdec_private **contexts;
+	int contexts_count;
+	int segments_size;
+	unsigned char *segments;	/* Start of each restart interval */
+	int coef_buf_size;
+	unsigned char *coef_buf;	/* Pipeline DCT coef ring buffer */
 };
 
-#define IDCT tinyjpeg_idct_float
 void tinyjpeg_idct_float (struct component *compptr, uint8_t *output_buf, int stride);
 
+void tinyjpeg_idct_int(struct component *compptr, uint8_t *output_buf, int stride);
+
+/* With a vector unit the integer IDCT is used, which is much faster, unless
+   TINYJPEG_FLAGS_FLOAT_IDCT asks for the float one (to compare the two) */
+#if defined(V4LCONVERT_SIMD_X86) || defined(V4LCONVERT_SIMD_NEON)
+#define IDCT(priv, compptr, output_buf, stride) \
+	(((priv)->flags & TINYJPEG_FLAGS_FLOAT_IDCT) ? tinyjpeg_idct_float : \
+	 tinyjpeg_idct_int)(compptr, output_buf, stride)
+#else
+#define IDCT(priv, compptr, output_buf, stride) \
+	tinyjpeg_idct_float(compptr, output_buf, stride)
+#endif
+
+/* Convert a whole MCU (of h_samp x v_samp blocks) to rgb24 or bgr24, returns
+   0 if this is not supported and the caller must do it instead */
+int tinyjpeg_mcu_to_rgb24_simd(const uint8_t *Y, const uint8_t *Cb,
+		const uint8_t *Cr, uint8_t *dest, int stride, int h_samp,
+		int v_samp, int bgr);
+
 #endif
 
@@ -0,0 +1,618 @@
+/*
+
+# Vectorized IDCT and colorspace conversion for tinyjpeg
+
+#             (C) 2026 the v4l-utils contributors
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+/* The IDCT here is an integer version of the IDCT, using the "islow"
+   (Loeffler, Ligtenberg and Moschytz) algorithm from the Independent JPEG
+   Group's jidctint.c with 13 bit constants, 16 bit coefficients and 32 bit
+   intermediate products. It differs from the float AA&N IDCT in
+   jidctflt.c by at most a few units (usually not at all, or 1) in the
+   output samples.
+
+   The colorspace conversion does a whole MCU at once and is bit for bit
+   identical to the YCrCB_to_RGB24_* / YCrCB_to_BGR24_* functions in
+   tinyjpeg.c. */
+
+#include <stdint.h>
+#include "tinyjpeg-internal.h"
+
+#define CONST_BITS	13
+#define PASS1_BITS	2
+
+#define FIX_0_298631336	2446
+#define FIX_0_390180644	3196
+#define FIX_0_541196100	4433
+#define FIX_0_765366865	6270
+#define FIX_0_899976223	7373
+#define FIX_1_175875602	9633
+#define FIX_1_501321110	12299
+#define FIX_1_847759065	15137
+#define FIX_1_961570560	16069
+#define FIX_2_053119869	16819
+#define FIX_2_562915447	20995
+#define FIX_3_072711026	25172
+
+/* Colorspace conversion constants, FIX(x) from tinyjpeg.c with 10 bits */
+#define FIX_1_40200	1436
+#define FIX_0_34414	352
+#define FIX_0_71414	731
+#define FIX_1_77200	1815
+
+#ifdef V4LCONVERT_SIMD_X86
+
+/* a * c0 + b * c1 for 8 pairs of 16 bit values, as 2 vectors of 32 bit
+   results */
+static inline void tinyjpeg_madd_sse2(__m128i a, __m128i b, int c0, int c1,
+		__m128i *lo, __m128i *hi)
+{
+	const __m128i c = _mm_setr_epi16(c0, c1, c0, c1, c0, c1, c0, c1);
+
+	*lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), c);
+	*hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), c);
+}
+
+/* Descale 2 vectors of 32 bit values with rounding, and pack them to 16 bit */
+static inline __m128i tinyjpeg_descale_sse2(__m128i lo, __m128i hi, int n)
+{
+	const __m128i round = _mm_set1_epi32(1 << (n - 1));
+
+	return _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(lo, round), n),
+			       _mm_srai_epi32(_mm_add_epi32(hi, round), n));
+}
+
+/* 1-D IDCT on 8 columns at once, x[k] holds input k for each column */
+static inline void tinyjpeg_idct_1d_sse2(__m128i x[8], int descale)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i tmp0_lo, tmp0_hi, tmp1_lo, tmp1_hi, tmp2_lo, tmp2_hi;
+	__m128i tmp3_lo, tmp3_hi, tmp10_lo, tmp10_hi, tmp11_lo, tmp11_hi;
+	__m128i tmp12_lo, tmp12_hi, tmp13_lo, tmp13_hi;
+	__m128i z3_lo, z3_hi, z4_lo, z4_hi, s;
+	__m128i o0_lo, o0_hi, o1_lo, o1_hi, o2_lo, o2_hi, o3_lo, o3_hi;
+
+	/* Even part */
+	tinyjpeg_madd_sse2(x[2], x[6], FIX_0_541196100 + FIX_0_765366865,
+			   FIX_0_541196100, &tmp3_lo, &tmp3_hi);
+	tinyjpeg_madd_sse2(x[2], x[6], FIX_0_541196100,
+			   FIX_0_541196100 - FIX_1_847759065, &tmp2_lo, &tmp2_hi);
+
+	/* (x0 +/- x4) << CONST_BITS, by putting it in the high 16 bits */
+	s = _mm_add_epi16(x[0], x[4]);
+	tmp0_lo = _mm_srai_epi32(_mm_unpacklo_epi16(zero, s), 16 - CONST_BITS);
+	tmp0_hi = _mm_srai_epi32(_mm_unpackhi_epi16(zero, s), 16 - CONST_BITS);
+	s = _mm_sub_epi16(x[0], x[4]);
+	tmp1_lo = _mm_srai_epi32(_mm_unpacklo_epi16(zero, s), 16 - CONST_BITS);
+	tmp1_hi = _mm_srai_epi32(_mm_unpackhi_epi16(zero, s), 16 - CONST_BITS);
+
+	tmp10_lo = _mm_add_epi32(tmp0_lo, tmp3_lo);
+	tmp10_hi = _mm_add_epi32(tmp0_hi, tmp3_hi);
+	tmp13_lo = _mm_sub_epi32(tmp0_lo, tmp3_lo);
+	tmp13_hi = _mm_sub_epi32(tmp0_hi, tmp3_hi);
+	tmp11_lo = _mm_add_epi32(tmp1_lo, tmp2_lo);
+	tmp11_hi = _mm_add_epi32(tmp1_hi, tmp2_hi);
+	tmp12_lo = _mm_sub_epi32(tmp1_lo, tmp2_lo);
+	tmp12_hi = _mm_sub_epi32(tmp1_hi, tmp2_hi);
+
+	/* Odd part, with the z1 - z5 multiplications folded into the
+	   constants so that each product is a single multiply-add */
+	tinyjpeg_madd_sse2(_mm_add_epi16(x[7], x[3]), _mm_add_epi16(x[5], x[1]),
+			   FIX_1_175875602 - FIX_1_961570560, FIX_1_175875602,
+			   &z3_lo, &z3_hi);
+	tinyjpeg_madd_sse2(_mm_add_epi16(x[7], x[3]), _mm_add_epi16(x[5], x[1]),
+			   FIX_1_175875602, FIX_1_175875602 - FIX_0_390180644,
+			   &z4_lo, &z4_hi);
+
+	tinyjpeg_madd_sse2(x[7], x[1], FIX_0_298631336 - FIX_0_899976223,
+			   -FIX_0_899976223, &tmp0_lo, &tmp0_hi);
+	tinyjpeg_madd_sse2(x[7], x[1], -FIX_0_899976223,
+			   FIX_1_501321110 - FIX_0_899976223, &tmp3_lo, &tmp3_hi);
+	tinyjpeg_madd_sse2(x[5], x[3], FIX_2_053119869 - FIX_2_562915447,
+			   -FIX_2_562915447, &tmp1_lo, &tmp1_hi);
+	tinyjpeg_madd_sse2(x[5], x[3], -FIX_2_562915447,
+			   FIX_3_072711026 - FIX_2_562915447, &tmp2_lo, &tmp2_hi);
+
+	o0_lo = _mm_add_epi32(tmp0_lo, z3_lo);
+	o0_hi = _mm_add_epi32(tmp0_hi, z3_hi);
+	o1_lo = _mm_add_epi32(tmp1_lo, z4_lo);
+	o1_hi = _mm_add_epi32(tmp1_hi, z4_hi);
+	o2_lo = _mm_add_epi32(tmp2_lo, z3_lo);
+	o2_hi = _mm_add_epi32(tmp2_hi, z3_hi);
+	o3_lo = _mm_add_epi32(tmp3_lo, z4_lo);
+	o3_hi = _mm_add_epi32(tmp3_hi, z4_hi);
+
+	x[0] = tinyjpeg_descale_sse2(_mm_add_epi32(tmp10_lo, o3_lo),
+				     _mm_add_epi32(tmp10_hi, o3_hi), descale);
+	x[7] = tinyjpeg_descale_sse2(_mm_sub_epi32(tmp10_lo, o3_lo),
+				     _mm_sub_epi32(tmp10_hi, o3_hi), descale);
+	x[1] = tinyjpeg_descale_sse2(_mm_add_epi32(tmp11_lo, o2_lo),
+				     _mm_add_epi32(tmp11_hi, o2_hi), descale);
+	x[6] = tinyjpeg_descale_sse2(_mm_sub_epi32(tmp11_lo, o2_lo),
+				     _mm_sub_epi32(tmp11_hi, o2_hi), descale);
+	x[2] = tinyjpeg_descale_sse2(_mm_add_epi32(tmp12_lo, o1_lo),
+				     _mm_add_epi32(tmp12_hi, o1_hi), descale);
+	x[5] = tinyjpeg_descale_sse2(_mm_sub_epi32(tmp12_lo, o1_lo),
+				     _mm_sub_epi32(tmp12_hi, o1_hi), descale);
+	x[3] = tinyjpeg_descale_sse2(_mm_add_epi32(tmp13_lo, o0_lo),
+				     _mm_add_epi32(tmp13_hi, o0_hi), descale);
+	x[4] = tinyjpeg_descale_sse2(_mm_sub_epi32(tmp13_lo, o0_lo),
+				     _mm_sub_epi32(tmp13_hi, o0_hi), descale);
+}
+
+static inline void tinyjpeg_transpose_8x8_sse2(__m128i x[8])
+{
+	__m128i a0, a1, a2, a3, a4, a5, a6, a7;
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7;
+
+	a0 = _mm_unpacklo_epi16(x[0], x[1]);
+	a1 = _mm_unpackhi_epi16(x[0], x[1]);
+	a2 = _mm_unpacklo_epi16(x[2], x[3]);
+	a3 = _mm_unpackhi_epi16(x[2], x[3]);
+	a4 = _mm_unpacklo_epi16(x[4], x[5]);
+	a5 = _mm_unpackhi_epi16(x[4], x[5]);
+	a6 = _mm_unpacklo_epi16(x[6], x[7]);
+	a7 = _mm_unpackhi_epi16(x[6], x[7]);
+
+	b0 = _mm_unpacklo_epi32(a0, a2);
+	b1 = _mm_unpackhi_epi32(a0, a2);
+	b2 = _mm_unpacklo_epi32(a1, a3);
+	b3 = _mm_unpackhi_epi32(a1, a3);
+	b4 = _mm_unpacklo_epi32(a4, a6);
+	b5 = _mm_unpackhi_epi32(a4, a6);
+	b6 = _mm_unpacklo_epi32(a5, a7);
+	b7 = _mm_unpackhi_epi32(a5, a7);
+
+	x[0] = _mm_unpacklo_epi64(b0, b4);
+	x[1] = _mm_unpackhi_epi64(b0, b4);
+	x[2] = _mm_unpacklo_epi64(b1, b5);
+	x[3] = _mm_unpackhi_epi64(b1, b5);
+	x[4] = _mm_unpacklo_epi64(b2, b6);
+	x[5] = _mm_unpackhi_epi64(b2, b6);
+	x[6] = _mm_unpacklo_epi64(b3, b7);
+	x[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+static void tinyjpeg_idct_sse2(struct component *compptr, uint8_t *output_buf,
+		int stride)
+{
+	const __m128i c128 = _mm_set1_epi16(128);
+	const __m128i dc_mask = _mm_setr_epi16(0, -1, -1, -1, -1, -1, -1, -1);
+	__m128i x[8], ac;
+	int i;
+
+	/* Dequantize, 16 bits is enough for the coefficients of 8 bit
+	   samples */
+	for (i = 0; i < 8; i++)
+		x[i] = _mm_mullo_epi16(
+			_mm_loadu_si128((const __m128i *)(compptr->DCT + 8 * i)),
+			_mm_loadu_si128((const __m128i *)(compptr->IQ_table + 8 * i)));
+
+	ac = _mm_and_si128(x[0], dc_mask);
+	for (i = 1; i < 8; i++)
+		ac = _mm_or_si128(ac, x[i]);
+
+	if (_mm_movemask_epi8(_mm_cmpeq_epi16(ac, _mm_setzero_si128())) ==
+			0xffff) {
+		/* Only a DC coefficient, which is very common. This gives the
+		   same result as the full IDCT: (dc + 4) >> 3 */
+		int dc = (short int)_mm_cvtsi128_si32(x[0]);
+		__m128i v;
+
+		dc = (dc + 4) >> 3;
+		v = _mm_packus_epi16(_mm_add_epi16(_mm_set1_epi16(dc), c128),
+				     _mm_setzero_si128());
+		for (i = 0; i < 8; i++) {
+			_mm_storel_epi64((__m128i *)output_buf, v);
+			output_buf += stride;
+		}
+		return;
+	}
+
+	/* Pass 1: process columns, each vector holds one row of all columns */
+	tinyjpeg_idct_1d_sse2(x, CONST_BITS - PASS1_BITS);
+	/* Pass 2: process rows, scale down by a further factor of 8 */
+	tinyjpeg_transpose_8x8_sse2(x);
+	tinyjpeg_idct_1d_sse2(x, CONST_BITS + PASS1_BITS + 3);
+	tinyjpeg_transpose_8x8_sse2(x);
+
+	for (i = 0; i < 8; i += 2) {
+		__m128i v = _mm_packus_epi16(_mm_add_epi16(x[i], c128),
+					     _mm_add_epi16(x[i + 1], c128));
+
+		_mm_storel_epi64((__m128i *)output_buf, v);
+		output_buf += stride;
+		_mm_storel_epi64((__m128i *)output_buf, _mm_srli_si128(v, 8));
+		output_buf += stride;
+	}
+}
+
+/* (c * coef + 512) >> 10 for 8 16 bit chroma values */
+static inline __m128i tinyjpeg_chroma_term_sse2(__m128i c, int coef)
+{
+	const __m128i k = _mm_setr_epi16(coef, 512, coef, 512,
+					 coef, 512, coef, 512);
+	const __m128i one = _mm_set1_epi16(1);
+
+	return _mm_packs_epi32(
+		_mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(c, one), k), 10),
+		_mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(c, one), k), 10));
+}
+
+/* (-FIX_0_34414 * cb - FIX_0_71414 * cr + 512) >> 10 for 8 chroma values */
+static inline __m128i tinyjpeg_green_term_sse2(__m128i cb, __m128i cr)
+{
+	const __m128i k = _mm_setr_epi16(-FIX_0_34414, -FIX_0_71414,
+					 -FIX_0_34414, -FIX_0_71414,
+					 -FIX_0_34414, -FIX_0_71414,
+					 -FIX_0_34414, -FIX_0_71414);
+	const __m128i round = _mm_set1_epi32(512);
+
+	return _mm_packs_epi32(
+		_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(
+			_mm_unpacklo_epi16(cb, cr), k), round), 10),
+		_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(
+			_mm_unpackhi_epi16(cb, cr), k), round), 10));
+}
+
+static int tinyjpeg_mcu_to_rgb24_sse2(const uint8_t *Y, const uint8_t *Cb,
+		const uint8_t *Cr, uint8_t *dest, int stride, int h_samp,
+		int v_samp, int bgr)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c128 = _mm_set1_epi16(128);
+	int width = 8 * h_samp;
+	int i, j;
+
+	for (i = 0; i < 8; i++) {
+		__m128i cb = _mm_sub_epi16(_mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)Cb), zero), c128);
+		__m128i cr = _mm_sub_epi16(_mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)Cr), zero), c128);
+		__m128i r_term = tinyjpeg_chroma_term_sse2(cr, FIX_1_40200);
+		__m128i g_term = tinyjpeg_green_term_sse2(cb, cr);
+		__m128i b_term = tinyjpeg_chroma_term_sse2(cb, FIX_1_77200);
+
+		for (j = 0; j < v_samp; j++) {
+			/* The store helper writes 1 byte past the pixels, so
+			   go through a temporary buffer */
+			unsigned char tmp[16 * 3 + 1];
+			__m128i y, y_lo, y_hi, r, g, b;
+
+			if (h_samp == 2) {
+				y = _mm_loadu_si128((const __m128i *)Y);
+				y_lo = _mm_unpacklo_epi8(y, zero);
+				y_hi = _mm_unpackhi_epi8(y, zero);
+				r = _mm_packus_epi16(
+				  _mm_add_epi16(y_lo, _mm_unpacklo_epi16(r_term, r_term)),
+				  _mm_add_epi16(y_hi, _mm_unpackhi_epi16(r_term, r_term)));
+				g = _mm_packus_epi16(
+				  _mm_add_epi16(y_lo, _mm_unpacklo_epi16(g_term, g_term)),
+				  _mm_add_epi16(y_hi, _mm_unpackhi_epi16(g_term, g_term)));
+				b = _mm_packus_epi16(
+				  _mm_add_epi16(y_lo, _mm_unpacklo_epi16(b_term, b_term)),
+				  _mm_add_epi16(y_hi, _mm_unpackhi_epi16(b_term, b_term)));
+			} else {
+				y_lo = _mm_unpacklo_epi8(
+					_mm_loadl_epi64((const __m128i *)Y), zero);
+				r = _mm_packus_epi16(_mm_add_epi16(y_lo, r_term), zero);
+				g = _mm_packus_epi16(_mm_add_epi16(y_lo, g_term), zero);
+				b = _mm_packus_epi16(_mm_add_epi16(y_lo, b_term), zero);
+			}
+
+			if (bgr)
+				v4lconvert_store_rgb24_sse2(tmp, b, g, r);
+			else
+				v4lconvert_store_rgb24_sse2(tmp, r, g, b);
+			memcpy(dest, tmp, width * 3);
+
+			Y += width;
+			dest += stride;
+		}
+		Cb += 8;
+		Cr += 8;
+	}
+
+	return 1;
+}
+
+#endif /* V4LCONVERT_SIMD_X86 */
+
+#ifdef V4LCONVERT_SIMD_NEON
+
+/* a * c0 + b * c1 for 8 pairs of 16 bit values, as 2 vectors of 32 bit
+   results */
+static inline void tinyjpeg_madd_neon(int16x8_t a, int16x8_t b, int16_t c0,
+		int16_t c1, int32x4_t *lo, int32x4_t *hi)
+{
+	*lo = vmlal_n_s16(vmull_n_s16(vget_low_s16(a), c0), vget_low_s16(b), c1);
+	*hi = vmlal_n_s16(vmull_n_s16(vget_high_s16(a), c0),
+			  vget_high_s16(b), c1);
+}
+
+static inline int16x8_t tinyjpeg_descale_neon(int32x4_t lo, int32x4_t hi,
+		int n)
+{
+	const int32x4_t round = vdupq_n_s32(1 << (n - 1));
+	const int32x4_t shift = vdupq_n_s32(-n);
+
+	return vcombine_s16(vqmovn_s32(vshlq_s32(vaddq_s32(lo, round), shift)),
+			    vqmovn_s32(vshlq_s32(vaddq_s32(hi, round), shift)));
+}
+
+static inline void tinyjpeg_idct_1d_neon(int16x8_t x[8], int descale)
+{
+	int32x4_t tmp0_lo, tmp0_hi, tmp1_lo, tmp1_hi, tmp2_lo, tmp2_hi;
+	int32x4_t tmp3_lo, tmp3_hi, tmp10_lo, tmp10_hi, tmp11_lo, tmp11_hi;
+	int32x4_t tmp12_lo, tmp12_hi, tmp13_lo, tmp13_hi;
+	int32x4_t z3_lo, z3_hi, z4_lo, z4_hi;
+	int32x4_t o0_lo, o0_hi, o1_lo, o1_hi, o2_lo, o2_hi, o3_lo, o3_hi;
+	int16x8_t s;
+
+	/* Even part */
+	tinyjpeg_madd_neon(x[2], x[6], FIX_0_541196100 + FIX_0_765366865,
+			   FIX_0_541196100, &tmp3_lo, &tmp3_hi);
+	tinyjpeg_madd_neon(x[2], x[6], FIX_0_541196100,
+			   FIX_0_541196100 - FIX_1_847759065, &tmp2_lo, &tmp2_hi);
+
+	s = vaddq_s16(x[0], x[4]);
+	tmp0_lo = vshll_n_s16(vget_low_s16(s), CONST_BITS);
+	tmp0_hi = vshll_n_s16(vget_high_s16(s), CONST_BITS);
+	s = vsubq_s16(x[0], x[4]);
+	tmp1_lo = vshll_n_s16(vget_low_s16(s), CONST_BITS);
+	tmp1_hi = vshll_n_s16(vget_high_s16(s), CONST_BITS);
+
+	tmp10_lo = vaddq_s32(tmp0_lo, tmp3_lo);
+	tmp10_hi = vaddq_s32(tmp0_hi, tmp3_hi);
+	tmp13_lo = vsubq_s32(tmp0_lo, tmp3_lo);
+	tmp13_hi = vsubq_s32(tmp0_hi, tmp3_hi);
+	tmp11_lo = vaddq_s32(tmp1_lo, tmp2_lo);
+	tmp11_hi = vaddq_s32(tmp1_hi, tmp2_hi);
+	tmp12_lo = vsubq_s32(tmp1_lo, tmp2_lo);
+	tmp12_hi = vsubq_s32(tmp1_hi, tmp2_hi);
+
+	/* Odd part */
+	tinyjpeg_madd_neon(vaddq_s16(x[7], x[3]), vaddq_s16(x[5], x[1]),
+			   FIX_1_175875602 - FIX_1_961570560, FIX_1_175875602,
+			   &z3_lo, &z3_hi);
+	tinyjpeg_madd_neon(vaddq_s16(x[7], x[3]), vaddq_s16(x[5], x[1]),
+			   FIX_1_175875602, FIX_1_175875602 - FIX_0_390180644,
+			   &z4_lo, &z4_hi);
+
+	tinyjpeg_madd_neon(x[7], x[1], FIX_0_298631336 - FIX_0_899976223,
+			   -FIX_0_899976223, &tmp0_lo, &tmp0_hi);
+	tinyjpeg_madd_neon(x[7], x[1], -FIX_0_899976223,
+			   FIX_1_501321110 - FIX_0_899976223, &tmp3_lo, &tmp3_hi);
+	tinyjpeg_madd_neon(x[5], x[3], FIX_2_053119869 - FIX_2_562915447,
+			   -FIX_2_562915447, &tmp1_lo, &tmp1_hi);
+	tinyjpeg_madd_neon(x[5], x[3], -FIX_2_562915447,
+			   FIX_3_072711026 - FIX_2_562915447, &tmp2_lo, &tmp2_hi);
+
+	o0_lo = vaddq_s32(tmp0_lo, z3_lo);
+	o0_hi = vaddq_s32(tmp0_hi, z3_hi);
+	o1_lo = vaddq_s32(tmp1_lo, z4_lo);
+	o1_hi = vaddq_s32(tmp1_hi, z4_hi);
+	o2_lo = vaddq_s32(tmp2_lo, z3_lo);
+	o2_hi = vaddq_s32(tmp2_hi, z3_hi);
+	o3_lo = vaddq_s32(tmp3_lo, z4_lo);
+	o3_hi = vaddq_s32(tmp3_hi, z4_hi);
+
+	x[0] = tinyjpeg_descale_neon(vaddq_s32(tmp10_lo, o3_lo),
+				     vaddq_s32(tmp10_hi, o3_hi), descale);
+	x[7] = tinyjpeg_descale_neon(vsubq_s32(tmp10_lo, o3_lo),
+				     vsubq_s32(tmp10_hi, o3_hi), descale);
+	x[1] = tinyjpeg_descale_neon(vaddq_s32(tmp11_lo, o2_lo),
+				     vaddq_s32(tmp11_hi, o2_hi), descale);
+	x[6] = tinyjpeg_descale_neon(vsubq_s32(tmp11_lo, o2_lo),
+				     vsubq_s32(tmp11_hi, o2_hi), descale);
+	x[2] = tinyjpeg_descale_neon(vaddq_s32(tmp12_lo, o1_lo),
+				     vaddq_s32(tmp12_hi, o1_hi), descale);
+	x[5] = tinyjpeg_descale_neon(vsubq_s32(tmp12_lo, o1_lo),
+				     vsubq_s32(tmp12_hi, o1_hi), descale);
+	x[3] = tinyjpeg_descale_neon(vaddq_s32(tmp13_lo, o0_lo),
+				     vaddq_s32(tmp13_hi, o0_hi), descale);
+	x[4] = tinyjpeg_descale_neon(vsubq_s32(tmp13_lo, o0_lo),
+				     vsubq_s32(tmp13_hi, o0_hi), descale);
+}
+
+static inline void tinyjpeg_transpose_8x8_neon(int16x8_t x[8])
+{
+	int16x8x2_t a0 = vtrnq_s16(x[0], x[1]);
+	int16x8x2_t a1 = vtrnq_s16(x[2], x[3]);
+	int16x8x2_t a2 = vtrnq_s16(x[4], x[5]);
+	int16x8x2_t a3 = vtrnq_s16(x[6], x[7]);
+	int32x4x2_t b0 = vtrnq_s32(vreinterpretq_s32_s16(a0.val[0]),
+				   vreinterpretq_s32_s16(a1.val[0]));
+	int32x4x2_t b1 = vtrnq_s32(vreinterpretq_s32_s16(a0.val[1]),
+				   vreinterpretq_s32_s16(a1.val[1]));
+	int32x4x2_t b2 = vtrnq_s32(vreinterpretq_s32_s16(a2.val[0]),
+				   vreinterpretq_s32_s16(a3.val[0]));
+	int32x4x2_t b3 = vtrnq_s32(vreinterpretq_s32_s16(a2.val[1]),
+				   vreinterpretq_s32_s16(a3.val[1]));
+
+#define TINYJPEG_COMBINE_LO(a, b) vreinterpretq_s16_s32(vcombine_s32( \
+		vget_low_s32(a), vget_low_s32(b)))
+#define TINYJPEG_COMBINE_HI(a, b) vreinterpretq_s16_s32(vcombine_s32( \
+		vget_high_s32(a), vget_high_s32(b)))
+	x[0] = TINYJPEG_COMBINE_LO(b0.val[0], b2.val[0]);
+	x[1] = TINYJPEG_COMBINE_LO(b1.val[0], b3.val[0]);
+	x[2] = TINYJPEG_COMBINE_LO(b0.val[1], b2.val[1]);
+	x[3] = TINYJPEG_COMBINE_LO(b1.val[1], b3.val[1]);
+	x[4] = TINYJPEG_COMBINE_HI(b0.val[0], b2.val[0]);
+	x[5] = TINYJPEG_COMBINE_HI(b1.val[0], b3.val[0]);
+	x[6] = TINYJPEG_COMBINE_HI(b0.val[1], b2.val[1]);
+	x[7] = TINYJPEG_COMBINE_HI(b1.val[1], b3.val[1]);
+#undef TINYJPEG_COMBINE_LO
+#undef TINYJPEG_COMBINE_HI
+}
+
+static void tinyjpeg_idct_neon(struct component *compptr, uint8_t *output_buf,
+		int stride)
+{
+	const int16x8_t c128 = vdupq_n_s16(128);
+	int16x8_t x[8], ac;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		x[i] = vmulq_s16(vld1q_s16(compptr->DCT + 8 * i),
+				 vld1q_s16(compptr->IQ_table + 8 * i));
+
+	ac = vsetq_lane_s16(0, x[0], 0);
+	for (i = 1; i < 8; i++)
+		ac = vorrq_s16(ac, x[i]);
+
+	if (vget_lane_u64(vreinterpret_u64_s16(vorr_s16(vget_low_s16(ac),
+			vget_high_s16(ac))), 0) == 0) {
+		/* Only a DC coefficient: (dc + 4) >> 3 */
+		int dc = (vgetq_lane_s16(x[0], 0) + 4) >> 3;
+		uint8x8_t v = vqmovun_s16(vdupq_n_s16(dc + 128));
+
+		for (i = 0; i < 8; i++) {
+			vst1_u8(output_buf, v);
+			output_buf += stride;
+		}
+		return;
+	}
+
+	tinyjpeg_idct_1d_neon(x, CONST_BITS - PASS1_BITS);
+	tinyjpeg_transpose_8x8_neon(x);
+	tinyjpeg_idct_1d_neon(x, CONST_BITS + PASS1_BITS + 3);
+	tinyjpeg_transpose_8x8_neon(x);
+
+	for (i = 0; i < 8; i++) {
+		vst1_u8(output_buf, vqmovun_s16(vaddq_s16(x[i], c128)));
+		output_buf += stride;
+	}
+}
+
+/* (c * coef + 512) >> 10 for 8 16 bit chroma values */
+static inline int16x8_t tinyjpeg_chroma_term_neon(int16x8_t c, int16_t coef)
+{
+	const int32x4_t round = vdupq_n_s32(512);
+
+	return vcombine_s16(
+		vmovn_s32(vshrq_n_s32(vmlal_n_s16(round, vget_low_s16(c), coef), 10)),
+		vmovn_s32(vshrq_n_s32(vmlal_n_s16(round, vget_high_s16(c), coef), 10)));
+}
+
+static inline int16x8_t tinyjpeg_green_term_neon(int16x8_t cb, int16x8_t cr)
+{
+	const int32x4_t round = vdupq_n_s32(512);
+	int32x4_t lo, hi;
+
+	lo = vmlal_n_s16(round, vget_low_s16(cb), -FIX_0_34414);
+	lo = vmlal_n_s16(lo, vget_low_s16(cr), -FIX_0_71414);
+	hi = vmlal_n_s16(round, vget_high_s16(cb), -FIX_0_34414);
+	hi = vmlal_n_s16(hi, vget_high_s16(cr), -FIX_0_71414);
+
+	return vcombine_s16(vmovn_s32(vshrq_n_s32(lo, 10)),
+			    vmovn_s32(vshrq_n_s32(hi, 10)));
+}
+
+static int tinyjpeg_mcu_to_rgb24_neon(const uint8_t *Y, const uint8_t *Cb,
+		const uint8_t *Cr, uint8_t *dest, int stride, int h_samp,
+		int v_samp, int bgr)
+{
+	const uint8x8_t c128 = vdup_n_u8(128);
+	int width = 8 * h_samp;
+	int i, j;
+
+	for (i = 0; i < 8; i++) {
+		int16x8_t cb = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(Cb), c128));
+		int16x8_t cr = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(Cr), c128));
+		int16x8_t terms[3];
+
+		terms[0] = tinyjpeg_chroma_term_neon(cr, FIX_1_40200);
+		terms[1] = tinyjpeg_green_term_neon(cb, cr);
+		terms[2] = tinyjpeg_chroma_term_neon(cb, FIX_1_77200);
+		if (bgr) {
+			int16x8_t tmp = terms[0];
+
+			terms[0] = terms[2];
+			terms[2] = tmp;
+		}
+
+		for (j = 0; j < v_samp; j++) {
+			int k;
+
+			if (h_samp == 2) {
+				uint8x16_t y = vld1q_u8(Y);
+				int16x8_t y_lo = vreinterpretq_s16_u16(
+						vmovl_u8(vget_low_u8(y)));
+				int16x8_t y_hi = vreinterpretq_s16_u16(
+						vmovl_u8(vget_high_u8(y)));
+				uint8x16x3_t out;
+
+				for (k = 0; k < 3; k++) {
+					int16x8x2_t d = vzipq_s16(terms[k], terms[k]);
+
+					out.val[k] = vcombine_u8(
+					  vqmovun_s16(vaddq_s16(y_lo, d.val[0])),
+					  vqmovun_s16(vaddq_s16(y_hi, d.val[1])));
+				}
+				vst3q_u8(dest, out);
+			} else {
+				int16x8_t y = vreinterpretq_s16_u16(
+						vmovl_u8(vld1_u8(Y)));
+				uint8x8x3_t out;
+
+				for (k = 0; k < 3; k++)
+					out.val[k] = vqmovun_s16(
+						vaddq_s16(y, terms[k]));
+				vst3_u8(dest, out);
+			}
+
+			Y += width;
+			dest += stride;
+		}
+		Cb += 8;
+		Cr += 8;
+	}
+
+	return 1;
+}
+
+#endif /* V4LCONVERT_SIMD_NEON */
+
+void tinyjpeg_idct_int(struct component *compptr, uint8_t *output_buf,
+		int stride)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	tinyjpeg_idct_sse2(compptr, output_buf, stride);
+#elif defined(V4LCONVERT_SIMD_NEON)
+	tinyjpeg_idct_neon(compptr, output_buf, stride);
+#else
+	tinyjpeg_idct_float(compptr, output_buf, stride);
+#endif
+}
+
+int tinyjpeg_mcu_to_rgb24_simd(const uint8_t *Y, const uint8_t *Cb,
+		const uint8_t *Cr, uint8_t *dest, int stride, int h_samp,
+		int v_samp, int bgr)
+{
+#if defined(V4LCONVERT_SIMD_X86)
+	return tinyjpeg_mcu_to_rgb24_sse2(Y, Cb, Cr, dest, stride, h_samp,
+					  v_samp, bgr);
+#elif defined(V4LCONVERT_SIMD_NEON)
+	return tinyjpeg_mcu_to_rgb24_neon(Y, Cb, Cr, dest, stride, h_samp,
+					  v_samp, bgr);
+#else
+	return 0;
+#endif
+}
@@ -36,6 +36,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "tinyjpeg.h"
 #include "tinyjpeg-internal.h"
@@ -502,23 +503,69 @@ static int build_huffman_table(struct jdec_private *priv, const unsigned char *b
 	return 0;
 }
 
-static int build_default_huffman_tables(struct jdec_private *priv)
+/*
+ * Most streams (and MJPEG streams without a DHT always) use the same
+ * tables every frame, so remember what each table was built from and only
+ * rebuild it when it changes. The hash is a cheap check, matching tables
+ * are compared in full to be sure.
+ */
+static unsigned int table_hash(const unsigned char *a, unsigned int a_len,
+		const unsigned char *b, unsigned int b_len)
+{
+	unsigned int i, hash = 2166136261u; /* FNV-1a */
+
+	for (i = 0; i < a_len; i++)
+		hash = (hash ^ a[i]) * 16777619u;
+	for (i = 0; i < b_len; i++)
+		hash = (hash ^ b[i]) * 16777619u;
+
+	return hash;
+}
+
+static int update_huffman_table(struct jdec_private *priv,
+		const unsigned char *bits, const unsigned char *vals,
+		struct huffman_table *table)
 {
-	if ((priv->flags & TINYJPEG_FLAGS_MJPEG_TABLE)
-			&& priv->default_huffman_table_initialized)
+	unsigned int i, count = 0, hash;
+
+	for (i = 1; i <= 16; i++)
+		count += bits[i];
+
+	/* Tables this large are bogus, leave them to build_huffman_table */
+	if (count > 256) {
+		table->src_len = 0;
+		return build_huffman_table(priv, bits, vals, table);
+	}
+
+	hash = table_hash(bits + 1, 16, vals, count);
+	if (table->src_len == 16 + count && table->hash == hash &&
+			!memcmp(table->src, bits + 1, 16) &&
+			!memcmp(table->src + 16, vals, count))
 		return 0;
 
-	if (build_huffman_table(priv, bits_dc_luminance, val_dc_luminance, &priv->HTDC[0]))
+	table->src_len = 0;
+	if (build_huffman_table(priv, bits, vals, table))
+		return -1;
+
+	table->hash = hash;
+	table->src_len = 16 + count;
+	memcpy(table->src, bits + 1, 16);
+	memcpy(table->src + 16, vals, count);
+	return 0;
+}
+
+static int build_default_huffman_tables(struct jdec_private *priv)
+{
+	if (update_huffman_table(priv, bits_dc_luminance, val_dc_luminance, &priv->HTDC[0]))
 		return -1;
-	if (build_huffman_table(priv, bits_ac_luminance, val_ac_luminance, &priv->HTAC[0]))
+	if (update_huffman_table(priv, bits_ac_luminance, val_ac_luminance, &priv->HTAC[0]))
 		return -1;
 
-	if (build_huffman_table(priv, bits_dc_chrominance, val_dc_chrominance, &priv->HTDC[1]))
+	if (update_huffman_table(priv, bits_dc_chrominance, val_dc_chrominance, &priv->HTDC[1]))
 		return -1;
-	if (build_huffman_table(priv, bits_ac_chrominance, val_ac_chrominance, &priv->HTAC[1]))
+	if (update_huffman_table(priv, bits_ac_chrominance, val_ac_chrominance, &priv->HTAC[1]))
 		return -1;
 
-	priv->default_huffman_table_initialized = 1;
 	return 0;
 }
 
@@ -717,6 +764,10 @@ static void YCrCB_to_RGB24_1x1(struct jdec_private *priv)
 	int i, j;
 	int offset_to_next_row;
 
+	if (tinyjpeg_mcu_to_rgb24_simd(priv->Y, priv->Cb, priv->Cr,
+				       priv->plane[0], priv->width * 3, 1, 1, 0))
+		return;
+
 #define SCALEBITS       10
 #define ONE_HALF        (1UL << (SCALEBITS - 1))
 #define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
@@ -770,6 +821,10 @@ static void YCrCB_to_BGR24_1x1(struct jdec_private *priv)
 	int i, j;
 	int offset_to_next_row;
 
+	if (tinyjpeg_mcu_to_rgb24_simd(priv->Y, priv->Cb, priv->Cr,
+				       priv->plane[0], priv->width * 3, 1, 1, 1))
+		return;
+
 #define SCALEBITS       10
 #define ONE_HALF        (1UL << (SCALEBITS - 1))
 #define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
@@ -823,6 +878,10 @@ static void YCrCB_to_RGB24_2x1(struct jdec_private *priv)
 	int i, j;
 	int offset_to_next_row;
 
+	if (tinyjpeg_mcu_to_rgb24_simd(priv->Y, priv->Cb, priv->Cr,
+				       priv->plane[0], priv->width * 3, 2, 1, 0))
+		return;
+
 #define SCALEBITS       10
 #define ONE_HALF        (1UL << (SCALEBITS - 1))
 #define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
@@ -883,6 +942,10 @@ static void YCrCB_to_BGR24_2x1(struct jdec_private *priv)
 	int i, j;
 	int offset_to_next_row;
 
+	if (tinyjpeg_mcu_to_rgb24_simd(priv->Y, priv->Cb, priv->Cr,
+				       priv->plane[0], priv->width * 3, 2, 1, 1))
+		return;
+
 #define SCALEBITS       10
 #define ONE_HALF        (1UL << (SCALEBITS - 1))
 #define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
@@ -945,6 +1008,10 @@ static void YCrCB_to_RGB24_1x2(struct jdec_private *priv)
 	int i, j;
 	int offset_to_next_row;
 
+	if (tinyjpeg_mcu_to_rgb24_simd(priv->Y, priv->Cb, priv->Cr,
+				       priv->plane[0], priv->width * 3, 1, 2, 0))
+		return;
+
 #define SCALEBITS       10
 #define ONE_HALF        (1UL << (SCALEBITS - 1))
 #define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
@@ -1010,6 +1077,10 @@ static void YCrCB_to_BGR24_1x2(struct jdec_private *priv)
 	int i, j;
 	int offset_to_next_row;
 
+	if (tinyjpeg_mcu_to_rgb24_simd(priv->Y, priv->Cb, priv->Cr,
+				       priv->plane[0], priv->width * 3, 1, 2, 1))
+		return;
+
 #define SCALEBITS       10
 #define ONE_HALF        (1UL << (SCALEBITS - 1))
 #define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
@@ -1076,6 +1147,10 @@ static void YCrCB_to_RGB24_2x2(struct jdec_private *priv)
 	int i, j;
 	int offset_to_next_row;
 
+	if (tinyjpeg_mcu_to_rgb24_simd(priv->Y, priv->Cb, priv->Cr,
+				       priv->plane[0], priv->width * 3, 2, 2, 0))
+		return;
+
 #define SCALEBITS       10
 #define ONE_HALF        (1UL << (SCALEBITS - 1))
 #define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
@@ -1157,6 +1232,10 @@ static void YCrCB_to_BGR24_2x2(struct jdec_private *priv)
 	int i, j;
 	int offset_to_next_row;
 
+	if (tinyjpeg_mcu_to_rgb24_simd(priv->Y, priv->Cb, priv->Cr,
+				       priv->plane[0], priv->width * 3, 2, 2, 1))
+		return;
+
 #define SCALEBITS       10
 #define ONE_HALF        (1UL << (SCALEBITS - 1))
 #define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
@@ -1327,15 +1406,15 @@ static void decode_MCU_1x1_3planes(struct jdec_private *priv)
 {
 	// Y
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y, 8);
+	IDCT(priv, &priv->component_infos[cY], priv->Y, 8);
 
 	// Cb
 	process_Huffman_data_unit(priv, cCb);
-	IDCT(&priv->component_infos[cCb], priv->Cb, 8);
+	IDCT(priv, &priv->component_infos[cCb], priv->Cb, 8);
 
 	// Cr
 	process_Huffman_data_unit(priv, cCr);
-	IDCT(&priv->component_infos[cCr], priv->Cr, 8);
+	IDCT(priv, &priv->component_infos[cCr], priv->Cr, 8);
 }
 
 /*
@@ -1345,15 +1424,15 @@ static void decode_MCU_1x1_1plane(struct jdec_private *priv)
 {
 	// Y
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y, 8);
+	IDCT(priv, &priv->component_infos[cY], priv->Y, 8);
 
 	// Cb
 	process_Huffman_data_unit(priv, cCb);
-	IDCT(&priv->component_infos[cCb], priv->Cb, 8);
+	IDCT(priv, &priv->component_infos[cCb], priv->Cb, 8);
 
 	// Cr
 	process_Huffman_data_unit(priv, cCr);
-	IDCT(&priv->component_infos[cCr], priv->Cr, 8);
+	IDCT(priv, &priv->component_infos[cCr], priv->Cr, 8);
 }
 
 
@@ -1367,20 +1446,21 @@ static void decode_MCU_2x1_3planes(struct jdec_private *priv)
 {
 	// Y
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y, 16);
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y + 8, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y + 8, 16);
 
 	// Cb
 	process_Huffman_data_unit(priv, cCb);
-	IDCT(&priv->component_infos[cCb], priv->Cb, 8);
+	IDCT(priv, &priv->component_infos[cCb], priv->Cb, 8);
 
 	// Cr
 	process_Huffman_data_unit(priv, cCr);
-	IDCT(&priv->component_infos[cCr], priv->Cr, 8);
+	IDCT(priv, &priv->component_infos[cCr], priv->Cr, 8);
 }
 
-static void build_quantization_table(float *qtable, const unsigned char *ref_table);
+static void update_quantization_table(struct jdec_private *priv, int qi,
+		const unsigned char *ref_table);
 
 static void pixart_decode_MCU_2x1_3planes(struct jdec_private *priv)
 {
@@ -1465,7 +1545,7 @@ static void pixart_decode_MCU_2x1_3planes(struct jdec_private *priv)
 			j = (pixart_q[lumi][i] * comp + 50) / 100;
 			qt[i] = (j < 255) ? j : 255;
 		}
-		build_quantization_table(priv->Q_tables[0], qt);
+		update_quantization_table(priv, 0, qt);
 
 		/* If bit 7 of the marker is set chrominance uses the
 		   luminance quantization table */
@@ -1476,7 +1556,7 @@ static void pixart_decode_MCU_2x1_3planes(struct jdec_private *priv)
 				qt[i] = (j < 255) ? j : 255;
 			}
 		}
-		build_quantization_table(priv->Q_tables[1], qt);
+		update_quantization_table(priv, 1, qt);
 
 		priv->marker = marker;
 	}
@@ -1484,17 +1564,17 @@ static void pixart_decode_MCU_2x1_3planes(struct jdec_private *priv)
 
 	// Y
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y, 16);
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y + 8, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y + 8, 16);
 
 	// Cb
 	process_Huffman_data_unit(priv, cCb);
-	IDCT(&priv->component_infos[cCb], priv->Cb, 8);
+	IDCT(priv, &priv->component_infos[cCb], priv->Cb, 8);
 
 	// Cr
 	process_Huffman_data_unit(priv, cCr);
-	IDCT(&priv->component_infos[cCr], priv->Cr, 8);
+	IDCT(priv, &priv->component_infos[cCr], priv->Cr, 8);
 }
 
 /*
@@ -1507,9 +1587,9 @@ static void decode_MCU_2x1_1plane(struct jdec_private *priv)
 {
 	// Y
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y, 16);
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y + 8, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y + 8, 16);
 
 	// Cb
 	process_Huffman_data_unit(priv, cCb);
@@ -1531,21 +1611,21 @@ static void decode_MCU_2x2_3planes(struct jdec_private *priv)
 {
 	// Y
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y, 16);
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y + 8, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y + 8, 16);
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y + 64 * 2, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y + 64 * 2, 16);
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y + 64 * 2 + 8, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y + 64 * 2 + 8, 16);
 
 	// Cb
 	process_Huffman_data_unit(priv, cCb);
-	IDCT(&priv->component_infos[cCb], priv->Cb, 8);
+	IDCT(priv, &priv->component_infos[cCb], priv->Cb, 8);
 
 	// Cr
 	process_Huffman_data_unit(priv, cCr);
-	IDCT(&priv->component_infos[cCr], priv->Cr, 8);
+	IDCT(priv, &priv->component_infos[cCr], priv->Cr, 8);
 }
 
 /*
@@ -1560,13 +1640,13 @@ static void decode_MCU_2x2_1plane(struct jdec_private *priv)
 {
 	// Y
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y, 16);
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y + 8, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y + 8, 16);
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y + 64 * 2, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y + 64 * 2, 16);
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y + 64 * 2 + 8, 16);
+	IDCT(priv, &priv->component_infos[cY], priv->Y + 64 * 2 + 8, 16);
 
 	// Cb
 	process_Huffman_data_unit(priv, cCb);
@@ -1587,17 +1667,17 @@ static void decode_MCU_1x2_3planes(struct jdec_private *priv)
 {
 	// Y
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y, 8);
+	IDCT(priv, &priv->component_infos[cY], priv->Y, 8);
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y + 64, 8);
+	IDCT(priv, &priv->component_infos[cY], priv->Y + 64, 8);
 
 	// Cb
 	process_Huffman_data_unit(priv, cCb);
-	IDCT(&priv->component_infos[cCb], priv->Cb, 8);
+	IDCT(priv, &priv->component_infos[cCb], priv->Cb, 8);
 
 	// Cr
 	process_Huffman_data_unit(priv, cCr);
-	IDCT(&priv->component_infos[cCr], priv->Cr, 8);
+	IDCT(priv, &priv->component_infos[cCr], priv->Cr, 8);
 }
 
 /*
@@ -1612,9 +1692,9 @@ static void decode_MCU_1x2_1plane(struct jdec_private *priv)
 {
 	// Y
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y, 8);
+	IDCT(priv, &priv->component_infos[cY], priv->Y, 8);
 	process_Huffman_data_unit(priv, cY);
-	IDCT(&priv->component_infos[cY], priv->Y + 64, 8);
+	IDCT(priv, &priv->component_infos[cY], priv->Y + 64, 8);
 
 	// Cb
 	process_Huffman_data_unit(priv, cCb);
@@ -1657,7 +1737,8 @@ static void print_SOF(const unsigned char *stream)
  *
  ******************************************************************************/
 
-static void build_quantization_table(float *qtable, const unsigned char *ref_table)
+static void build_quantization_table(float *qtable, short int *iqtable,
+		const unsigned char *ref_table)
 {
 	/* Taken from libjpeg. Copyright Independent JPEG Group's LLM idct.
 	 * For float AA&N IDCT method, divisors are equal to quantization
@@ -1679,12 +1760,32 @@ static void build_quantization_table(float *qtable, const unsigned char *ref_tab
 		for (j = 0; j < 8; j++)
 			*qtable++ = ref_table[*zz++] * aanscalefactor[i] * aanscalefactor[j];
 
+	/* The integer IDCT uses the plain (dezigzagged) coefficients */
+	for (i = 0; i < 64; i++)
+		iqtable[i] = ref_table[zigzag[i]];
+}
+
+/* Like the huffman tables, only rebuild quantization tables which changed */
+static void update_quantization_table(struct jdec_private *priv, int qi,
+		const unsigned char *ref_table)
+{
+	unsigned int hash = table_hash(ref_table, 64, NULL, 0);
+
+	if ((priv->Q_tables_valid & (1 << qi)) &&
+			priv->Q_tables_hash[qi] == hash &&
+			!memcmp(priv->Q_tables_src[qi], ref_table, 64))
+		return;
+
+	build_quantization_table(priv->Q_tables[qi], priv->IQ_tables[qi],
+				 ref_table);
+	priv->Q_tables_hash[qi] = hash;
+	memcpy(priv->Q_tables_src[qi], ref_table, 64);
+	priv->Q_tables_valid |= 1 << qi;
 }
 
 static int parse_DQT(struct jdec_private *priv, const unsigned char *stream)
 {
 	int qi;
-	float *table;
 	const unsigned char *dqt_block_end;
 
 	trace("> DQT marker\n");
@@ -1700,8 +1801,7 @@ static int parse_DQT(struct jdec_private *priv, const unsigned char *stream)
 			error("No more than %d quantization tables supported (got %d)\n",
 					COMPONENTS, qi + 1);
 #endif
-		table = priv->Q_tables[qi];
-		build_quantization_table(table, stream);
+		update_quantization_table(priv, qi, stream);
 		stream += 64;
 	}
 	trace("< DQT marker\n");
@@ -1744,6 +1844,7 @@ static int parse_SOF(struct jdec_private *priv, const unsigned char *stream)
 		c->Vfactor = sampling_factor & 0xf;
 		c->Hfactor = sampling_factor >> 4;
 		c->Q_table = priv->Q_tables[Q_table];
+		c->IQ_table = priv->IQ_tables[Q_table];
 		trace("Component:%d  factor:%dx%d  Quantization table:%d\n",
 				cid, c->Hfactor, c->Hfactor, Q_table);
 
@@ -1851,10 +1952,10 @@ static int parse_DHT(struct jdec_private *priv, const unsigned char *stream)
 #endif
 
 		if (index & 0xf0) {
-			if (build_huffman_table(priv, huff_bits, stream, &priv->HTAC[index & 0xf]))
+			if (update_huffman_table(priv, huff_bits, stream, &priv->HTAC[index & 0xf]))
 				return -1;
 		} else {
-			if (build_huffman_table(priv, huff_bits, stream, &priv->HTDC[index & 0xf]))
+			if (update_huffman_table(priv, huff_bits, stream, &priv->HTDC[index & 0xf]))
 				return -1;
 		}
 
@@ -2100,6 +2201,11 @@ void tinyjpeg_free(struct jdec_private *priv)
 		priv->tmp_buf[i] = NULL;
 	}
 	priv->tmp_buf_y_size = 0;
+	for (i = 0; i < priv->contexts_count; i++)
+		free(priv->contexts[i]);
+	free(priv->contexts);
+	free(priv->segments);
+	free(priv->coef_buf);
 	free(priv->stream_filtered);
 	free(priv);
 }
@@ -2231,6 +2337,440 @@ kernel: 0xff 0xff 0x00 0xff 0x96, and we skip one unknown byte */
 	error("Short Pixart JPEG frame\n");
 }
 
+/*******************************************************************************
+ *
+ * Multi threaded decoding
+ *
+ * When the stream has restart intervals, ranges of restart intervals get
+ * decoded in parallel, each thread using its own decoder context. Without
+ * restart intervals the huffman decoding of the next MCUs is done in parallel
+ * with the IDCT and colorspace conversion of the previous MCUs.
+ *
+ * Either way the result is identical to decoding the image sequentially, and
+ * so are the errors reported for corrupt images.
+ *
+ ******************************************************************************/
+
+/* Number of MCU rows the huffman decoding may run ahead of the IDCT */
+#define PIPELINE_ROWS 4
+
+struct mcu_layout {
+	decode_MCU_fct decode_MCU;
+	convert_colorspace_fct convert_to_pixfmt;
+	int sampling;		/* Index in the decode_MCU / colorspace tables */
+	unsigned int mcus_per_row;
+	unsigned int mcus;
+	unsigned int bytes_per_blocklines[COMPONENTS];
+	unsigned int bytes_per_mcu[COMPONENTS];
+};
+
+/* Where decode_MCU_*_3planes puts the Y blocks for each sampling */
+static const struct {
+	int blocks;
+	int offset[4];
+	int stride;
+} Y_blocks[4] = {
+	{ 1, { 0 }, 8 },			/* 1x1 */
+	{ 2, { 0, 64 }, 8 },			/* 1x2 */
+	{ 2, { 0, 8 }, 16 },			/* 2x1 */
+	{ 4, { 0, 8, 64 * 2, 64 * 2 + 8 }, 16 },	/* 2x2 */
+};
+
+struct intervals_job {
+	struct jdec_private *priv;
+	const struct mcu_layout *layout;
+	const unsigned char **segments;	/* Start of each restart interval */
+	const unsigned char **markers;	/* RST marker before each interval */
+	unsigned int intervals;
+	const unsigned char *end;	/* Where the last interval ended */
+	int failed[V4LCONVERT_MAX_THREADS];
+};
+
+struct pipeline_job {
+	struct jdec_private *priv;
+	const struct mcu_layout *layout;
+	short int *coefs;		/* Ring buffer with the DCT coefs */
+	unsigned int ring_mcus;
+	unsigned int blocks_per_mcu;
+	unsigned int current;		/* MCU being huffman decoded */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int decoded;		/* MCUs ready for the IDCT */
+	unsigned int converted;		/* MCUs done */
+	int done;
+	int failed;
+};
+
+/* Get decoder context index, with the decoding state copied from priv. The
+   huffman and quantization tables are not copied, the components keep
+   pointing to the tables in priv. */
+static struct jdec_private *get_context(struct jdec_private *priv, int index)
+{
+	struct jdec_private *ctx;
+
+	if (index >= priv->contexts_count) {
+		struct jdec_private **contexts;
+
+		contexts = realloc(priv->contexts, (index + 1) * sizeof(*contexts));
+		if (contexts == NULL)
+			return NULL;
+		memset(contexts + priv->contexts_count, 0,
+		       (index + 1 - priv->contexts_count) * sizeof(*contexts));
+		priv->contexts = contexts;
+		priv->contexts_count = index + 1;
+	}
+
+	if (priv->contexts[index] == NULL) {
+		priv->contexts[index] = malloc(sizeof(struct jdec_private));
+		if (priv->contexts[index] == NULL)
+			return NULL;
+	}
+
+	ctx = priv->contexts[index];
+	ctx->width = priv->width;
+	ctx->height = priv->height;
+	ctx->flags = priv->flags;
+	ctx->stream = priv->stream;
+	ctx->stream_end = priv->stream_end;
+	ctx->reservoir = priv->reservoir;
+	ctx->nbits_in_reservoir = priv->nbits_in_reservoir;
+	ctx->restart_interval = priv->restart_interval;
+	ctx->restarts_to_go = priv->restarts_to_go;
+	ctx->last_rst_marker_seen = priv->last_rst_marker_seen;
+	memcpy(ctx->component_infos, priv->component_infos,
+	       sizeof(ctx->component_infos));
+	memcpy(ctx->components, priv->components, sizeof(ctx->components));
+	ctx->error_string[0] = 0;
+
+	return ctx;
+}
+
+static void set_mcu_planes(struct jdec_private *ctx,
+			   const struct mcu_layout *layout, unsigned int mcu)
+{
+	unsigned int x = mcu % layout->mcus_per_row;
+	unsigned int y = mcu / layout->mcus_per_row;
+	int i;
+
+	for (i = 0; i < COMPONENTS; i++)
+		ctx->plane[i] = ctx->components[i] +
+			y * layout->bytes_per_blocklines[i] +
+			x * layout->bytes_per_mcu[i];
+}
+
+/*
+ * Find the start of all restart intervals. This only succeeds if
+ * find_next_rst_marker() would find the same markers, so on any unexpected
+ * marker we give up and leave it to the sequential decoder to deal with it.
+ */
+static int find_restart_intervals(struct intervals_job *job)
+{
+	struct jdec_private *priv = job->priv;
+	const unsigned char *stream = priv->stream;
+	unsigned int i;
+	int marker;
+
+	job->segments = (const unsigned char **)v4lconvert_alloc_buffer(
+			2 * job->intervals * sizeof(*job->segments),
+			&priv->segments, &priv->segments_size);
+	if (job->segments == NULL)
+		return -1;
+	job->markers = job->segments + job->intervals;
+
+	job->segments[0] = stream;
+	job->markers[0] = stream;
+	for (i = 1; i < job->intervals; i++) {
+		while (1) {
+			if (stream >= priv->stream_end)
+				return -1;
+			if (*stream++ != 0xff)
+				continue;
+			/* Skip any padding ff byte (this is normal) */
+			while (stream < priv->stream_end && *stream == 0xff)
+				stream++;
+			if (stream >= priv->stream_end)
+				return -1;
+
+			marker = *stream++;
+			if (marker == RST + ((i - 1) & 7))
+				break;
+			if ((marker >= RST && marker <= RST7) || marker == EOI)
+				return -1;
+		}
+		job->markers[i] = stream - 1;
+		job->segments[i] = stream;
+	}
+
+	return 0;
+}
+
+static void decode_intervals(void *arg, int band, int start, int end)
+{
+	struct intervals_job *job = arg;
+	const struct mcu_layout *layout = job->layout;
+	struct jdec_private *ctx = job->priv->contexts[band];
+	unsigned int i, mcu, last;
+
+	if (setjmp(ctx->jump_state)) {
+		job->failed[band] = 1;
+		return;
+	}
+
+	for (i = start; i < end; i++) {
+		ctx->stream = job->segments[i];
+		resync(ctx);
+
+		last = (i + 1) * ctx->restart_interval;
+		if (last > layout->mcus)
+			last = layout->mcus;
+		for (mcu = i * ctx->restart_interval; mcu < last; mcu++) {
+			set_mcu_planes(ctx, layout, mcu);
+			layout->decode_MCU(ctx);
+			layout->convert_to_pixfmt(ctx);
+		}
+
+		/* The sequential decoder looks for the next RST marker from
+		   here, check it would find the one we found */
+		ctx->stream -= ctx->nbits_in_reservoir / 8;
+		if (i + 1 < job->intervals && ctx->stream >= job->markers[i + 1]) {
+			job->failed[band] = 1;
+			return;
+		}
+	}
+
+	if (end == job->intervals)
+		job->end = ctx->stream;
+}
+
+/* Returns 1 if the image must be decoded sequentially instead */
+static int decode_restart_intervals(struct jdec_private *priv,
+				    const struct mcu_layout *layout)
+{
+	struct intervals_job job;
+	int i, bands = v4lconvert_threads_count(priv->threads);
+
+	memset(&job, 0, sizeof(job));
+	job.priv = priv;
+	job.layout = layout;
+	job.intervals = (layout->mcus + priv->restart_interval - 1) /
+			priv->restart_interval;
+	if (job.intervals < 2)
+		return 1;
+	if (bands > job.intervals)
+		bands = job.intervals;
+
+	if (find_restart_intervals(&job))
+		return 1;
+
+	for (i = 0; i < bands; i++)
+		if (get_context(priv, i) == NULL)
+			return 1;
+
+	v4lconvert_threads_run_bands(priv->threads, decode_intervals, &job,
+				     job.intervals, bands);
+
+	/* On errors decode the image again sequentially, so that the same error
+	   gets reported. Intervals after the error which did decode fine are
+	   left in place, this is a corrupt frame anyways. */
+	for (i = 0; i < bands; i++)
+		if (job.failed[i])
+			return 1;
+
+	/* Like the sequential decoder, check for a RST marker (or EOI) after
+	   a last interval which ends exactly at the end of the image */
+	if (layout->mcus % priv->restart_interval == 0) {
+		priv->stream = job.end;
+		priv->last_rst_marker_seen = (job.intervals - 1) & 7;
+		if (find_next_rst_marker(priv) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void pipeline_huffman_decode(struct pipeline_job *job,
+				    struct jdec_private *ctx)
+{
+	const struct mcu_layout *layout = job->layout;
+	int Y_count = Y_blocks[layout->sampling].blocks;
+	unsigned int b, mcu, row_end;
+	short int *coefs;
+
+	if (setjmp(ctx->jump_state)) {
+		pthread_mutex_lock(&job->lock);
+		job->decoded = job->current;
+		job->failed = 1;
+		job->done = 1;
+		pthread_cond_broadcast(&job->cond);
+		pthread_mutex_unlock(&job->lock);
+		return;
+	}
+
+	for (job->current = 0; job->current < layout->mcus; job->current++) {
+		mcu = job->current;
+
+		if (mcu % layout->mcus_per_row == 0) {
+			/* Wait for room for a new row in the ring buffer */
+			row_end = mcu + layout->mcus_per_row;
+			pthread_mutex_lock(&job->lock);
+			while (row_end - job->converted > job->ring_mcus)
+				pthread_cond_wait(&job->cond, &job->lock);
+			pthread_mutex_unlock(&job->lock);
+		}
+
+		coefs = job->coefs + (mcu % job->ring_mcus) * job->blocks_per_mcu * 64;
+		for (b = 0; b < job->blocks_per_mcu; b++) {
+			int component = b < Y_count ? cY : (b == Y_count ? cCb : cCr);
+
+			process_Huffman_data_unit(ctx, component);
+			memcpy(coefs, ctx->component_infos[component].DCT,
+			       64 * sizeof(short int));
+			coefs += 64;
+		}
+
+		if (ctx->restarts_to_go > 0) {
+			ctx->restarts_to_go--;
+			if (ctx->restarts_to_go == 0) {
+				ctx->stream -= (ctx->nbits_in_reservoir / 8);
+				resync(ctx);
+				if (find_next_rst_marker(ctx) < 0) {
+					job->current++;
+					longjmp(ctx->jump_state, -EIO);
+				}
+			}
+		}
+
+		if ((mcu + 1) % layout->mcus_per_row == 0) {
+			pthread_mutex_lock(&job->lock);
+			job->decoded = mcu + 1;
+			pthread_cond_broadcast(&job->cond);
+			pthread_mutex_unlock(&job->lock);
+		}
+	}
+
+	pthread_mutex_lock(&job->lock);
+	job->decoded = layout->mcus;
+	job->done = 1;
+	pthread_cond_broadcast(&job->cond);
+	pthread_mutex_unlock(&job->lock);
+}
+
+static void pipeline_convert(struct pipeline_job *job, struct jdec_private *ctx)
+{
+	const struct mcu_layout *layout = job->layout;
+	int Y_count = Y_blocks[layout->sampling].blocks;
+	unsigned int b, mcu = 0, decoded;
+	short int *coefs;
+
+	while (1) {
+		pthread_mutex_lock(&job->lock);
+		while (job->decoded == mcu && !job->done)
+			pthread_cond_wait(&job->cond, &job->lock);
+		decoded = job->decoded;
+		pthread_mutex_unlock(&job->lock);
+
+		if (decoded == mcu)
+			break;
+
+		for (; mcu < decoded; mcu++) {
+			coefs = job->coefs +
+				(mcu % job->ring_mcus) * job->blocks_per_mcu * 64;
+			for (b = 0; b < job->blocks_per_mcu; b++) {
+				struct component *c;
+
+				if (b < Y_count) {
+					c = &ctx->component_infos[cY];
+					memcpy(c->DCT, coefs, 64 * sizeof(short int));
+					IDCT(ctx, c, ctx->Y + Y_blocks[layout->sampling].offset[b],
+					     Y_blocks[layout->sampling].stride);
+				} else if (b == Y_count) {
+					c = &ctx->component_infos[cCb];
+					memcpy(c->DCT, coefs, 64 * sizeof(short int));
+					IDCT(ctx, c, ctx->Cb, 8);
+				} else {
+					c = &ctx->component_infos[cCr];
+					memcpy(c->DCT, coefs, 64 * sizeof(short int));
+					IDCT(ctx, c, ctx->Cr, 8);
+				}
+				coefs += 64;
+			}
+			set_mcu_planes(ctx, layout, mcu);
+			layout->convert_to_pixfmt(ctx);
+		}
+
+		pthread_mutex_lock(&job->lock);
+		job->converted = mcu;
+		pthread_cond_broadcast(&job->cond);
+		pthread_mutex_unlock(&job->lock);
+	}
+}
+
+static void pipeline_run(void *arg, int band, int start, int end)
+{
+	struct pipeline_job *job = arg;
+
+	if (band == 0)
+		pipeline_huffman_decode(job, job->priv->contexts[0]);
+	else
+		pipeline_convert(job, job->priv->contexts[1]);
+}
+
+/* Only for the 3 planes decode_MCU functions. Returns 1 if the image must be
+   decoded sequentially instead. */
+static int decode_pipelined(struct jdec_private *priv,
+			    const struct mcu_layout *layout)
+{
+	struct pipeline_job job;
+
+	memset(&job, 0, sizeof(job));
+	job.priv = priv;
+	job.layout = layout;
+	job.blocks_per_mcu = Y_blocks[layout->sampling].blocks + 2;
+	job.ring_mcus = PIPELINE_ROWS * layout->mcus_per_row;
+	job.coefs = (short int *)v4lconvert_alloc_buffer(
+			job.ring_mcus * job.blocks_per_mcu * 64 * sizeof(short int),
+			&priv->coef_buf, &priv->coef_buf_size);
+	if (job.coefs == NULL ||
+	    get_context(priv, 0) == NULL || get_context(priv, 1) == NULL)
+		return 1;
+
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.cond, NULL);
+
+	v4lconvert_threads_run_bands(priv->threads, pipeline_run, &job, 2, 2);
+
+	pthread_cond_destroy(&job.cond);
+	pthread_mutex_destroy(&job.lock);
+
+	if (job.failed) {
+		strcpy(priv->error_string, priv->contexts[0]->error_string);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Returns 1 if the image must be decoded sequentially instead */
+static int decode_threaded(struct jdec_private *priv,
+			   const struct mcu_layout *layout, int planes)
+{
+	int result;
+
+	if (v4lconvert_threads_count(priv->threads) < 2 || layout->mcus == 0)
+		return 1;
+
+	if (priv->restart_interval > 0) {
+		result = decode_restart_intervals(priv, layout);
+		if (result <= 0)
+			return result;
+	}
+
+	if (planes == 3)
+		return decode_pipelined(priv, layout);
+
+	return 1;
+}
+
 /**
  * Decode and convert the jpeg image into @pixfmt@ image
  *
@@ -2240,6 +2780,7 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 {
 	unsigned int x, y, xstride_by_mcu, ystride_by_mcu;
 	unsigned int bytes_per_blocklines[3], bytes_per_mcu[3];
+	int sampling;
 	decode_MCU_fct decode_MCU;
 	const decode_MCU_fct *decode_mcu_table;
 	const convert_colorspace_fct *colorspace_array_conv;
@@ -2329,21 +2870,25 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 
 	xstride_by_mcu = ystride_by_mcu = 8;
 	if ((priv->component_infos[cY].Hfactor | priv->component_infos[cY].Vfactor) == 1) {
+		sampling = 0;
 		decode_MCU = decode_mcu_table[0];
 		convert_to_pixfmt = colorspace_array_conv[0];
 		trace("Use decode 1x1 sampling\n");
 	} else if (priv->component_infos[cY].Hfactor == 1) {
+		sampling = 1;
 		decode_MCU = decode_mcu_table[1];
 		convert_to_pixfmt = colorspace_array_conv[1];
 		ystride_by_mcu = 16;
 		trace("Use decode 1x2 sampling (not supported)\n");
 	} else if (priv->component_infos[cY].Vfactor == 2) {
+		sampling = 3;
 		decode_MCU = decode_mcu_table[3];
 		convert_to_pixfmt = colorspace_array_conv[3];
 		xstride_by_mcu = 16;
 		ystride_by_mcu = 16;
 		trace("Use decode 2x2 sampling\n");
 	} else {
+		sampling = 2;
 		decode_MCU = decode_mcu_table[2];
 		convert_to_pixfmt = colorspace_array_conv[2];
 		xstride_by_mcu = 16;
@@ -2364,6 +2909,27 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 	bytes_per_mcu[1] *= xstride_by_mcu / 8;
 	bytes_per_mcu[2] *= xstride_by_mcu / 8;
 
+	if (priv->threads && !(priv->flags & TINYJPEG_FLAGS_PIXART_JPEG)) {
+		struct mcu_layout layout;
+		int result;
+
+		layout.decode_MCU = decode_MCU;
+		layout.convert_to_pixfmt = convert_to_pixfmt;
+		layout.sampling = sampling;
+		layout.mcus_per_row = (priv->width + xstride_by_mcu - 1) /
+				      xstride_by_mcu;
+		layout.mcus = layout.mcus_per_row * (priv->height / ystride_by_mcu);
+		memcpy(layout.bytes_per_blocklines, bytes_per_blocklines,
+		       sizeof(layout.bytes_per_blocklines));
+		memcpy(layout.bytes_per_mcu, bytes_per_mcu,
+		       sizeof(layout.bytes_per_mcu));
+
+		result = decode_threaded(priv, &layout,
+				decode_mcu_table == decode_mcu_3comp_table ? 3 : 1);
+		if (result <= 0)
+			return result;
+	}
+
 	/* Just the decode the image by macroblock (size is 8x8, 8x16, or 16x16) */
 	for (y = 0; y < priv->height / ystride_by_mcu; y++) {
 		//trace("Decoding row %d\n", y);
@@ -2444,7 +3010,7 @@ int tinyjpeg_decode_planar(struct jdec_private *priv, int pixfmt)
 	for (y = 0; y < priv->height / 8; y++) {
 		for (x = 0; x < priv->width / 8; x++) {
 			process_Huffman_data_unit(priv, cY);
-			IDCT(&priv->component_infos[cY], y_buf, priv->width);
+			IDCT(priv, &priv->component_infos[cY], y_buf, priv->width);
 			y_buf += 8;
 		}
 		y_buf += 7 * priv->width;
@@ -2466,7 +3032,7 @@ int tinyjpeg_decode_planar(struct jdec_private *priv, int pixfmt)
 	for (y = 0; y < priv->height / 16; y++) {
 		for (x = 0; x < priv->width / 16; x++) {
 			process_Huffman_data_unit(priv, cCb);
-			IDCT(&priv->component_infos[cCb], u_buf, priv->width / 2);
+			IDCT(priv, &priv->component_infos[cCb], u_buf, priv->width / 2);
 			u_buf += 8;
 		}
 		u_buf += 7 * (priv->width / 2);
@@ -2488,7 +3054,7 @@ int tinyjpeg_decode_planar(struct jdec_private *priv, int pixfmt)
 	for (y = 0; y < priv->height / 16; y++) {
 		for (x = 0; x < priv->width / 16; x++) {
 			process_Huffman_data_unit(priv, cCr);
-			IDCT(&priv->component_infos[cCr], v_buf, priv->width / 2);
+			IDCT(priv, &priv->component_infos[cCr], v_buf, priv->width / 2);
 			v_buf += 8;
 		}
 		v_buf += 7 * (priv->width / 2);
@@ -2668,3 +3234,12 @@ int tinyjpeg_set_flags(struct jdec_private *priv, int flags)
 	return oldflags;
 }
 
+/**
+ * Use the passed in worker threads for decoding, NULL means decode
+ * sequentially from the calling thread.
+ */
+void tinyjpeg_set_threads(struct jdec_private *priv,
+			  struct v4lconvert_threads *threads)
+{
+	priv->threads = threads;
+}
@@ -40,11 +40,13 @@ extern "C" {
 #endif
 
 struct jdec_private;
+struct v4lconvert_threads;
 
 /* Flags that can be set by any applications */
-#define TINYJPEG_FLAGS_MJPEG_TABLE	(1<<1)
 #define TINYJPEG_FLAGS_PIXART_JPEG	(1<<2)
 #define TINYJPEG_FLAGS_PLANAR_JPEG	(1<<3)
+/* Use the float IDCT even when the faster integer IDCT is available */
+#define TINYJPEG_FLAGS_FLOAT_IDCT	(1<<4)
 
 /* Format accepted in outout */
 enum tinyjpeg_fmt {
@@ -65,6 +67,8 @@ int tinyjpeg_get_components(struct jdec_private *priv, unsigned char **component
 int tinyjpeg_set_components(struct jdec_private *priv, unsigned char **components,
 				unsigned int ncomponents);
 int tinyjpeg_set_flags(struct jdec_private *priv, int flags);
+void tinyjpeg_set_threads(struct jdec_private *priv,
+			 struct v4lconvert_threads *threads);
 
 #ifdef __cplusplus
 }